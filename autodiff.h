@@ -0,0 +1,285 @@
+/*! \file autodiff.h
+ *  \brief Forward mode automatic differentiation.
+ *
+ *  A Dual<T, K> carries a value and its derivatives with respect to K
+ *  independent variables.  A mapping written as a class template over its
+ *  scalar type, e.g.
+ *
+ *      template <class S>
+ *      class Henon : public dynamics::MappingAutonomousEndogenous<S, 2>
+ *
+ *  can be instantiated with S = Dual<double, 2>; evaluating the right hand
+ *  side at a state whose components are seeded with Dual(x[k], k) yields
+ *  the Jacobian exactly, in one call and without step size tuning.
+ *
+ *  Elementary functions are found by argument dependent lookup, so model
+ *  code should call them unqualified after a using declaration, e.g.
+ *  "using std::sin; rhs[1] = -sin(x[0]);".
+ */
+
+#ifndef __AUTODIFF_H__
+#define __AUTODIFF_H__
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace dynamics {
+  /*! \class Dual
+   *  \brief A value with derivatives with respect to K variables.
+   *  \tparam T Data type of the value and derivatives (typically double).
+   *  \tparam K Number of independent variables.
+   */
+  template <class T, int K>
+  class Dual {
+    public:
+      //! A constant zero.
+      Dual() : _value(0) { _derivatives.fill(T(0)); }
+
+      //! A constant; implicit so that constants mix with Dual in formulas.
+      Dual(const T & value) : _value(value) { _derivatives.fill(T(0)); }
+
+      //! Independent variable number k with the given value.
+      Dual(const T & value, int k) : _value(value)
+      {
+        _derivatives.fill(T(0));
+        _derivatives[k] = T(1);
+      }
+
+      const T & Value() const { return _value; }
+      T & Value() { return _value; }
+
+      //! Derivative with respect to independent variable k.
+      const T & Derivative(int k) const { return _derivatives[k]; }
+      T & Derivative(int k) { return _derivatives[k]; }
+
+      Dual & operator+=(const Dual & b)
+      {
+        _value += b._value;
+        for (int k = 0; k < K; ++k)
+          _derivatives[k] += b._derivatives[k];
+        return *this;
+      }
+
+      Dual & operator-=(const Dual & b)
+      {
+        _value -= b._value;
+        for (int k = 0; k < K; ++k)
+          _derivatives[k] -= b._derivatives[k];
+        return *this;
+      }
+
+      Dual & operator*=(const Dual & b)
+      {
+        for (int k = 0; k < K; ++k)
+          _derivatives[k] = _derivatives[k] * b._value
+            + _value * b._derivatives[k];
+        _value *= b._value;
+        return *this;
+      }
+
+      Dual & operator/=(const Dual & b)
+      {
+        const T inverse = T(1) / b._value;
+        _value *= inverse;
+        for (int k = 0; k < K; ++k)
+          _derivatives[k] = (_derivatives[k] - _value * b._derivatives[k])
+            * inverse;
+        return *this;
+      }
+
+      Dual & operator+=(const T & b) { _value += b; return *this; }
+      Dual & operator-=(const T & b) { _value -= b; return *this; }
+
+      Dual & operator*=(const T & b)
+      {
+        _value *= b;
+        for (int k = 0; k < K; ++k)
+          _derivatives[k] *= b;
+        return *this;
+      }
+
+      Dual & operator/=(const T & b) { return *this *= T(1) / b; }
+
+      // Operators are friends defined in the class so that constants of any
+      // type convertible to T (e.g. int literals) mix with Dual.
+      friend Dual operator-(const Dual & a)
+      {
+        Dual r(a);
+        r._value = -r._value;
+        for (int k = 0; k < K; ++k)
+          r._derivatives[k] = -r._derivatives[k];
+        return r;
+      }
+      friend Dual operator+(const Dual & a) { return a; }
+
+      friend Dual operator+(Dual a, const Dual & b) { return a += b; }
+      friend Dual operator+(Dual a, const T & b) { return a += b; }
+      friend Dual operator+(const T & a, Dual b) { return b += a; }
+
+      friend Dual operator-(Dual a, const Dual & b) { return a -= b; }
+      friend Dual operator-(Dual a, const T & b) { return a -= b; }
+      friend Dual operator-(const T & a, const Dual & b)
+      {
+        Dual r(-b);
+        return r += a;
+      }
+
+      friend Dual operator*(Dual a, const Dual & b) { return a *= b; }
+      friend Dual operator*(Dual a, const T & b) { return a *= b; }
+      friend Dual operator*(const T & a, Dual b) { return b *= a; }
+
+      friend Dual operator/(Dual a, const Dual & b) { return a /= b; }
+      friend Dual operator/(Dual a, const T & b) { return a /= b; }
+      friend Dual operator/(const T & a, const Dual & b)
+      {
+        Dual r(a);
+        return r /= b;
+      }
+
+      // Comparisons only look at values.
+      friend bool operator<(const Dual & a, const Dual & b)
+      {
+        return a._value < b._value;
+      }
+      friend bool operator>(const Dual & a, const Dual & b)
+      {
+        return a._value > b._value;
+      }
+      friend bool operator<=(const Dual & a, const Dual & b)
+      {
+        return a._value <= b._value;
+      }
+      friend bool operator>=(const Dual & a, const Dual & b)
+      {
+        return a._value >= b._value;
+      }
+      friend bool operator==(const Dual & a, const Dual & b)
+      {
+        return a._value == b._value;
+      }
+      friend bool operator!=(const Dual & a, const Dual & b)
+      {
+        return a._value != b._value;
+      }
+
+      /*!
+       * Applies the chain rule: the result has value f and derivatives
+       * df times those of a.
+       */
+      friend Dual Chain(const Dual & a, const T & f, const T & df)
+      {
+        Dual r;
+        r._value = f;
+        for (int k = 0; k < K; ++k)
+          r._derivatives[k] = df * a._derivatives[k];
+        return r;
+      }
+
+    private:
+      T _value;
+      std::array<T, K> _derivatives;
+  };
+
+  template <class T, int K>
+  Dual<T, K> sin(const Dual<T, K> & a)
+  {
+    using std::sin;
+    using std::cos;
+    return Chain(a, sin(a.Value()), cos(a.Value()));
+  }
+
+  template <class T, int K>
+  Dual<T, K> cos(const Dual<T, K> & a)
+  {
+    using std::sin;
+    using std::cos;
+    return Chain(a, cos(a.Value()), -sin(a.Value()));
+  }
+
+  template <class T, int K>
+  Dual<T, K> tan(const Dual<T, K> & a)
+  {
+    using std::tan;
+    T t = tan(a.Value());
+    return Chain(a, t, T(1) + t * t);
+  }
+
+  template <class T, int K>
+  Dual<T, K> exp(const Dual<T, K> & a)
+  {
+    using std::exp;
+    T e = exp(a.Value());
+    return Chain(a, e, e);
+  }
+
+  template <class T, int K>
+  Dual<T, K> log(const Dual<T, K> & a)
+  {
+    using std::log;
+    return Chain(a, log(a.Value()), T(1) / a.Value());
+  }
+
+  template <class T, int K>
+  Dual<T, K> sqrt(const Dual<T, K> & a)
+  {
+    using std::sqrt;
+    T s = sqrt(a.Value());
+    return Chain(a, s, T(1) / (T(2) * s));
+  }
+
+  template <class T, int K>
+  Dual<T, K> tanh(const Dual<T, K> & a)
+  {
+    using std::tanh;
+    T t = tanh(a.Value());
+    return Chain(a, t, T(1) - t * t);
+  }
+
+  template <class T, int K>
+  Dual<T, K> atan(const Dual<T, K> & a)
+  {
+    using std::atan;
+    return Chain(a, atan(a.Value()), T(1) / (T(1) + a.Value() * a.Value()));
+  }
+
+  //! Power with a constant exponent.
+  template <class T, int K>
+  Dual<T, K> pow(const Dual<T, K> & a, const T & p)
+  {
+    using std::pow;
+    T q = pow(a.Value(), p - T(1));
+    return Chain(a, q * a.Value(), p * q);
+  }
+
+  //! Absolute value; the derivative at zero is taken to be zero.
+  template <class T, int K>
+  Dual<T, K> fabs(const Dual<T, K> & a)
+  {
+    if (a.Value() > T(0))
+      return a;
+    if (a.Value() < T(0))
+      return -a;
+    return Chain(a, a.Value(), T(0));
+  }
+
+  template <class T, int K>
+  Dual<T, K> abs(const Dual<T, K> & a)
+  {
+    return fabs(a);
+  }
+
+  /*!
+   * Seeds a state with the independent variables 0, ..., N - 1.
+   *
+   * \param[in] x Point of evaluation.
+   * \param[out] seeded Dual state with value x and unit derivatives.
+   */
+  template <class T, int N>
+  void Seed(const std::array<T, std::size_t(N)> & x,
+            std::array<Dual<T, N>, std::size_t(N)> & seeded)
+  {
+    for (int k = 0; k < N; ++k)
+      seeded[k] = Dual<T, N>(x[k], k);
+  }
+}
+#endif
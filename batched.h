@@ -0,0 +1,322 @@
+/*! \file batched.h
+ *  \brief Batched small matrix factorizations and an ensemble Rosenbrock
+ *  integrator built on them.
+ *
+ *  Every member of an ensemble of stiff integrations factors its own N x N
+ *  Newton matrix I - gamma h J at every step.  Done one member at a time,
+ *  these factorizations are too small to vectorize.  The batched kernels
+ *  here factor B members at once from an interleaved (structure of arrays)
+ *  layout in which entry (i, j) of all B members is contiguous, so every
+ *  elimination update is a loop over B lanes that the compiler turns into
+ *  SIMD instructions.  Pivot search and row interchanges differ between
+ *  lanes and are done lane by lane; they are O(N^2) against the O(N^3)
+ *  elimination.
+ */
+
+#ifndef __BATCHED_H__
+#define __BATCHED_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "parallel.h"
+#include "trace.h"
+
+namespace dynamics {
+  /*! \class BatchedMatrix
+   *  \brief B square matrices of size N in interleaved layout.
+   *  \tparam T Data type of the entries (typically double).
+   *  \tparam N Number of rows and columns.
+   *  \tparam B Number of matrices (lanes).
+   */
+  template <class T, int N, int B = 8>
+  class BatchedMatrix {
+    public:
+      //! Pointer to the B lanes of entry (i, j).
+      T * operator()(int i, int j) { return &_data[(i * N + j) * B]; }
+      const T * operator()(int i, int j) const
+      {
+        return &_data[(i * N + j) * B];
+      }
+
+    private:
+      std::array<T, N * N * B> _data;
+  };
+
+  /*! \class BatchedVector
+   *  \brief B vectors of size N in interleaved layout.
+   *  \tparam T Data type of the entries (typically double).
+   *  \tparam N Number of entries.
+   *  \tparam B Number of vectors (lanes).
+   */
+  template <class T, int N, int B = 8>
+  class BatchedVector {
+    public:
+      //! Pointer to the B lanes of entry i.
+      T * operator()(int i) { return &_data[i * B]; }
+      const T * operator()(int i) const { return &_data[i * B]; }
+
+    private:
+      std::array<T, N * B> _data;
+  };
+
+  /*!
+   * In place LU factorization with partial pivoting of B matrices, PA = LU.
+   *
+   * \param[in,out] A Matrices, replaced by L (unit diagonal, below the
+   *                diagonal) and U (on and above the diagonal).
+   * \param[out] pivots Row interchanges, pivots[k * B + b] for lane b.
+   * \return false if any of the matrices is singular to working precision;
+   *         the factors of the other lanes are still valid.
+   */
+  template <class T, int N, int B>
+  bool BatchedLUFactor(BatchedMatrix<T, N, B> & A,
+                       std::array<int, std::size_t(N * B)> & pivots)
+  {
+    bool regular = true;
+    T inverse[B];
+    for (int k = 0; k < N; ++k) {
+      for (int b = 0; b < B; ++b) {
+        int p = k;
+        T best = std::fabs(A(k, k)[b]);
+        for (int i = k + 1; i < N; ++i) {
+          T v = std::fabs(A(i, k)[b]);
+          if (v > best) {
+            best = v;
+            p = i;
+          }
+        }
+        pivots[k * B + b] = p;
+        if (p != k)
+          for (int j = 0; j < N; ++j) {
+            T t = A(k, j)[b];
+            A(k, j)[b] = A(p, j)[b];
+            A(p, j)[b] = t;
+          }
+        if (best == T(0)) {
+          regular = false;
+          inverse[b] = T(0);
+        } else {
+          inverse[b] = T(1) / A(k, k)[b];
+        }
+      }
+      for (int i = k + 1; i < N; ++i) {
+        T * l = A(i, k);
+        for (int b = 0; b < B; ++b)
+          l[b] *= inverse[b];
+        for (int j = k + 1; j < N; ++j) {
+          T * a = A(i, j);
+          const T * u = A(k, j);
+          for (int b = 0; b < B; ++b)
+            a[b] -= l[b] * u[b];
+        }
+      }
+    }
+    return regular;
+  }
+
+  /*!
+   * Solves A x = b in place for B right hand sides given the output of
+   * BatchedLUFactor.
+   */
+  template <class T, int N, int B>
+  void BatchedLUSolve(const BatchedMatrix<T, N, B> & LU,
+                      const std::array<int, std::size_t(N * B)> & pivots,
+                      BatchedVector<T, N, B> & x)
+  {
+    for (int k = 0; k < N; ++k)
+      for (int b = 0; b < B; ++b) {
+        int p = pivots[k * B + b];
+        T t = x(k)[b];
+        x(k)[b] = x(p)[b];
+        x(p)[b] = t;
+      }
+    for (int i = 1; i < N; ++i) {
+      T * y = x(i);
+      for (int j = 0; j < i; ++j) {
+        const T * l = LU(i, j);
+        const T * z = x(j);
+        for (int b = 0; b < B; ++b)
+          y[b] -= l[b] * z[b];
+      }
+    }
+    for (int i = N - 1; i >= 0; --i) {
+      T * y = x(i);
+      for (int j = i + 1; j < N; ++j) {
+        const T * u = LU(i, j);
+        const T * z = x(j);
+        for (int b = 0; b < B; ++b)
+          y[b] -= u[b] * z[b];
+      }
+      const T * d = LU(i, i);
+      for (int b = 0; b < B; ++b)
+        y[b] /= d[b];
+    }
+  }
+
+  /*! \class BatchedRosenbrock
+   *  \brief The ROS2 Rosenbrock method applied to B states in lock step.
+   *  \tparam State State type, std::array<T, N>.
+   *  \tparam B Number of states advanced together.
+   *
+   *  ROS2 (Verwer et al., 1999) is a second order, L-stable linearly
+   *  implicit method with gamma = 1 + 1/sqrt(2):
+   *
+   *      W k1 = f(x),  W k2 = f(x + h k1) - 2 k1,  x += h (3 k1 + k2) / 2,
+   *
+   *  with W = I - gamma h J.  It needs one Jacobian and one factorization
+   *  of W per step and no Newton iteration, which makes its cost per step
+   *  predictable and the B members of a batch easy to keep in lock step.
+   *  The Jacobians are approximated by forward differences; the B matrices
+   *  W are factored with BatchedLUFactor.
+   */
+  template <class State, int B = 8>
+  class BatchedRosenbrock {
+    public:
+      typedef typename State::value_type T;
+      static const int N = static_cast<int>(std::tuple_size<State>::value);
+
+      /*!
+       * Advances the states from t to t + h.
+       *
+       * \param[in] f System, called as f(t, x, rhs).
+       * \param[in] t Current value of the independent variable.
+       * \param[in] h Step size.
+       * \param[in,out] x States at t, replaced by the states at t + h.
+       * \return false if one of the matrices W was singular; the states of
+       *         the lanes concerned are then not finite.
+       */
+      template <class System, class I>
+      bool Step(System & f, const I & t, const I & h,
+                std::array<State, B> & x)
+      {
+        const T gamma = T(1) + T(1) / std::sqrt(T(2));
+        const T sqrt_eps = std::sqrt(std::numeric_limits<T>::epsilon());
+        State fx, fy, y;
+        DYNAMICS_TRACE_SPAN("step");
+        for (int b = 0; b < B; ++b) {
+          DYNAMICS_TRACE_SPAN("jacobian");
+          f(t, x[b], fx);
+          for (int i = 0; i < N; ++i)
+            _k1(i)[b] = fx[i];
+          y = x[b];
+          for (int j = 0; j < N; ++j) {
+            const T delta = sqrt_eps * std::max(T(1), std::fabs(x[b][j]));
+            y[j] = x[b][j] + delta;
+            f(t, y, fy);
+            y[j] = x[b][j];
+            const T scale = -gamma * T(h) / delta;
+            for (int i = 0; i < N; ++i)
+              _W(i, j)[b] = scale * (fy[i] - fx[i]);
+          }
+        }
+        for (int i = 0; i < N; ++i) {
+          T * d = _W(i, i);
+          for (int b = 0; b < B; ++b)
+            d[b] += T(1);
+        }
+        bool regular;
+        {
+          DYNAMICS_TRACE_SPAN("lu");
+          regular = BatchedLUFactor(_W, _pivots);
+          BatchedLUSolve(_W, _pivots, _k1);
+        }
+
+        for (int b = 0; b < B; ++b) {
+          DYNAMICS_TRACE_SPAN("rhs batch");
+          for (int i = 0; i < N; ++i)
+            y[i] = x[b][i] + T(h) * _k1(i)[b];
+          f(t + h, y, fy);
+          for (int i = 0; i < N; ++i)
+            _k2(i)[b] = fy[i];
+        }
+        for (int i = 0; i < N; ++i) {
+          T * k2 = _k2(i);
+          const T * k1 = _k1(i);
+          for (int b = 0; b < B; ++b)
+            k2[b] -= T(2) * k1[b];
+        }
+        {
+          DYNAMICS_TRACE_SPAN("lu");
+          BatchedLUSolve(_W, _pivots, _k2);
+        }
+        for (int b = 0; b < B; ++b)
+          for (int i = 0; i < N; ++i)
+            x[b][i] += T(h) / T(2) * (T(3) * _k1(i)[b] + _k2(i)[b]);
+        return regular;
+      }
+
+    private:
+      BatchedMatrix<T, N, B> _W;
+      BatchedVector<T, N, B> _k1, _k2;
+      std::array<int, std::size_t(N * B)> _pivots;
+  };
+
+  /*!
+   * Integrates an ensemble of stiff systems with BatchedRosenbrock, B
+   * members at a time, and reduces the trajectories into an accumulator as
+   * RunEnsemble does.  The last batch is padded with copies of its last
+   * member, whose results are discarded.  A step whose Newton matrix is
+   * singular for some member throws std::runtime_error, since the states
+   * of that batch are no longer finite; nothing is recorded for it.
+   *
+   * \param[in] system System adapter of the mapping, e.g. from MakeSystem;
+   *            copied once per batch.  The mapping's ComputeRHS must
+   *            tolerate concurrent calls.
+   * \param[in] members Number of ensemble members.
+   * \param[in] t0 Initial value of the independent variable.
+   * \param[in] h Step size.
+   * \param[in] steps Number of steps.
+   * \param[in] prototype Empty accumulator copied once per thread; it must
+   *            provide Merge(const Accumulator &).
+   * \param[in] initial Called as initial(i, x) to set the initial state of
+   *            member i.
+   * \param[in] record Called as record(i, k, x, accumulator) with the state
+   *            of member i after k steps, k = 0, ..., steps.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \return The merged accumulator.
+   */
+  template <int B, class System, class I, class Accumulator, class Initial,
+            class Record>
+  Accumulator RunRosenbrockEnsemble(const System & system,
+                                    std::size_t members, I t0, I h,
+                                    std::size_t steps,
+                                    const Accumulator & prototype,
+                                    Initial initial, Record record,
+                                    unsigned threads = 0)
+  {
+    typedef typename System::State State;
+    const std::size_t batches = (members + B - 1) / B;
+    std::vector<Accumulator> partial(ResolveThreads(threads, batches),
+                                     prototype);
+    ParallelFor(batches, [&](std::size_t batch, unsigned thread) {
+      System f(system);
+      BatchedRosenbrock<State, B> stepper;
+      std::array<State, B> x;
+      const std::size_t first = batch * B;
+      const int active = static_cast<int>(
+          std::min<std::size_t>(B, members - first));
+      for (int b = 0; b < B; ++b)
+        initial(first + std::min(b, active - 1), x[b]);
+      for (std::size_t k = 0; ; ++k) {
+        for (int b = 0; b < active; ++b)
+          record(first + b, k, static_cast<const State &>(x[b]),
+                 partial[thread]);
+        if (k == steps)
+          break;
+        if (!stepper.Step(f, t0 + h * I(k), h, x))
+          throw std::runtime_error("RunRosenbrockEnsemble: singular Newton "
+                                   "matrix");
+      }
+    }, threads);
+    for (std::size_t t = 1; t < partial.size(); ++t)
+      partial[0].Merge(partial[t]);
+    return partial[0];
+  }
+}
+#endif
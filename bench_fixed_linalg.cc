@@ -0,0 +1,107 @@
+/*! \example bench_fixed_linalg.cc
+ * Benchmark of the fixed size kernels against Eigen's fixed size types (when
+ * Eigen is available) for the state dimensions typical of mappings.
+ */
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "fixed_linalg.h"
+#include "random.h"
+
+#ifdef HAVE_EIGEN
+#include <Eigen/Dense>
+#endif
+
+// Keeps the optimizer from discarding benchmarked results.
+static volatile double sink;
+
+template <class F>
+double NanosecondsPerCall(F f, long calls)
+{
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  for (long k = 0; k < calls; ++k)
+    f();
+  std::chrono::duration<double, std::nano> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count()/calls;
+}
+
+template <int N>
+void Bench()
+{
+  dynamics::SplitMix64 rng(N);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  dynamics::Matrix<double, N> A, S;
+  std::array<double, N> b;
+  for (int i = 0; i < N; ++i) {
+    b[i] = uniform(rng);
+    for (int j = 0; j < N; ++j)
+      A(i, j) = uniform(rng) + (i == j ? N : 0.0);
+  }
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j)
+      S(i, j) = 0.5*(A(i, j) + A(j, i));
+  const long calls = 20000000/(N*N*N) + 1000;
+
+  double lu = NanosecondsPerCall([&]() {
+    dynamics::Matrix<double, N> LU(A);
+    std::array<int, N> pivots;
+    std::array<double, N> x(b);
+    if (dynamics::LUFactor(LU, pivots))
+      dynamics::LUSolve(LU, pivots, x);
+    sink = x[0];
+  }, calls);
+  double chol = NanosecondsPerCall([&]() {
+    dynamics::Matrix<double, N> L(S);
+    std::array<double, N> x(b);
+    if (dynamics::CholeskyFactor(L))
+      dynamics::CholeskySolve(L, x);
+    sink = x[0];
+  }, calls);
+  double mv = NanosecondsPerCall([&]() {
+    std::array<double, N> y;
+    dynamics::MatVec(A, b, y);
+    sink = y[0];
+  }, calls*N);
+  std::printf("N=%2d  LU %9.1f ns  Cholesky %9.1f ns  MatVec %7.1f ns\n",
+              N, lu, chol, mv);
+
+#ifdef HAVE_EIGEN
+  typedef Eigen::Matrix<double, N, N, Eigen::RowMajor> EM;
+  typedef Eigen::Matrix<double, N, 1> EV;
+  EM eA = Eigen::Map<const EM>(A.Data());
+  EM eS = Eigen::Map<const EM>(S.Data());
+  EV eb = Eigen::Map<const EV>(b.data());
+  double elu = NanosecondsPerCall([&]() {
+    EV x = eA.partialPivLu().solve(eb);
+    sink = x[0];
+  }, calls);
+  double echol = NanosecondsPerCall([&]() {
+    EV x = eS.llt().solve(eb);
+    sink = x[0];
+  }, calls);
+  double emv = NanosecondsPerCall([&]() {
+    EV y = eA*eb;
+    sink = y[0];
+  }, calls*N);
+  std::printf("Eigen LU %9.1f ns  Cholesky %9.1f ns  MatVec %7.1f ns\n",
+              elu, echol, emv);
+#endif
+}
+
+int main(void)
+{
+  Bench<2>();
+  Bench<3>();
+  Bench<4>();
+  Bench<6>();
+  Bench<8>();
+  Bench<12>();
+  Bench<16>();
+  Bench<24>();
+  Bench<32>();
+  return 0;
+}
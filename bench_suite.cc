@@ -0,0 +1,344 @@
+/*! \example bench_suite.cc
+ * End-to-end benchmark workloads with stored baselines.  Every workload
+ * reports its wall time and the number of right hand side evaluations it
+ * took; the latter depends only on the algorithms, not on the machine.
+ *
+ *   bench_suite                        runs the workloads
+ *   bench_suite --write FILE           also records them as a baseline
+ *   bench_suite --compare FILE         flags regressions against FILE
+ *               [--threshold 0.25]     relative slowdown that is flagged
+ *               [--counts-only]        only compares evaluation counts
+ *
+ * A workload regresses when it is slower than its baseline by more than
+ * the threshold or needs more than 2% more right hand side evaluations;
+ * the exit status is nonzero if any workload regresses.  Timings are only
+ * comparable on the machine that recorded the baseline, evaluation counts
+ * everywhere.
+ */
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ensemble.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "mlmc.h"
+#include "random.h"
+#include "switching.h"
+
+class Henon : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1] + 1.0 - 1.4*x[0]*x[0];
+      rhs[1] = 0.3*x[0];
+    }
+};
+
+// Robertson's chemical kinetics, a classic stiff test problem.
+class Robertson : public dynamics::MappingAutonomousEndogenous<double, 3> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 3> & y,
+                            std::array<double, 3> & rhs)
+    {
+      rhs[0] = -0.04*y[0] + 1e4*y[1]*y[2];
+      rhs[2] = 3e7*y[1]*y[1];
+      rhs[1] = -rhs[0] - rhs[2];
+    }
+};
+
+class VanDerPol : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = 1000.0*((1 - x[0]*x[0])*x[1] - x[0]);
+    }
+};
+
+// Ring of pendulums with nearest neighbour springs.
+class OscillatorNetwork
+  : public dynamics::MappingAutonomousEndogenous<double, dynamics::Dynamic> {
+  public:
+    OscillatorNetwork(int n) : _n(n) {}
+    virtual int Dimension() const { return 2*_n; }
+    virtual void ComputeRHS(const std::vector<double> & x,
+                            std::vector<double> & rhs)
+    {
+      for (int i = 0; i < _n; ++i) {
+        const double left = x[2*((i + _n - 1) % _n)];
+        const double right = x[2*((i + 1) % _n)];
+        rhs[2*i] = x[2*i + 1];
+        rhs[2*i + 1] = -std::sin(x[2*i]) - 0.01*x[2*i + 1]
+          + 0.5*(left - 2*x[2*i] + right);
+      }
+    }
+
+  private:
+    int _n;
+};
+
+// Stochastic double well dx = (x - x^3) dt + 0.5 dW.
+class DoubleWell
+  : public dynamics::MappingAutonomousExogenous<double, 1, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 1> & x,
+                            const std::array<double, 1> & u,
+                            std::array<double, 1> & rhs)
+    {
+      rhs[0] = x[0] - x[0]*x[0]*x[0] + 0.5*u[0];
+    }
+};
+
+// Forwards to a mapping and counts its right hand side evaluations, for
+// workloads whose drivers do not report them.
+template <int N>
+class CountingEndogenous
+  : public dynamics::MappingAutonomousEndogenous<double, N> {
+  public:
+    CountingEndogenous(dynamics::MappingAutonomousEndogenous<double, N> & f)
+      : calls(0), _f(f) {}
+    virtual void ComputeRHS(const std::array<double, N> & x,
+                            std::array<double, N> & rhs)
+    {
+      ++calls;
+      _f.ComputeRHS(x, rhs);
+    }
+
+    long calls;
+
+  private:
+    dynamics::MappingAutonomousEndogenous<double, N> & _f;
+};
+
+template <int N, int M>
+class CountingExogenous
+  : public dynamics::MappingAutonomousExogenous<double, N, M> {
+  public:
+    CountingExogenous(dynamics::MappingAutonomousExogenous<double, N, M> & f)
+      : calls(0), _f(f) {}
+    virtual void ComputeRHS(const std::array<double, N> & x,
+                            const std::array<double, M> & u,
+                            std::array<double, N> & rhs)
+    {
+      ++calls;
+      _f.ComputeRHS(x, u, rhs);
+    }
+
+    long calls;
+
+  private:
+    dynamics::MappingAutonomousExogenous<double, N, M> & _f;
+};
+
+struct Result {
+  double seconds;
+  long rhs_evaluations;
+};
+
+struct Sum {
+  Sum() : value(0.0), evaluations(0) {}
+  void Merge(const Sum & other)
+  {
+    value += other.value;
+    evaluations += other.evaluations;
+  }
+  double value;
+  long evaluations;
+};
+
+// Keeps the optimizer from discarding benchmarked results.
+static volatile double sink;
+
+template <class F>
+static Result Time(F workload)
+{
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  Result result;
+  result.rhs_evaluations = workload();
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  result.seconds = elapsed.count();
+  return result;
+}
+
+static long HenonOrbit()
+{
+  Henon map;
+  CountingEndogenous<2> henon(map);
+  std::array<double, 2> x = {{0.1, 0.1}}, y;
+  for (long k = 0; k < 20000000; ++k) {
+    henon.ComputeRHS(x, y);
+    x = y;
+  }
+  sink = x[0];
+  return henon.calls;
+}
+
+static long RobertsonKinetics()
+{
+  Robertson robertson;
+  dynamics::AutonomousEndogenousSystem<double, 3> f =
+    dynamics::MakeSystem(robertson);
+  dynamics::SwitchingOptions options;
+  options.integration.rtol = 1e-6;
+  options.integration.atol = 1e-10;
+  long evaluations = 0;
+  for (int run = 0; run < 200; ++run) {
+    std::array<double, 3> y = {{1.0, 0.0, 0.0}};
+    evaluations += dynamics::IntegrateSwitching(f, 0.0, 1e5, y, options)
+      .rhs_evaluations;
+    sink = y[2];
+  }
+  return evaluations;
+}
+
+static long VanDerPolRelaxation()
+{
+  VanDerPol vdp;
+  dynamics::AutonomousEndogenousSystem<double, 2> f =
+    dynamics::MakeSystem(vdp);
+  dynamics::SwitchingOptions options;
+  std::array<double, 2> x = {{2.0, 0.0}};
+  long evaluations =
+    dynamics::IntegrateSwitching(f, 0.0, 3000.0, x, options)
+    .rhs_evaluations;
+  sink = x[0];
+  return evaluations;
+}
+
+static long Network()
+{
+  OscillatorNetwork network(2000);
+  dynamics::AutonomousEndogenousSystem<double, dynamics::Dynamic> f =
+    dynamics::MakeSystem(network);
+  std::vector<double> x(4000, 0.0);
+  for (int i = 0; i < 2000; ++i)
+    x[2*i] = std::sin(0.01*i*i);
+  dynamics::DormandPrince54<std::vector<double> > stepper;
+  long evaluations =
+    dynamics::IntegrateAdaptive(stepper, f, 0.0, 200.0, x).rhs_evaluations;
+  sink = x[0];
+  return evaluations;
+}
+
+static long SDEEnsemble()
+{
+  DoubleWell well;
+  const std::size_t members = 4000, steps = 2000;
+  Sum fraction = dynamics::RunEnsemble(members, Sum(),
+      [&](std::size_t i, Sum & acc, unsigned) {
+        // One counter per member, since the members run concurrently.
+        CountingExogenous<1, 1> counted(well);
+        auto sampler = dynamics::MakeSDEPathSampler(
+            counted, 10.0, steps,
+            [](dynamics::SplitMix64 & rng, std::array<double, 1> & x0) {
+              x0[0] = std::uniform_real_distribution<double>(-0.1, 0.1)(rng);
+            },
+            [](const std::array<double, 1> & x) {
+              return x[0] > 0 ? 1.0 : 0.0;
+            });
+        dynamics::SplitMix64 rng(dynamics::Mix64(i));
+        acc.value += sampler(0, rng);
+        acc.evaluations += counted.calls;
+      });
+  sink = fraction.value;
+  return fraction.evaluations;
+}
+
+int main(int argc, char ** argv)
+{
+  std::string write, compare;
+  double threshold = 0.25;
+  bool counts_only = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--write") && i + 1 < argc)
+      write = argv[++i];
+    else if (!std::strcmp(argv[i], "--compare") && i + 1 < argc)
+      compare = argv[++i];
+    else if (!std::strcmp(argv[i], "--threshold") && i + 1 < argc)
+      threshold = std::atof(argv[++i]);
+    else if (!std::strcmp(argv[i], "--counts-only"))
+      counts_only = true;
+    else {
+      std::cerr << "usage: " << argv[0] << " [--write FILE] [--compare FILE"
+                << " [--threshold T] [--counts-only]]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::map<std::string, Result> baseline;
+  if (!compare.empty()) {
+    std::ifstream file(compare.c_str());
+    if (!file) {
+      std::cerr << "cannot read " << compare << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+      if (line.empty() || line[0] == '#')
+        continue;
+      std::istringstream fields(line);
+      std::string name;
+      Result result;
+      if (fields >> name >> result.seconds >> result.rhs_evaluations)
+        baseline[name] = result;
+    }
+  }
+
+  const char * names[] = {"henon", "robertson", "vanderpol", "network",
+                          "sde_ensemble"};
+  long (*workloads[])() = {HenonOrbit, RobertsonKinetics,
+                           VanDerPolRelaxation, Network, SDEEnsemble};
+  std::ostringstream record;
+  record << "# workload seconds rhs_evaluations\n";
+  bool regressed = false;
+  for (int w = 0; w < 5; ++w) {
+    Result result = Time(workloads[w]);
+    std::printf("%-13s %9.4f s %10ld RHS", names[w], result.seconds,
+                result.rhs_evaluations);
+    std::map<std::string, Result>::const_iterator base =
+      baseline.find(names[w]);
+    if (base != baseline.end()) {
+      const Result & b = base->second;
+      const double slowdown = result.seconds/b.seconds - 1.0;
+      const double extra =
+        double(result.rhs_evaluations)/b.rhs_evaluations - 1.0;
+      std::printf("  %+7.1f%% time %+7.2f%% RHS", 100*slowdown, 100*extra);
+      if (extra > 0.02 || (!counts_only && slowdown > threshold)) {
+        std::printf("  REGRESSION");
+        regressed = true;
+      } else if (extra < -0.02) {
+        std::printf("  (fewer evaluations, update the baseline)");
+      }
+    } else if (!compare.empty()) {
+      std::printf("  (no baseline)");
+    }
+    std::printf("\n");
+    record << names[w] << ' ' << result.seconds << ' '
+           << result.rhs_evaluations << '\n';
+  }
+
+  if (!write.empty()) {
+    std::ofstream file(write.c_str());
+    file << record.str();
+    if (!file) {
+      std::cerr << "cannot write " << write << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
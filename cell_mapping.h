@@ -0,0 +1,315 @@
+/*! \file cell_mapping.h
+ *  \brief Global analysis by simple cell mapping.
+ *
+ *  Simple cell mapping (Hsu, 1980) replaces a map, or a flow sampled at a
+ *  fixed time, by a map between the cells of a uniform grid over a region
+ *  of state space: every cell is sent to the cell containing the image of
+ *  its center, and images leaving the region go to a sink cell.  The
+ *  resulting functional graph is stored as one integer per cell.  Its
+ *  cycles, the periodic groups, approximate attractors, and the cells
+ *  whose orbits end in a group form its domain of attraction.  Both are
+ *  found by a single pass over the graph, in time linear in the number of
+ *  cells, so a global picture costs one function evaluation per cell
+ *  instead of a long integration per initial state.
+ *
+ *  Images are computed in parallel over blocks of consecutive cells.
+ */
+
+#ifndef __CELL_MAPPING_H__
+#define __CELL_MAPPING_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "integrators.h"
+#include "mappings.h"
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \class CellGrid
+   *  \brief Uniform grid of cells over a box.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *
+   *  Cells are numbered with the first state varying fastest.
+   */
+  template <class T, int N>
+  class CellGrid {
+    public:
+      typedef std::array<T, std::size_t(N)> State;
+
+      /*!
+       * \param[in] lower Lower corner of the region.
+       * \param[in] upper Upper corner of the region.
+       * \param[in] cells Number of cells along each state.
+       */
+      CellGrid(const State & lower, const State & upper,
+               const std::array<std::size_t, std::size_t(N)> & cells)
+        : _lower(lower), _cells(cells), _total(1)
+      {
+        for (int i = 0; i < N; ++i) {
+          if (cells[i] == 0 || !(upper[i] > lower[i]))
+            throw std::invalid_argument("CellGrid: degenerate grid");
+          _size[i] = (upper[i] - lower[i]) / T(cells[i]);
+          _total *= cells[i];
+        }
+        if (_total >= std::numeric_limits<std::uint32_t>::max())
+          throw std::invalid_argument("CellGrid: too many cells");
+      }
+
+      //! Number of cells; the sink cell has this index.
+      std::size_t Cells() const { return _total; }
+
+      //! Index of the sink cell.
+      std::uint32_t Sink() const { return std::uint32_t(_total); }
+
+      //! Index of the cell containing x, or Sink() outside the region.
+      std::uint32_t Index(const State & x) const
+      {
+        std::size_t index = 0, stride = 1;
+        for (int i = 0; i < N; ++i) {
+          const T s = (x[i] - _lower[i]) / _size[i];
+          if (!(s >= T(0) && s < T(_cells[i])))
+            return Sink();
+          index += std::size_t(s) * stride;
+          stride *= _cells[i];
+        }
+        return std::uint32_t(index);
+      }
+
+      //! Center of cell c.
+      void Center(std::size_t c, State & x) const
+      {
+        for (int i = 0; i < N; ++i) {
+          x[i] = _lower[i] + (T(c % _cells[i]) + T(0.5)) * _size[i];
+          c /= _cells[i];
+        }
+      }
+
+    private:
+      State _lower, _size;
+      std::array<std::size_t, std::size_t(N)> _cells;
+      std::size_t _total;
+  };
+
+  /*! \struct CellMappingOptions
+   *  \brief Parameters of SimpleCellMapping.
+   */
+  struct CellMappingOptions {
+    CellMappingOptions() : block(4096), threads(0) {}
+
+    //! Cells per parallel block.
+    std::size_t block;
+    //! Number of threads computing images, 0 selects HardwareThreads().
+    unsigned threads;
+  };
+
+  /*! \class SimpleCellMapping
+   *  \brief Cell-to-cell map over a grid and its periodic groups.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *
+   *  Build the map with one of the Build methods, then call Analyze.  The
+   *  sink cell always forms group 0, of period 1.  Building discards the
+   *  groups, so Groups() is 0 and the other group accessors must not be
+   *  called until Analyze is called again.
+   */
+  template <class T, int N>
+  class SimpleCellMapping {
+    public:
+      typedef std::array<T, std::size_t(N)> State;
+
+      explicit SimpleCellMapping(const CellGrid<T, N> & grid,
+                                 const CellMappingOptions & options =
+                                   CellMappingOptions())
+        : _grid(grid), _options(options),
+          _image(grid.Cells() + 1, grid.Sink())
+      {
+        if (options.block == 0)
+          throw std::invalid_argument("SimpleCellMapping: block must be "
+                                      "positive");
+      }
+
+      /*!
+       * Computes the image of every cell as the cell of image(x, y) at its
+       * center x.  image is copied for every block, so it may keep state.
+       */
+      template <class Image>
+      void Build(Image image)
+      {
+        const std::size_t cells = _grid.Cells();
+        const std::size_t blocks = (cells + _options.block - 1)
+          / _options.block;
+        ParallelFor(blocks, [&](std::size_t b, unsigned) {
+          Image f(image);
+          State x, y;
+          const std::size_t end = std::min(cells, (b + 1) * _options.block);
+          for (std::size_t c = b * _options.block; c < end; ++c) {
+            _grid.Center(c, x);
+            f(x, y);
+            _image[c] = _grid.Index(y);
+          }
+        }, _options.threads, 1);
+        _image[cells] = _grid.Sink();
+        _group.clear();
+        _steps.clear();
+        _period.clear();
+        _first.clear();
+      }
+
+      /*!
+       * Builds the cell map of a discrete map, whose ComputeRHS returns the
+       * image of a state; ComputeRHS must tolerate concurrent calls when
+       * threads != 1.
+       */
+      void BuildMap(MappingAutonomousEndogenous<T, N> & f)
+      {
+        Build(MapImage(f));
+      }
+
+      /*!
+       * Builds the cell map of the flow of an ODE over the time steps * h,
+       * integrated with RungeKutta4; ComputeRHS must tolerate concurrent
+       * calls when threads != 1.
+       */
+      void BuildFlow(MappingAutonomousEndogenous<T, N> & f, T h,
+                     std::size_t steps)
+      {
+        Build(FlowImage(f, h, steps));
+      }
+
+      /*!
+       * Finds the periodic groups and assigns every cell to the group its
+       * orbit ends in, with the number of steps it takes to get there.
+       * Every cell is visited a bounded number of times.
+       */
+      void Analyze()
+      {
+        const std::size_t cells = _grid.Cells() + 1;
+        const std::uint32_t unvisited =
+          std::numeric_limits<std::uint32_t>::max();
+        _group.assign(cells, unvisited);
+        _steps.assign(cells, 0);
+        _period.clear();
+        _first.clear();
+        // The sink is group 0.
+        _group[cells - 1] = 0;
+        _period.push_back(1);
+        _first.push_back(std::uint32_t(cells - 1));
+        // Cells on the current path are marked with its starting cell, so
+        // that reaching one of them closes a new cycle.
+        std::vector<std::uint32_t> path;
+        std::vector<std::uint32_t> mark(cells, unvisited);
+        for (std::size_t start = 0; start + 1 < cells; ++start) {
+          if (_group[start] != unvisited)
+            continue;
+          path.clear();
+          std::uint32_t c = std::uint32_t(start);
+          while (_group[c] == unvisited && mark[c] != start) {
+            mark[c] = std::uint32_t(start);
+            path.push_back(c);
+            c = _image[c];
+          }
+          std::size_t remaining = path.size();
+          std::uint32_t steps = 0;
+          if (_group[c] == unvisited) {
+            // Closed a new cycle, starting at c on the path.
+            const std::uint32_t g = std::uint32_t(_period.size());
+            std::size_t k = remaining;
+            while (path[k - 1] != c)
+              --k;
+            _period.push_back(std::uint32_t(remaining - (k - 1)));
+            _first.push_back(c);
+            for (std::size_t j = k - 1; j < remaining; ++j) {
+              _group[path[j]] = g;
+              _steps[path[j]] = 0;
+            }
+            remaining = k - 1;
+          } else {
+            steps = _steps[c];
+          }
+          const std::uint32_t g = _group[remaining < path.size()
+                                         ? path[remaining] : c];
+          for (std::size_t j = remaining; j-- > 0; ) {
+            _group[path[j]] = g;
+            _steps[path[j]] = ++steps;
+          }
+        }
+      }
+
+      const CellGrid<T, N> & Grid() const { return _grid; }
+
+      //! Image of cell c; the sink maps to itself.
+      std::uint32_t Image(std::size_t c) const { return _image[c]; }
+
+      //! The cell map, with the sink last.
+      const std::vector<std::uint32_t> & Images() const { return _image; }
+
+      //! Number of periodic groups, including the sink.
+      std::size_t Groups() const { return _period.size(); }
+
+      //! Period of group g.
+      std::size_t Period(std::size_t g) const { return _period[g]; }
+
+      //! A cell of the cycle of group g.
+      std::uint32_t Representative(std::size_t g) const { return _first[g]; }
+
+      //! Group whose domain of attraction contains cell c.
+      std::uint32_t Group(std::size_t c) const { return _group[c]; }
+
+      //! Number of steps from cell c to its periodic group.
+      std::uint32_t Steps(std::size_t c) const { return _steps[c]; }
+
+      //! Number of cells (including periodic ones) in each domain.
+      std::vector<std::size_t> DomainSizes() const
+      {
+        std::vector<std::size_t> sizes(_period.size(), 0);
+        for (std::size_t c = 0; c + 1 < _group.size(); ++c)
+          ++sizes[_group[c]];
+        return sizes;
+      }
+
+    private:
+      class MapImage {
+        public:
+          explicit MapImage(MappingAutonomousEndogenous<T, N> & f)
+            : _f(f) {}
+
+          void operator()(const State & x, State & y) { _f.ComputeRHS(x, y); }
+
+        private:
+          MappingAutonomousEndogenous<T, N> & _f;
+      };
+
+      class FlowImage {
+        public:
+          FlowImage(MappingAutonomousEndogenous<T, N> & f, T h,
+                    std::size_t steps)
+            : _f(f), _h(h), _steps(steps) {}
+
+          void operator()(const State & x, State & y)
+          {
+            AutonomousEndogenousSystem<T, N> system(_f);
+            y = x;
+            for (std::size_t k = 0; k < _steps; ++k)
+              _stepper.Step(system, _h * T(k), _h, y);
+          }
+
+        private:
+          MappingAutonomousEndogenous<T, N> & _f;
+          T _h;
+          std::size_t _steps;
+          RungeKutta4<State> _stepper;
+      };
+
+      CellGrid<T, N> _grid;
+      CellMappingOptions _options;
+      std::vector<std::uint32_t> _image, _group, _steps, _period, _first;
+  };
+}
+#endif
@@ -0,0 +1,553 @@
+/*! \file collocation.h
+ *  \brief Trajectory optimization by Hermite-Simpson direct collocation.
+ *
+ *  TrajectoryOptimizer discretizes an optimal control problem over a
+ *  MappingAutonomousExogenous model on a uniform grid.  States and inputs
+ *  at the grid nodes are the unknowns; inputs are linear between nodes, and
+ *  the compressed Hermite-Simpson rule couples consecutive nodes through
+ *  one defect per interval.  Every defect only depends on two nodes, so
+ *  the constraint Jacobian consists of one block per interval, which is
+ *  computed exactly by evaluating the defect in Dual arithmetic (see
+ *  autodiff.h); intervals are evaluated in parallel.
+ *
+ *  The resulting nonlinear program is solved by SQP with the Hessian of
+ *  the (quadratic) cost and an l1 merit line search.  With unknowns and
+ *  multipliers interleaved node by node the KKT matrix is banded, with a
+ *  bandwidth set by the state and input dimensions only, and it is
+ *  factored by banded LU with partial pivoting in time linear in the
+ *  number of intervals.
+ */
+
+#ifndef __COLLOCATION_H__
+#define __COLLOCATION_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "autodiff.h"
+#include "fixed_linalg.h"
+#include "mappings.h"
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \struct CollocationOptions
+   *  \brief Parameters of TrajectoryOptimizer.
+   */
+  struct CollocationOptions {
+    CollocationOptions()
+      : tolerance(1e-8), max_iterations(100), threads(0) {}
+
+    //! Convergence when the largest step component is below tolerance
+    //! (1 + |z|), with z the largest unknown, and the largest constraint
+    //! violation below tolerance.
+    double tolerance;
+    //! Largest number of SQP iterations.
+    int max_iterations;
+    //! Number of threads evaluating intervals, 0 selects
+    //! HardwareThreads().
+    unsigned threads;
+  };
+
+  /*! \struct CollocationResult
+   *  \brief Result of TrajectoryOptimizer::Solve.
+   */
+  template <class T>
+  struct CollocationResult {
+    //! Cost of the last iterate.
+    T cost;
+    //! Largest constraint violation of the last iterate.
+    T infeasibility;
+    bool converged;
+    int iterations;
+  };
+
+  namespace internal {
+    /*! \class BandLU
+     *  \brief LU factorization with partial pivoting of a band matrix.
+     *
+     *  Row i stores columns i - lower to i + upper + lower, which leaves
+     *  room for the fill-in caused by row interchanges.
+     */
+    template <class T>
+    class BandLU {
+      public:
+        //! Zero matrix of size n with the given half bandwidths.
+        void Reset(std::size_t n, std::size_t lower, std::size_t upper)
+        {
+          _n = n;
+          _lower = lower;
+          _width = 2 * lower + upper + 1;
+          _data.assign(n * _width, T(0));
+          _pivots.resize(n);
+        }
+
+        //! Entry (i, j), which must lie in the band.
+        T & operator()(std::size_t i, std::size_t j)
+        {
+          return _data[i * _width + j + _lower - i];
+        }
+
+        //! Factors in place; returns false if the matrix is singular.
+        bool Factor()
+        {
+          const std::size_t reach = _width - _lower - 1;
+          for (std::size_t k = 0; k < _n; ++k) {
+            const std::size_t last = std::min(_n - 1, k + _lower);
+            const std::size_t end = std::min(_n - 1, k + reach);
+            std::size_t p = k;
+            for (std::size_t i = k + 1; i <= last; ++i)
+              if (std::fabs((*this)(i, k)) > std::fabs((*this)(p, k)))
+                p = i;
+            _pivots[k] = p;
+            if ((*this)(p, k) == T(0))
+              return false;
+            if (p != k)
+              for (std::size_t j = k; j <= end; ++j)
+                std::swap((*this)(k, j), (*this)(p, j));
+            const T pivot = (*this)(k, k);
+            for (std::size_t i = k + 1; i <= last; ++i) {
+              const T l = (*this)(i, k) /= pivot;
+              if (l == T(0))
+                continue;
+              for (std::size_t j = k + 1; j <= end; ++j)
+                (*this)(i, j) -= l * (*this)(k, j);
+            }
+          }
+          return true;
+        }
+
+        //! Solves A x = b in place after Factor.
+        void Solve(std::vector<T> & b)
+        {
+          const std::size_t reach = _width - _lower - 1;
+          for (std::size_t k = 0; k < _n; ++k) {
+            std::swap(b[k], b[_pivots[k]]);
+            const std::size_t last = std::min(_n - 1, k + _lower);
+            for (std::size_t i = k + 1; i <= last; ++i)
+              b[i] -= (*this)(i, k) * b[k];
+          }
+          for (std::size_t i = _n; i-- > 0; ) {
+            const std::size_t end = std::min(_n - 1, i + reach);
+            T s = b[i];
+            for (std::size_t j = i + 1; j <= end; ++j)
+              s -= (*this)(i, j) * b[j];
+            b[i] = s / (*this)(i, i);
+          }
+        }
+
+      private:
+        std::size_t _n, _lower, _width;
+        std::vector<T> _data;
+        std::vector<std::size_t> _pivots;
+    };
+  }
+
+  /*! \class TrajectoryOptimizer
+   *  \brief Hermite-Simpson direct collocation solved by banded SQP.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of the inputs.
+   *
+   *  Minimizes
+   *  \f[
+   *    \frac{1}{2} \int_0^{t_f} \|x - x_r\|_Q^2 + \|u - u_r\|_R^2 \, dt
+   *      + \frac{1}{2} \|x(t_f) - x_r\|_{Q_f}^2,
+   *  \f]
+   *  with the state term integrated by the trapezoidal rule and the input
+   *  term exactly for the piecewise linear inputs, subject to the model, a
+   *  given initial state and optionally a given final state.  The mappings
+   *  are called concurrently from several threads.
+   */
+  template <class T, int N, int M>
+  class TrajectoryOptimizer {
+    public:
+      typedef std::array<T, std::size_t(N)> State;
+      typedef std::array<T, std::size_t(M)> Input;
+      //! Scalar of the defect Jacobians: both nodes of an interval.
+      typedef Dual<T, 2 * (N + M)> Scalar;
+
+      /*!
+       * \param[in] f Model.
+       * \param[in] df The same model instantiated with Dual<T, 2 (N + M)>
+       *            scalars.
+       * \param[in] intervals Number of collocation intervals.
+       * \param[in] duration Length of the time horizon.
+       * \param[in] Q State weight.
+       * \param[in] R Input weight, positive definite.
+       * \param[in] Qf Terminal state weight.
+       * \param[in] options Parameters.
+       */
+      TrajectoryOptimizer(MappingAutonomousExogenous<T, N, M> & f,
+                          MappingAutonomousExogenous<Scalar, N, M> & df,
+                          std::size_t intervals, T duration,
+                          const Matrix<T, N> & Q, const Matrix<T, M> & R,
+                          const Matrix<T, N> & Qf,
+                          const CollocationOptions & options
+                            = CollocationOptions())
+        : _f(f), _df(df), _K(intervals), _h(duration / T(intervals)),
+          _Q(Q), _R(R), _Qf(Qf), _options(options), _fixed_final(false),
+          _z((intervals + 1) * (N + M)), _c(intervals * N),
+          _jacobians(intervals)
+      {
+        if (intervals == 0)
+          throw std::invalid_argument("TrajectoryOptimizer: no intervals");
+        _xr.fill(T(0));
+        _ur.fill(T(0));
+        _final.fill(T(0));
+      }
+
+      //! Sets the state and input the cost tracks.
+      void SetReference(const State & x, const Input & u)
+      {
+        _xr = x;
+        _ur = u;
+      }
+
+      //! Constrains the final state.
+      void SetFinalState(const State & x)
+      {
+        _final = x;
+        _fixed_final = true;
+      }
+
+      //! Leaves the final state free.
+      void ClearFinalState() { _fixed_final = false; }
+
+      /*!
+       * Sets the initial guess to states interpolated linearly between
+       * two states and a constant input.
+       */
+      void Initialize(const State & start, const State & end,
+                      const Input & u)
+      {
+        for (std::size_t k = 0; k <= _K; ++k) {
+          const T s = T(k) / T(_K);
+          for (int i = 0; i < N; ++i)
+            _z[k * (N + M) + i] = (1 - s) * start[i] + s * end[i];
+          for (int j = 0; j < M; ++j)
+            _z[k * (N + M) + N + j] = u[j];
+        }
+      }
+
+      /*!
+       * Optimizes the trajectory starting from x0, from the current
+       * iterate (see Initialize).
+       */
+      CollocationResult<T> Solve(const State & x0)
+      {
+        const std::size_t n = N + M;
+        const std::size_t size = N + (_K + 1) * n + _K * N
+          + (_fixed_final ? N : 0);
+        // Defects couple a node to its neighbours' states, the input cost
+        // to their inputs.
+        const std::size_t band = 2 * n - 1;
+        CollocationResult<T> result;
+        result.converged = false;
+        std::vector<T> rhs, trial(_z.size()), gradient(_z.size());
+        for (result.iterations = 0;
+             result.iterations < _options.max_iterations;
+             ++result.iterations) {
+          Linearize();
+          Gradient(_z, gradient);
+          _kkt.Reset(size, band, band);
+          rhs.assign(size, T(0));
+          // Initial state constraint.
+          for (int i = 0; i < N; ++i) {
+            _kkt(i, Node(0) + i) = _kkt(Node(0) + i, i) = T(1);
+            rhs[i] = x0[i] - _z[i];
+          }
+          for (std::size_t k = 0; k <= _K; ++k) {
+            const T w = Weight(k);
+            for (int i = 0; i < N; ++i)
+              for (int j = 0; j < N; ++j)
+                _kkt(Node(k) + i, Node(k) + j) = w * _Q(i, j)
+                  + (k == _K ? _Qf(i, j) : T(0));
+            const T diagonal = k == 0 || k == _K ? _h / 3 : 2 * _h / 3;
+            for (int a = 0; a < M; ++a)
+              for (int b = 0; b < M; ++b) {
+                _kkt(Node(k) + N + a, Node(k) + N + b) = diagonal * _R(a, b);
+                if (k < _K)
+                  _kkt(Node(k) + N + a, Node(k + 1) + N + b)
+                    = _kkt(Node(k + 1) + N + b, Node(k) + N + a)
+                    = _h / 6 * _R(a, b);
+              }
+            for (std::size_t v = 0; v < n; ++v)
+              rhs[Node(k) + v] = -gradient[k * n + v];
+          }
+          for (std::size_t k = 0; k < _K; ++k) {
+            const std::size_t row = Node(k) + n;
+            for (int i = 0; i < N; ++i) {
+              for (std::size_t v = 0; v < 2 * n; ++v) {
+                const std::size_t column = Node(k) + v + (v < n ? 0 : N);
+                _kkt(row + i, column) = _kkt(column, row + i)
+                  = _jacobians[k](i, v);
+              }
+              rhs[row + i] = -_c[k * N + i];
+            }
+          }
+          if (_fixed_final) {
+            const std::size_t row = Node(_K) + n;
+            for (int i = 0; i < N; ++i) {
+              _kkt(row + i, Node(_K) + i) = _kkt(Node(_K) + i, row + i) = T(1);
+              rhs[row + i] = _final[i] - _z[_K * n + i];
+            }
+          }
+          if (!_kkt.Factor())
+            throw std::runtime_error("TrajectoryOptimizer: singular KKT "
+                                     "matrix");
+          _kkt.Solve(rhs);
+
+          // l1 merit line search; the penalty exceeds the multipliers.
+          T step(0), scale(0), directional(0), multipliers(0);
+          for (std::size_t k = 0; k <= _K; ++k)
+            for (std::size_t v = 0; v < n; ++v) {
+              const T d = rhs[Node(k) + v];
+              step = std::max(step, std::fabs(d));
+              scale = std::max(scale, std::fabs(_z[k * n + v]));
+              directional += gradient[k * n + v] * d;
+            }
+          for (std::size_t r = 0; r < size; ++r)
+            if (!IsNode(r))
+              multipliers = std::max(multipliers, std::fabs(rhs[r]));
+          _penalty = result.iterations == 0 ? 2 * multipliers
+            : std::max(_penalty, 2 * multipliers);
+          const T violation = Violation(x0, _c, _z);
+          result.infeasibility = MaxViolation(x0);
+          if (step <= T(_options.tolerance) * (1 + scale)
+              && result.infeasibility <= T(_options.tolerance)) {
+            result.converged = true;
+            break;
+          }
+          // Decreases below rounding errors of the merit still count.
+          const T merit = Cost(_z) + _penalty * violation;
+          const T slack = 16 * std::numeric_limits<T>::epsilon()
+            * (1 + std::fabs(merit));
+          directional -= _penalty * violation;
+          T alpha(1);
+          bool accepted = false;
+          for (int halvings = 0; halvings < 30 && !accepted;
+               ++halvings, alpha /= 2) {
+            for (std::size_t k = 0; k <= _K; ++k)
+              for (std::size_t v = 0; v < n; ++v)
+                trial[k * n + v] = _z[k * n + v]
+                  + alpha * rhs[Node(k) + v];
+            Defects(trial, _trial_c);
+            accepted = Cost(trial) + _penalty * Violation(x0, _trial_c, trial)
+              <= merit + T(1e-4) * alpha * std::min(directional, T(0))
+              + slack;
+          }
+          // No decrease at all: the iterate is as good as rounding allows.
+          if (!accepted)
+            break;
+          _z.swap(trial);
+        }
+        Defects(_z, _c);
+        result.cost = Cost(_z);
+        result.infeasibility = MaxViolation(x0);
+        return result;
+      }
+
+      //! State at node k (time k duration / intervals).
+      State States(std::size_t k) const
+      {
+        State x;
+        std::copy(&_z[k * (N + M)], &_z[k * (N + M)] + N, x.begin());
+        return x;
+      }
+
+      //! Input at node k; inputs are linear between nodes.
+      Input Inputs(std::size_t k) const
+      {
+        Input u;
+        std::copy(&_z[k * (N + M) + N], &_z[k * (N + M)] + N + M,
+                  u.begin());
+        return u;
+      }
+
+      std::size_t Intervals() const { return _K; }
+
+    private:
+      // Position of node k in the KKT system, whose unknowns are the
+      // initial state multipliers followed by node k and the defect
+      // multipliers of interval k for every k, and the final state
+      // multipliers.
+      std::size_t Node(std::size_t k) const { return N + k * (2 * N + M); }
+
+      bool IsNode(std::size_t r) const
+      {
+        return r >= N && (r - N) % (2 * N + M) < std::size_t(N + M)
+          && (r - N) / (2 * N + M) <= _K;
+      }
+
+      // Trapezoidal quadrature weight of node k.
+      T Weight(std::size_t k) const
+      {
+        return k == 0 || k == _K ? _h / 2 : _h;
+      }
+
+      // Hermite-Simpson defect of the interval between nodes a and b:
+      // x_b - x_a - h/6 (f_a + 4 f_m + f_b) with the midpoint state
+      // (x_a + x_b)/2 + h/8 (f_a - f_b) and input (u_a + u_b)/2.
+      template <class S, class Mapping>
+      void Defect(Mapping & f, const S * a, const S * b, S * c) const
+      {
+        std::array<S, std::size_t(N)> xa, xb, xm, fa, fb, fm;
+        std::array<S, std::size_t(M)> ua, ub, um;
+        for (int i = 0; i < N; ++i) {
+          xa[i] = a[i];
+          xb[i] = b[i];
+        }
+        for (int j = 0; j < M; ++j) {
+          ua[j] = a[N + j];
+          ub[j] = b[N + j];
+          um[j] = T(0.5) * (ua[j] + ub[j]);
+        }
+        f.ComputeRHS(xa, ua, fa);
+        f.ComputeRHS(xb, ub, fb);
+        for (int i = 0; i < N; ++i)
+          xm[i] = T(0.5) * (xa[i] + xb[i]) + _h / 8 * (fa[i] - fb[i]);
+        f.ComputeRHS(xm, um, fm);
+        for (int i = 0; i < N; ++i)
+          c[i] = xb[i] - xa[i] - _h / 6 * (fa[i] + 4 * fm[i] + fb[i]);
+      }
+
+      // Defects and their Jacobians with respect to both nodes.
+      void Linearize()
+      {
+        const std::size_t n = N + M;
+        ParallelFor(_K, [&](std::size_t k, unsigned) {
+          std::array<Scalar, 2 * (N + M)> z;
+          for (std::size_t v = 0; v < 2 * n; ++v)
+            z[v] = Scalar(_z[k * n + v], int(v));
+          std::array<Scalar, std::size_t(N)> c;
+          Defect(_df, z.data(), z.data() + n, c.data());
+          for (int i = 0; i < N; ++i) {
+            _c[k * N + i] = c[i].Value();
+            for (std::size_t v = 0; v < 2 * n; ++v)
+              _jacobians[k](i, v) = c[i].Derivative(int(v));
+          }
+        }, _options.threads);
+      }
+
+      void Defects(const std::vector<T> & z, std::vector<T> & c)
+      {
+        const std::size_t n = N + M;
+        c.resize(_K * N);
+        ParallelFor(_K, [&](std::size_t k, unsigned) {
+          Defect(_f, &z[k * n], &z[(k + 1) * n], &c[k * N]);
+        }, _options.threads);
+      }
+
+      T Cost(const std::vector<T> & z) const
+      {
+        const std::size_t n = N + M;
+        T cost(0);
+        for (std::size_t k = 0; k <= _K; ++k) {
+          const T * x = &z[k * n];
+          T s(0), terminal(0);
+          for (int i = 0; i < N; ++i)
+            for (int j = 0; j < N; ++j) {
+              s += (x[i] - _xr[i]) * _Q(i, j) * (x[j] - _xr[j]);
+              terminal += (x[i] - _xr[i]) * _Qf(i, j) * (x[j] - _xr[j]);
+            }
+          cost += Weight(k) * s + (k == _K ? terminal : T(0));
+        }
+        // Linear inputs a to b over an interval: the integral of
+        // u^T R u is h/6 (2 a^T R a + a^T R b + b^T R a + 2 b^T R b).
+        for (std::size_t k = 0; k < _K; ++k) {
+          const T * a = &z[k * n + N];
+          const T * b = &z[(k + 1) * n + N];
+          T s(0);
+          for (int i = 0; i < M; ++i)
+            for (int j = 0; j < M; ++j) {
+              const T ai = a[i] - _ur[i], aj = a[j] - _ur[j];
+              const T bi = b[i] - _ur[i], bj = b[j] - _ur[j];
+              s += _R(i, j) * (2 * ai * aj + ai * bj + bi * aj
+                               + 2 * bi * bj);
+            }
+          cost += _h / 6 * s;
+        }
+        return cost / 2;
+      }
+
+      void Gradient(const std::vector<T> & z, std::vector<T> & g) const
+      {
+        const std::size_t n = N + M;
+        for (std::size_t k = 0; k <= _K; ++k) {
+          const T * x = &z[k * n];
+          const T w = Weight(k);
+          for (int i = 0; i < N; ++i) {
+            T s(0);
+            for (int j = 0; j < N; ++j)
+              s += (w * _Q(i, j) + (k == _K ? _Qf(i, j) : T(0)))
+                * (x[j] - _xr[j]);
+            g[k * n + i] = s;
+          }
+          // Derivative of the exact input integrals of both neighbouring
+          // intervals.
+          const T diagonal = k == 0 || k == _K ? _h / 3 : 2 * _h / 3;
+          for (int a = 0; a < M; ++a) {
+            T s(0);
+            for (int b = 0; b < M; ++b) {
+              s += diagonal * _R(a, b) * (x[N + b] - _ur[b]);
+              if (k > 0)
+                s += _h / 6 * _R(a, b) * (x[N + b - n] - _ur[b]);
+              if (k < _K)
+                s += _h / 6 * _R(a, b) * (x[N + b + n] - _ur[b]);
+            }
+            g[k * n + N + a] = s;
+          }
+        }
+      }
+
+      // l1 norm of all constraint violations.
+      T Violation(const State & x0, const std::vector<T> & c,
+                  const std::vector<T> & z) const
+      {
+        T v(0);
+        for (std::size_t r = 0; r < c.size(); ++r)
+          v += std::fabs(c[r]);
+        for (int i = 0; i < N; ++i) {
+          v += std::fabs(z[i] - x0[i]);
+          if (_fixed_final)
+            v += std::fabs(z[_K * (N + M) + i] - _final[i]);
+        }
+        return v;
+      }
+
+      T MaxViolation(const State & x0) const
+      {
+        T v(0);
+        for (std::size_t r = 0; r < _c.size(); ++r)
+          v = std::max(v, std::fabs(_c[r]));
+        for (int i = 0; i < N; ++i) {
+          v = std::max(v, std::fabs(_z[i] - x0[i]));
+          if (_fixed_final)
+            v = std::max(v, std::fabs(_z[_K * (N + M) + i] - _final[i]));
+        }
+        return v;
+      }
+
+      MappingAutonomousExogenous<T, N, M> & _f;
+      MappingAutonomousExogenous<Scalar, N, M> & _df;
+      std::size_t _K;
+      T _h;
+      Matrix<T, N> _Q;
+      Matrix<T, M> _R;
+      Matrix<T, N> _Qf;
+      CollocationOptions _options;
+      State _xr, _final;
+      Input _ur;
+      bool _fixed_final;
+      T _penalty;
+      //! Nodes: state then input of every node.
+      std::vector<T> _z, _c, _trial_c;
+      std::vector<Matrix<T, N, 2 * (N + M)> > _jacobians;
+      internal::BandLU<T> _kkt;
+  };
+}
+#endif
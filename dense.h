@@ -0,0 +1,689 @@
+/*! \file dense.h
+ *  \brief Dense matrices whose size is only known at run time.
+ *
+ *  These are the building blocks of the model reduction and data analysis
+ *  tools: products of tall matrices, thin QR factorizations, symmetric
+ *  eigenvalue problems and small LU solves.  Matrices are stored in column
+ *  major order, so that the columns of a snapshot matrix are contiguous
+ *  states.  Small nonsymmetric eigenvalue problems are solved by
+ *  Hessenberg reduction and the shifted QR algorithm.
+ */
+
+#ifndef __DENSE_H__
+#define __DENSE_H__
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \class DenseMatrix
+   *  \brief A dense, column major matrix.
+   *  \tparam T Data type of the entries (typically double).
+   */
+  template <class T>
+  class DenseMatrix {
+    public:
+      DenseMatrix() : _rows(0), _cols(0) {}
+
+      /*!
+       * \param[in] rows Number of rows.
+       * \param[in] cols Number of columns.
+       * \param[in] value Initial value of every entry.
+       */
+      DenseMatrix(std::size_t rows, std::size_t cols, T value = T(0))
+        : _rows(rows), _cols(cols), _data(rows * cols, value) {}
+
+      /*!
+       * Changes the shape of the matrix; existing entries are not preserved.
+       * Storage is only reallocated when the matrix grows.
+       */
+      void Resize(std::size_t rows, std::size_t cols, T value = T(0))
+      {
+        _rows = rows;
+        _cols = cols;
+        _data.assign(rows * cols, value);
+      }
+
+      /*!
+       * Appends a column; the matrix must already have its number of rows.
+       * Growing the matrix column by column is amortized constant time per
+       * entry, which makes DenseMatrix usable as a snapshot store.
+       *
+       * \param[in] column Pointer to Rows() entries.
+       */
+      void AppendColumn(const T * column)
+      {
+        _data.insert(_data.end(), column, column + _rows);
+        ++_cols;
+      }
+
+      std::size_t Rows() const { return _rows; }
+      std::size_t Cols() const { return _cols; }
+
+      T & operator()(std::size_t i, std::size_t j)
+      {
+        return _data[i + j * _rows];
+      }
+      const T & operator()(std::size_t i, std::size_t j) const
+      {
+        return _data[i + j * _rows];
+      }
+
+      //! Pointer to the contiguous entries of column j.
+      T * Column(std::size_t j) { return &_data[j * _rows]; }
+      const T * Column(std::size_t j) const { return &_data[j * _rows]; }
+
+      T * Data() { return _data.data(); }
+      const T * Data() const { return _data.data(); }
+
+      //! Identity matrix of size n.
+      static DenseMatrix Identity(std::size_t n)
+      {
+        DenseMatrix I(n, n);
+        for (std::size_t i = 0; i < n; ++i)
+          I(i, i) = T(1);
+        return I;
+      }
+
+    private:
+      std::size_t _rows, _cols;
+      std::vector<T> _data;
+  };
+
+  /*!
+   * Computes C = A B.  Columns of C are computed in parallel.
+   *
+   * \param[in] A Left factor.
+   * \param[in] B Right factor.
+   * \param[out] C Product, resized as needed.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   */
+  template <class T>
+  void Multiply(const DenseMatrix<T> & A, const DenseMatrix<T> & B,
+                DenseMatrix<T> & C, unsigned threads = 0)
+  {
+    if (A.Cols() != B.Rows())
+      throw std::invalid_argument("Multiply: shape mismatch");
+    C.Resize(A.Rows(), B.Cols());
+    ParallelFor(B.Cols(), [&](std::size_t j, unsigned) {
+      T * c = C.Column(j);
+      for (std::size_t k = 0; k < A.Cols(); ++k) {
+        const T * a = A.Column(k);
+        T b = B(k, j);
+        for (std::size_t i = 0; i < A.Rows(); ++i)
+          c[i] += a[i] * b;
+      }
+    }, threads);
+  }
+
+  /*!
+   * Computes C = A^T B.  Entries of C are dot products of columns and are
+   * computed in parallel.
+   *
+   * \param[in] A Left factor, transposed.
+   * \param[in] B Right factor.
+   * \param[out] C Product, resized as needed.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   */
+  template <class T>
+  void TransposeMultiply(const DenseMatrix<T> & A, const DenseMatrix<T> & B,
+                         DenseMatrix<T> & C, unsigned threads = 0)
+  {
+    if (A.Rows() != B.Rows())
+      throw std::invalid_argument("TransposeMultiply: shape mismatch");
+    C.Resize(A.Cols(), B.Cols());
+    ParallelFor(A.Cols() * B.Cols(), [&](std::size_t n, unsigned) {
+      std::size_t i = n % A.Cols(), j = n / A.Cols();
+      const T * a = A.Column(i);
+      const T * b = B.Column(j);
+      T s(0);
+      for (std::size_t k = 0; k < A.Rows(); ++k)
+        s += a[k] * b[k];
+      C(i, j) = s;
+    }, threads);
+  }
+
+  /*!
+   * Replaces the columns of A by an orthonormal basis of their span, using
+   * Householder reflections (thin Q factor of a QR factorization).  A must
+   * have at least as many rows as columns.
+   *
+   * \param[in,out] A Matrix to orthonormalize.
+   */
+  template <class T>
+  void Orthonormalize(DenseMatrix<T> & A)
+  {
+    const std::size_t m = A.Rows(), n = A.Cols();
+    if (m < n)
+      throw std::invalid_argument("Orthonormalize: more columns than rows");
+    std::vector<T> beta(n);
+    for (std::size_t k = 0; k < n; ++k) {
+      T * v = A.Column(k);
+      T norm(0);
+      for (std::size_t i = k; i < m; ++i)
+        norm += v[i] * v[i];
+      norm = std::sqrt(norm);
+      if (norm == T(0)) {
+        beta[k] = T(0);
+        continue;
+      }
+      T alpha = v[k] > T(0) ? -norm : norm;
+      v[k] -= alpha;
+      beta[k] = T(1) / (-alpha * v[k]);
+      for (std::size_t j = k + 1; j < n; ++j) {
+        T * a = A.Column(j);
+        T s(0);
+        for (std::size_t i = k; i < m; ++i)
+          s += v[i] * a[i];
+        s *= beta[k];
+        for (std::size_t i = k; i < m; ++i)
+          a[i] -= s * v[i];
+      }
+    }
+    // Accumulate Q = H_0 ... H_{n-1} [I; 0] from the last reflector back.
+    DenseMatrix<T> Q(m, n);
+    for (std::size_t j = 0; j < n; ++j)
+      Q(j, j) = T(1);
+    for (std::size_t k = n; k-- > 0; ) {
+      const T * v = A.Column(k);
+      for (std::size_t j = k; j < n; ++j) {
+        T * q = Q.Column(j);
+        T s(0);
+        for (std::size_t i = k; i < m; ++i)
+          s += v[i] * q[i];
+        s *= beta[k];
+        for (std::size_t i = k; i < m; ++i)
+          q[i] -= s * v[i];
+      }
+    }
+    A = Q;
+  }
+
+  /*!
+   * Eigenvalues and eigenvectors of a symmetric matrix by cyclic Jacobi
+   * rotations.  Eigenvalues are returned in decreasing order and column k
+   * of vectors is the eigenvector of values[k].  Intended for the small
+   * (up to a few hundred) matrices arising in reduced spaces.
+   *
+   * \param[in] A Symmetric matrix; only its entries are read.
+   * \param[out] values Eigenvalues in decreasing order.
+   * \param[out] vectors Orthonormal eigenvectors.
+   */
+  template <class T>
+  void SymmetricEigen(const DenseMatrix<T> & A, std::vector<T> & values,
+                      DenseMatrix<T> & vectors)
+  {
+    const std::size_t n = A.Rows();
+    if (A.Cols() != n)
+      throw std::invalid_argument("SymmetricEigen: matrix not square");
+    DenseMatrix<T> a(A);
+    DenseMatrix<T> v = DenseMatrix<T>::Identity(n);
+    for (int sweep = 0; sweep < 100; ++sweep) {
+      T off(0), diag(0);
+      for (std::size_t j = 0; j < n; ++j)
+        for (std::size_t i = 0; i < n; ++i)
+          (i == j ? diag : off) += a(i, j) * a(i, j);
+      if (off <= std::numeric_limits<T>::epsilon()
+                 * std::numeric_limits<T>::epsilon() * diag || off == T(0))
+        break;
+      for (std::size_t p = 0; p + 1 < n; ++p) {
+        for (std::size_t q = p + 1; q < n; ++q) {
+          if (a(p, q) == T(0))
+            continue;
+          T theta = (a(q, q) - a(p, p)) / (2 * a(p, q));
+          T t = (theta >= T(0) ? T(1) : T(-1))
+            / (std::fabs(theta) + std::sqrt(theta * theta + T(1)));
+          T c = T(1) / std::sqrt(t * t + T(1)), s = t * c;
+          for (std::size_t k = 0; k < n; ++k) {
+            T akp = a(k, p), akq = a(k, q);
+            a(k, p) = c * akp - s * akq;
+            a(k, q) = s * akp + c * akq;
+          }
+          for (std::size_t k = 0; k < n; ++k) {
+            T apk = a(p, k), aqk = a(q, k);
+            a(p, k) = c * apk - s * aqk;
+            a(q, k) = s * apk + c * aqk;
+          }
+          for (std::size_t k = 0; k < n; ++k) {
+            T vkp = v(k, p), vkq = v(k, q);
+            v(k, p) = c * vkp - s * vkq;
+            v(k, q) = s * vkp + c * vkq;
+          }
+        }
+      }
+    }
+    std::vector<std::pair<T, std::size_t> > order(n);
+    for (std::size_t i = 0; i < n; ++i)
+      order[i] = std::make_pair(-a(i, i), i);
+    std::sort(order.begin(), order.end());
+    values.resize(n);
+    vectors.Resize(n, n);
+    for (std::size_t k = 0; k < n; ++k) {
+      values[k] = -order[k].first;
+      std::copy(v.Column(order[k].second), v.Column(order[k].second) + n,
+                vectors.Column(k));
+    }
+  }
+
+  /*!
+   * In place LU factorization with partial pivoting, PA = LU.
+   *
+   * \param[in,out] A Square matrix, replaced by L (unit diagonal, below the
+   *                diagonal) and U (on and above the diagonal).
+   * \param[out] pivots Row interchanges.
+   * \return false if A is singular to working precision.
+   */
+  template <class T>
+  bool LUFactor(DenseMatrix<T> & A, std::vector<std::size_t> & pivots)
+  {
+    const std::size_t n = A.Rows();
+    if (A.Cols() != n)
+      throw std::invalid_argument("LUFactor: matrix not square");
+    pivots.resize(n);
+    for (std::size_t k = 0; k < n; ++k) {
+      std::size_t p = k;
+      for (std::size_t i = k + 1; i < n; ++i)
+        if (std::fabs(A(i, k)) > std::fabs(A(p, k)))
+          p = i;
+      pivots[k] = p;
+      if (A(p, k) == T(0))
+        return false;
+      if (p != k)
+        for (std::size_t j = 0; j < n; ++j)
+          std::swap(A(p, j), A(k, j));
+      for (std::size_t i = k + 1; i < n; ++i)
+        A(i, k) /= A(k, k);
+      for (std::size_t j = k + 1; j < n; ++j) {
+        T akj = A(k, j);
+        if (akj == T(0))
+          continue;
+        for (std::size_t i = k + 1; i < n; ++i)
+          A(i, j) -= A(i, k) * akj;
+      }
+    }
+    return true;
+  }
+
+  /*!
+   * Solves A x = b given the output of LUFactor.
+   *
+   * \param[in] LU Factorization computed by LUFactor.
+   * \param[in] pivots Row interchanges computed by LUFactor.
+   * \param[in,out] b Right hand side, replaced by the solution.
+   */
+  template <class T>
+  void LUSolve(const DenseMatrix<T> & LU,
+               const std::vector<std::size_t> & pivots, T * b)
+  {
+    const std::size_t n = LU.Rows();
+    for (std::size_t k = 0; k < n; ++k)
+      std::swap(b[k], b[pivots[k]]);
+    for (std::size_t j = 0; j < n; ++j)
+      for (std::size_t i = j + 1; i < n; ++i)
+        b[i] -= LU(i, j) * b[j];
+    for (std::size_t j = n; j-- > 0; ) {
+      b[j] /= LU(j, j);
+      for (std::size_t i = 0; i < j; ++i)
+        b[i] -= LU(i, j) * b[j];
+    }
+  }
+
+  namespace internal {
+    // Reduces A to upper Hessenberg form by Householder similarity
+    // transformations.
+    template <class T>
+    void Hessenberg(DenseMatrix<T> & A)
+    {
+      const std::size_t n = A.Rows();
+      std::vector<T> v(n);
+      for (std::size_t k = 0; k + 2 < n; ++k) {
+        T alpha(0);
+        for (std::size_t i = k + 1; i < n; ++i)
+          alpha += A(i, k) * A(i, k);
+        alpha = std::sqrt(alpha);
+        if (alpha == T(0))
+          continue;
+        if (A(k + 1, k) > T(0))
+          alpha = -alpha;
+        T norm(0);
+        for (std::size_t i = k + 1; i < n; ++i) {
+          v[i] = A(i, k) - (i == k + 1 ? alpha : T(0));
+          norm += v[i] * v[i];
+        }
+        if (norm == T(0))
+          continue;
+        // A <- H A H with H = I - 2 v v^T / (v^T v).
+        for (std::size_t j = 0; j < n; ++j) {
+          T s(0);
+          for (std::size_t i = k + 1; i < n; ++i)
+            s += v[i] * A(i, j);
+          s *= T(2) / norm;
+          for (std::size_t i = k + 1; i < n; ++i)
+            A(i, j) -= s * v[i];
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+          T s(0);
+          for (std::size_t j = k + 1; j < n; ++j)
+            s += A(i, j) * v[j];
+          s *= T(2) / norm;
+          for (std::size_t j = k + 1; j < n; ++j)
+            A(i, j) -= s * v[j];
+        }
+        for (std::size_t i = k + 2; i < n; ++i)
+          A(i, k) = T(0);
+      }
+    }
+
+    // Householder reflector P = I - tau v v^T with v = (1, x[1], ...,
+    // x[n-1]), chosen so that P (x[0], ..., x[n-1]) = (beta, 0, ..., 0)
+    // (as LAPACK's dlarfg).  x is overwritten by (beta, v[1], ...);
+    // returns tau, which is 0 if x already has that form.
+    template <class T>
+    T Reflector(int n, T * x)
+    {
+      T tail(0);
+      for (int i = 1; i < n; ++i)
+        tail = std::hypot(tail, x[i]);
+      if (tail == T(0))
+        return T(0);
+      const T alpha = x[0];
+      const T beta = alpha >= T(0) ? -std::hypot(alpha, tail)
+        : std::hypot(alpha, tail);
+      for (int i = 1; i < n; ++i)
+        x[i] /= alpha - beta;
+      x[0] = beta;
+      return (beta - alpha) / beta;
+    }
+
+    // Eigenvalues of the real 2 x 2 matrix [a b; c d], computed from
+    // its scaled trace and determinant.
+    template <class T>
+    void Eigenvalues2(T a, T b, T c, T d, std::complex<T> & first,
+                      std::complex<T> & second)
+    {
+      const T scale = std::fabs(a) + std::fabs(b) + std::fabs(c)
+        + std::fabs(d);
+      if (scale == T(0)) {
+        first = second = std::complex<T>(0);
+        return;
+      }
+      a /= scale;
+      b /= scale;
+      c /= scale;
+      d /= scale;
+      const T half = T(0.5) * (a - d), mean = T(0.5) * (a + d);
+      const T discriminant = half * half + b * c;
+      const T root = std::sqrt(std::fabs(discriminant));
+      if (discriminant < T(0)) {
+        first = std::complex<T>(mean, root) * scale;
+        second = std::conj(first);
+      } else if (half == T(0) && root == T(0)) {
+        first = second = std::complex<T>(mean * scale);
+      } else {
+        // The root of larger magnitude first, the other from the product
+        // of the roots, which avoids cancellation.
+        const T large = mean + (mean >= T(0) ? root : -root);
+        first = std::complex<T>(large * scale);
+        second = std::complex<T>(large != T(0)
+                                 ? (a * d - b * c) / large * scale : T(0));
+      }
+    }
+
+    // Eigenvalues of an upper Hessenberg matrix by the implicit double
+    // shift QR algorithm; a is destroyed.  The structure follows LAPACK's
+    // dlahqr (BSD license): small subdiagonal entries are deflated with
+    // the criterion of Ahues and Tisseur, each sweep chases a bulge
+    // created from the eigenvalues of the trailing 2 x 2 block with 3 x 3
+    // reflectors, and every tenth sweep on a block uses an exceptional
+    // shift.  Only the active diagonal block is updated, as eigenvectors
+    // are not wanted.
+    template <class T>
+    void HessenbergQR(DenseMatrix<T> & a, std::vector<std::complex<T> > & w)
+    {
+      typedef std::complex<T> C;
+      const int n = int(a.Rows());
+      const T ulp = std::numeric_limits<T>::epsilon();
+      const T tiny = std::numeric_limits<T>::min() * (T(n) / ulp);
+      w.assign(n, C(0));
+      for (int j = 0; j + 3 < n; ++j) {
+        a(j + 2, j) = T(0);
+        a(j + 3, j) = T(0);
+      }
+      if (n > 2)
+        a(n - 1, n - 3) = T(0);
+      const int limit = 30 * std::max(10, n);
+      // The active block is rows and columns lo..hi.
+      int hi = n - 1;
+      while (hi >= 0) {
+        int lo = 0, iterations = 0;
+        for (;;) {
+          // Deflate at the last negligible subdiagonal entry.
+          for (lo = hi; lo > 0; --lo) {
+            const T sub = std::fabs(a(lo, lo - 1));
+            if (sub <= tiny)
+              break;
+            T diagonal = std::fabs(a(lo - 1, lo - 1)) + std::fabs(a(lo, lo));
+            if (diagonal == T(0)) {
+              if (lo >= 2)
+                diagonal += std::fabs(a(lo - 1, lo - 2));
+              if (lo + 1 <= hi)
+                diagonal += std::fabs(a(lo + 1, lo));
+            }
+            if (sub > ulp * diagonal)
+              continue;
+            const T super = std::fabs(a(lo - 1, lo));
+            const T gap = std::fabs(a(lo - 1, lo - 1) - a(lo, lo));
+            const T ab = std::max(sub, super), ba = std::min(sub, super);
+            const T aa = std::max(std::fabs(a(lo, lo)), gap);
+            const T bb = std::min(std::fabs(a(lo, lo)), gap);
+            const T s = aa + ab;
+            if (ba * (ab / s) <= std::max(tiny, ulp * (bb * (aa / s))))
+              break;
+          }
+          if (lo > 0)
+            a(lo, lo - 1) = T(0);
+          if (lo + 1 >= hi)
+            break;
+          if (++iterations > limit)
+            throw std::runtime_error("NonsymmetricEigen: no convergence");
+
+          // Shifts: the eigenvalues of the trailing 2 x 2 block, or an
+          // exceptional pair that breaks cycles.
+          T h11 = a(hi - 1, hi - 1), h12 = a(hi - 1, hi);
+          T h21 = a(hi, hi - 1), h22 = a(hi, hi);
+          if (iterations % 10 == 0) {
+            const T s = std::fabs(a(hi, hi - 1))
+              + std::fabs(a(hi - 1, hi - 2));
+            h11 = T(0.75) * s + a(hi, hi);
+            h12 = T(-0.4375) * s;
+            h21 = s;
+            h22 = h11;
+          }
+          C shift1, shift2;
+          Eigenvalues2(h11, h12, h21, h22, shift1, shift2);
+          if (shift1.imag() == T(0)) {
+            // Two real shifts: use the one closer to h22 twice.
+            if (std::fabs(shift1.real() - h22)
+                > std::fabs(shift2.real() - h22))
+              shift1 = shift2;
+            shift2 = shift1;
+          }
+
+          // First column of (H - shift1)(H - shift2) at the top of the
+          // sweep, which starts at the first row m where the bulge would
+          // not disturb the entry below the previous diagonal element.
+          T v[3];
+          int m = hi - 2;
+          for (;; --m) {
+            T h21s = a(m + 1, m);
+            T s = std::fabs(a(m, m) - shift2.real())
+              + std::fabs(shift2.imag()) + std::fabs(h21s);
+            h21s /= s;
+            v[0] = h21s * a(m, m + 1) + (a(m, m) - shift1.real())
+              * ((a(m, m) - shift2.real()) / s)
+              - shift1.imag() * (shift2.imag() / s);
+            v[1] = h21s * (a(m, m) + a(m + 1, m + 1) - shift1.real()
+                           - shift2.real());
+            v[2] = h21s * a(m + 2, m + 1);
+            s = std::fabs(v[0]) + std::fabs(v[1]) + std::fabs(v[2]);
+            for (int i = 0; i < 3; ++i)
+              v[i] /= s;
+            if (m == lo)
+              break;
+            const T below = std::fabs(a(m, m - 1))
+              * (std::fabs(v[1]) + std::fabs(v[2]));
+            const T scale = std::fabs(v[0])
+              * (std::fabs(a(m - 1, m - 1)) + std::fabs(a(m, m))
+                 + std::fabs(a(m + 1, m + 1)));
+            if (below <= ulp * scale)
+              break;
+          }
+
+          // Chase the bulge down to the bottom of the block.
+          for (int k = m; k < hi; ++k) {
+            const int size = std::min(3, hi - k + 1);
+            if (k > m)
+              for (int i = 0; i < size; ++i)
+                v[i] = a(k + i, k - 1);
+            const T tau = Reflector(size, v);
+            if (k > m) {
+              a(k, k - 1) = v[0];
+              for (int i = 1; i < size; ++i)
+                a(k + i, k - 1) = T(0);
+            } else if (m > lo) {
+              // The reflector changes the sign of the entry left of the
+              // sweep; multiplying by 1 - tau is exact when v underflows.
+              a(k, k - 1) *= T(1) - tau;
+            }
+            if (tau == T(0))
+              continue;
+            v[0] = T(1);
+            for (int j = k; j <= hi; ++j) {
+              T s(0);
+              for (int i = 0; i < size; ++i)
+                s += v[i] * a(k + i, j);
+              s *= tau;
+              for (int i = 0; i < size; ++i)
+                a(k + i, j) -= s * v[i];
+            }
+            const int last = std::min(k + 3, hi);
+            for (int i = lo; i <= last; ++i) {
+              T s(0);
+              for (int j = 0; j < size; ++j)
+                s += a(i, k + j) * v[j];
+              s *= tau;
+              for (int j = 0; j < size; ++j)
+                a(i, k + j) -= s * v[j];
+            }
+          }
+        }
+
+        // A 1 x 1 or 2 x 2 block split off at the bottom.
+        if (lo == hi) {
+          w[hi] = C(a(hi, hi));
+        } else {
+          Eigenvalues2(a(hi - 1, hi - 1), a(hi - 1, hi), a(hi, hi - 1),
+                       a(hi, hi), w[hi - 1], w[hi]);
+        }
+        hi = lo - 1;
+      }
+    }
+  }
+
+  /*!
+   * Eigenvalues and eigenvectors of a general real matrix.  Eigenvalues are
+   * computed by Hessenberg reduction and the implicit double shift QR
+   * algorithm and sorted by decreasing magnitude; eigenvectors by inverse
+   * iteration in complex arithmetic.  Intended for small matrices, such as
+   * reduced operators.
+   *
+   * \param[in] A Square matrix.
+   * \param[out] values Eigenvalues; complex pairs are adjacent.
+   * \param[out] vectors Column k is the unit eigenvector of values[k].
+   */
+  template <class T>
+  void NonsymmetricEigen(const DenseMatrix<T> & A,
+                         std::vector<std::complex<T> > & values,
+                         DenseMatrix<std::complex<T> > & vectors)
+  {
+    typedef std::complex<T> C;
+    const std::size_t n = A.Rows();
+    if (A.Cols() != n)
+      throw std::invalid_argument("NonsymmetricEigen: matrix not square");
+    DenseMatrix<T> h(A);
+    internal::Hessenberg(h);
+    internal::HessenbergQR(h, values);
+    std::vector<std::pair<T, std::size_t> > order(n);
+    for (std::size_t k = 0; k < n; ++k)
+      order[k] = std::make_pair(-std::abs(values[k]), k);
+    std::stable_sort(order.begin(), order.end());
+    std::vector<C> sorted(n);
+    for (std::size_t k = 0; k < n; ++k)
+      sorted[k] = values[order[k].second];
+    values.swap(sorted);
+
+    T norm(0);
+    for (std::size_t j = 0; j < n; ++j)
+      for (std::size_t i = 0; i < n; ++i)
+        norm = std::max(norm, std::fabs(A(i, j)));
+    const T eps = std::numeric_limits<T>::epsilon();
+    vectors.Resize(n, n);
+    DenseMatrix<C> lu(n, n);
+    std::vector<C> b(n);
+    for (std::size_t k = 0; k < n; ++k) {
+      // The shift is perturbed so that A - shift I is not exactly
+      // singular.
+      const C shift = values[k] + C(eps * (norm + T(1)));
+      for (std::size_t j = 0; j < n; ++j)
+        for (std::size_t i = 0; i < n; ++i)
+          lu(i, j) = C(A(i, j)) - (i == j ? shift : C(0));
+      std::vector<std::size_t> pivots(n);
+      for (std::size_t c = 0; c < n; ++c) {
+        std::size_t p = c;
+        for (std::size_t i = c + 1; i < n; ++i)
+          if (std::abs(lu(i, c)) > std::abs(lu(p, c)))
+            p = i;
+        pivots[c] = p;
+        if (p != c)
+          for (std::size_t j = 0; j < n; ++j)
+            std::swap(lu(p, j), lu(c, j));
+        if (lu(c, c) == C(0))
+          lu(c, c) = C(eps * (norm + T(1)));
+        for (std::size_t i = c + 1; i < n; ++i)
+          lu(i, c) /= lu(c, c);
+        for (std::size_t j = c + 1; j < n; ++j)
+          for (std::size_t i = c + 1; i < n; ++i)
+            lu(i, j) -= lu(i, c) * lu(c, j);
+      }
+      for (std::size_t i = 0; i < n; ++i)
+        b[i] = C(T(1) / std::sqrt(T(n)), T(i % 3) / T(n));
+      for (int iteration = 0; iteration < 3; ++iteration) {
+        for (std::size_t c = 0; c < n; ++c)
+          std::swap(b[c], b[pivots[c]]);
+        for (std::size_t j = 0; j < n; ++j)
+          for (std::size_t i = j + 1; i < n; ++i)
+            b[i] -= lu(i, j) * b[j];
+        for (std::size_t j = n; j-- > 0; ) {
+          b[j] /= lu(j, j);
+          for (std::size_t i = 0; i < j; ++i)
+            b[i] -= lu(i, j) * b[j];
+        }
+        T s(0);
+        for (std::size_t i = 0; i < n; ++i)
+          s += std::norm(b[i]);
+        s = std::sqrt(s);
+        for (std::size_t i = 0; i < n; ++i)
+          b[i] /= s;
+      }
+      std::copy(b.begin(), b.end(), vectors.Column(k));
+    }
+  }
+}
+#endif
@@ -0,0 +1,275 @@
+/*! \file dmd.h
+ *  \brief Streaming dynamic mode decomposition (DMD).
+ *
+ *  DMD approximates the evolution between consecutive samples x_k ->
+ *  x_{k+1} by a linear operator whose eigenvalues and eigenvectors (modes)
+ *  describe the growth rates and frequencies of coherent structures.  The
+ *  streaming variant (Hemati, Williams and Rowley, 2014) never stores the
+ *  snapshots: it keeps orthonormal bases Qx and Qy of the spans of the
+ *  samples and their successors, plus small matrices of projected
+ *  correlations of the projected samples a_k = Qx^T x_k and successors
+ *  b_k = Qy^T x_{k+1},
+ *
+ *      A = sum_k b_k a_k^T,   Gx = sum_k a_k a_k^T,   Gy = sum_k b_k b_k^T.
+ *
+ *  New directions extend the bases by Gram-Schmidt;
+ *  once a basis exceeds the requested rank it is rotated onto the dominant
+ *  eigenvectors of its correlation matrix and truncated, which is an
+ *  incremental truncated SVD of the snapshot matrix.  Memory is therefore
+ *  bounded by two N x (rank + 1) bases however long the trajectory.  The
+ *  reduced operator Qx^T Qy A Gx^+ and its eigendecomposition can be
+ *  computed at any time.
+ */
+
+#ifndef __DMD_H__
+#define __DMD_H__
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "dense.h"
+
+namespace dynamics {
+  /*! \class StreamingDMD
+   *  \brief Integrator observer computing a DMD of the observed states.
+   *  \tparam T Data type of state variables (typically double).
+   *
+   *  Pass it as the observer of Integrate; every stride-th observed state
+   *  is paired with the previous one.  Pairs can also be supplied directly
+   *  with Update.
+   */
+  template <class T>
+  class StreamingDMD {
+    public:
+      /*!
+       * \param[in] rank Largest dimension of the bases.
+       * \param[in] stride Use every stride-th observed state.
+       * \param[in] tolerance Relative size of the component of a sample
+       *            orthogonal to the basis below which the basis is not
+       *            extended.
+       */
+      explicit StreamingDMD(std::size_t rank, std::size_t stride = 1,
+                            T tolerance = T(1e-10))
+        : _rank(rank), _stride(stride == 0 ? 1 : stride),
+          _tolerance(tolerance), _seen(0), _pairs(0)
+      {
+        if (rank == 0)
+          throw std::invalid_argument("StreamingDMD: rank must be positive");
+      }
+
+      template <class I, class State>
+      void operator()(const I &, const State & x)
+      {
+        if (_seen++ % _stride)
+          return;
+        if (!_previous.empty())
+          Update(&_previous[0], &x[0], x.size());
+        _previous.assign(x.begin(), x.end());
+      }
+
+      /*!
+       * Adds the pair x -> y.
+       *
+       * \param[in] x Sample.
+       * \param[in] y Its successor.
+       * \param[in] n Dimension of the samples.
+       */
+      void Update(const T * x, const T * y, std::size_t n)
+      {
+        if (_Qx.Rows() == 0) {
+          _Qx.Resize(n, 0);
+          _Qy.Resize(n, 0);
+        }
+        if (n != _Qx.Rows())
+          throw std::invalid_argument("StreamingDMD: dimension changed");
+        if (Extend(_Qx, x)) {
+          Grow(_A, _A.Rows(), _A.Cols() + 1);
+          Grow(_Gx, _Gx.Rows() + 1, _Gx.Cols() + 1);
+        }
+        if (Extend(_Qy, y)) {
+          Grow(_A, _A.Rows() + 1, _A.Cols());
+          Grow(_Gy, _Gy.Rows() + 1, _Gy.Cols() + 1);
+        }
+        Project(_Qx, x, _xt);
+        Project(_Qy, y, _yt);
+        for (std::size_t j = 0; j < _xt.size(); ++j) {
+          for (std::size_t i = 0; i < _yt.size(); ++i)
+            _A(i, j) += _yt[i] * _xt[j];
+          for (std::size_t i = 0; i < _xt.size(); ++i)
+            _Gx(i, j) += _xt[i] * _xt[j];
+        }
+        for (std::size_t j = 0; j < _yt.size(); ++j)
+          for (std::size_t i = 0; i < _yt.size(); ++i)
+            _Gy(i, j) += _yt[i] * _yt[j];
+        // Truncate only now that the new directions carry the pair, so
+        // that they compete with the old ones on their energy.
+        if (_Qx.Cols() > _rank)
+          Truncate(_Qx, _Gx, false);
+        if (_Qy.Cols() > _rank)
+          Truncate(_Qy, _Gy, true);
+        ++_pairs;
+      }
+
+      /*!
+       * Reduced operator K = Qx^T Qy A Gx^+, whose eigenvalues are the DMD
+       * eigenvalues.
+       */
+      void Operator(DenseMatrix<T> & K) const
+      {
+        const std::size_t r = _Qx.Cols();
+        std::vector<T> values;
+        DenseMatrix<T> V;
+        SymmetricEigen(_Gx, values, V);
+        DenseMatrix<T> pinv(r, r);
+        const T floor = r > 0 ? values[0] * std::numeric_limits<T>::epsilon()
+          * T(r) : T(0);
+        for (std::size_t k = 0; k < r; ++k) {
+          if (!(values[k] > floor))
+            continue;
+          for (std::size_t j = 0; j < r; ++j)
+            for (std::size_t i = 0; i < r; ++i)
+              pinv(i, j) += V(i, k) * V(j, k) / values[k];
+        }
+        DenseMatrix<T> QxQy, C;
+        TransposeMultiply(_Qx, _Qy, QxQy, 1);
+        Multiply(QxQy, _A, C, 1);
+        Multiply(C, pinv, K, 1);
+      }
+
+      /*!
+       * DMD eigenvalues of the pairs seen so far, by decreasing magnitude.
+       */
+      void Eigenvalues(std::vector<std::complex<T> > & values) const
+      {
+        DenseMatrix<std::complex<T> > vectors;
+        DenseMatrix<T> K;
+        Operator(K);
+        NonsymmetricEigen(K, values, vectors);
+      }
+
+      /*!
+       * DMD eigenvalues and the corresponding (projected) modes.
+       *
+       * \param[out] values Eigenvalues by decreasing magnitude.
+       * \param[out] modes Column k is the unit mode of values[k].
+       */
+      void Compute(std::vector<std::complex<T> > & values,
+                   DenseMatrix<std::complex<T> > & modes) const
+      {
+        DenseMatrix<std::complex<T> > vectors;
+        DenseMatrix<T> K;
+        Operator(K);
+        NonsymmetricEigen(K, values, vectors);
+        const std::size_t n = _Qx.Rows(), r = _Qx.Cols();
+        modes.Resize(n, r);
+        for (std::size_t k = 0; k < r; ++k) {
+          std::complex<T> * mode = modes.Column(k);
+          for (std::size_t j = 0; j < r; ++j) {
+            const T * q = _Qx.Column(j);
+            const std::complex<T> w = vectors(j, k);
+            for (std::size_t i = 0; i < n; ++i)
+              mode[i] += q[i] * w;
+          }
+        }
+      }
+
+      //! Current dimension of the basis of the samples.
+      std::size_t Rank() const { return _Qx.Cols(); }
+
+      //! Number of pairs seen.
+      std::size_t Pairs() const { return _pairs; }
+
+    private:
+      // Coordinates of x in the basis Q.
+      static void Project(const DenseMatrix<T> & Q, const T * x,
+                          std::vector<T> & c)
+      {
+        c.assign(Q.Cols(), T(0));
+        for (std::size_t j = 0; j < Q.Cols(); ++j) {
+          const T * q = Q.Column(j);
+          T s(0);
+          for (std::size_t i = 0; i < Q.Rows(); ++i)
+            s += q[i] * x[i];
+          c[j] = s;
+        }
+      }
+
+      // Appends the normalized component of x orthogonal to Q, computed by
+      // Gram-Schmidt with reorthogonalization, unless it is negligible.
+      bool Extend(DenseMatrix<T> & Q, const T * x)
+      {
+        const std::size_t n = Q.Rows();
+        _residual.assign(x, x + n);
+        T norm(0);
+        for (std::size_t i = 0; i < n; ++i)
+          norm += x[i] * x[i];
+        norm = std::sqrt(norm);
+        for (int pass = 0; pass < 2; ++pass) {
+          Project(Q, &_residual[0], _xt);
+          for (std::size_t j = 0; j < Q.Cols(); ++j) {
+            const T * q = Q.Column(j);
+            for (std::size_t i = 0; i < n; ++i)
+              _residual[i] -= _xt[j] * q[i];
+          }
+        }
+        T e(0);
+        for (std::size_t i = 0; i < n; ++i)
+          e += _residual[i] * _residual[i];
+        e = std::sqrt(e);
+        if (!(e > _tolerance * norm))
+          return false;
+        for (std::size_t i = 0; i < n; ++i)
+          _residual[i] /= e;
+        Q.AppendColumn(&_residual[0]);
+        return true;
+      }
+
+      // Rotates the basis Q onto the dominant rank eigenvectors of its
+      // correlation matrix G and drops the others; A is transformed on the
+      // right (samples) or on the left (successors).
+      void Truncate(DenseMatrix<T> & Q, DenseMatrix<T> & G, bool left)
+      {
+        std::vector<T> values;
+        DenseMatrix<T> V;
+        SymmetricEigen(G, values, V);
+        const std::size_t r = Q.Cols();
+        DenseMatrix<T> W(r, _rank);
+        for (std::size_t k = 0; k < _rank; ++k)
+          std::copy(V.Column(k), V.Column(k) + r, W.Column(k));
+        DenseMatrix<T> rotated;
+        Multiply(Q, W, rotated, 1);
+        Q = rotated;
+        G.Resize(_rank, _rank);
+        for (std::size_t k = 0; k < _rank; ++k)
+          G(k, k) = values[k];
+        DenseMatrix<T> A;
+        if (left) {
+          TransposeMultiply(W, _A, A, 1);
+        } else {
+          Multiply(_A, W, A, 1);
+        }
+        _A = A;
+      }
+
+      // Enlarges M, keeping its entries and zero filling the new ones.
+      static void Grow(DenseMatrix<T> & M, std::size_t rows, std::size_t cols)
+      {
+        DenseMatrix<T> grown(rows, cols);
+        for (std::size_t j = 0; j < M.Cols(); ++j)
+          for (std::size_t i = 0; i < M.Rows(); ++i)
+            grown(i, j) = M(i, j);
+        M = grown;
+      }
+
+      std::size_t _rank, _stride;
+      T _tolerance;
+      std::size_t _seen, _pairs;
+      std::vector<T> _previous, _residual, _xt, _yt;
+      DenseMatrix<T> _Qx, _Qy, _A, _Gx, _Gy;
+  };
+}
+#endif
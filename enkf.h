@@ -0,0 +1,400 @@
+/*! \file enkf.h
+ *  \brief Ensemble transform Kalman filter for large mappings.
+ *
+ *  The filter represents the state distribution of a Dynamic size mapping
+ *  by an ensemble of states, so memory grows like the dimension times the
+ *  number of members and covariance matrices are never formed.  Members
+ *  are propagated in parallel, each with its own copy of the system
+ *  adapter and a per-thread stepper.
+ *
+ *  The analysis is the ensemble transform Kalman filter (ETKF) of Bishop
+ *  et al. (2001) in the formulation of Hunt et al. (2007): it is computed
+ *  in the space spanned by the members, where it only needs the
+ *  eigendecomposition of a members x members matrix, and it maps the
+ *  forecast ensemble to the analysis ensemble through a weight matrix.
+ *  With localization every state variable has its own analysis using only
+ *  nearby observations, whose precision is tapered with distance (the
+ *  LETKF); state variables are processed in parallel, and consecutive
+ *  variables that see the same observations share one transform.
+ */
+
+#ifndef __ENKF_H__
+#define __ENKF_H__
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "dense.h"
+#include "integrators.h"
+#include "parallel.h"
+#include "random.h"
+
+namespace dynamics {
+  /*! \struct EnsembleKalmanOptions
+   *  \brief Parameters of EnsembleKalmanFilter.
+   */
+  struct EnsembleKalmanOptions {
+    EnsembleKalmanOptions()
+      : substeps(1), inflation(1.0), block(256), threads(0), seed(0) {}
+
+    //! Steps of the stepper per prediction interval.
+    int substeps;
+    //! Multiplicative inflation of the forecast covariance, applied in
+    //! every analysis; values slightly above 1 counter the spread
+    //! deficiency of small ensembles.
+    double inflation;
+    //! State variables per parallel work item in the analysis.
+    std::size_t block;
+    //! Number of threads, 0 selects HardwareThreads().
+    unsigned threads;
+    std::uint64_t seed;
+  };
+
+  /*!
+   * Gaspari and Cohn's (1999) compactly supported fifth order
+   * approximation of a Gaussian, the usual localization taper.
+   *
+   * \param[in] distance Distance between a state variable and an
+   *            observation.
+   * \param[in] radius Half width; the taper vanishes beyond 2 radius.
+   * \return Weight in [0, 1].
+   */
+  template <class T>
+  T GaspariCohn(T distance, T radius)
+  {
+    const T z = std::fabs(distance) / radius;
+    if (z >= T(2))
+      return T(0);
+    if (z <= T(1))
+      return (((-T(0.25) * z + T(0.5)) * z + T(0.625)) * z - T(5) / T(3))
+        * z * z + T(1);
+    return ((((z / T(12) - T(0.5)) * z + T(0.625)) * z + T(5) / T(3)) * z
+            - T(5)) * z + T(4) - T(2) / (T(3) * z);
+  }
+
+  /*! \class EnsembleKalmanFilter
+   *  \brief Ensemble transform Kalman filter, optionally localized.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam System System adapter of a Dynamic size mapping (see
+   *          integrators.h); it is copied once per member and the mapping
+   *          must tolerate concurrent calls.
+   *  \tparam Stepper Fixed step stepper, e.g. RungeKutta4.
+   *
+   *  Observations have independent errors with variances r.  Observation
+   *  operators are called as h(x, y) with y resized to the number of
+   *  observations, concurrently for different members.
+   */
+  template <class T, class System,
+            class Stepper = RungeKutta4<std::vector<T> > >
+  class EnsembleKalmanFilter {
+    public:
+      /*!
+       * \param[in] f Process model; the filter keeps a reference.
+       * \param[in] dimension Dimension of the state space.
+       * \param[in] members Number of members, at least 2.
+       * \param[in] options Parameters; options.block must be positive.
+       */
+      EnsembleKalmanFilter(System & f, std::size_t dimension,
+                           std::size_t members,
+                           const EnsembleKalmanOptions & options
+                             = EnsembleKalmanOptions())
+        : _f(f), _options(options), _n(dimension), _m(members),
+          _x(members, std::vector<T>(dimension)), _mean(dimension),
+          _steppers(ResolveThreads(options.threads, members)), _step(0)
+      {
+        if (members < 2)
+          throw std::invalid_argument("EnsembleKalmanFilter: at least two "
+                                      "members are needed");
+        if (options.block == 0)
+          throw std::invalid_argument("EnsembleKalmanFilter: block must be "
+                                      "positive");
+      }
+
+      /*!
+       * Draws the initial ensemble.
+       *
+       * \param[in] initial Called as initial(rng, x) for every member; rng
+       *            is a SplitMix64 and x has the dimension of the state.
+       */
+      template <class Initial>
+      void Initialize(Initial initial)
+      {
+        ParallelFor(_m, [&](std::size_t k, unsigned) {
+          SplitMix64 rng(Seed(), k);
+          initial(rng, _x[k]);
+        }, _options.threads);
+        ++_step;
+      }
+
+      /*!
+       * Propagates every member from t to t + dt.
+       *
+       * \param[in] t Current time.
+       * \param[in] dt Prediction interval.
+       */
+      void Predict(T t, T dt)
+      {
+        Predict(t, dt, [](SplitMix64 &, std::vector<T> &) {});
+      }
+
+      /*!
+       * Propagates every member from t to t + dt and applies a stochastic
+       * model error.
+       *
+       * \param[in] t Current time.
+       * \param[in] dt Prediction interval.
+       * \param[in] noise Called as noise(rng, x) after the propagation of
+       *            every member; rng is a SplitMix64.
+       */
+      template <class Noise>
+      void Predict(T t, T dt, Noise noise)
+      {
+        const T h = dt / T(_options.substeps);
+        ParallelFor(_m, [&](std::size_t k, unsigned thread) {
+          System f(_f);
+          Stepper & stepper = _steppers[thread];
+          for (int s = 0; s < _options.substeps; ++s)
+            stepper.Step(f, t + h * T(s), h, _x[k]);
+          SplitMix64 rng(Seed(), k);
+          noise(rng, _x[k]);
+        }, _options.threads, 1);
+        ++_step;
+      }
+
+      /*!
+       * Global analysis: every observation updates every state variable.
+       *
+       * \param[in] h Observation operator.
+       * \param[in] z Observations.
+       * \param[in] r Error variances of the observations.
+       */
+      template <class Observation>
+      void Update(Observation & h, const std::vector<T> & z,
+                  const std::vector<T> & r)
+      {
+        Observe(h, z, r);
+        std::vector<Workspace> & workspaces =
+          Workspaces(ResolveThreads(_options.threads, Blocks()));
+        Workspace & w = workspaces[0];
+        w.observations.resize(z.size());
+        w.weights.assign(z.size(), T(1));
+        for (std::size_t l = 0; l < z.size(); ++l)
+          w.observations[l] = l;
+        Transform(z, r, w);
+        ParallelFor(Blocks(), [&](std::size_t b, unsigned thread) {
+          std::vector<T> & scratch = workspaces[thread].scratch;
+          for (std::size_t i = Begin(b); i < End(b); ++i)
+            Apply(i, w.transform, scratch);
+        }, _options.threads);
+        ++_step;
+      }
+
+      /*!
+       * Localized analysis: every state variable is updated from the
+       * observations selected by the localization, whose inverse error
+       * variances are multiplied by the returned weights.
+       *
+       * \param[in] h Observation operator.
+       * \param[in] z Observations.
+       * \param[in] r Error variances of the observations.
+       * \param[in] localization Called as localization(i, observations,
+       *            weights) with empty vectors for state variable i; fills
+       *            in the indices of the observations that influence it
+       *            and their weights in (0, 1], e.g. from GaspariCohn.
+       */
+      template <class Observation, class Localization>
+      void Update(Observation & h, const std::vector<T> & z,
+                  const std::vector<T> & r, Localization localization)
+      {
+        Observe(h, z, r);
+        std::vector<Workspace> & workspaces =
+          Workspaces(ResolveThreads(_options.threads, Blocks()));
+        ParallelFor(Blocks(), [&](std::size_t b, unsigned thread) {
+          Workspace & w = workspaces[thread];
+          bool valid = false;
+          for (std::size_t i = Begin(b); i < End(b); ++i) {
+            w.next_observations.clear();
+            w.next_weights.clear();
+            localization(i, w.next_observations, w.next_weights);
+            if (w.next_observations.size() != w.next_weights.size())
+              throw std::invalid_argument("EnsembleKalmanFilter: "
+                                          "localization sizes differ");
+            if (!valid || w.next_observations != w.observations
+                || w.next_weights != w.weights) {
+              w.observations.swap(w.next_observations);
+              w.weights.swap(w.next_weights);
+              Transform(z, r, w);
+              valid = true;
+            }
+            Apply(i, w.transform, w.scratch);
+          }
+        }, _options.threads);
+        ++_step;
+      }
+
+      //! Ensemble mean.
+      const std::vector<T> & Mean()
+      {
+        ParallelFor(Blocks(), [&](std::size_t b, unsigned) {
+          for (std::size_t i = Begin(b); i < End(b); ++i)
+            _mean[i] = RowMean(i);
+        }, _options.threads);
+        return _mean;
+      }
+
+      //! Member k.
+      std::vector<T> & Member(std::size_t k) { return _x[k]; }
+      const std::vector<T> & Member(std::size_t k) const { return _x[k]; }
+
+      std::size_t Members() const { return _m; }
+      std::size_t Dimension() const { return _n; }
+
+    private:
+      struct Workspace {
+        std::vector<std::size_t> observations, next_observations;
+        std::vector<T> weights, next_weights, values, g, scratch;
+        DenseMatrix<T> C, A, V, transform;
+      };
+
+      std::size_t Blocks() const
+      {
+        return (_n + _options.block - 1) / _options.block;
+      }
+      std::size_t Begin(std::size_t b) const { return b * _options.block; }
+      std::size_t End(std::size_t b) const
+      {
+        return std::min(_n, (b + 1) * _options.block);
+      }
+
+      std::uint64_t Seed() const { return Mix64(_options.seed + _step); }
+
+      std::vector<Workspace> & Workspaces(std::size_t count)
+      {
+        if (_workspaces.size() < count)
+          _workspaces.resize(count);
+        return _workspaces;
+      }
+
+      T RowMean(std::size_t i) const
+      {
+        T s(0);
+        for (std::size_t k = 0; k < _m; ++k)
+          s += _x[k][i];
+        return s / T(_m);
+      }
+
+      // Observed ensemble, stored as mean and anomalies.
+      template <class Observation>
+      void Observe(Observation & h, const std::vector<T> & z,
+                   const std::vector<T> & r)
+      {
+        const std::size_t p = z.size();
+        if (r.size() != p)
+          throw std::invalid_argument("EnsembleKalmanFilter: observation "
+                                      "sizes differ");
+        _Y.Resize(p, _m);
+        _observed.resize(_m);
+        ParallelFor(_m, [&](std::size_t k, unsigned) {
+          h(static_cast<const std::vector<T> &>(_x[k]), _observed[k]);
+          if (_observed[k].size() != p)
+            throw std::invalid_argument("EnsembleKalmanFilter: observation "
+                                        "operator size mismatch");
+          std::copy(_observed[k].begin(), _observed[k].end(), _Y.Column(k));
+        }, _options.threads);
+        _ybar.assign(p, T(0));
+        for (std::size_t k = 0; k < _m; ++k)
+          for (std::size_t l = 0; l < p; ++l)
+            _ybar[l] += _Y(l, k);
+        for (std::size_t l = 0; l < p; ++l)
+          _ybar[l] /= T(_m);
+        for (std::size_t k = 0; k < _m; ++k)
+          for (std::size_t l = 0; l < p; ++l)
+            _Y(l, k) -= _ybar[l];
+      }
+
+      // Weight matrix of the analysis from the observations selected in w:
+      // with C = Y^T R^-1 and A = (m - 1) / inflation I + C Y = V L V^T,
+      // the analysis members are the forecast mean plus the anomalies
+      // times V (m - 1)^1/2 L^-1/2 V^T + V L^-1 V^T C (z - ybar).
+      void Transform(const std::vector<T> & z, const std::vector<T> & r,
+                     Workspace & w)
+      {
+        const std::size_t p = w.observations.size();
+        w.C.Resize(_m, p);
+        for (std::size_t l = 0; l < p; ++l) {
+          const std::size_t o = w.observations[l];
+          const T scale = w.weights[l] / r[o];
+          for (std::size_t j = 0; j < _m; ++j)
+            w.C(j, l) = _Y(o, j) * scale;
+        }
+        w.A.Resize(_m, _m);
+        for (std::size_t k = 0; k < _m; ++k) {
+          w.A(k, k) = T(_m - 1) / T(_options.inflation);
+          for (std::size_t l = 0; l < p; ++l) {
+            const T y = _Y(w.observations[l], k);
+            for (std::size_t j = 0; j < _m; ++j)
+              w.A(j, k) += w.C(j, l) * y;
+          }
+        }
+        SymmetricEigen(w.A, w.values, w.V);
+        w.g.assign(_m, T(0));
+        for (std::size_t l = 0; l < p; ++l) {
+          const std::size_t o = w.observations[l];
+          const T d = z[o] - _ybar[o];
+          for (std::size_t j = 0; j < _m; ++j)
+            w.g[j] += w.C(j, l) * d;
+        }
+        // g <- L^-1 V^T g, then mean weights V g.
+        w.scratch.assign(_m, T(0));
+        for (std::size_t q = 0; q < _m; ++q) {
+          T s(0);
+          for (std::size_t j = 0; j < _m; ++j)
+            s += w.V(j, q) * w.g[j];
+          w.scratch[q] = s / w.values[q];
+        }
+        w.transform.Resize(_m, _m);
+        for (std::size_t k = 0; k < _m; ++k) {
+          for (std::size_t q = 0; q < _m; ++q) {
+            const T c = w.V(k, q) * std::sqrt(T(_m - 1) / w.values[q]);
+            for (std::size_t j = 0; j < _m; ++j)
+              w.transform(j, k) += w.V(j, q) * c;
+          }
+          for (std::size_t j = 0; j < _m; ++j)
+            for (std::size_t q = 0; q < _m; ++q)
+              w.transform(j, k) += w.V(j, q) * w.scratch[q];
+        }
+      }
+
+      // Replaces row i of the ensemble by mean + anomalies * transform.
+      void Apply(std::size_t i, const DenseMatrix<T> & transform,
+                 std::vector<T> & anomalies)
+      {
+        const T mean = RowMean(i);
+        anomalies.resize(_m);
+        for (std::size_t j = 0; j < _m; ++j)
+          anomalies[j] = _x[j][i] - mean;
+        for (std::size_t k = 0; k < _m; ++k) {
+          const T * column = transform.Column(k);
+          T s(0);
+          for (std::size_t j = 0; j < _m; ++j)
+            s += anomalies[j] * column[j];
+          _x[k][i] = mean + s;
+        }
+      }
+
+      System & _f;
+      EnsembleKalmanOptions _options;
+      std::size_t _n, _m;
+      std::vector<std::vector<T> > _x;
+      std::vector<T> _mean, _ybar;
+      std::vector<std::vector<T> > _observed;
+      DenseMatrix<T> _Y;
+      std::vector<Stepper> _steppers;
+      std::vector<Workspace> _workspaces;
+      std::uint64_t _step;
+  };
+}
+#endif
@@ -0,0 +1,47 @@
+/*! \file ensemble.h
+ *  \brief Parallel ensemble runner.
+ *
+ *  An ensemble is a set of independent members (integrations from different
+ *  initial conditions or parameters) whose outputs are reduced into an
+ *  accumulator, e.g. TrajectoryMoments.  Every thread reduces into its own
+ *  copy of the accumulator and the copies are merged at the end, so members
+ *  never contend for shared state.
+ */
+
+#ifndef __ENSEMBLE_H__
+#define __ENSEMBLE_H__
+#include <cstddef>
+#include <vector>
+
+#include "parallel.h"
+#include "trace.h"
+
+namespace dynamics {
+  /*!
+   * Runs members [0, members) in parallel and merges their results.
+   *
+   * \param[in] members Number of ensemble members.
+   * \param[in] prototype Empty accumulator copied once per thread.  The
+   *            accumulator must provide Merge(const Accumulator &).
+   * \param[in] member Called as member(i, accumulator, thread) for every
+   *            member i; it adds its results to accumulator, which is owned
+   *            by the calling thread.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \return The merged accumulator.
+   */
+  template <class Accumulator, class Member>
+  Accumulator RunEnsemble(std::size_t members, const Accumulator & prototype,
+                          Member member, unsigned threads = 0)
+  {
+    std::vector<Accumulator> partial(ResolveThreads(threads, members),
+                                     prototype);
+    ParallelFor(members, [&](std::size_t i, unsigned thread) {
+      DYNAMICS_TRACE_SPAN("member");
+      member(i, partial[thread], thread);
+    }, threads);
+    for (std::size_t t = 1; t < partial.size(); ++t)
+      partial[0].Merge(partial[t]);
+    return partial[0];
+  }
+}
+#endif
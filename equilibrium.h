@@ -0,0 +1,472 @@
+/*! \file equilibrium.h
+ *  \brief Equilibria of flows and fixed points of maps.
+ *
+ *  An equilibrium of a flow dx/dt = f(x) solves f(x) = 0 and a fixed point
+ *  of a map x_{i+1} = f(x_i) solves f(x) - x = 0.  Both are found with a
+ *  globalized Newton method: the Newton step is damped by a backtracking
+ *  line search on |r|^2 so that the iteration also converges from poor
+ *  initial guesses, and the Jacobian is only computed at the start and
+ *  whenever the line search stalls; in between, Broyden's rank one update
+ *  keeps it current from the residuals already computed.
+ *
+ *  Jacobians are exact when the mapping is a class template over its
+ *  scalar type and a Dual instantiation is passed along (see autodiff.h),
+ *  and forward difference approximations otherwise.
+ *
+ *  The multistart driver runs the solver from many initial guesses spread
+ *  over a box in parallel and returns the distinct roots, which replaces
+ *  integrating transients to steady state from many initial conditions.
+ */
+
+#ifndef __EQUILIBRIUM_H__
+#define __EQUILIBRIUM_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "autodiff.h"
+#include "fixed_linalg.h"
+#include "mappings.h"
+#include "parallel.h"
+#include "qmc.h"
+#include "trace.h"
+
+namespace dynamics {
+  //! Which equation an equilibrium solves.
+  enum EquilibriumKind {
+    //! f(x) = 0, an equilibrium of the flow dx/dt = f(x).
+    FlowEquilibrium,
+    //! f(x) = x, a fixed point of the map x_{i+1} = f(x_i).
+    MapFixedPoint
+  };
+
+  /*! \struct EquilibriumOptions
+   *  \brief Parameters of FindEquilibrium and FindEquilibria.
+   */
+  struct EquilibriumOptions {
+    EquilibriumOptions()
+      : kind(FlowEquilibrium), tolerance(1e-10), max_iterations(100),
+        broyden(true), distinct(1e-6), threads(0), seed(0) {}
+
+    EquilibriumKind kind;
+    //! Convergence when the largest residual component is below this.
+    double tolerance;
+    //! Largest number of Newton iterations.
+    int max_iterations;
+    //! Update the Jacobian with Broyden's method instead of recomputing it.
+    bool broyden;
+    //! Roots closer than distinct (1 + |x|) in the max norm are the same.
+    double distinct;
+    //! Number of threads of FindEquilibria, 0 selects HardwareThreads().
+    unsigned threads;
+    //! Seed of the initial guesses of FindEquilibria.
+    std::uint64_t seed;
+  };
+
+  /*! \struct EquilibriumResult
+   *  \brief Result of FindEquilibrium.
+   */
+  template <class T, int N>
+  struct EquilibriumResult {
+    //! Last iterate, the root if converged.
+    std::array<T, N> x;
+    //! Largest residual component at x.
+    T residual;
+    bool converged;
+    int iterations;
+    int residual_evaluations;
+    int jacobian_evaluations;
+  };
+
+  namespace internal {
+    template <class T, int N>
+    T MaxNorm(const std::array<T, N> & x)
+    {
+      T m(0);
+      for (int i = 0; i < N; ++i)
+        m = std::max(m, T(std::fabs(x[i])));
+      return m;
+    }
+
+    template <class T, int N>
+    T SquaredNorm(const std::array<T, N> & x)
+    {
+      T s(0);
+      for (int i = 0; i < N; ++i)
+        s += x[i] * x[i];
+      return s;
+    }
+
+    // Residual f(x) or f(x) - x of a mapping.
+    template <class T, int N>
+    class EquilibriumResidual {
+      public:
+        EquilibriumResidual(MappingAutonomousEndogenous<T, N> & f,
+                            EquilibriumKind kind)
+          : _f(f), _kind(kind) {}
+
+        void operator()(const std::array<T, N> & x, std::array<T, N> & r)
+        {
+          _f.ComputeRHS(x, r);
+          if (_kind == MapFixedPoint)
+            for (int i = 0; i < N; ++i)
+              r[i] -= x[i];
+        }
+
+      private:
+        MappingAutonomousEndogenous<T, N> & _f;
+        EquilibriumKind _kind;
+    };
+
+    // Forward difference Jacobian of the residual.
+    template <class T, int N>
+    class FiniteDifferenceJacobian {
+      public:
+        explicit FiniteDifferenceJacobian(
+            const EquilibriumResidual<T, N> & residual)
+          : _residual(residual) {}
+
+        void operator()(const std::array<T, N> & x, Matrix<T, N> & J)
+        {
+          const T sqrt_eps = std::sqrt(std::numeric_limits<T>::epsilon());
+          std::array<T, N> r, rd, y(x);
+          _residual(x, r);
+          for (int j = 0; j < N; ++j) {
+            const T delta = sqrt_eps * std::max(T(1), T(std::fabs(x[j])));
+            y[j] = x[j] + delta;
+            _residual(y, rd);
+            y[j] = x[j];
+            for (int i = 0; i < N; ++i)
+              J(i, j) = (rd[i] - r[i]) / delta;
+          }
+        }
+
+      private:
+        EquilibriumResidual<T, N> _residual;
+    };
+
+    // Exact Jacobian of the residual from the Dual instantiation of the
+    // mapping.
+    template <class T, int N>
+    class DualJacobian {
+      public:
+        DualJacobian(MappingAutonomousEndogenous<Dual<T, N>, N> & df,
+                     EquilibriumKind kind)
+          : _df(df), _kind(kind) {}
+
+        void operator()(const std::array<T, N> & x, Matrix<T, N> & J)
+        {
+          std::array<Dual<T, N>, N> seeded, rhs;
+          Seed<T, N>(x, seeded);
+          _df.ComputeRHS(seeded, rhs);
+          for (int i = 0; i < N; ++i)
+            for (int j = 0; j < N; ++j)
+              J(i, j) = rhs[i].Derivative(j);
+          if (_kind == MapFixedPoint)
+            for (int i = 0; i < N; ++i)
+              J(i, i) -= T(1);
+        }
+
+      private:
+        MappingAutonomousEndogenous<Dual<T, N>, N> & _df;
+        EquilibriumKind _kind;
+    };
+  }
+
+  /*!
+   * Solves residual(x) = 0 by Newton's method with a backtracking line
+   * search and Broyden updates of the Jacobian.
+   *
+   * \param[in] residual Called as residual(x, r).
+   * \param[in] jacobian Called as jacobian(x, J) for the Jacobian of the
+   *            residual at x.
+   * \param[in] x0 Initial guess.
+   * \param[in] options Parameters; kind is ignored.
+   */
+  template <class T, int N, class Residual, class Jacobian>
+  EquilibriumResult<T, N> SolveNewton(Residual & residual,
+                                      Jacobian & jacobian,
+                                      const std::array<T, std::size_t(N)> & x0,
+                                      const EquilibriumOptions & options
+                                        = EquilibriumOptions())
+  {
+    // Armijo constant and smallest step length of the line search.
+    const T armijo(1e-4), min_step(1.0 / 1024.0);
+    EquilibriumResult<T, N> result;
+    result.x = x0;
+    result.converged = false;
+    result.iterations = 0;
+    result.residual_evaluations = 1;
+    result.jacobian_evaluations = 0;
+    std::array<T, N> r, rt, xt, d;
+    residual(result.x, r);
+    T phi = internal::SquaredNorm<T, N>(r);
+
+    Matrix<T, N> J, LU;
+    std::array<int, N> pivots;
+    // J is valid at x (computed there or Broyden updated), J is a Broyden
+    // update rather than a computed Jacobian, LU holds the factors of J.
+    bool valid = false, stale = false, factored = false;
+    for (;;) {
+      result.residual = internal::MaxNorm<T, N>(r);
+      if (result.residual <= T(options.tolerance)) {
+        result.converged = true;
+        break;
+      }
+      if (result.iterations == options.max_iterations
+          || !(result.residual < std::numeric_limits<T>::infinity()))
+        break;
+      if (!valid) {
+        DYNAMICS_TRACE_SPAN("jacobian");
+        jacobian(result.x, J);
+        ++result.jacobian_evaluations;
+        valid = true;
+        stale = false;
+        factored = false;
+      }
+      if (!factored) {
+        {
+          DYNAMICS_TRACE_SPAN("lu");
+          LU = J;
+          factored = LUFactor(LU, pivots);
+        }
+        if (!factored) {
+          if (!stale)
+            break;
+          valid = false;
+          continue;
+        }
+      }
+
+      for (int i = 0; i < N; ++i)
+        d[i] = -r[i];
+      LUSolve(LU, pivots, d);
+      T lambda(1), phit(0);
+      bool accepted = false;
+      for (; lambda >= min_step; lambda /= 2) {
+        for (int i = 0; i < N; ++i)
+          xt[i] = result.x[i] + lambda * d[i];
+        residual(xt, rt);
+        ++result.residual_evaluations;
+        phit = internal::SquaredNorm<T, N>(rt);
+        if (phit <= (T(1) - 2 * armijo * lambda) * phi) {
+          accepted = true;
+          break;
+        }
+      }
+      if (!accepted) {
+        // An updated Jacobian may point uphill; retry with a computed one.
+        if (!stale)
+          break;
+        valid = false;
+        continue;
+      }
+      ++result.iterations;
+
+      if (options.broyden) {
+        // J += (y - J s) s^T / (s^T s) with s = xt - x, y = rt - r.  The
+        // updated matrix is refactored, which for the sizes used here is
+        // cheap next to computing a Jacobian.
+        std::array<T, N> s, Js;
+        for (int i = 0; i < N; ++i)
+          s[i] = xt[i] - result.x[i];
+        MatVec(J, s, Js);
+        const T ss = internal::SquaredNorm<T, N>(s);
+        if (ss > T(0))
+          for (int i = 0; i < N; ++i) {
+            const T c = (rt[i] - r[i] - Js[i]) / ss;
+            for (int j = 0; j < N; ++j)
+              J(i, j) += c * s[j];
+          }
+        stale = true;
+      } else {
+        valid = false;
+      }
+      factored = false;
+      result.x = xt;
+      r = rt;
+      phi = phit;
+    }
+    return result;
+  }
+
+  /*!
+   * Finds an equilibrium (or fixed point) of a mapping near x0, with
+   * forward difference Jacobians.
+   *
+   * \param[in] f Mapping.
+   * \param[in] x0 Initial guess.
+   * \param[in] options Parameters.
+   */
+  template <class T, int N>
+  EquilibriumResult<T, N>
+  FindEquilibrium(MappingAutonomousEndogenous<T, N> & f,
+                  const std::array<T, std::size_t(N)> & x0,
+                  const EquilibriumOptions & options = EquilibriumOptions())
+  {
+    internal::EquilibriumResidual<T, N> residual(f, options.kind);
+    internal::FiniteDifferenceJacobian<T, N> jacobian(residual);
+    return SolveNewton<T, N>(residual, jacobian, x0, options);
+  }
+
+  /*!
+   * Finds an equilibrium (or fixed point) of a mapping near x0, with exact
+   * Jacobians.
+   *
+   * \param[in] f Mapping.
+   * \param[in] df The same mapping instantiated with Dual<T, N> scalars.
+   * \param[in] x0 Initial guess.
+   * \param[in] options Parameters.
+   */
+  template <class T, int N>
+  EquilibriumResult<T, N>
+  FindEquilibrium(MappingAutonomousEndogenous<T, N> & f,
+                  MappingAutonomousEndogenous<Dual<T, N>, N> & df,
+                  const std::array<T, std::size_t(N)> & x0,
+                  const EquilibriumOptions & options = EquilibriumOptions())
+  {
+    internal::EquilibriumResidual<T, N> residual(f, options.kind);
+    internal::DualJacobian<T, N> jacobian(df, options.kind);
+    return SolveNewton<T, N>(residual, jacobian, x0, options);
+  }
+
+  namespace internal {
+    // Initial guesses in the unit cube: scrambled Sobol' points up to the
+    // size of the direction number table, scrambled Halton points up to
+    // the number of tabulated primes, and independent uniform points from
+    // one SplitMix64 stream per start beyond that.
+    template <int N>
+    class StartPoints {
+      public:
+        explicit StartPoints(std::uint64_t seed)
+          : _seed(seed),
+            _sobol(N <= SobolSequence::MaxDimensions ? N : 1, true, seed),
+            _halton(N <= HaltonSequence::MaxDimensions ? N : 1, true, seed)
+        {}
+
+        void Point(std::size_t i, double * u) const
+        {
+          if (N <= SobolSequence::MaxDimensions) {
+            _sobol.Point(i, u);
+          } else if (N <= HaltonSequence::MaxDimensions) {
+            _halton.Point(i, u);
+          } else {
+            SplitMix64 rng(_seed, i);
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            for (int k = 0; k < N; ++k)
+              u[k] = uniform(rng);
+          }
+        }
+
+      private:
+        std::uint64_t _seed;
+        SobolSequence _sobol;
+        HaltonSequence _halton;
+    };
+
+    // Solves from the start points in [lower, upper] in parallel and keeps
+    // the distinct roots, in order of the first start that found them, so
+    // results do not depend on the number of threads.
+    template <class T, int N, class Solve>
+    std::vector<EquilibriumResult<T, N> >
+    Multistart(Solve solve, const std::array<T, N> & lower,
+               const std::array<T, N> & upper, std::size_t starts,
+               const EquilibriumOptions & options)
+    {
+      StartPoints<N> points(options.seed);
+      std::vector<EquilibriumResult<T, N> > found(starts);
+      ParallelFor(starts, [&](std::size_t i, unsigned) {
+        double u[N];
+        points.Point(i, u);
+        std::array<T, N> x0;
+        for (int k = 0; k < N; ++k)
+          x0[k] = lower[k] + T(u[k]) * (upper[k] - lower[k]);
+        found[i] = solve(x0);
+      }, options.threads);
+
+      std::vector<EquilibriumResult<T, N> > roots;
+      for (std::size_t i = 0; i < starts; ++i) {
+        if (!found[i].converged)
+          continue;
+        bool seen = false;
+        for (std::size_t j = 0; j < roots.size() && !seen; ++j) {
+          T distance(0);
+          for (int k = 0; k < N; ++k)
+            distance = std::max(distance,
+                                T(std::fabs(found[i].x[k] - roots[j].x[k])));
+          seen = distance <= T(options.distinct)
+            * (T(1) + MaxNorm<T, N>(roots[j].x));
+        }
+        if (!seen)
+          roots.push_back(found[i]);
+      }
+      return roots;
+    }
+  }
+
+  /*!
+   * Finds the distinct equilibria (or fixed points) reached by Newton's
+   * method from starts initial guesses spread over a box, with forward
+   * difference Jacobians.  The solves run in parallel, so the mapping's
+   * ComputeRHS must tolerate concurrent calls.
+   *
+   * \param[in] f Mapping.
+   * \param[in] lower Lower corner of the box of initial guesses.
+   * \param[in] upper Upper corner of the box of initial guesses.
+   * \param[in] starts Number of initial guesses: scrambled Sobol' points
+   *            for N up to SobolSequence::MaxDimensions, scrambled Halton
+   *            points up to HaltonSequence::MaxDimensions and independent
+   *            uniform points above.
+   * \param[in] options Parameters.
+   * \return The converged, distinct roots.
+   */
+  template <class T, int N>
+  std::vector<EquilibriumResult<T, N> >
+  FindEquilibria(MappingAutonomousEndogenous<T, N> & f,
+                 const std::array<T, std::size_t(N)> & lower,
+                 const std::array<T, std::size_t(N)> & upper,
+                 std::size_t starts,
+                 const EquilibriumOptions & options = EquilibriumOptions())
+  {
+    return internal::Multistart<T, N>(
+        [&](const std::array<T, N> & x0) {
+          return FindEquilibrium(f, x0, options);
+        }, lower, upper, starts, options);
+  }
+
+  /*!
+   * Finds the distinct equilibria (or fixed points) reached by Newton's
+   * method from starts initial guesses spread over a box, with exact
+   * Jacobians.  The solves run in parallel, so ComputeRHS of both mappings
+   * must tolerate concurrent calls.
+   *
+   * \param[in] f Mapping.
+   * \param[in] df The same mapping instantiated with Dual<T, N> scalars.
+   * \param[in] lower Lower corner of the box of initial guesses.
+   * \param[in] upper Upper corner of the box of initial guesses.
+   * \param[in] starts Number of initial guesses, spread as in the
+   *            overload above.
+   * \param[in] options Parameters.
+   * \return The converged, distinct roots.
+   */
+  template <class T, int N>
+  std::vector<EquilibriumResult<T, N> >
+  FindEquilibria(MappingAutonomousEndogenous<T, N> & f,
+                 MappingAutonomousEndogenous<Dual<T, N>, N> & df,
+                 const std::array<T, std::size_t(N)> & lower,
+                 const std::array<T, std::size_t(N)> & upper,
+                 std::size_t starts,
+                 const EquilibriumOptions & options = EquilibriumOptions())
+  {
+    return internal::Multistart<T, N>(
+        [&](const std::array<T, N> & x0) {
+          return FindEquilibrium(f, df, x0, options);
+        }, lower, upper, starts, options);
+  }
+}
+#endif
@@ -0,0 +1,518 @@
+/*! \file estimation.h
+ *  \brief Parameter estimation by multiple shooting least squares.
+ *
+ *  EstimateParameters fits the parameters of a model to a measured
+ *  trajectory.  Parameters enter the model as the exogenous inputs of a
+ *  MappingAutonomousExogenous, held constant.  The measurement interval is
+ *  split into shooting segments whose initial states are estimated along
+ *  with the parameters; continuity between segments is a heavily weighted
+ *  residual.  Since every segment starts from states close to the data,
+ *  fits from poor initial parameters do not get trapped as easily as
+ *  single shooting fits, whose trajectories drift away from the data.
+ *
+ *  Segments are integrated in parallel with a fixed step stepper run in
+ *  Dual arithmetic (see autodiff.h), which yields the forward sensitivities
+ *  of the states with respect to the segment's initial state and the
+ *  parameters.  The Gauss-Newton normal equations are block tridiagonal in
+ *  the segment states, bordered by the parameters; the Levenberg-Marquardt
+ *  steps are solved by block elimination in time linear in the number of
+ *  segments.
+ */
+
+#ifndef __ESTIMATION_H__
+#define __ESTIMATION_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "autodiff.h"
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \struct EstimationOptions
+   *  \brief Parameters of EstimateParameters.
+   */
+  struct EstimationOptions {
+    EstimationOptions()
+      : segments(8), substeps(4), continuity(1e4), damping(1e-3),
+        tolerance(1e-8), max_iterations(200), threads(0) {}
+
+    //! Number of shooting segments; 1 is single shooting.
+    std::size_t segments;
+    //! Steps of the stepper between consecutive measurements.
+    int substeps;
+    //! Weight of the continuity residuals relative to measurements with
+    //! unit standard deviation; defects at the solution scale like the
+    //! inverse square of this weight.
+    double continuity;
+    //! Initial Levenberg-Marquardt damping.
+    double damping;
+    //! Convergence when no unknown changes by more than tolerance times
+    //! (1 + its magnitude).
+    double tolerance;
+    //! Largest number of Levenberg-Marquardt iterations, counting failed
+    //! and rejected steps.
+    int max_iterations;
+    //! Number of threads integrating segments, 0 selects
+    //! HardwareThreads().
+    unsigned threads;
+  };
+
+  /*! \struct EstimationResult
+   *  \brief Result of EstimateParameters.
+   */
+  template <class T, int N, int P>
+  struct EstimationResult {
+    std::array<T, P> parameters;
+    //! Estimated state at the first measurement.
+    std::array<T, N> initial_state;
+    //! Half the sum of squared weighted residuals, without continuity.
+    T cost;
+    //! Largest continuity defect between segments.
+    T defect;
+    //! False if max_iterations was reached or the damping grew without
+    //! bound, for instance because the model diverges.
+    bool converged;
+    //! Levenberg-Marquardt iterations, including rejected steps.
+    int iterations;
+  };
+
+  namespace internal {
+    // Gauss-Newton normal equations of a multiple shooting problem and
+    // their Levenberg-Marquardt solution.
+    template <class T, int N, int P>
+    class MultipleShooting {
+      public:
+        typedef std::array<T, std::size_t(N)> State;
+        typedef std::array<T, std::size_t(P)> Parameters;
+        typedef Dual<T, N + P> Scalar;
+
+        MultipleShooting(MappingAutonomousExogenous<T, N, P> & f,
+                         MappingAutonomousExogenous<Scalar, N, P> & df,
+                         const std::vector<T> & times,
+                         const std::vector<State> & measurements,
+                         const State & sigma,
+                         const EstimationOptions & options)
+          : _f(f), _df(df), _times(times), _y(measurements),
+            _options(options)
+        {
+          if (times.size() < 2 || times.size() != measurements.size())
+            throw std::invalid_argument("EstimateParameters: need matching "
+                                        "times and measurements");
+          for (int i = 0; i < N; ++i)
+            _w[i] = sigma[i] > T(0) ? T(1) / sigma[i] : T(0);
+          _S = std::max<std::size_t>(1, std::min(options.segments,
+                                                 times.size() - 1));
+          _begin.resize(_S + 1);
+          for (std::size_t i = 0; i <= _S; ++i)
+            _begin[i] = i * (times.size() - 1) / _S;
+          _s.resize(_S);
+          for (std::size_t i = 0; i < _S; ++i)
+            _s[i] = measurements[_begin[i]];
+          _segments.resize(_S);
+          _D.resize(_S);
+          _E.resize(_S);
+          _B.resize(_S);
+          _g.resize(_S);
+          _Dh.resize(_S);
+          _Bh.resize(_S);
+          _gh.resize(_S);
+          _ds.resize(_S);
+          _trial.resize(_S);
+        }
+
+        EstimationResult<T, N, P> Fit(const Parameters & p0)
+        {
+          EstimationResult<T, N, P> result;
+          result.converged = false;
+          _p = p0;
+          T lambda = T(_options.damping);
+          T cost = Linearize();
+          // Failed and rejected steps raise the damping; past this bound
+          // the steps are negligible and the fit gives up.
+          const T max_lambda(1e16);
+          result.iterations = 0;
+          while (result.iterations < _options.max_iterations
+                 && lambda <= max_lambda) {
+            ++result.iterations;
+            Parameters dp;
+            if (!Step(lambda, dp)) {
+              lambda *= 4;
+              continue;
+            }
+            T change(0);
+            for (std::size_t i = 0; i < _S; ++i)
+              for (int k = 0; k < N; ++k) {
+                _trial[i][k] = _s[i][k] + _ds[i][k];
+                change = std::max(change, std::fabs(_ds[i][k])
+                                  / (1 + std::fabs(_s[i][k])));
+              }
+            Parameters trial_p;
+            for (int k = 0; k < P; ++k) {
+              trial_p[k] = _p[k] + dp[k];
+              change = std::max(change, std::fabs(dp[k])
+                                / (1 + std::fabs(_p[k])));
+            }
+            // A non-finite trial cost, from a trajectory that diverges,
+            // rejects the step.
+            const T trial = Cost(_trial, trial_p);
+            if (std::isfinite(trial)
+                && (trial < cost || !std::isfinite(cost))) {
+              _s.swap(_trial);
+              _p = trial_p;
+              lambda = std::max(lambda / 3, T(1e-12));
+              cost = Linearize();
+              if (change <= T(_options.tolerance)) {
+                result.converged = true;
+                break;
+              }
+            } else {
+              if (change <= T(_options.tolerance) && std::isfinite(trial)
+                  && std::isfinite(cost)) {
+                result.converged = true;
+                break;
+              }
+              lambda *= 4;
+            }
+          }
+          result.parameters = _p;
+          result.initial_state = _s[0];
+          result.cost = T(0);
+          result.defect = T(0);
+          for (std::size_t i = 0; i < _S; ++i) {
+            result.cost += _segments[i].cost;
+            for (int k = 0; k < N; ++k)
+              if (i + 1 < _S)
+                result.defect = std::max(result.defect,
+                                         std::fabs(_segments[i].c[k]));
+          }
+          return result;
+        }
+
+      private:
+        // Contributions of one segment to the normal equations.
+        struct Segment {
+          Matrix<T, N> D, G;
+          Matrix<T, N, P> B, Gp;
+          Matrix<T, P> Dp;
+          State g, c;
+          Parameters gp;
+          T cost, trial_cost;
+        };
+
+        // Integrates segment i from state x with parameters p, calling
+        // measure(j, x) at every measurement of the segment and returning
+        // the state at the start of the next segment.
+        template <class S, class Mapping, class Measure>
+        std::array<S, std::size_t(N)>
+        Shoot(Mapping & f, std::size_t i, std::array<S, std::size_t(N)> x,
+              const std::array<S, std::size_t(P)> & p, Measure measure)
+        {
+          AutonomousExogenousSystem<S, N, P> system(f, p);
+          RungeKutta4<std::array<S, std::size_t(N)> > stepper;
+          for (std::size_t j = _begin[i]; j < _begin[i + 1]; ++j) {
+            measure(j, x);
+            const T h = (_times[j + 1] - _times[j]) / T(_options.substeps);
+            for (int s = 0; s < _options.substeps; ++s)
+              stepper.Step(system, _times[j] + h * T(s), h, x);
+          }
+          if (i + 1 == _S)
+            measure(_begin[_S], x);
+          return x;
+        }
+
+        // Weighted measurement residual component k at measurement j.
+        template <class S>
+        S Residual(std::size_t j, const std::array<S, std::size_t(N)> & x,
+                   int k) const
+        {
+          return _w[k] * (x[k] - _y[j][k]);
+        }
+
+        // Cost of the trial unknowns, without derivatives.
+        T Cost(const std::vector<State> & s, const Parameters & p)
+        {
+          const T w = T(_options.continuity);
+          ParallelFor(_S, [&](std::size_t i, unsigned) {
+            T cost(0);
+            State end = Shoot(_f, i, s[i], p,
+                              [&](std::size_t j, const State & x) {
+                                for (int k = 0; k < N; ++k)
+                                  cost += T(0.5) * Residual(j, x, k)
+                                    * Residual(j, x, k);
+                              });
+            if (i + 1 < _S)
+              for (int k = 0; k < N; ++k)
+                cost += T(0.5) * w * w * (end[k] - s[i + 1][k])
+                  * (end[k] - s[i + 1][k]);
+            _segments[i].trial_cost = cost;
+          }, _options.threads);
+          T cost(0);
+          for (std::size_t i = 0; i < _S; ++i)
+            cost += _segments[i].trial_cost;
+          return cost;
+        }
+
+        // Residuals and sensitivities of every segment, assembled into the
+        // blocks of the normal equations; returns the cost.
+        T Linearize()
+        {
+          ParallelFor(_S, [&](std::size_t i, unsigned) {
+            Segment & seg = _segments[i];
+            seg.D = Matrix<T, N>::Zero();
+            seg.B = Matrix<T, N, P>::Zero();
+            seg.Dp = Matrix<T, P>::Zero();
+            seg.g.fill(T(0));
+            seg.gp.fill(T(0));
+            seg.cost = T(0);
+            std::array<Scalar, std::size_t(N)> x;
+            std::array<Scalar, std::size_t(P)> p;
+            for (int k = 0; k < N; ++k)
+              x[k] = Scalar(_s[i][k], k);
+            for (int k = 0; k < P; ++k)
+              p[k] = Scalar(_p[k], N + k);
+            x = Shoot(_df, i, x, p, [&](std::size_t j,
+                          const std::array<Scalar, std::size_t(N)> & y) {
+              for (int k = 0; k < N; ++k) {
+                if (_w[k] == T(0))
+                  continue;
+                const Scalar r = Residual(j, y, k);
+                const T value = r.Value();
+                seg.cost += T(0.5) * value * value;
+                for (int a = 0; a < N + P; ++a) {
+                  const T ja = r.Derivative(a);
+                  if (ja == T(0))
+                    continue;
+                  for (int b = 0; b < N + P; ++b)
+                    Add(seg, a, b, ja * r.Derivative(b));
+                  if (a < N)
+                    seg.g[a] += ja * value;
+                  else
+                    seg.gp[a - N] += ja * value;
+                }
+              }
+            });
+            for (int k = 0; k < N; ++k) {
+              seg.c[k] = i + 1 < _S ? x[k].Value() - _s[i + 1][k] : T(0);
+              for (int a = 0; a < N; ++a)
+                seg.G(k, a) = x[k].Derivative(a);
+              for (int a = 0; a < P; ++a)
+                seg.Gp(k, a) = x[k].Derivative(N + a);
+            }
+          }, _options.threads);
+
+          // Continuity residuals w (x_end(s_i, p) - s_{i+1}) couple
+          // neighbouring segments.
+          const T w2 = T(_options.continuity) * T(_options.continuity);
+          T cost(0);
+          _Dp = Matrix<T, P>::Zero();
+          _gp.fill(T(0));
+          for (std::size_t i = 0; i < _S; ++i) {
+            const Segment & seg = _segments[i];
+            cost += seg.cost;
+            _D[i] = seg.D;
+            _B[i] = seg.B;
+            _g[i] = seg.g;
+            for (int a = 0; a < P; ++a) {
+              _gp[a] += seg.gp[a];
+              for (int b = 0; b < P; ++b)
+                _Dp(a, b) += seg.Dp(a, b);
+            }
+          }
+          for (std::size_t i = 0; i + 1 < _S; ++i) {
+            const Segment & seg = _segments[i];
+            for (int k = 0; k < N; ++k)
+              cost += T(0.5) * w2 * seg.c[k] * seg.c[k];
+            for (int a = 0; a < N; ++a) {
+              for (int b = 0; b < N; ++b) {
+                T s(0);
+                for (int k = 0; k < N; ++k)
+                  s += seg.G(k, a) * seg.G(k, b);
+                _D[i](a, b) += w2 * s;
+                _E[i](a, b) = -w2 * seg.G(b, a);
+              }
+              _D[i + 1](a, a) += w2;
+              for (int b = 0; b < P; ++b) {
+                T s(0);
+                for (int k = 0; k < N; ++k)
+                  s += seg.G(k, a) * seg.Gp(k, b);
+                _B[i](a, b) += w2 * s;
+                _B[i + 1](a, b) -= w2 * seg.Gp(a, b);
+              }
+              T s(0);
+              for (int k = 0; k < N; ++k)
+                s += seg.G(k, a) * seg.c[k];
+              _g[i][a] += w2 * s;
+              _g[i + 1][a] -= w2 * seg.c[a];
+            }
+            for (int a = 0; a < P; ++a) {
+              T s(0);
+              for (int k = 0; k < N; ++k)
+                s += seg.Gp(k, a) * seg.c[k];
+              _gp[a] += w2 * s;
+              for (int b = 0; b < P; ++b) {
+                T t(0);
+                for (int k = 0; k < N; ++k)
+                  t += seg.Gp(k, a) * seg.Gp(k, b);
+                _Dp(a, b) += w2 * t;
+              }
+            }
+          }
+          return cost;
+        }
+
+        static void Add(Segment & seg, int a, int b, T value)
+        {
+          if (a < N) {
+            if (b < N)
+              seg.D(a, b) += value;
+            else
+              seg.B(a, b - N) += value;
+          } else if (b >= N) {
+            seg.Dp(a - N, b - N) += value;
+          }
+        }
+
+        // Solves the damped normal equations for the steps _ds and dp by
+        // block elimination of the segment states, then the parameters
+        // from their Schur complement.  Returns false if a block is not
+        // positive definite.
+        bool Step(T lambda, Parameters & dp)
+        {
+          Matrix<T, P> schur = _Dp;
+          Parameters rp;
+          for (int a = 0; a < P; ++a) {
+            schur(a, a) += lambda * std::max(_Dp(a, a), T(1e-12));
+            rp[a] = -_gp[a];
+          }
+          for (std::size_t i = 0; i < _S; ++i) {
+            Matrix<T, N> & Dh = _Dh[i];
+            Matrix<T, N, P> & Bh = _Bh[i];
+            State & gh = _gh[i];
+            Dh = _D[i];
+            Bh = _B[i];
+            for (int a = 0; a < N; ++a) {
+              Dh(a, a) += lambda * std::max(_D[i](a, a), T(1e-12));
+              gh[a] = -_g[i][a];
+            }
+            if (i > 0) {
+              // Subtract E^T Dh^-1 [E | Bh | gh] of the previous segment.
+              const Matrix<T, N> & E = _E[i - 1];
+              for (int b = 0; b < N; ++b) {
+                State column;
+                for (int k = 0; k < N; ++k)
+                  column[k] = E(k, b);
+                CholeskySolve(_Dh[i - 1], column);
+                for (int a = 0; a < N; ++a)
+                  for (int k = 0; k < N; ++k)
+                    Dh(a, b) -= E(k, a) * column[k];
+              }
+              for (int b = 0; b < P; ++b) {
+                State column;
+                for (int k = 0; k < N; ++k)
+                  column[k] = _Bh[i - 1](k, b);
+                CholeskySolve(_Dh[i - 1], column);
+                for (int a = 0; a < N; ++a)
+                  for (int k = 0; k < N; ++k)
+                    Bh(a, b) -= E(k, a) * column[k];
+              }
+              State column = _gh[i - 1];
+              CholeskySolve(_Dh[i - 1], column);
+              for (int a = 0; a < N; ++a)
+                for (int k = 0; k < N; ++k)
+                  gh[a] -= E(k, a) * column[k];
+            }
+            if (!CholeskyFactor(Dh))
+              return false;
+            // Schur complement of the parameters.
+            for (int b = 0; b < P; ++b) {
+              State column;
+              for (int k = 0; k < N; ++k)
+                column[k] = Bh(k, b);
+              CholeskySolve(Dh, column);
+              for (int a = 0; a < P; ++a)
+                for (int k = 0; k < N; ++k)
+                  schur(a, b) -= Bh(k, a) * column[k];
+            }
+            State column = gh;
+            CholeskySolve(Dh, column);
+            for (int a = 0; a < P; ++a)
+              for (int k = 0; k < N; ++k)
+                rp[a] -= Bh(k, a) * column[k];
+          }
+          if (!CholeskyFactor(schur))
+            return false;
+          dp = rp;
+          CholeskySolve(schur, dp);
+          for (std::size_t i = _S; i-- > 0; ) {
+            State & ds = _ds[i];
+            for (int a = 0; a < N; ++a) {
+              T s = _gh[i][a];
+              for (int b = 0; b < P; ++b)
+                s -= _Bh[i](a, b) * dp[b];
+              if (i + 1 < _S)
+                for (int b = 0; b < N; ++b)
+                  s -= _E[i](a, b) * _ds[i + 1][b];
+              ds[a] = s;
+            }
+            CholeskySolve(_Dh[i], ds);
+          }
+          return true;
+        }
+
+        MappingAutonomousExogenous<T, N, P> & _f;
+        MappingAutonomousExogenous<Scalar, N, P> & _df;
+        const std::vector<T> & _times;
+        const std::vector<State> & _y;
+        EstimationOptions _options;
+        State _w;
+        std::size_t _S;
+        //! Index of the first measurement of every segment.
+        std::vector<std::size_t> _begin;
+        std::vector<State> _s, _trial, _ds, _g, _gh;
+        Parameters _p, _gp;
+        std::vector<Segment> _segments;
+        std::vector<Matrix<T, N> > _D, _E, _Dh;
+        std::vector<Matrix<T, N, P> > _B, _Bh;
+        Matrix<T, P> _Dp;
+    };
+  }
+
+  /*!
+   * Fits the parameters of a model to measurements of its states by
+   * Levenberg-Marquardt over multiple shooting residuals.
+   *
+   * \param[in] f Model, with the parameters as its exogenous inputs.
+   * \param[in] df The same model instantiated with Dual<T, N + P> scalars.
+   * \param[in] times Increasing measurement times.
+   * \param[in] measurements Measured states at the times.
+   * \param[in] sigma Standard deviations of the measurement errors of the
+   *            state components; 0 marks components that are not measured
+   *            (their measurements still initialize the segment states).
+   * \param[in] p0 Initial guess of the parameters.
+   * \param[in] options Parameters.
+   */
+  template <class T, int N, int P>
+  EstimationResult<T, N, P>
+  EstimateParameters(MappingAutonomousExogenous<T, N, P> & f,
+                     MappingAutonomousExogenous<Dual<T, N + P>, N, P> & df,
+                     const std::vector<T> & times,
+                     const std::vector<std::array<T, std::size_t(N)> >
+                       & measurements,
+                     const std::array<T, std::size_t(N)> & sigma,
+                     const std::array<T, std::size_t(P)> & p0,
+                     const EstimationOptions & options = EstimationOptions())
+  {
+    internal::MultipleShooting<T, N, P> problem(f, df, times, measurements,
+                                                sigma, options);
+    return problem.Fit(p0);
+  }
+}
+#endif
@@ -0,0 +1,371 @@
+/*! \file fixed_linalg.h
+ *  \brief Dense linear algebra on matrices whose size is a template
+ *  parameter.
+ *
+ *  Implicit integrators, filters and Newton solvers over std::array<T, N>
+ *  states need many tiny factorizations and solves.  At N = 2..32 the call
+ *  overhead and run time dispatch of general purpose libraries dominates, so
+ *  the kernels here are specialized on the sizes: every loop bound is a
+ *  compile time constant (factorizations recurse over the pivot column as a
+ *  template parameter), the innermost dot products and row updates are
+ *  unrolled explicitly, and the compiler is free to vectorize what remains.
+ *  All factorizations work in place and nothing allocates.
+ *
+ *  Vectors are the std::array types used for states by the mapping classes.
+ */
+
+#ifndef __FIXED_LINALG_H__
+#define __FIXED_LINALG_H__
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace dynamics {
+  /*! \class Matrix
+   *  \brief A fixed size, row major matrix.
+   *  \tparam T Data type of the entries (typically double).
+   *  \tparam R Number of rows.
+   *  \tparam C Number of columns.
+   */
+  template <class T, int R, int C = R>
+  class Matrix {
+    public:
+      T & operator()(int i, int j) { return _data[i * C + j]; }
+      const T & operator()(int i, int j) const { return _data[i * C + j]; }
+
+      //! Pointer to the contiguous entries of row i.
+      T * Row(int i) { return &_data[i * C]; }
+      const T * Row(int i) const { return &_data[i * C]; }
+
+      T * Data() { return _data.data(); }
+      const T * Data() const { return _data.data(); }
+
+      void Fill(const T & value) { _data.fill(value); }
+
+      static Matrix Zero()
+      {
+        Matrix A;
+        A.Fill(T(0));
+        return A;
+      }
+
+      static Matrix Identity()
+      {
+        Matrix A = Zero();
+        for (int i = 0; i < (R < C ? R : C); ++i)
+          A(i, i) = T(1);
+        return A;
+      }
+
+    private:
+      std::array<T, R * C> _data;
+  };
+
+  namespace internal {
+    // Calls f(i) for i = Begin, ..., End - 1 with the loop fully unrolled.
+    template <int Begin, int End>
+    struct Unroll {
+      template <class F>
+      static inline void Run(F & f)
+      {
+        f(Begin);
+        Unroll<Begin + 1, End>::Run(f);
+      }
+    };
+
+    template <int End>
+    struct Unroll<End, End> {
+      template <class F>
+      static inline void Run(F &) {}
+    };
+
+    // sum_{k < K} a[k] b[k * stride]
+    template <int K, int Stride, class T>
+    inline T Dot(const T * a, const T * b)
+    {
+      T s(0);
+      auto f = [&](int k) { s += a[k] * b[k * Stride]; };
+      Unroll<0, K>::Run(f);
+      return s;
+    }
+
+    // y[k] -= alpha x[k] for k < K
+    template <int K, class T>
+    inline void Axpy(T alpha, const T * x, T * y)
+    {
+      auto f = [&](int k) { y[k] -= alpha * x[k]; };
+      Unroll<0, K>::Run(f);
+    }
+
+    // One column of the LU factorization; recurses to the next column.
+    template <class T, int N, int K>
+    struct LUStep {
+      static inline bool Run(Matrix<T, N> & A, std::array<int, N> & pivots)
+      {
+        int p = K;
+        T best = std::fabs(A(K, K));
+        for (int i = K + 1; i < N; ++i) {
+          T v = std::fabs(A(i, K));
+          if (v > best) {
+            best = v;
+            p = i;
+          }
+        }
+        pivots[K] = p;
+        if (best == T(0))
+          return false;
+        if (p != K) {
+          T * a = A.Row(K);
+          T * b = A.Row(p);
+          auto swap = [&](int j) { T t = a[j]; a[j] = b[j]; b[j] = t; };
+          Unroll<0, N>::Run(swap);
+        }
+        const T inverse = T(1) / A(K, K);
+        const T * pivot_row = A.Row(K) + K + 1;
+        for (int i = K + 1; i < N; ++i) {
+          T * row = A.Row(i);
+          row[K] *= inverse;
+          Axpy<N - K - 1>(row[K], pivot_row, row + K + 1);
+        }
+        return LUStep<T, N, K + 1>::Run(A, pivots);
+      }
+    };
+
+    template <class T, int N>
+    struct LUStep<T, N, N> {
+      static inline bool Run(Matrix<T, N> &, std::array<int, N> &)
+      {
+        return true;
+      }
+    };
+
+    // Row K of the Cholesky factor; recurses to the next row.
+    template <class T, int N, int K>
+    struct CholeskyStep {
+      static inline bool Run(Matrix<T, N> & A)
+      {
+        T * row = A.Row(K);
+        for (int j = 0; j < K; ++j) {
+          const T * other = A.Row(j);
+          T s = row[j];
+          for (int k = 0; k < j; ++k)
+            s -= row[k] * other[k];
+          row[j] = s / other[j];
+        }
+        T d = row[K] - Dot<K, 1>(row, row);
+        if (!(d > T(0)))
+          return false;
+        row[K] = std::sqrt(d);
+        return CholeskyStep<T, N, K + 1>::Run(A);
+      }
+    };
+
+    template <class T, int N>
+    struct CholeskyStep<T, N, N> {
+      static inline bool Run(Matrix<T, N> &) { return true; }
+    };
+
+    // Householder reflector for column K; recurses to the next column.
+    template <class T, int R, int C, int K>
+    struct QRStep {
+      static inline void Run(Matrix<T, R, C> & A, std::array<T, C> & tau)
+      {
+        T norm(0);
+        for (int i = K; i < R; ++i)
+          norm += A(i, K) * A(i, K);
+        norm = std::sqrt(norm);
+        if (norm == T(0)) {
+          tau[K] = T(0);
+        } else {
+          // v = x - alpha e_K scaled so that v_K = 1, H = I - tau v v^T.
+          T alpha = A(K, K) > T(0) ? -norm : norm;
+          T v0 = A(K, K) - alpha;
+          for (int i = K + 1; i < R; ++i)
+            A(i, K) /= v0;
+          tau[K] = -v0 / alpha;
+          A(K, K) = alpha;
+          for (int j = K + 1; j < C; ++j) {
+            T s = A(K, j);
+            for (int i = K + 1; i < R; ++i)
+              s += A(i, K) * A(i, j);
+            s *= tau[K];
+            A(K, j) -= s;
+            for (int i = K + 1; i < R; ++i)
+              A(i, j) -= s * A(i, K);
+          }
+        }
+        QRStep<T, R, C, K + 1>::Run(A, tau);
+      }
+    };
+
+    template <class T, int R, int C>
+    struct QRStep<T, R, C, C> {
+      static inline void Run(Matrix<T, R, C> &, std::array<T, C> &) {}
+    };
+  }
+
+  /*!
+   * Computes y = A x.
+   */
+  template <class T, int R, int C>
+  inline void MatVec(const Matrix<T, R, C> & A,
+                     const std::array<T, std::size_t(C)> & x,
+                     std::array<T, std::size_t(R)> & y)
+  {
+    for (int i = 0; i < R; ++i)
+      y[i] = internal::Dot<C, 1>(A.Row(i), x.data());
+  }
+
+  /*!
+   * Computes y = A^T x.
+   */
+  template <class T, int R, int C>
+  inline void MatTransposeVec(const Matrix<T, R, C> & A,
+                              const std::array<T, std::size_t(R)> & x,
+                              std::array<T, std::size_t(C)> & y)
+  {
+    y.fill(T(0));
+    for (int i = 0; i < R; ++i)
+      internal::Axpy<C>(-x[i], A.Row(i), y.data());
+  }
+
+  /*!
+   * Computes P = A B.
+   */
+  template <class T, int R, int K, int C>
+  inline void MatMul(const Matrix<T, R, K> & A, const Matrix<T, K, C> & B,
+                     Matrix<T, R, C> & P)
+  {
+    for (int i = 0; i < R; ++i) {
+      T * p = P.Row(i);
+      for (int j = 0; j < C; ++j)
+        p[j] = T(0);
+      for (int k = 0; k < K; ++k)
+        internal::Axpy<C>(-A(i, k), B.Row(k), p);
+    }
+  }
+
+  /*!
+   * In place LU factorization with partial pivoting, PA = LU.
+   *
+   * \param[in,out] A Matrix, replaced by L (unit diagonal, below the
+   *                diagonal) and U (on and above the diagonal).
+   * \param[out] pivots Row interchanges.
+   * \return false if A is singular to working precision.
+   */
+  template <class T, int N>
+  inline bool LUFactor(Matrix<T, N> & A,
+                       std::array<int, std::size_t(N)> & pivots)
+  {
+    return internal::LUStep<T, N, 0>::Run(A, pivots);
+  }
+
+  /*!
+   * Solves A x = b in place given the output of LUFactor.
+   */
+  template <class T, int N>
+  inline void LUSolve(const Matrix<T, N> & LU,
+                      const std::array<int, std::size_t(N)> & pivots,
+                      std::array<T, std::size_t(N)> & b)
+  {
+    for (int k = 0; k < N; ++k) {
+      T t = b[k];
+      b[k] = b[pivots[k]];
+      b[pivots[k]] = t;
+    }
+    for (int i = 1; i < N; ++i) {
+      T s = b[i];
+      for (int j = 0; j < i; ++j)
+        s -= LU(i, j) * b[j];
+      b[i] = s;
+    }
+    for (int i = N - 1; i >= 0; --i) {
+      T s = b[i];
+      for (int j = i + 1; j < N; ++j)
+        s -= LU(i, j) * b[j];
+      b[i] = s / LU(i, i);
+    }
+  }
+
+  /*!
+   * In place Cholesky factorization A = L L^T of a symmetric positive
+   * definite matrix.
+   *
+   * \param[in,out] A Matrix; its lower triangle is replaced by L, the strict
+   *                upper triangle is left untouched.
+   * \return false if A is not positive definite to working precision.
+   */
+  template <class T, int N>
+  inline bool CholeskyFactor(Matrix<T, N> & A)
+  {
+    return internal::CholeskyStep<T, N, 0>::Run(A);
+  }
+
+  /*!
+   * Solves A x = b in place given the output of CholeskyFactor.
+   */
+  template <class T, int N>
+  inline void CholeskySolve(const Matrix<T, N> & L,
+                            std::array<T, std::size_t(N)> & b)
+  {
+    for (int i = 0; i < N; ++i) {
+      T s = b[i];
+      for (int j = 0; j < i; ++j)
+        s -= L(i, j) * b[j];
+      b[i] = s / L(i, i);
+    }
+    for (int i = N - 1; i >= 0; --i) {
+      T s = b[i];
+      for (int j = i + 1; j < N; ++j)
+        s -= L(j, i) * b[j];
+      b[i] = s / L(i, i);
+    }
+  }
+
+  /*!
+   * In place Householder QR factorization A = QR, R >= C.
+   *
+   * \param[in,out] A Matrix, replaced by R (on and above the diagonal) and
+   *                the Householder vectors (below the diagonal, with an
+   *                implicit unit leading entry).
+   * \param[out] tau Householder coefficients.
+   */
+  template <class T, int R, int C>
+  inline void QRFactor(Matrix<T, R, C> & A,
+                       std::array<T, std::size_t(C)> & tau)
+  {
+    static_assert(R >= C, "QRFactor needs at least as many rows as columns");
+    internal::QRStep<T, R, C, 0>::Run(A, tau);
+  }
+
+  /*!
+   * Least squares solution of A x = b given the output of QRFactor.
+   *
+   * \param[in] QR Factorization computed by QRFactor.
+   * \param[in] tau Householder coefficients computed by QRFactor.
+   * \param[in,out] b Right hand side; on return its first C entries hold
+   *                the solution and the rest the residual in the Q basis.
+   */
+  template <class T, int R, int C>
+  inline void QRSolve(const Matrix<T, R, C> & QR,
+                      const std::array<T, std::size_t(C)> & tau,
+                      std::array<T, std::size_t(R)> & b)
+  {
+    for (int k = 0; k < C; ++k) {
+      T s = b[k];
+      for (int i = k + 1; i < R; ++i)
+        s += QR(i, k) * b[i];
+      s *= tau[k];
+      b[k] -= s;
+      for (int i = k + 1; i < R; ++i)
+        b[i] -= s * QR(i, k);
+    }
+    for (int i = C - 1; i >= 0; --i) {
+      T s = b[i];
+      for (int j = i + 1; j < C; ++j)
+        s -= QR(i, j) * b[j];
+      b[i] = s / QR(i, i);
+    }
+  }
+}
+#endif
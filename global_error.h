@@ -0,0 +1,160 @@
+/*! \file global_error.h
+ *  \brief Global error estimation for adaptive integrations.
+ *
+ *  Step size control only bounds the local error of every step; how the
+ *  local errors accumulate into the global error depends on the model.
+ *  For a tolerance proportional integrator the global error is close to
+ *  C tol^alpha with alpha near one, so solving twice, at tol and tol / q,
+ *  gives the estimate
+ *
+ *      e(tol) = |x(tol) - x(tol / q)| / (1 - q^-alpha)
+ *
+ *  at the price of one extra, more accurate solve.  Given the estimate,
+ *  the loosest tolerance that meets a target error follows from the same
+ *  model, so tolerances need not be chosen by trial and error.  alpha is
+ *  assumed to be one unless a third solve is requested to measure it.
+ */
+
+#ifndef __GLOBAL_ERROR_H__
+#define __GLOBAL_ERROR_H__
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "integrators.h"
+
+namespace dynamics {
+  /*! \struct GlobalErrorOptions
+   *  \brief Parameters of EstimateGlobalError.
+   */
+  struct GlobalErrorOptions {
+    GlobalErrorOptions() : ratio(10.0), exponent(1.0) {}
+
+    //! Tolerances and step size limits of the solve being assessed.
+    AdaptiveOptions integration;
+    //! Factor q by which the reference solve tightens both tolerances.
+    double ratio;
+    /*!
+     * Assumed exponent alpha of the global error in the tolerance; zero or
+     * less measures it with a third solve at tolerances tightened by q^2.
+     */
+    double exponent;
+  };
+
+  /*! \struct GlobalErrorReport
+   *  \brief Result of EstimateGlobalError.
+   */
+  template <class T>
+  struct GlobalErrorReport {
+    //! Relative tolerance of the assessed solve.
+    double rtol;
+    //! Estimated global error (max norm) of the assessed solve at t1.
+    T error;
+    //! Estimated global error of the reference solve at t1.
+    T reference_error;
+    //! Exponent alpha used, assumed or measured.
+    double exponent;
+    //! Work of the assessed solve.
+    AdaptiveReport work;
+    //! Work of the reference solve (and of the third solve, if any).
+    AdaptiveReport reference_work;
+  };
+
+  namespace internal {
+    template <class State>
+    typename State::value_type MaxDifference(const State & a,
+                                             const State & b)
+    {
+      typename State::value_type d(0);
+      for (std::size_t i = 0; i < a.size(); ++i)
+        d = std::max(d, std::fabs(a[i] - b[i]));
+      return d;
+    }
+
+    inline void AddWork(AdaptiveReport & total, const AdaptiveReport & work)
+    {
+      total.accepted += work.accepted;
+      total.rejected += work.rejected;
+      total.rhs_evaluations += work.rhs_evaluations;
+      total.success = total.success && work.success;
+    }
+  }
+
+  /*!
+   * Integrates from t0 to t1 at the given tolerances and at tolerances
+   * tightened by options.ratio, and estimates the global error of both.
+   *
+   * \param[in] stepper Adaptive stepper, e.g. DormandPrince54.
+   * \param[in] f System, called as f(t, x, rhs).
+   * \param[in] t0 Initial value of the independent variable.
+   * \param[in] t1 Final value of the independent variable.
+   * \param[in,out] x Initial state, replaced by the final state of the
+   *                reference (most accurate) solve.
+   * \param[in] options Parameters.
+   */
+  template <class Stepper, class System, class I, class State>
+  GlobalErrorReport<typename State::value_type>
+  EstimateGlobalError(Stepper & stepper, System & f, I t0, I t1, State & x,
+                      const GlobalErrorOptions & options
+                        = GlobalErrorOptions())
+  {
+    typedef typename State::value_type T;
+    GlobalErrorReport<T> report;
+    report.rtol = options.integration.rtol;
+    const double q = options.ratio;
+    AdaptiveOptions tight(options.integration);
+    State coarse(x);
+    report.work = IntegrateAdaptive(stepper, f, t0, t1, coarse,
+                                    options.integration);
+    tight.rtol /= q;
+    tight.atol /= q;
+    tight.initial_step = 0.0;
+    State fine(x);
+    report.reference_work = IntegrateAdaptive(stepper, f, t0, t1, fine,
+                                              tight);
+    T difference = internal::MaxDifference(coarse, fine);
+
+    report.exponent = options.exponent;
+    if (report.exponent <= 0.0) {
+      tight.rtol /= q;
+      tight.atol /= q;
+      State finest(x);
+      internal::AddWork(report.reference_work,
+                        IntegrateAdaptive(stepper, f, t0, t1, finest,
+                                          tight));
+      T next = internal::MaxDifference(fine, finest);
+      // |x(tol) - x(tol/q)| / |x(tol/q) - x(tol/q^2)| = q^alpha, clamped
+      // to a plausible range in case of cancellation.
+      report.exponent = next > T(0) && difference > T(0)
+        ? std::log(double(difference / next)) / std::log(q) : 1.0;
+      report.exponent = std::min(2.0, std::max(0.25, report.exponent));
+      fine.swap(finest);
+    }
+    const double reduction = std::pow(q, -report.exponent);
+    report.error = difference / T(1.0 - reduction);
+    report.reference_error = report.error * T(reduction);
+    if (options.exponent <= 0.0)
+      report.reference_error *= T(reduction);
+    x.swap(fine);
+    return report;
+  }
+
+  /*!
+   * Loosest relative tolerance predicted to meet a global error target,
+   * from the error model of a previous estimate.  Absolute tolerances
+   * should be scaled by the same factor.
+   *
+   * \param[in] report Result of EstimateGlobalError.
+   * \param[in] target Desired global error (max norm) at t1.
+   */
+  template <class T>
+  double ToleranceForError(const GlobalErrorReport<T> & report,
+                           const T & target)
+  {
+    if (!(report.error > T(0)))
+      return report.rtol;
+    return report.rtol * std::pow(double(target / report.error),
+                                  1.0 / report.exponent);
+  }
+}
+#endif
@@ -0,0 +1,577 @@
+/*! \file integrators.h
+ *  \brief Time integration of the mapping classes.
+ *
+ *  Integrators do not talk to the mapping classes directly.  Instead, a
+ *  mapping is wrapped in a system, a small adapter with the uniform call
+ *  signature
+ *
+ *      f(t, x, rhs)
+ *
+ *  that supplies whatever else the mapping needs (exogenous inputs, the
+ *  independent variable).  Steppers are templated on the state type, so the
+ *  same stepper works for std::array states of the fixed size mappings and
+ *  std::vector states of the Dynamic ones.  Steppers own their stage storage
+ *  and only allocate when the state dimension grows, so stepping is
+ *  allocation free after the first step.
+ *
+ *  Fixed step steppers provide Step(f, t, h, x) and are driven by
+ *  Integrate.  Adaptive steppers (DormandPrince54) also estimate their
+ *  local error and are driven by IntegrateAdaptive, which controls the step
+ *  size to meet a tolerance and reports the work it took.
+ */
+
+#ifndef __INTEGRATORS_H__
+#define __INTEGRATORS_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "mappings.h"
+#include "metrics.h"
+#include "trace.h"
+
+namespace dynamics {
+  /*!
+   * Gives work storage the shape of a state.  This is a no-op for
+   * std::array states.
+   */
+  template <class T, std::size_t N>
+  inline void ResizeLike(std::array<T, N> &, const std::array<T, N> &) {}
+
+  template <class T>
+  inline void ResizeLike(std::vector<T> & work, const std::vector<T> & x)
+  {
+    work.resize(x.size());
+  }
+
+  /*! \class AutonomousEndogenousSystem
+   *  \brief System adapter for MappingAutonomousEndogenous.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space, or Dynamic.
+   */
+  template <class T, int N>
+  class AutonomousEndogenousSystem {
+    public:
+      typedef MappingAutonomousEndogenous<T, N> Mapping;
+      typedef typename Mapping::State State;
+
+      explicit AutonomousEndogenousSystem(Mapping & f) : _f(f) {}
+
+      template <class I>
+      void operator()(const I &, const State & x, State & rhs)
+      {
+        _f.ComputeRHS(x, rhs);
+      }
+
+      Mapping & GetMapping() { return _f; }
+
+    private:
+      Mapping & _f;
+  };
+
+  /*! \class AutonomousExogenousSystem
+   *  \brief System adapter for MappingAutonomousExogenous.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of exogenous inputs.
+   *
+   *  The exogenous inputs are held constant (zero-order hold) until changed
+   *  through Input().
+   */
+  template <class T, int N, int M>
+  class AutonomousExogenousSystem {
+    public:
+      typedef MappingAutonomousExogenous<T, N, M> Mapping;
+      typedef typename Mapping::State State;
+
+      AutonomousExogenousSystem(Mapping & f, const std::array<T, M> & u)
+        : _f(f), _u(u) {}
+
+      template <class I>
+      void operator()(const I &, const State & x, State & rhs)
+      {
+        _f.ComputeRHS(x, _u, rhs);
+      }
+
+      //! Exogenous inputs applied from now on.
+      std::array<T, M> & Input() { return _u; }
+
+      Mapping & GetMapping() { return _f; }
+
+    private:
+      Mapping & _f;
+      std::array<T, M> _u;
+  };
+
+  /*! \class NonAutonomousEndogenousSystem
+   *  \brief System adapter for MappingNonAutonomousEndogenous.
+   *  \tparam I Data type of independent variable.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   */
+  template <class I, class T, int N>
+  class NonAutonomousEndogenousSystem {
+    public:
+      typedef MappingNonAutonomousEndogenous<I, T, N> Mapping;
+      typedef typename Mapping::State State;
+
+      explicit NonAutonomousEndogenousSystem(Mapping & f) : _f(f) {}
+
+      void operator()(const I & t, const State & x, State & rhs)
+      {
+        _f.ComputeRHS(t, x, rhs);
+      }
+
+      Mapping & GetMapping() { return _f; }
+
+    private:
+      Mapping & _f;
+  };
+
+  /*! \class NonAutonomousExogenousSystem
+   *  \brief System adapter for MappingNonAutonomousExogenous.
+   *  \tparam I Data type of independent variable.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of exogenous inputs.
+   *  \tparam Input Input signal, called as input(t, u) to fill the
+   *          exogenous inputs u at t.
+   */
+  template <class I, class T, int N, int M, class Input>
+  class NonAutonomousExogenousSystem {
+    public:
+      typedef MappingNonAutonomousExogenous<I, T, N, M> Mapping;
+      typedef typename Mapping::State State;
+
+      NonAutonomousExogenousSystem(Mapping & f, Input input)
+        : _f(f), _input(input) {}
+
+      void operator()(const I & t, const State & x, State & rhs)
+      {
+        _input(t, _u);
+        _f.ComputeRHS(t, x, _u, rhs);
+      }
+
+      Mapping & GetMapping() { return _f; }
+
+    private:
+      Mapping & _f;
+      Input _input;
+      std::array<T, M> _u;
+  };
+
+  //! Wraps a mapping in its system adapter.
+  template <class T, int N>
+  AutonomousEndogenousSystem<T, N>
+  MakeSystem(MappingAutonomousEndogenous<T, N> & f)
+  {
+    return AutonomousEndogenousSystem<T, N>(f);
+  }
+
+  //! Wraps a mapping in its system adapter.
+  template <class T, int N, int M>
+  AutonomousExogenousSystem<T, N, M>
+  MakeSystem(MappingAutonomousExogenous<T, N, M> & f,
+             const std::array<T, std::size_t(M)> & u)
+  {
+    return AutonomousExogenousSystem<T, N, M>(f, u);
+  }
+
+  //! Wraps a mapping in its system adapter.
+  template <class I, class T, int N>
+  NonAutonomousEndogenousSystem<I, T, N>
+  MakeSystem(MappingNonAutonomousEndogenous<I, T, N> & f)
+  {
+    return NonAutonomousEndogenousSystem<I, T, N>(f);
+  }
+
+  //! Wraps a mapping in its system adapter.
+  template <class I, class T, int N, int M, class Input>
+  NonAutonomousExogenousSystem<I, T, N, M, Input>
+  MakeSystem(MappingNonAutonomousExogenous<I, T, N, M> & f, Input input)
+  {
+    return NonAutonomousExogenousSystem<I, T, N, M, Input>(f, input);
+  }
+
+  /*! \class Euler
+   *  \brief The explicit (forward) Euler method.
+   *  \tparam State State type (std::array or std::vector).
+   *
+   *  Applied to an AutonomousExogenousSystem whose input is set to dW/h
+   *  before every step, this is the Euler-Maruyama method for stochastic
+   *  differential equations dx = a(x) dt + b(x) dW, provided the mapping is
+   *  affine in its inputs, f(x, u) = a(x) + b(x) u.
+   */
+  template <class State>
+  class Euler {
+    public:
+      /*!
+       * Advances x from t to t + h.
+       *
+       * \param[in] f System, called as f(t, x, rhs).
+       * \param[in] t Current value of the independent variable.
+       * \param[in] h Step size.
+       * \param[in,out] x State at t, replaced by the state at t + h.
+       */
+      template <class System, class I>
+      void Step(System & f, const I & t, const I & h, State & x)
+      {
+        ResizeLike(_k, x);
+        f(t, x, _k);
+        for (std::size_t i = 0; i < x.size(); ++i)
+          x[i] += h * _k[i];
+      }
+
+    private:
+      State _k;
+  };
+
+  /*! \class RungeKutta4
+   *  \brief The classical fixed step, fourth order Runge-Kutta method.
+   *  \tparam State State type (std::array or std::vector).
+   */
+  template <class State>
+  class RungeKutta4 {
+    public:
+      /*!
+       * Advances x from t to t + h.
+       *
+       * \param[in] f System, called as f(t, x, rhs).
+       * \param[in] t Current value of the independent variable.
+       * \param[in] h Step size.
+       * \param[in,out] x State at t, replaced by the state at t + h.
+       */
+      template <class System, class I>
+      void Step(System & f, const I & t, const I & h, State & x)
+      {
+        ResizeLike(_k1, x);
+        ResizeLike(_k2, x);
+        ResizeLike(_k3, x);
+        ResizeLike(_k4, x);
+        ResizeLike(_y, x);
+        const std::size_t n = x.size();
+        const I half = h / 2;
+        f(t, x, _k1);
+        for (std::size_t i = 0; i < n; ++i)
+          _y[i] = x[i] + half * _k1[i];
+        f(t + half, _y, _k2);
+        for (std::size_t i = 0; i < n; ++i)
+          _y[i] = x[i] + half * _k2[i];
+        f(t + half, _y, _k3);
+        for (std::size_t i = 0; i < n; ++i)
+          _y[i] = x[i] + h * _k3[i];
+        f(t + h, _y, _k4);
+        for (std::size_t i = 0; i < n; ++i)
+          x[i] += h / 6 * (_k1[i] + 2 * (_k2[i] + _k3[i]) + _k4[i]);
+      }
+
+    private:
+      State _k1, _k2, _k3, _k4, _y;
+  };
+
+  /*!
+   * Integrates with a fixed step size, calling observe(t, x) at the initial
+   * point and after every step.
+   *
+   * \param[in] stepper Stepper, e.g. RungeKutta4.
+   * \param[in] f System, called as f(t, x, rhs).
+   * \param[in] t0 Initial value of the independent variable.
+   * \param[in] h Step size.
+   * \param[in] steps Number of steps.
+   * \param[in,out] x Initial state, replaced by the final state.
+   * \param[in] observe Observer, called as observe(t, x); passed by
+   *            reference so that stateful observers keep what they saw.
+   */
+  template <class Stepper, class System, class I, class State,
+            class Observer>
+  void Integrate(Stepper & stepper, System & f, I t0, I h, std::size_t steps,
+                 State & x, Observer && observe)
+  {
+    observe(t0, static_cast<const State &>(x));
+    for (std::size_t k = 0; k < steps; ++k) {
+      I t = t0 + h * I(k);
+      DYNAMICS_TRACE_SPAN("step");
+      stepper.Step(f, t, h, x);
+      observe(t0 + h * I(k + 1), static_cast<const State &>(x));
+    }
+  }
+  /*! \struct AdaptiveOptions
+   *  \brief Error tolerances and step size limits of IntegrateAdaptive.
+   */
+  struct AdaptiveOptions {
+    AdaptiveOptions()
+      : rtol(1e-6), atol(1e-9), initial_step(0.0),
+        max_step(std::numeric_limits<double>::infinity()),
+        max_steps(1000000), metrics(0) {}
+
+    //! Relative tolerance of the local error.
+    double rtol;
+    //! Absolute tolerance of the local error.
+    double atol;
+    //! First step size tried; 0 selects one from the initial slope.
+    double initial_step;
+    //! Largest step size.
+    double max_step;
+    //! Largest number of step attempts.
+    std::size_t max_steps;
+    //! Metrics to update, if not null.
+    SolverMetrics * metrics;
+  };
+
+  /*! \struct AdaptiveReport
+   *  \brief Work done by IntegrateAdaptive.
+   */
+  struct AdaptiveReport {
+    AdaptiveReport()
+      : accepted(0), rejected(0), rhs_evaluations(0), success(false) {}
+
+    std::size_t accepted;
+    std::size_t rejected;
+    std::size_t rhs_evaluations;
+    //! Whether the final time was reached within max_steps.
+    bool success;
+  };
+
+  /*! \class DormandPrince54
+   *  \brief The Dormand-Prince 5(4) embedded Runge-Kutta pair.
+   *  \tparam State State type (std::array or std::vector).
+   *
+   *  The fifth order solution is propagated and the difference to the
+   *  embedded fourth order one estimates the local error.  The last stage
+   *  of a step is the first stage of the next (first same as last), so an
+   *  accepted step costs six right hand side evaluations.
+   */
+  template <class State>
+  class DormandPrince54 {
+    public:
+      typedef typename State::value_type T;
+
+      DormandPrince54() : _stiffness(0), _fresh(false), _evaluations(0) {}
+
+      static int Order() { return 5; }
+
+      /*!
+       * Attempts a step from t to t + h without changing x.
+       *
+       * \param[in] f System, called as f(t, x, rhs).
+       * \param[in] t Current value of the independent variable.
+       * \param[in] h Step size.
+       * \param[in] x State at t.
+       * \param[out] y Fifth order state at t + h.
+       * \param[in] rtol Relative tolerance.
+       * \param[in] atol Absolute tolerance.
+       * \return Root mean square of the local error estimate scaled by
+       *         atol + rtol max(|x|, |y|); the step meets the tolerance if
+       *         this is at most one.
+       */
+      template <class System, class I>
+      T Attempt(System & f, const I & t, const I & h, const State & x,
+                State & y, double rtol, double atol)
+      {
+        ResizeLike(_k2, x);
+        ResizeLike(_k3, x);
+        ResizeLike(_k4, x);
+        ResizeLike(_k5, x);
+        ResizeLike(_k6, x);
+        ResizeLike(_k7, x);
+        ResizeLike(_stage, x);
+        ResizeLike(y, x);
+        const std::size_t n = x.size();
+        if (!_fresh) {
+          ResizeLike(_k1, x);
+          f(t, x, _k1);
+          ++_evaluations;
+          _fresh = true;
+        }
+        for (std::size_t i = 0; i < n; ++i)
+          _stage[i] = x[i] + h * (T(1) / 5 * _k1[i]);
+        f(t + h / 5, _stage, _k2);
+        for (std::size_t i = 0; i < n; ++i)
+          _stage[i] = x[i] + h * (T(3) / 40 * _k1[i] + T(9) / 40 * _k2[i]);
+        f(t + 3 * h / 10, _stage, _k3);
+        for (std::size_t i = 0; i < n; ++i)
+          _stage[i] = x[i] + h * (T(44) / 45 * _k1[i] - T(56) / 15 * _k2[i]
+                                  + T(32) / 9 * _k3[i]);
+        f(t + 4 * h / 5, _stage, _k4);
+        for (std::size_t i = 0; i < n; ++i)
+          _stage[i] = x[i] + h * (T(19372) / 6561 * _k1[i]
+                                  - T(25360) / 2187 * _k2[i]
+                                  + T(64448) / 6561 * _k3[i]
+                                  - T(212) / 729 * _k4[i]);
+        f(t + 8 * h / 9, _stage, _k5);
+        for (std::size_t i = 0; i < n; ++i)
+          _stage[i] = x[i] + h * (T(9017) / 3168 * _k1[i]
+                                  - T(355) / 33 * _k2[i]
+                                  + T(46732) / 5247 * _k3[i]
+                                  + T(49) / 176 * _k4[i]
+                                  - T(5103) / 18656 * _k5[i]);
+        f(t + h, _stage, _k6);
+        for (std::size_t i = 0; i < n; ++i)
+          y[i] = x[i] + h * (T(35) / 384 * _k1[i] + T(500) / 1113 * _k3[i]
+                             + T(125) / 192 * _k4[i]
+                             - T(2187) / 6784 * _k5[i]
+                             + T(11) / 84 * _k6[i]);
+        f(t + h, y, _k7);
+        _evaluations += 6;
+
+        // Stages 6 and 7 are both evaluated at t + h, so their difference
+        // quotient estimates the dominant eigenvalue of the Jacobian
+        // (Hairer and Wanner, Section IV.2).
+        T dk(0), dx(0);
+        for (std::size_t i = 0; i < n; ++i) {
+          dk += (_k7[i] - _k6[i]) * (_k7[i] - _k6[i]);
+          dx += (y[i] - _stage[i]) * (y[i] - _stage[i]);
+        }
+        _stiffness = dx > T(0) ? T(std::fabs(h)) * std::sqrt(dk / dx) : T(0);
+
+        T sum(0);
+        for (std::size_t i = 0; i < n; ++i) {
+          T e = h * (T(71) / 57600 * _k1[i] - T(71) / 16695 * _k3[i]
+                     + T(71) / 1920 * _k4[i] - T(17253) / 339200 * _k5[i]
+                     + T(22) / 525 * _k6[i] - T(1) / 40 * _k7[i]);
+          T scale = T(atol) + T(rtol) * std::max(std::fabs(x[i]),
+                                                 std::fabs(y[i]));
+          sum += (e / scale) * (e / scale);
+        }
+        return std::sqrt(sum / T(n));
+      }
+
+      //! Accepts the last attempt; its last stage becomes the next first.
+      void Accept() { _k1.swap(_k7); }
+
+      //! Forgets the cached first stage, e.g. after x was changed.
+      void Reset() { _fresh = false; }
+
+      //! Number of right hand side evaluations so far.
+      std::size_t Evaluations() const { return _evaluations; }
+
+      /*!
+       * h times the magnitude of the dominant eigenvalue of the Jacobian,
+       * estimated during the last attempt.  Above about 3.3 the step size
+       * is limited by the stability of the method rather than by accuracy,
+       * i.e. the problem is stiff.
+       */
+      T Stiffness() const { return _stiffness; }
+
+    protected:
+      State _k1, _k2, _k3, _k4, _k5, _k6, _k7, _stage;
+      T _stiffness;
+      bool _fresh;
+      std::size_t _evaluations;
+  };
+
+  /*!
+   * Initial step size over which the initial slope changes x by about 1%
+   * in the norm of the tolerances (Hairer, Norsett and Wanner, Section
+   * II.4, without the second derivative estimate).  Costs one right hand
+   * side evaluation.
+   */
+  template <class System, class I, class State>
+  I InitialStepSize(System & f, const I & t0, const State & x,
+                    const AdaptiveOptions & options)
+  {
+    typedef typename State::value_type T;
+    State slope;
+    ResizeLike(slope, x);
+    f(t0, x, slope);
+    T d0(0), d1(0);
+    for (std::size_t i = 0; i < x.size(); ++i) {
+      T scale = T(options.atol) + T(options.rtol) * std::fabs(x[i]);
+      d0 += (x[i] / scale) * (x[i] / scale);
+      d1 += (slope[i] / scale) * (slope[i] / scale);
+    }
+    return d0 < T(1e-10) || d1 < T(1e-10) ? I(1e-6)
+      : I(0.01 * std::sqrt(d0 / d1));
+  }
+
+  /*!
+   * Integrates from t0 to t1 with an adaptive stepper, choosing step sizes
+   * so that every step meets the local error tolerance, and calls
+   * observe(t, x) at the initial point and after every accepted step.
+   *
+   * \param[in] stepper Adaptive stepper, e.g. DormandPrince54.
+   * \param[in] f System, called as f(t, x, rhs).
+   * \param[in] t0 Initial value of the independent variable.
+   * \param[in] t1 Final value of the independent variable.
+   * \param[in,out] x Initial state, replaced by the final state.
+   * \param[in] options Tolerances and step size limits.
+   * \param[in] observe Observer, called as observe(t, x).
+   * \return Step counts and right hand side evaluations.
+   */
+  template <class Stepper, class System, class I, class State,
+            class Observer>
+  AdaptiveReport IntegrateAdaptive(Stepper & stepper, System & f, I t0,
+                                   I t1, State & x,
+                                   const AdaptiveOptions & options,
+                                   Observer && observe)
+  {
+    typedef typename State::value_type T;
+    AdaptiveReport report;
+    const std::size_t evaluations = stepper.Evaluations();
+    const T exponent = T(-1) / T(stepper.Order());
+    State y;
+    ResizeLike(y, x);
+    stepper.Reset();
+    observe(t0, static_cast<const State &>(x));
+
+    I h = I(options.initial_step);
+    if (h == I(0)) {
+      h = InitialStepSize(f, t0, x, options);
+      ++report.rhs_evaluations;
+    }
+    I t = t0;
+    while (t < t1) {
+      if (report.accepted + report.rejected == options.max_steps)
+        break;
+      h = std::min(h, I(options.max_step));
+      const bool last = t + h >= t1;
+      if (last)
+        h = t1 - t;
+      DYNAMICS_TRACE_SPAN("step");
+      T error = stepper.Attempt(f, t, h, x, y, options.rtol, options.atol);
+      // Step size controller with safety factor 0.9, limited to a change
+      // by a factor in [0.2, 5].
+      T factor = error > T(0) ? T(0.9) * std::pow(error, exponent) : T(5);
+      factor = std::min(T(5), std::max(T(0.2), factor));
+      if (error <= T(1)) {
+        ++report.accepted;
+        if (options.metrics) {
+          options.metrics->steps.Add();
+          options.metrics->step_size.Observe(double(h));
+        }
+        stepper.Accept();
+        t = last ? t1 : t + h;
+        x.swap(y);
+        observe(t, static_cast<const State &>(x));
+      } else {
+        ++report.rejected;
+        if (options.metrics)
+          options.metrics->rejected_steps.Add();
+        factor = std::min(factor, T(1));
+      }
+      h = h * I(factor);
+    }
+    report.success = !(t < t1);
+    report.rhs_evaluations += stepper.Evaluations() - evaluations;
+    if (options.metrics)
+      options.metrics->rhs_evaluations.Add(report.rhs_evaluations);
+    return report;
+  }
+
+  /*!
+   * Integrates from t0 to t1 with an adaptive stepper.
+   */
+  template <class Stepper, class System, class I, class State>
+  AdaptiveReport IntegrateAdaptive(Stepper & stepper, System & f, I t0,
+                                   I t1, State & x,
+                                   const AdaptiveOptions & options
+                                     = AdaptiveOptions())
+  {
+    return IntegrateAdaptive(stepper, f, t0, t1, x, options,
+                             [](const I &, const State &) {});
+  }
+}
+#endif
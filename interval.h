@@ -0,0 +1,287 @@
+/*! \file interval.h
+ *  \brief Interval arithmetic.
+ *
+ *  An Interval encloses every value a quantity may take; arithmetic and
+ *  elementary functions return intervals that enclose all results for
+ *  arguments in their operands.  Bounds are rounded outward by one unit in
+ *  the last place after every operation, which keeps enclosures rigorous
+ *  without changing the floating point rounding mode.
+ *
+ *  Since the functions are found by argument dependent lookup, mappings
+ *  written as templates over their scalar (with "using std::sin;") can be
+ *  evaluated over boxes of states, and Dual<Interval<T>, K> (see
+ *  autodiff.h) encloses their Jacobians over boxes.
+ */
+
+#ifndef __INTERVAL_H__
+#define __INTERVAL_H__
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+
+namespace dynamics {
+  /*! \class Interval
+   *  \brief A closed interval [lower, upper].
+   *  \tparam T Data type of the bounds (typically double).
+   */
+  template <class T>
+  class Interval {
+    public:
+      //! The point zero.
+      Interval() : _lower(0), _upper(0) {}
+
+      //! A point; implicit so that constants mix with intervals.
+      Interval(const T & value) : _lower(value), _upper(value) {}
+
+      Interval(const T & lower, const T & upper)
+        : _lower(lower), _upper(upper)
+      {
+        if (!(lower <= upper))
+          throw std::invalid_argument("Interval: lower bound above upper");
+      }
+
+      const T & Lower() const { return _lower; }
+      const T & Upper() const { return _upper; }
+      T Mid() const { return T(0.5) * (_lower + _upper); }
+      T Radius() const { return Up(T(0.5) * (_upper - _lower)); }
+      T Width() const { return Up(_upper - _lower); }
+
+      bool Contains(const T & x) const { return _lower <= x && x <= _upper; }
+
+      //! True if this interval lies within b.
+      bool Within(const Interval & b) const
+      {
+        return b._lower <= _lower && _upper <= b._upper;
+      }
+
+      Interval & operator+=(const Interval & b)
+      {
+        _lower = Down(_lower + b._lower);
+        _upper = Up(_upper + b._upper);
+        return *this;
+      }
+
+      Interval & operator-=(const Interval & b)
+      {
+        const T lower = Down(_lower - b._upper);
+        _upper = Up(_upper - b._lower);
+        _lower = lower;
+        return *this;
+      }
+
+      Interval & operator*=(const Interval & b)
+      {
+        const T p[4] = {_lower * b._lower, _lower * b._upper,
+                        _upper * b._lower, _upper * b._upper};
+        _lower = Down(*std::min_element(p, p + 4));
+        _upper = Up(*std::max_element(p, p + 4));
+        return *this;
+      }
+
+      Interval & operator/=(const Interval & b)
+      {
+        if (b._lower <= T(0) && b._upper >= T(0)) {
+          _lower = -std::numeric_limits<T>::infinity();
+          _upper = std::numeric_limits<T>::infinity();
+          return *this;
+        }
+        const T p[4] = {_lower / b._lower, _lower / b._upper,
+                        _upper / b._lower, _upper / b._upper};
+        _lower = Down(*std::min_element(p, p + 4));
+        _upper = Up(*std::max_element(p, p + 4));
+        return *this;
+      }
+
+      friend Interval operator-(const Interval & a)
+      {
+        return Interval(-a._upper, -a._lower);
+      }
+      friend Interval operator+(const Interval & a) { return a; }
+
+      friend Interval operator+(Interval a, const Interval & b)
+      {
+        return a += b;
+      }
+      friend Interval operator-(Interval a, const Interval & b)
+      {
+        return a -= b;
+      }
+      friend Interval operator*(Interval a, const Interval & b)
+      {
+        return a *= b;
+      }
+      friend Interval operator/(Interval a, const Interval & b)
+      {
+        return a /= b;
+      }
+
+      // Order comparisons hold if they hold for all members.
+      friend bool operator<(const Interval & a, const Interval & b)
+      {
+        return a._upper < b._lower;
+      }
+      friend bool operator>(const Interval & a, const Interval & b)
+      {
+        return a._lower > b._upper;
+      }
+      friend bool operator<=(const Interval & a, const Interval & b)
+      {
+        return a._upper <= b._lower;
+      }
+      friend bool operator>=(const Interval & a, const Interval & b)
+      {
+        return a._lower >= b._upper;
+      }
+      friend bool operator==(const Interval & a, const Interval & b)
+      {
+        return a._lower == b._lower && a._upper == b._upper;
+      }
+      friend bool operator!=(const Interval & a, const Interval & b)
+      {
+        return !(a == b);
+      }
+
+      //! Smallest interval containing a and b.
+      friend Interval Hull(const Interval & a, const Interval & b)
+      {
+        return Interval(std::min(a._lower, b._lower),
+                        std::max(a._upper, b._upper));
+      }
+
+      friend std::ostream & operator<<(std::ostream & out,
+                                       const Interval & a)
+      {
+        return out << "[" << a._lower << ", " << a._upper << "]";
+      }
+
+      //! Next representable number towards minus infinity.
+      static T Down(const T & x)
+      {
+        return std::nextafter(x, -std::numeric_limits<T>::infinity());
+      }
+
+      //! Next representable number towards plus infinity.
+      static T Up(const T & x)
+      {
+        return std::nextafter(x, std::numeric_limits<T>::infinity());
+      }
+
+      //! Interval from bounds computed with rounding to nearest.
+      static Interval Outward(const T & lower, const T & upper)
+      {
+        return Interval(Down(lower), Up(upper));
+      }
+
+    private:
+      T _lower, _upper;
+  };
+
+  namespace internal {
+    // Range of a function of period 2 pi with maxima at peak + 2 k pi and
+    // minima at peak + pi + 2 k pi, given its values at the ends.  The
+    // extremum tests are widened so that rounding never misses one.
+    template <class T>
+    Interval<T> PeriodicRange(const Interval<T> & a, T peak, T first,
+                              T last)
+    {
+      const T pi = T(3.14159265358979323846), period = 2 * pi;
+      if (!(a.Width() < period))
+        return Interval<T>(-1, 1);
+      T lower = std::min(first, last), upper = std::max(first, last);
+      const T slack = 4 * std::numeric_limits<T>::epsilon()
+        * (1 + std::fabs(a.Lower()) + std::fabs(a.Upper()));
+      const T top = std::ceil((a.Lower() - slack - peak) / period);
+      if (peak + top * period <= a.Upper() + slack)
+        upper = T(1);
+      const T bottom = std::ceil((a.Lower() - slack - peak - pi) / period);
+      if (peak + pi + bottom * period <= a.Upper() + slack)
+        lower = T(-1);
+      return Interval<T>(std::max(Interval<T>::Down(lower), T(-1)),
+                         std::min(Interval<T>::Up(upper), T(1)));
+    }
+  }
+
+  template <class T>
+  Interval<T> sin(const Interval<T> & a)
+  {
+    using std::sin;
+    return internal::PeriodicRange(a, T(3.14159265358979323846) / 2,
+                                   sin(a.Lower()), sin(a.Upper()));
+  }
+
+  template <class T>
+  Interval<T> cos(const Interval<T> & a)
+  {
+    using std::cos;
+    return internal::PeriodicRange(a, T(0), cos(a.Lower()),
+                                   cos(a.Upper()));
+  }
+
+  template <class T>
+  Interval<T> exp(const Interval<T> & a)
+  {
+    using std::exp;
+    return Interval<T>(std::max(Interval<T>::Down(exp(a.Lower())), T(0)),
+                       Interval<T>::Up(exp(a.Upper())));
+  }
+
+  template <class T>
+  Interval<T> log(const Interval<T> & a)
+  {
+    using std::log;
+    if (!(a.Lower() > T(0)))
+      throw std::domain_error("log: interval not positive");
+    return Interval<T>::Outward(log(a.Lower()), log(a.Upper()));
+  }
+
+  template <class T>
+  Interval<T> sqrt(const Interval<T> & a)
+  {
+    using std::sqrt;
+    if (a.Lower() < T(0))
+      throw std::domain_error("sqrt: interval not nonnegative");
+    return Interval<T>(std::max(Interval<T>::Down(sqrt(a.Lower())), T(0)),
+                       Interval<T>::Up(sqrt(a.Upper())));
+  }
+
+  template <class T>
+  Interval<T> tanh(const Interval<T> & a)
+  {
+    using std::tanh;
+    return Interval<T>(std::max(Interval<T>::Down(tanh(a.Lower())), T(-1)),
+                       std::min(Interval<T>::Up(tanh(a.Upper())), T(1)));
+  }
+
+  template <class T>
+  Interval<T> atan(const Interval<T> & a)
+  {
+    using std::atan;
+    return Interval<T>::Outward(atan(a.Lower()), atan(a.Upper()));
+  }
+
+  //! Power of a positive interval.
+  template <class T>
+  Interval<T> pow(const Interval<T> & a, const Interval<T> & p)
+  {
+    return exp(p * log(a));
+  }
+
+  template <class T>
+  Interval<T> fabs(const Interval<T> & a)
+  {
+    if (a.Lower() >= T(0))
+      return a;
+    if (a.Upper() <= T(0))
+      return -a;
+    return Interval<T>(T(0), std::max(-a.Lower(), a.Upper()));
+  }
+
+  template <class T>
+  Interval<T> abs(const Interval<T> & a)
+  {
+    return fabs(a);
+  }
+}
+#endif
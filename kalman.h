@@ -0,0 +1,381 @@
+/*! \file kalman.h
+ *  \brief Extended and unscented Kalman filters with mappings as process
+ *  models.
+ *
+ *  The filters predict by integrating a system (see integrators.h) over
+ *  the prediction interval with a fixed step stepper, so any mapping
+ *  wrapped in a system adapter serves as process model; exogenous inputs
+ *  are set through the adapter before Predict.  The extended filter
+ *  obtains the state transition matrix by propagating the state and N
+ *  perturbed copies, the unscented filter propagates 2 N + 1 sigma points.
+ *  Either way the states are propagated together as one batch, substep by
+ *  substep, so the stepper's work storage and the model stay in cache.
+ *
+ *  Measurements are functors h(x, y) that fill a std::array<T, P>; the
+ *  measurement dimension P is taken from the noise covariance passed to
+ *  Update.  All matrices have compile time sizes and are factored with the
+ *  Cholesky kernels of fixed_linalg.h, so predict and update cycles do not
+ *  allocate.
+ */
+
+#ifndef __KALMAN_H__
+#define __KALMAN_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+
+#include "fixed_linalg.h"
+#include "integrators.h"
+
+namespace dynamics {
+  /*! \struct KalmanOptions
+   *  \brief Parameters of ExtendedKalmanFilter and UnscentedKalmanFilter.
+   */
+  struct KalmanOptions {
+    KalmanOptions() : substeps(1), alpha(1.0), beta(2.0), kappa(0.0) {}
+
+    //! Steps of the stepper per prediction interval.
+    int substeps;
+    //! Spread of the sigma points (unscented filter only).
+    double alpha;
+    //! Prior knowledge of the distribution, 2 is optimal for Gaussians
+    //! (unscented filter only).
+    double beta;
+    //! Secondary scaling of the sigma points (unscented filter only).
+    double kappa;
+  };
+
+  namespace internal {
+    // Advances every state of the batch from t to t + dt.
+    template <class System, class Stepper, class T, class Batch>
+    void PropagateBatch(System & f, Stepper & stepper, T t, T dt,
+                        int substeps, Batch & x)
+    {
+      const T h = dt / T(substeps);
+      for (int s = 0; s < substeps; ++s)
+        for (std::size_t b = 0; b < x.size(); ++b)
+          stepper.Step(f, t + h * T(s), h, x[b]);
+    }
+
+    template <class T, int N>
+    void Symmetrize(Matrix<T, N> & P)
+    {
+      for (int i = 0; i < N; ++i)
+        for (int j = 0; j < i; ++j)
+          P(i, j) = P(j, i) = T(0.5) * (P(i, j) + P(j, i));
+    }
+
+    // Kalman update from the innovation covariance S, the cross
+    // covariance C = cov(x, y) and the innovation nu:
+    //   x += C S^-1 nu,  P -= C S^-1 C^T.
+    // Returns the normalized innovation squared nu^T S^-1 nu.
+    template <class T, int N, int P>
+    T KalmanGain(Matrix<T, P> & S, const Matrix<T, N, P> & C,
+                 std::array<T, std::size_t(P)> & nu,
+                 std::array<T, std::size_t(N)> & x, Matrix<T, N> & cov)
+    {
+      if (!CholeskyFactor(S))
+        throw std::runtime_error("Kalman filter: innovation covariance is "
+                                 "not positive definite");
+      std::array<T, std::size_t(P)> w(nu);
+      CholeskySolve(S, w);
+      T nis(0);
+      for (int k = 0; k < P; ++k)
+        nis += nu[k] * w[k];
+      Matrix<T, N, P> K;
+      for (int i = 0; i < N; ++i) {
+        std::array<T, std::size_t(P)> row;
+        for (int k = 0; k < P; ++k)
+          row[k] = C(i, k);
+        CholeskySolve(S, row);
+        for (int k = 0; k < P; ++k)
+          K(i, k) = row[k];
+        x[i] += internal::Dot<P, 1>(C.Row(i), w.data());
+      }
+      for (int i = 0; i < N; ++i)
+        for (int j = 0; j <= i; ++j) {
+          T s = internal::Dot<P, 1>(K.Row(i), C.Row(j));
+          cov(i, j) -= s;
+          if (j != i)
+            cov(j, i) -= s;
+        }
+      return nis;
+    }
+  }
+
+  /*! \class ExtendedKalmanFilter
+   *  \brief Extended Kalman filter with a finite difference linearization
+   *  of the propagated process model.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam System System adapter of the process model, e.g. an
+   *          AutonomousExogenousSystem.
+   *  \tparam Stepper Fixed step stepper, e.g. RungeKutta4.
+   */
+  template <class T, int N, class System,
+            class Stepper = RungeKutta4<std::array<T, std::size_t(N)> > >
+  class ExtendedKalmanFilter {
+    public:
+      typedef std::array<T, std::size_t(N)> State;
+
+      /*!
+       * \param[in] f Process model; the filter keeps a reference.
+       * \param[in] x0 Initial state estimate.
+       * \param[in] P0 Initial error covariance.
+       * \param[in] options Parameters.
+       */
+      ExtendedKalmanFilter(System & f, const State & x0,
+                           const Matrix<T, N> & P0,
+                           const KalmanOptions & options = KalmanOptions())
+        : _f(f), _x(x0), _P(P0), _options(options) {}
+
+      /*!
+       * Propagates the estimate from t to t + dt and adds the process
+       * noise covariance Q accumulated over the interval.
+       */
+      void Predict(T t, T dt, const Matrix<T, N> & Q)
+      {
+        // Column j of the state transition matrix from a forward
+        // difference of the propagation along e_j.
+        const T sqrt_eps = std::sqrt(std::numeric_limits<T>::epsilon());
+        std::array<T, std::size_t(N)> delta;
+        _batch[N] = _x;
+        for (int j = 0; j < N; ++j) {
+          delta[j] = sqrt_eps * std::max(T(1), std::fabs(_x[j]));
+          _batch[j] = _x;
+          _batch[j][j] += delta[j];
+        }
+        internal::PropagateBatch(_f, _stepper, t, dt, _options.substeps,
+                                 _batch);
+        _x = _batch[N];
+        Matrix<T, N> Phi, PhiP;
+        for (int i = 0; i < N; ++i)
+          for (int j = 0; j < N; ++j)
+            Phi(i, j) = (_batch[j][i] - _x[i]) / delta[j];
+        MatMul(Phi, _P, PhiP);
+        for (int i = 0; i < N; ++i)
+          for (int j = 0; j <= i; ++j)
+            _P(i, j) = _P(j, i) =
+              internal::Dot<N, 1>(PhiP.Row(i), Phi.Row(j)) + Q(i, j);
+      }
+
+      /*!
+       * Incorporates a measurement z = h(x) + v, v ~ N(0, R).
+       *
+       * \param[in] h Measurement function, called as h(x, y).
+       * \param[in] z Measurement.
+       * \param[in] R Measurement noise covariance.
+       * \return Normalized innovation squared, chi-square distributed with
+       *         P degrees of freedom for a consistent filter.
+       */
+      template <int P, class Measurement>
+      T Update(Measurement & h, const std::array<T, std::size_t(P)> & z,
+               const Matrix<T, P> & R)
+      {
+        const T sqrt_eps = std::sqrt(std::numeric_limits<T>::epsilon());
+        std::array<T, std::size_t(P)> y, yd, nu;
+        Matrix<T, P, N> H;
+        h(static_cast<const State &>(_x), y);
+        State xd(_x);
+        for (int j = 0; j < N; ++j) {
+          const T d = sqrt_eps * std::max(T(1), std::fabs(_x[j]));
+          xd[j] = _x[j] + d;
+          h(static_cast<const State &>(xd), yd);
+          xd[j] = _x[j];
+          for (int k = 0; k < P; ++k)
+            H(k, j) = (yd[k] - y[k]) / d;
+        }
+        // C = P H^T, S = H P H^T + R.
+        Matrix<T, N, P> C;
+        for (int i = 0; i < N; ++i)
+          for (int k = 0; k < P; ++k)
+            C(i, k) = internal::Dot<N, 1>(_P.Row(i), H.Row(k));
+        Matrix<T, P> S;
+        for (int k = 0; k < P; ++k) {
+          nu[k] = z[k] - y[k];
+          for (int l = 0; l < P; ++l) {
+            T s = R(k, l);
+            for (int i = 0; i < N; ++i)
+              s += H(k, i) * C(i, l);
+            S(k, l) = s;
+          }
+        }
+        T nis = internal::KalmanGain(S, C, nu, _x, _P);
+        internal::Symmetrize(_P);
+        return nis;
+      }
+
+      const State & Mean() const { return _x; }
+      const Matrix<T, N> & Covariance() const { return _P; }
+
+      //! Restarts the filter from a new estimate.
+      void Reset(const State & x0, const Matrix<T, N> & P0)
+      {
+        _x = x0;
+        _P = P0;
+      }
+
+    private:
+      System & _f;
+      Stepper _stepper;
+      State _x;
+      Matrix<T, N> _P;
+      KalmanOptions _options;
+      std::array<State, std::size_t(N + 1)> _batch;
+  };
+
+  /*! \class UnscentedKalmanFilter
+   *  \brief Unscented Kalman filter (scaled unscented transform with
+   *  2 N + 1 sigma points).
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam System System adapter of the process model, e.g. an
+   *          AutonomousExogenousSystem.
+   *  \tparam Stepper Fixed step stepper, e.g. RungeKutta4.
+   *
+   *  No derivatives are needed, and the mean and covariance are propagated
+   *  exactly to second order, which makes the filter more robust than the
+   *  extended one for strongly nonlinear models at about twice the cost.
+   */
+  template <class T, int N, class System,
+            class Stepper = RungeKutta4<std::array<T, std::size_t(N)> > >
+  class UnscentedKalmanFilter {
+    public:
+      typedef std::array<T, std::size_t(N)> State;
+
+      /*!
+       * \param[in] f Process model; the filter keeps a reference.
+       * \param[in] x0 Initial state estimate.
+       * \param[in] P0 Initial error covariance.
+       * \param[in] options Parameters.
+       */
+      UnscentedKalmanFilter(System & f, const State & x0,
+                            const Matrix<T, N> & P0,
+                            const KalmanOptions & options = KalmanOptions())
+        : _f(f), _x(x0), _P(P0), _options(options)
+      {
+        const T alpha = T(options.alpha);
+        const T lambda = alpha * alpha * (T(N) + T(options.kappa)) - T(N);
+        _scale = std::sqrt(T(N) + lambda);
+        _wm0 = lambda / (T(N) + lambda);
+        _wc0 = _wm0 + T(1) - alpha * alpha + T(options.beta);
+        _wi = T(1) / (T(2) * (T(N) + lambda));
+      }
+
+      /*!
+       * Propagates the sigma points from t to t + dt and adds the process
+       * noise covariance Q accumulated over the interval.
+       */
+      void Predict(T t, T dt, const Matrix<T, N> & Q)
+      {
+        DrawSigmaPoints();
+        internal::PropagateBatch(_f, _stepper, t, dt, _options.substeps,
+                                 _sigma);
+        WeightedMean(_sigma, _x);
+        for (int i = 0; i < N; ++i)
+          for (int j = 0; j <= i; ++j) {
+            T s = Q(i, j);
+            for (int b = 0; b < 2 * N + 1; ++b)
+              s += Weight(b) * (_sigma[b][i] - _x[i])
+                * (_sigma[b][j] - _x[j]);
+            _P(i, j) = _P(j, i) = s;
+          }
+      }
+
+      /*!
+       * Incorporates a measurement z = h(x) + v, v ~ N(0, R).
+       *
+       * \param[in] h Measurement function, called as h(x, y).
+       * \param[in] z Measurement.
+       * \param[in] R Measurement noise covariance.
+       * \return Normalized innovation squared.
+       */
+      template <int P, class Measurement>
+      T Update(Measurement & h, const std::array<T, std::size_t(P)> & z,
+               const Matrix<T, P> & R)
+      {
+        typedef std::array<T, std::size_t(P)> Output;
+        DrawSigmaPoints();
+        std::array<Output, std::size_t(2 * N + 1)> Y;
+        for (int b = 0; b < 2 * N + 1; ++b)
+          h(static_cast<const State &>(_sigma[b]), Y[b]);
+        Output y, nu;
+        WeightedMean(Y, y);
+        Matrix<T, P> S;
+        Matrix<T, N, P> C;
+        for (int k = 0; k < P; ++k) {
+          nu[k] = z[k] - y[k];
+          for (int l = 0; l < P; ++l) {
+            T s = R(k, l);
+            for (int b = 0; b < 2 * N + 1; ++b)
+              s += Weight(b) * (Y[b][k] - y[k]) * (Y[b][l] - y[l]);
+            S(k, l) = s;
+          }
+          for (int i = 0; i < N; ++i) {
+            T s(0);
+            for (int b = 0; b < 2 * N + 1; ++b)
+              s += Weight(b) * (_sigma[b][i] - _x[i]) * (Y[b][k] - y[k]);
+            C(i, k) = s;
+          }
+        }
+        T nis = internal::KalmanGain(S, C, nu, _x, _P);
+        internal::Symmetrize(_P);
+        return nis;
+      }
+
+      const State & Mean() const { return _x; }
+      const Matrix<T, N> & Covariance() const { return _P; }
+
+      //! Restarts the filter from a new estimate.
+      void Reset(const State & x0, const Matrix<T, N> & P0)
+      {
+        _x = x0;
+        _P = P0;
+      }
+
+    private:
+      // x and x +- sqrt(N + lambda) times the columns of chol(P).
+      void DrawSigmaPoints()
+      {
+        Matrix<T, N> L(_P);
+        if (!CholeskyFactor(L))
+          throw std::runtime_error("UnscentedKalmanFilter: covariance is "
+                                   "not positive definite");
+        _sigma[0] = _x;
+        for (int j = 0; j < N; ++j) {
+          _sigma[1 + j] = _x;
+          _sigma[1 + N + j] = _x;
+          for (int i = j; i < N; ++i) {
+            _sigma[1 + j][i] += _scale * L(i, j);
+            _sigma[1 + N + j][i] -= _scale * L(i, j);
+          }
+        }
+      }
+
+      // Covariance weight of sigma point b.
+      T Weight(int b) const { return b == 0 ? _wc0 : _wi; }
+
+      template <class Points, class Vector>
+      void WeightedMean(const Points & points, Vector & mean) const
+      {
+        for (std::size_t k = 0; k < mean.size(); ++k) {
+          T s = _wm0 * points[0][k];
+          for (int b = 1; b < 2 * N + 1; ++b)
+            s += _wi * points[b][k];
+          mean[k] = s;
+        }
+      }
+
+      System & _f;
+      Stepper _stepper;
+      State _x;
+      Matrix<T, N> _P;
+      KalmanOptions _options;
+      std::array<State, std::size_t(2 * N + 1)> _sigma;
+      T _scale, _wm0, _wc0, _wi;
+  };
+}
+#endif
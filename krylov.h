@@ -0,0 +1,215 @@
+/*! \file krylov.h
+ *  \brief Krylov subspace solvers for large linear systems.
+ *
+ *  The solvers only need the action v -> A v of the matrix, so they apply
+ *  to Jacobians of Dynamic mappings that are never formed: the product of
+ *  the Jacobian of f at x with v is approximated by the directional
+ *  difference (f(x + eps v) - f(x)) / eps, one right hand side evaluation
+ *  per Krylov iteration (Jacobian-free Newton-Krylov).
+ */
+
+#ifndef __KRYLOV_H__
+#define __KRYLOV_H__
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "mappings.h"
+
+namespace dynamics {
+  /*! \struct GmresOptions
+   *  \brief Parameters of Gmres.
+   */
+  struct GmresOptions {
+    GmresOptions() : restart(30), max_iterations(300), tolerance(1e-6) {}
+
+    //! Krylov subspace dimension before a restart.
+    int restart;
+    //! Largest total number of iterations (matrix vector products).
+    int max_iterations;
+    //! Convergence when |b - A x| <= tolerance |b|.
+    double tolerance;
+  };
+
+  /*! \struct KrylovResult
+   *  \brief Result of Gmres.
+   */
+  template <class T>
+  struct KrylovResult {
+    //! Relative residual |b - A x| / |b| at return.
+    T residual;
+    bool converged;
+    int iterations;
+  };
+
+  namespace internal {
+    template <class T>
+    T Dot(const std::vector<T> & a, const std::vector<T> & b)
+    {
+      T s(0);
+      for (std::size_t i = 0; i < a.size(); ++i)
+        s += a[i] * b[i];
+      return s;
+    }
+  }
+
+  /*!
+   * Solves A x = b by restarted GMRES (Saad and Schultz, 1986) with
+   * modified Gram-Schmidt orthogonalization and Givens rotations.
+   *
+   * \param[in] A Operator, called as A(v, Av).
+   * \param[in] b Right hand side.
+   * \param[in,out] x Initial guess, replaced by the solution.
+   * \param[in] options Parameters.
+   */
+  template <class T, class Operator>
+  KrylovResult<T> Gmres(Operator & A, const std::vector<T> & b,
+                        std::vector<T> & x,
+                        const GmresOptions & options = GmresOptions())
+  {
+    const std::size_t n = b.size();
+    const int m = options.restart;
+    if (m < 1)
+      throw std::invalid_argument("Gmres: restart must be positive");
+    KrylovResult<T> result;
+    result.converged = false;
+    result.iterations = 0;
+    x.resize(n, T(0));
+    const T norm_b = std::sqrt(internal::Dot(b, b));
+    if (norm_b == T(0)) {
+      x.assign(n, T(0));
+      result.residual = T(0);
+      result.converged = true;
+      return result;
+    }
+
+    std::vector<std::vector<T> > V(m + 1, std::vector<T>(n));
+    std::vector<T> H((m + 1) * m), cs(m), sn(m), g(m + 1), w(n), y(m);
+    for (;;) {
+      // r = b - A x starts the Krylov basis.
+      A(x, w);
+      for (std::size_t i = 0; i < n; ++i)
+        V[0][i] = b[i] - w[i];
+      T beta = std::sqrt(internal::Dot(V[0], V[0]));
+      result.residual = beta / norm_b;
+      if (result.residual <= T(options.tolerance)) {
+        result.converged = true;
+        return result;
+      }
+      if (result.iterations >= options.max_iterations)
+        return result;
+      for (std::size_t i = 0; i < n; ++i)
+        V[0][i] /= beta;
+      g.assign(m + 1, T(0));
+      g[0] = beta;
+
+      int j = 0;
+      for (; j < m && result.iterations < options.max_iterations; ++j) {
+        ++result.iterations;
+        A(V[j], V[j + 1]);
+        for (int i = 0; i <= j; ++i) {
+          T h = internal::Dot(V[j + 1], V[i]);
+          H[i * m + j] = h;
+          for (std::size_t k = 0; k < n; ++k)
+            V[j + 1][k] -= h * V[i][k];
+        }
+        T h = std::sqrt(internal::Dot(V[j + 1], V[j + 1]));
+        H[(j + 1) * m + j] = h;
+        if (h > T(0))
+          for (std::size_t k = 0; k < n; ++k)
+            V[j + 1][k] /= h;
+        // Apply the previous rotations to the new column, then eliminate
+        // its subdiagonal entry.
+        for (int i = 0; i < j; ++i) {
+          T a = H[i * m + j], c = H[(i + 1) * m + j];
+          H[i * m + j] = cs[i] * a + sn[i] * c;
+          H[(i + 1) * m + j] = -sn[i] * a + cs[i] * c;
+        }
+        T a = H[j * m + j], c = H[(j + 1) * m + j];
+        T r = std::sqrt(a * a + c * c);
+        cs[j] = r > T(0) ? a / r : T(1);
+        sn[j] = r > T(0) ? c / r : T(0);
+        H[j * m + j] = r;
+        H[(j + 1) * m + j] = T(0);
+        g[j + 1] = -sn[j] * g[j];
+        g[j] = cs[j] * g[j];
+        if (std::fabs(g[j + 1]) <= T(options.tolerance) * norm_b || h == T(0)) {
+          ++j;
+          break;
+        }
+      }
+
+      // x += V y with H y = g (upper triangular).
+      for (int i = j - 1; i >= 0; --i) {
+        T s = g[i];
+        for (int k = i + 1; k < j; ++k)
+          s -= H[i * m + k] * y[k];
+        y[i] = s / H[i * m + i];
+      }
+      for (int i = 0; i < j; ++i)
+        for (std::size_t k = 0; k < n; ++k)
+          x[k] += y[i] * V[i][k];
+    }
+  }
+
+  /*! \class JacobianVectorProduct
+   *  \brief Matrix free product of the Jacobian of a Dynamic mapping.
+   *  \tparam T Data type of state variables (typically double).
+   *
+   *  Approximates J(x) v by a forward difference along v, one right hand
+   *  side evaluation per product.
+   */
+  template <class T>
+  class JacobianVectorProduct {
+    public:
+      explicit JacobianVectorProduct(
+          MappingAutonomousEndogenous<T, Dynamic> & f)
+        : _f(f), _evaluations(0) {}
+
+      /*!
+       * Sets the point of linearization.
+       *
+       * \param[in] x Point.
+       * \param[in] fx Right hand side at x.
+       */
+      void Linearize(const std::vector<T> & x, const std::vector<T> & fx)
+      {
+        _x = x;
+        _fx = fx;
+        _norm_x = std::sqrt(internal::Dot(x, x));
+      }
+
+      //! Computes Jv = J(x) v.
+      void operator()(const std::vector<T> & v, std::vector<T> & Jv)
+      {
+        const std::size_t n = _x.size();
+        const T norm_v = std::sqrt(internal::Dot(v, v));
+        Jv.resize(n);
+        if (norm_v == T(0)) {
+          Jv.assign(n, T(0));
+          return;
+        }
+        const T eps = std::sqrt(std::numeric_limits<T>::epsilon())
+          * (T(1) + _norm_x) / norm_v;
+        _y.resize(n);
+        for (std::size_t i = 0; i < n; ++i)
+          _y[i] = _x[i] + eps * v[i];
+        _f.ComputeRHS(_y, Jv);
+        ++_evaluations;
+        for (std::size_t i = 0; i < n; ++i)
+          Jv[i] = (Jv[i] - _fx[i]) / eps;
+      }
+
+      //! Number of right hand side evaluations so far.
+      long Evaluations() const { return _evaluations; }
+
+    private:
+      MappingAutonomousEndogenous<T, Dynamic> & _f;
+      std::vector<T> _x, _fx, _y;
+      T _norm_x;
+      long _evaluations;
+  };
+}
+#endif
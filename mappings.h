@@ -23,15 +23,27 @@
  *   Note that all of the classes in this project assume that the mapping is
  *   dependent on the state; this covers most interesting cases, but not ones
  *   which purely depend upon the independent variable or on exogenous inputs.
+ *
+ *   MappingAutonomousEndogenous may also be instantiated with N = Dynamic for
+ *   large models whose dimension is only known at run time; such models store
+ *   their states in std::vector instead of std::array.
  */
 
 #ifndef __MAPPINGS_H__
 #define __MAPPINGS_H__
 #include <array>
+#include <cstddef>
+#include <vector>
   /*! \namespace dynamics
    *  \brief A namespace for classes and functions useful for dynamics.
    */
 namespace dynamics {
+  /*!
+   * Value of the state dimension template parameter that selects a state
+   * space whose dimension is only known at run time.
+   */
+  const int Dynamic = -1;
+
   /*! \class MappingNonAutonomousExogenous
    *  \brief An abstract base class for ODE's and discrete maps.
    *  \tparam I Data type of independent variable (typically double or int)
@@ -48,6 +60,9 @@ namespace dynamics {
   template <class I, class T, int N, int M>
   class MappingNonAutonomousExogenous {
     public:
+      //! Type used to store states and right hand sides.
+      typedef std::array<T, N> State;
+
       /*!
        * Pure virtual method that must be implemented by clients subclassing
        * Mapping.  This method should compute the right hand side of
@@ -94,6 +109,9 @@ namespace dynamics {
   template <class T, int N, int M>
   class MappingAutonomousExogenous {
     public:
+      //! Type used to store states and right hand sides.
+      typedef std::array<T, N> State;
+
       /*!
        * Pure virtual method that must be implemented by clients subclassing
        * MappingAutonomous.  This method should compute the right hand side of
@@ -137,6 +155,9 @@ namespace dynamics {
   template <class T, int N>
   class MappingAutonomousEndogenous {
     public:
+      //! Type used to store states and right hand sides.
+      typedef std::array<T, N> State;
+
       /*!
        * Pure virtual method that must be implemented by clients subclassing
        * MappingAutonomousEndogenous.  This method should compute the right
@@ -163,6 +184,76 @@ namespace dynamics {
       virtual ~MappingAutonomousEndogenous() {};
   };
 
+  /*! \class MappingAutonomousEndogenous<T, Dynamic>
+   *  \brief An abstract base class for large ODE's and discrete maps.
+   *  \tparam T Data type of state variables (typically double).
+   *
+   *  Specialization of MappingAutonomousEndogenous for models whose
+   *  dimension is only known at run time, e.g. spatial discretizations.
+   *  States are stored in std::vector and have Dimension() entries.
+   */
+  template <class T>
+  class MappingAutonomousEndogenous<T, Dynamic> {
+    public:
+      //! Type used to store states and right hand sides.
+      typedef std::vector<T> State;
+
+      /*!
+       * Pure virtual method that must return the dimension of the state
+       * space.
+       */
+      virtual int Dimension() const = 0;
+
+      /*!
+       * Pure virtual method that must be implemented by clients subclassing
+       * MappingAutonomousEndogenous<T, Dynamic>.  This method should compute
+       * the right hand side of ordinary differential equations of the form:
+       *
+       * \f[
+       *   \frac{dx}{dt} = f(x(t))
+       * \f]
+       *
+       * or discrete maps of the form
+       *
+       * \f[
+       *   x_{i+1} = f(x_{i})
+       * \f]
+       *
+       * \param[in] x States, \f$x\in\mathbf{R}^{n}\f$.
+       * \param[out] rhs Right hand side of the mapping, of size Dimension().
+       */
+      virtual void ComputeRHS(const std::vector<T> & x,
+                              std::vector<T> & rhs) = 0;
+
+      /*!
+       * Computes selected components of the right hand side.  The default
+       * implementation evaluates the full right hand side; models whose
+       * components can be evaluated individually (e.g. finite difference
+       * stencils) should override it, since hyper-reduced models only ever
+       * need a few components.
+       *
+       * \param[in] x States, \f$x\in\mathbf{R}^{n}\f$.
+       * \param[in] components Indices of the requested components.
+       * \param[out] values values[k] is component components[k] of the
+       *             right hand side.
+       */
+      virtual void ComputeRHSComponents(const std::vector<T> & x,
+                                        const std::vector<int> & components,
+                                        std::vector<T> & values)
+      {
+        std::vector<T> rhs(x.size());
+        ComputeRHS(x, rhs);
+        values.resize(components.size());
+        for (std::size_t k = 0; k < components.size(); ++k)
+          values[k] = rhs[components[k]];
+      }
+
+      /*!
+       * Destructor
+       */
+      virtual ~MappingAutonomousEndogenous() {};
+  };
+
   /*! \class MappingNonAutonomousEndogenous
    *  \brief An abstract base class for ODE's and discrete maps.
    *  \tparam I Data type of independent variable (typically double or int)
@@ -179,6 +270,9 @@ namespace dynamics {
   template <class I, class T, int N>
   class MappingNonAutonomousEndogenous {
     public:
+      //! Type used to store states and right hand sides.
+      typedef std::array<T, N> State;
+
       /*!
        * Pure virtual method that must be implemented by clients subclassing
        * MappingEndogenous.  This method should compute the right hand side of
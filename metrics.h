@@ -0,0 +1,418 @@
+/*! \file metrics.h
+ *  \brief Solver health metrics: counters and histograms in Prometheus
+ *  text format.
+ *
+ *  A MetricsRegistry holds named counters and histograms.  Every thread
+ *  that updates a metric gets its own block of cells in the registry, so
+ *  updates are plain relaxed loads and stores to memory no other thread
+ *  writes: no locks, no atomic read-modify-write and no shared cache lines.
+ *  Reading a metric sums the cells of all threads, which is safe while the
+ *  threads keep updating.
+ *
+ *  Histograms have logarithmic buckets with upper bounds 2^k, so a single
+ *  histogram resolves step sizes over many orders of magnitude.
+ *  MetricsRegistry::Write dumps all metrics in the Prometheus text
+ *  exposition format to a file, from where a node exporter's textfile
+ *  collector or any script can pick them up.
+ *
+ *  SolverMetrics bundles the metrics the integrators update when
+ *  AdaptiveOptions::metrics points to one.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dynamics {
+  class MetricsRegistry;
+
+  /*! \class Counter
+   *  \brief Handle of a monotonic counter in a MetricsRegistry.
+   */
+  class Counter {
+    public:
+      Counter() : _registry(0), _cell(0) {}
+
+      //! Adds n; safe to call from any thread.
+      void Add(std::uint64_t n = 1) const;
+
+      //! Sum over all threads.
+      std::uint64_t Value() const;
+
+    private:
+      friend class MetricsRegistry;
+      Counter(MetricsRegistry * registry, std::size_t cell)
+        : _registry(registry), _cell(cell) {}
+
+      MetricsRegistry * _registry;
+      std::size_t _cell;
+  };
+
+  /*! \class Histogram
+   *  \brief Handle of a histogram with buckets (2^(k-1), 2^k] in a
+   *  MetricsRegistry.
+   *
+   *  Bucket i counts observations up to UpperBound(i) = 2^(min_exponent +
+   *  i) and above the bound of the previous bucket; the first bucket also
+   *  counts everything smaller and the last one, with an infinite bound,
+   *  everything larger.
+   */
+  class Histogram {
+    public:
+      Histogram() : _registry(0), _cell(0), _min_exponent(0), _buckets(0) {}
+
+      //! Adds an observation; safe to call from any thread.
+      void Observe(double value) const;
+
+      //! Number of observations over all threads.
+      std::uint64_t Count() const;
+      //! Sum of the observations over all threads.
+      double Sum() const;
+      //! Number of buckets, including the last, unbounded one.
+      int Buckets() const { return _buckets; }
+      //! Observations in bucket i over all threads.
+      std::uint64_t Bucket(int i) const;
+      //! Upper bound of bucket i (infinity for the last).
+      double UpperBound(int i) const
+      {
+        return i + 1 == _buckets ? std::numeric_limits<double>::infinity()
+          : std::ldexp(1.0, _min_exponent + i);
+      }
+
+      //! Bucket that counts value.
+      int Index(double value) const
+      {
+        if (!(value > 0.0))
+          return 0;
+        int e;
+        double m = std::frexp(value, &e);
+        // value = m 2^e with m in [0.5, 1), so 2^(e-1) <= value < 2^e.
+        int i = (m == 0.5 ? e - 1 : e) - _min_exponent;
+        return i < 0 ? 0 : (i >= _buckets ? _buckets - 1 : i);
+      }
+
+    private:
+      friend class MetricsRegistry;
+      Histogram(MetricsRegistry * registry, std::size_t cell,
+                int min_exponent, int buckets)
+        : _registry(registry), _cell(cell), _min_exponent(min_exponent),
+          _buckets(buckets) {}
+
+      // Cells: count, sum (as the bits of a double), buckets.
+      MetricsRegistry * _registry;
+      std::size_t _cell;
+      int _min_exponent;
+      int _buckets;
+  };
+
+  /*! \class MetricsRegistry
+   *  \brief Named counters and histograms with per-thread storage.
+   */
+  class MetricsRegistry {
+    public:
+      //! Cells available per thread; a counter takes one cell, a
+      //! histogram two more than its number of buckets.
+      static const std::size_t Capacity = 1024;
+
+      MetricsRegistry() : _id(NextId()), _used(0) {}
+
+      /*!
+       * Adds a counter.
+       *
+       * \param[in] name Metric name, conventionally ending in _total.
+       * \param[in] help Description written with the metric.
+       */
+      Counter AddCounter(const std::string & name, const std::string & help)
+      {
+        return Counter(this, Add(name, help, -1, 0, 1));
+      }
+
+      /*!
+       * Adds a histogram with buckets up to 2^min_exponent, ...,
+       * 2^max_exponent and an unbounded last bucket.
+       *
+       * \param[in] name Metric name.
+       * \param[in] help Description written with the metric.
+       * \param[in] min_exponent Exponent of the upper bound of the first
+       *            bucket.
+       * \param[in] max_exponent Exponent of the largest finite bound.
+       */
+      Histogram AddHistogram(const std::string & name,
+                             const std::string & help, int min_exponent,
+                             int max_exponent)
+      {
+        if (max_exponent < min_exponent)
+          throw std::invalid_argument("MetricsRegistry: empty histogram "
+                                      + name);
+        const int buckets = max_exponent - min_exponent + 2;
+        return Histogram(this, Add(name, help, min_exponent, buckets,
+                                   buckets + 2),
+                         min_exponent, buckets);
+      }
+
+      //! The calling thread's cells, created on first use.
+      std::atomic<std::uint64_t> * ThreadCells()
+      {
+        // The identifier of a registry is never reused, so a cached block
+        // of a destroyed registry is never returned.
+        static thread_local std::uint64_t cached_id = 0;
+        static thread_local std::atomic<std::uint64_t> * cached = 0;
+        if (cached_id != _id) {
+          cached = FindBlock();
+          cached_id = _id;
+        }
+        return cached;
+      }
+
+      //! Sum of a cell over all threads.
+      std::uint64_t Total(std::size_t cell) const
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::uint64_t total = 0;
+        for (std::size_t b = 0; b < _blocks.size(); ++b)
+          total += _blocks[b]->cells[cell].load(std::memory_order_relaxed);
+        return total;
+      }
+
+      //! Sum of a cell holding the bits of a double over all threads.
+      double TotalDouble(std::size_t cell) const
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        double total = 0.0;
+        for (std::size_t b = 0; b < _blocks.size(); ++b)
+          total += ToDouble(_blocks[b]->cells[cell].load(
+              std::memory_order_relaxed));
+        return total;
+      }
+
+      /*!
+       * Writes all metrics in the Prometheus text exposition format.  The
+       * file is written under a temporary name and renamed, so a collector
+       * never reads a partial dump.
+       *
+       * \param[in] path Output file.
+       */
+      void Write(const std::string & path) const
+      {
+        const std::string temporary = path + ".tmp";
+        std::FILE * file = std::fopen(temporary.c_str(), "w");
+        if (!file)
+          throw std::runtime_error("MetricsRegistry: cannot open " + path);
+        std::vector<Metric> metrics;
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          metrics = _metrics;
+        }
+        for (std::size_t m = 0; m < metrics.size(); ++m) {
+          const Metric & metric = metrics[m];
+          const char * name = metric.name.c_str();
+          std::fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", name,
+                       metric.help.c_str(), name,
+                       metric.buckets ? "histogram" : "counter");
+          if (!metric.buckets) {
+            std::fprintf(file, "%s %llu\n", name,
+                         static_cast<unsigned long long>(Total(metric.cell)));
+            continue;
+          }
+          Histogram h(const_cast<MetricsRegistry *>(this), metric.cell,
+                      metric.min_exponent, metric.buckets);
+          unsigned long long cumulative = 0;
+          for (int i = 0; i < metric.buckets; ++i) {
+            cumulative += h.Bucket(i);
+            if (i + 1 < metric.buckets)
+              std::fprintf(file, "%s_bucket{le=\"%.17g\"} %llu\n", name,
+                           h.UpperBound(i), cumulative);
+            else
+              std::fprintf(file, "%s_bucket{le=\"+Inf\"} %llu\n", name,
+                           cumulative);
+          }
+          std::fprintf(file, "%s_sum %.17g\n%s_count %llu\n", name, h.Sum(),
+                       name, cumulative);
+        }
+        bool ok = std::fclose(file) == 0;
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+          throw std::runtime_error("MetricsRegistry: cannot write " + path);
+      }
+
+      static double ToDouble(std::uint64_t bits)
+      {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+      }
+
+      static std::uint64_t FromDouble(double value)
+      {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+      }
+
+    private:
+      MetricsRegistry(const MetricsRegistry &);
+      MetricsRegistry & operator=(const MetricsRegistry &);
+
+      struct Metric {
+        std::string name, help;
+        std::size_t cell;
+        int min_exponent, buckets;
+      };
+
+      struct Block {
+        std::thread::id thread;
+        std::atomic<std::uint64_t> cells[Capacity];
+      };
+
+      static std::uint64_t NextId()
+      {
+        static std::atomic<std::uint64_t> next(0);
+        return ++next;
+      }
+
+      std::size_t Add(const std::string & name, const std::string & help,
+                      int min_exponent, int buckets, std::size_t cells)
+      {
+        if (name.empty()
+            || name.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+                                      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                      "0123456789_:") != std::string::npos
+            || (name[0] >= '0' && name[0] <= '9'))
+          throw std::invalid_argument("MetricsRegistry: invalid name "
+                                      + name);
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (std::size_t m = 0; m < _metrics.size(); ++m)
+          if (_metrics[m].name == name)
+            throw std::invalid_argument("MetricsRegistry: duplicate name "
+                                        + name);
+        if (_used + cells > Capacity)
+          throw std::length_error("MetricsRegistry: out of cells for "
+                                  + name);
+        Metric metric = {name, help, _used, min_exponent, buckets};
+        _metrics.push_back(metric);
+        _used += cells;
+        return metric.cell;
+      }
+
+      std::atomic<std::uint64_t> * FindBlock()
+      {
+        const std::thread::id thread = std::this_thread::get_id();
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (std::size_t b = 0; b < _blocks.size(); ++b)
+          if (_blocks[b]->thread == thread)
+            return _blocks[b]->cells;
+        // Cells of metrics added later are already zero.
+        _blocks.push_back(std::unique_ptr<Block>(new Block));
+        Block & block = *_blocks.back();
+        block.thread = thread;
+        for (std::size_t c = 0; c < Capacity; ++c)
+          block.cells[c].store(0, std::memory_order_relaxed);
+        return block.cells;
+      }
+
+      const std::uint64_t _id;
+      mutable std::mutex _mutex;
+      std::vector<Metric> _metrics;
+      std::vector<std::unique_ptr<Block> > _blocks;
+      std::size_t _used;
+  };
+
+  namespace internal {
+    // Single writer increment of a cell of the calling thread.
+    inline void Increment(std::atomic<std::uint64_t> & cell, std::uint64_t n)
+    {
+      cell.store(cell.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+    }
+  }
+
+  inline void Counter::Add(std::uint64_t n) const
+  {
+    internal::Increment(_registry->ThreadCells()[_cell], n);
+  }
+
+  inline std::uint64_t Counter::Value() const
+  {
+    return _registry->Total(_cell);
+  }
+
+  inline void Histogram::Observe(double value) const
+  {
+    std::atomic<std::uint64_t> * cells = _registry->ThreadCells() + _cell;
+    internal::Increment(cells[0], 1);
+    cells[1].store(MetricsRegistry::FromDouble(
+        MetricsRegistry::ToDouble(cells[1].load(std::memory_order_relaxed))
+        + value), std::memory_order_relaxed);
+    internal::Increment(cells[2 + Index(value)], 1);
+  }
+
+  inline std::uint64_t Histogram::Count() const
+  {
+    return _registry->Total(_cell);
+  }
+
+  inline double Histogram::Sum() const
+  {
+    return _registry->TotalDouble(_cell + 1);
+  }
+
+  inline std::uint64_t Histogram::Bucket(int i) const
+  {
+    return _registry->Total(_cell + 2 + i);
+  }
+
+  /*! \struct SolverMetrics
+   *  \brief Metrics updated by the integrators.
+   *
+   *  The sum of the step size histogram is the integrated time, so right
+   *  hand side evaluations per unit of model time are
+   *  rhs_evaluations / step_size.Sum(), and the rejection rate is
+   *  rejected_steps / (steps + rejected_steps).
+   */
+  struct SolverMetrics {
+    /*!
+     * Adds the metrics to a registry.
+     *
+     * \param[in] registry Registry.
+     * \param[in] prefix Prefix of the metric names.
+     */
+    explicit SolverMetrics(MetricsRegistry & registry,
+                           const std::string & prefix = "dynamics")
+      : steps(registry.AddCounter(prefix + "_steps_total",
+                                  "Accepted steps.")),
+        rejected_steps(registry.AddCounter(prefix + "_rejected_steps_total",
+                                           "Rejected steps.")),
+        rhs_evaluations(registry.AddCounter(
+            prefix + "_rhs_evaluations_total",
+            "Right hand side evaluations, including those for Jacobians.")),
+        jacobian_evaluations(registry.AddCounter(
+            prefix + "_jacobian_evaluations_total", "Jacobian evaluations.")),
+        switches(registry.AddCounter(prefix + "_method_switches_total",
+                                     "Switches between explicit and "
+                                     "implicit methods.")),
+        step_size(registry.AddHistogram(prefix + "_step_size",
+                                        "Size of accepted steps.", -40, 16)),
+        newton_iterations(registry.AddHistogram(
+            prefix + "_newton_iterations",
+            "Newton iterations per implicit step.", 0, 6)) {}
+
+    Counter steps;
+    Counter rejected_steps;
+    Counter rhs_evaluations;
+    Counter jacobian_evaluations;
+    Counter switches;
+    Histogram step_size;
+    Histogram newton_iterations;
+  };
+}
+#endif
@@ -0,0 +1,299 @@
+/*! \file mlmc.h
+ *  \brief Multilevel Monte Carlo estimation of expected outputs.
+ *
+ *  Multilevel Monte Carlo (Giles, 2008) estimates E[P] of an output P of a
+ *  discretized SDE or ODE as the telescoping sum
+ *
+ *      E[P_L] = E[P_0] + sum_{l=1}^{L} E[P_l - P_{l-1}],
+ *
+ *  where level l integrates with 2^l times as many steps as level 0.  The
+ *  fine and coarse paths of a correction P_l - P_{l-1} share their noise
+ *  increments, so corrections have small variance and need few samples on
+ *  the expensive levels.  The driver estimates the per-level variances on
+ *  line, chooses the number of samples per level that minimizes cost for a
+ *  target root mean square error, adds levels until the estimated bias is
+ *  small enough, and runs all samples on the parallel ensemble runner.
+ */
+
+#ifndef __MLMC_H__
+#define __MLMC_H__
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "ensemble.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "random.h"
+#include "statistics.h"
+
+namespace dynamics {
+  /*! \class SDEPathSampler
+   *  \brief Coupled coarse/fine Euler-Maruyama paths of a stochastic mapping.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of the Wiener process.
+   *  \tparam Initial Initial condition sampler, see the constructor.
+   *  \tparam Output Output functional, see the constructor.
+   *
+   *  The SDE dx = a(x) dt + b(x) dW is described by a
+   *  MappingAutonomousExogenous whose exogenous inputs are the white noise
+   *  dW/dt, i.e. ComputeRHS(x, u) = a(x) + b(x) u.  With M = 0 the mapping is
+   *  an ODE and only the initial conditions are random.
+   */
+  template <class T, int N, int M, class Initial, class Output>
+  class SDEPathSampler {
+    public:
+      /*!
+       * \param[in] f Mapping; ComputeRHS must tolerate concurrent calls.
+       * \param[in] horizon Final time of the integration.
+       * \param[in] steps Number of steps on level 0.
+       * \param[in] initial Called as initial(rng, x0) to draw an initial
+       *            state; rng is a SplitMix64.
+       * \param[in] output Called as output(x) to compute the output from the
+       *            final state.
+       */
+      SDEPathSampler(MappingAutonomousExogenous<T, N, M> & f, T horizon,
+                     std::size_t steps, Initial initial, Output output)
+        : _f(f), _horizon(horizon), _steps(steps), _initial(initial),
+          _output(output) {}
+
+      /*!
+       * Draws P_level - P_{level-1} (P_0 on level 0).
+       *
+       * \param[in] level Level; the fine path takes steps * 2^level steps.
+       * \param[in] rng Random number stream of this sample.
+       */
+      T operator()(int level, SplitMix64 & rng) const
+      {
+        std::array<T, N> xf, xc;
+        _initial(rng, xf);
+        xc = xf;
+        std::array<T, M> zero, dWc;
+        zero.fill(T(0));
+        dWc.fill(T(0));
+        AutonomousExogenousSystem<T, N, M> fine(_f, zero), coarse(_f, zero);
+        Euler<std::array<T, N> > fine_stepper, coarse_stepper;
+        std::normal_distribution<T> normal;
+        const std::size_t n = _steps << level;
+        const T h = _horizon / T(n), sqrt_h = std::sqrt(h);
+        for (std::size_t k = 0; k < n; ++k) {
+          const T t = h * T(k);
+          for (int m = 0; m < M; ++m) {
+            T dW = sqrt_h * normal(rng);
+            fine.Input()[m] = dW / h;
+            dWc[m] += dW;
+          }
+          fine_stepper.Step(fine, t, h, xf);
+          if (level > 0 && k % 2 == 1) {
+            for (int m = 0; m < M; ++m) {
+              coarse.Input()[m] = dWc[m] / (2 * h);
+              dWc[m] = T(0);
+            }
+            coarse_stepper.Step(coarse, t - h, 2 * h, xc);
+          }
+        }
+        return level == 0 ? _output(xf) : _output(xf) - _output(xc);
+      }
+
+      //! Relative cost of one sample: fine plus coarse steps.
+      double Cost(int level) const
+      {
+        double fine = double(_steps << level);
+        return level == 0 ? fine : 1.5 * fine;
+      }
+
+    private:
+      MappingAutonomousExogenous<T, N, M> & _f;
+      T _horizon;
+      std::size_t _steps;
+      Initial _initial;
+      Output _output;
+  };
+
+  //! Creates an SDEPathSampler, deducing its template arguments.
+  template <class T, int N, int M, class Initial, class Output>
+  SDEPathSampler<T, N, M, Initial, Output>
+  MakeSDEPathSampler(MappingAutonomousExogenous<T, N, M> & f, T horizon,
+                     std::size_t steps, Initial initial, Output output)
+  {
+    return SDEPathSampler<T, N, M, Initial, Output>(f, horizon, steps,
+                                                    initial, output);
+  }
+
+  /*! \struct MLMCOptions
+   *  \brief Parameters of RunMultilevelMonteCarlo.
+   */
+  struct MLMCOptions {
+    MLMCOptions()
+      : epsilon(1e-2), initial_samples(100), min_levels(3), max_levels(12),
+        alpha(1.0), beta(1.0), threads(0), seed(0) {}
+
+    //! Target root mean square error of the estimate.
+    double epsilon;
+    //! Samples taken on a level when it is first used.
+    std::size_t initial_samples;
+    //! Number of levels to start with, at least 2 for the bias test.
+    int min_levels;
+    //! Largest number of levels.
+    int max_levels;
+    //! Weak order: |E[P_l - P]| decays like 2^(-alpha l).
+    double alpha;
+    //! Variance of P_l - P_{l-1} decays like 2^(-beta l).
+    double beta;
+    //! Number of threads, 0 selects HardwareThreads().
+    unsigned threads;
+    //! Seed of the per-sample random number streams.
+    std::uint64_t seed;
+  };
+
+  /*! \struct MLMCLevel
+   *  \brief Per-level results of RunMultilevelMonteCarlo.
+   */
+  template <class T>
+  struct MLMCLevel {
+    //! Moments of P_l - P_{l-1}.
+    RunningMoments<T> correction;
+    //! Relative cost of one sample.
+    double cost;
+  };
+
+  /*! \struct MLMCResult
+   *  \brief Result of RunMultilevelMonteCarlo.
+   */
+  template <class T>
+  struct MLMCResult {
+    //! Estimate of the expected output.
+    T estimate;
+    //! Variance of the estimate (sampling error only).
+    T variance;
+    //! Whether the bias test passed within options.max_levels.
+    bool converged;
+    std::vector<MLMCLevel<T> > levels;
+  };
+
+  /*! \class LevelMoments
+   *  \brief Per-level accumulator used by RunMultilevelMonteCarlo.
+   */
+  template <class T>
+  class LevelMoments {
+    public:
+      explicit LevelMoments(std::size_t levels = 0) : _moments(levels) {}
+      RunningMoments<T> & operator[](std::size_t l) { return _moments[l]; }
+      void Merge(const LevelMoments & other)
+      {
+        for (std::size_t l = 0; l < _moments.size(); ++l)
+          _moments[l].Merge(other._moments[l]);
+      }
+
+    private:
+      std::vector<RunningMoments<T> > _moments;
+  };
+
+  /*!
+   * Estimates E[P] to a root mean square error of options.epsilon.
+   *
+   * \param[in] sampler Called concurrently as sampler(level, rng) to draw
+   *            one sample of P_level - P_{level-1}, and as
+   *            sampler.Cost(level) for the relative cost of a sample, e.g.
+   *            an SDEPathSampler.  Sample j of level l always receives the
+   *            same random stream, so results do not depend on the number
+   *            of threads.
+   * \param[in] options Parameters.
+   */
+  template <class T, class Sampler>
+  MLMCResult<T> RunMultilevelMonteCarlo(const Sampler & sampler,
+                                        const MLMCOptions & options
+                                          = MLMCOptions())
+  {
+    if (options.min_levels < 2 || options.max_levels < options.min_levels)
+      throw std::invalid_argument("RunMultilevelMonteCarlo: bad levels");
+    MLMCResult<T> result;
+    result.converged = false;
+    std::vector<std::size_t> extra(options.min_levels,
+                                   options.initial_samples);
+    result.levels.resize(options.min_levels);
+    for (int l = 0; l < options.min_levels; ++l)
+      result.levels[l].cost = sampler.Cost(l);
+    const double eps2 = options.epsilon * options.epsilon;
+
+    for (;;) {
+      // Run all outstanding samples of all levels as one ensemble.
+      const std::size_t L = result.levels.size();
+      std::vector<std::size_t> offset(L + 1, 0), taken(L);
+      for (std::size_t l = 0; l < L; ++l) {
+        offset[l + 1] = offset[l] + extra[l];
+        taken[l] = result.levels[l].correction.Count();
+      }
+      if (offset[L] > 0) {
+        LevelMoments<T> batch = RunEnsemble(
+            offset[L], LevelMoments<T>(L),
+            [&](std::size_t i, LevelMoments<T> & acc, unsigned) {
+              std::size_t l = 0;
+              while (i >= offset[l + 1])
+                ++l;
+              std::uint64_t j = taken[l] + (i - offset[l]);
+              SplitMix64 rng(options.seed, (std::uint64_t(l) << 40) + j);
+              acc[l].Add(sampler(static_cast<int>(l), rng));
+            }, options.threads);
+        for (std::size_t l = 0; l < L; ++l)
+          result.levels[l].correction.Merge(batch[l]);
+      }
+
+      // Optimal number of samples per level for the current variances;
+      // levels with too few samples borrow the decay model from the level
+      // below.
+      std::vector<double> V(L);
+      double sum = 0.0;
+      for (std::size_t l = 0; l < L; ++l) {
+        V[l] = double(result.levels[l].correction.Variance());
+        if (l > 0 && result.levels[l].correction.Count()
+                     < options.initial_samples)
+          V[l] = std::max(V[l], V[l - 1] / std::pow(2.0, options.beta));
+        sum += std::sqrt(V[l] * result.levels[l].cost);
+      }
+      bool done = true;
+      for (std::size_t l = 0; l < L; ++l) {
+        double optimal = std::ceil(2.0 / eps2 * std::sqrt(
+            V[l] / result.levels[l].cost) * sum);
+        std::size_t have = result.levels[l].correction.Count();
+        extra[l] = optimal > double(have)
+          ? static_cast<std::size_t>(optimal) - have : 0;
+        if (extra[l] > 0.01 * double(have))
+          done = false;
+      }
+      if (!done)
+        continue;
+
+      // Bias test on the last two levels; add a level when it fails.
+      const double r = std::pow(2.0, options.alpha);
+      double bias = std::max(
+          std::fabs(double(result.levels[L - 1].correction.Mean())),
+          std::fabs(double(result.levels[L - 2].correction.Mean())) / r)
+        / (r - 1.0);
+      if (bias <= options.epsilon / std::sqrt(2.0)) {
+        result.converged = true;
+        break;
+      }
+      if (static_cast<int>(L) == options.max_levels)
+        break;
+      result.levels.push_back(MLMCLevel<T>());
+      result.levels.back().cost = sampler.Cost(static_cast<int>(L));
+      extra.push_back(options.initial_samples);
+    }
+
+    result.estimate = T(0);
+    result.variance = T(0);
+    for (std::size_t l = 0; l < result.levels.size(); ++l) {
+      const RunningMoments<T> & m = result.levels[l].correction;
+      result.estimate += m.Mean();
+      result.variance += m.Variance() / T(m.Count());
+    }
+    return result;
+  }
+}
+#endif
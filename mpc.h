@@ -0,0 +1,384 @@
+/*! \file mpc.h
+ *  \brief Nonlinear model predictive control by multiple shooting.
+ *
+ *  ModelPredictiveController minimizes a quadratic tracking cost over a
+ *  horizon of shooting intervals of a MappingAutonomousExogenous plant with
+ *  piecewise constant inputs.  States at the start of every interval are
+ *  optimization variables, so intervals are independent: their end states
+ *  and sensitivities are integrated in parallel, with a fixed step stepper
+ *  run in Dual arithmetic (see autodiff.h) so that the sensitivities are
+ *  the exact derivatives of the discretized plant.
+ *
+ *  Every iteration is a Gauss-Newton SQP step whose quadratic program is
+ *  solved by a Riccati recursion, in time linear in the horizon with only
+ *  inputs x inputs Cholesky factorizations.  In closed loop the solution
+ *  of one sample, shifted by one interval, is the initial guess of the
+ *  next, and a single iteration per sample (the real-time iteration of
+ *  Diehl et al.) usually suffices.  All storage is allocated on
+ *  construction.
+ */
+
+#ifndef __MPC_H__
+#define __MPC_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "autodiff.h"
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \struct MPCOptions
+   *  \brief Parameters of ModelPredictiveController.
+   */
+  struct MPCOptions {
+    MPCOptions() : substeps(1), iterations(1), threads(1) {}
+
+    //! Steps of the stepper per shooting interval.
+    int substeps;
+    //! SQP iterations per Solve; 1 is the real-time iteration.
+    int iterations;
+    //! Number of threads integrating the intervals, 0 selects
+    //! HardwareThreads().  Threads are started on every iteration, which
+    //! only pays off for plants that are expensive to integrate.
+    unsigned threads;
+  };
+
+  /*! \class ModelPredictiveController
+   *  \brief Multiple shooting MPC with a Riccati recursion.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of the inputs.
+   *
+   *  Minimizes
+   *  \f[
+   *    \frac{1}{2} \sum_{k=0}^{K-1} \left( \|x_k - x_r\|_Q^2
+   *      + \|u_k - u_r\|_R^2 \right) + \frac{1}{2} \|x_K - x_r\|_{Q_f}^2
+   *  \f]
+   *  subject to the plant dynamics, x_0 equal to the measured state and,
+   *  optionally, bounds on the inputs.  Bounds are enforced by clipping
+   *  the inputs after every iteration, which leaves the iterates feasible
+   *  but is only exact while the bounds are inactive at the solution.
+   */
+  template <class T, int N, int M>
+  class ModelPredictiveController {
+    public:
+      typedef std::array<T, std::size_t(N)> State;
+      typedef std::array<T, std::size_t(M)> Input;
+      typedef Dual<T, N + M> Scalar;
+      typedef MappingAutonomousExogenous<Scalar, N, M> Plant;
+
+      /*!
+       * \param[in] plant The plant instantiated with Dual<T, N + M>
+       *            scalars; it must tolerate concurrent calls if more than
+       *            one thread is used.
+       * \param[in] horizon Number of shooting intervals.
+       * \param[in] dt Length of a shooting interval.
+       * \param[in] Q State weight.
+       * \param[in] R Input weight, positive definite.
+       * \param[in] Qf Terminal state weight.
+       * \param[in] options Parameters.
+       */
+      ModelPredictiveController(Plant & plant, std::size_t horizon, T dt,
+                                const Matrix<T, N> & Q,
+                                const Matrix<T, M> & R,
+                                const Matrix<T, N> & Qf,
+                                const MPCOptions & options = MPCOptions())
+        : _plant(plant), _K(horizon), _dt(dt), _Q(Q), _R(R), _Qf(Qf),
+          _options(options), _s(horizon + 1), _q(horizon),
+          _d(horizon), _A(horizon), _B(horizon),
+          _gain(horizon), _feedforward(horizon),
+          _steppers(ResolveThreads(options.threads, horizon))
+      {
+        if (horizon == 0)
+          throw std::invalid_argument("ModelPredictiveController: empty "
+                                      "horizon");
+        _xr.fill(T(0));
+        _ur.fill(T(0));
+        _lower.fill(-std::numeric_limits<T>::infinity());
+        _upper.fill(std::numeric_limits<T>::infinity());
+        Initialize(_xr, _ur);
+      }
+
+      //! Sets the state and input the cost tracks.
+      void SetReference(const State & x, const Input & u)
+      {
+        _xr = x;
+        _ur = u;
+      }
+
+      //! Sets bounds on the inputs.
+      void SetBounds(const Input & lower, const Input & upper)
+      {
+        _lower = lower;
+        _upper = upper;
+        for (std::size_t k = 0; k < _K; ++k)
+          Clip(_q[k]);
+      }
+
+      //! Sets the initial guess to constant states and inputs.
+      void Initialize(const State & x, const Input & u)
+      {
+        std::fill(_s.begin(), _s.end(), x);
+        std::fill(_q.begin(), _q.end(), u);
+        for (std::size_t k = 0; k < _K; ++k)
+          Clip(_q[k]);
+      }
+
+      /*!
+       * Improves the solution for the measured state by
+       * MPCOptions::iterations SQP iterations.
+       *
+       * \param[in] x0 Measured state.
+       * \return Input to apply over the next interval.
+       */
+      const Input & Solve(const State & x0)
+      {
+        for (int i = 0; i < _options.iterations; ++i) {
+          Linearize();
+          Riccati();
+          Expand(x0);
+        }
+        return _q[0];
+      }
+
+      /*!
+       * Shifts the solution by one interval, as the initial guess of the
+       * next sample.  The new last interval holds the last input and
+       * starts and ends at the old terminal state; the next iteration
+       * closes its defect.
+       */
+      void Shift()
+      {
+        for (std::size_t k = 0; k + 1 < _K; ++k) {
+          _s[k] = _s[k + 1];
+          _q[k] = _q[k + 1];
+        }
+        _s[_K - 1] = _s[_K];
+      }
+
+      //! Predicted state at the start of interval k (k <= horizon).
+      const State & States(std::size_t k) const { return _s[k]; }
+      //! Input over interval k.
+      const Input & Inputs(std::size_t k) const { return _q[k]; }
+
+      /*!
+       * Largest continuity defect |F(x_k, u_k) - x_{k+1}| of the last
+       * linearization; zero once the SQP iterations have converged.
+       */
+      T Defect() const
+      {
+        T defect(0);
+        for (std::size_t k = 0; k < _K; ++k)
+          for (int i = 0; i < N; ++i)
+            defect = std::max(defect, std::fabs(_d[k][i]));
+        return defect;
+      }
+
+      //! Cost of the current states and inputs.
+      T Cost() const
+      {
+        T cost(0);
+        for (std::size_t k = 0; k < _K; ++k)
+          cost += Quadratic(_Q, _s[k], _xr) + Quadratic(_R, _q[k], _ur);
+        return T(0.5) * (cost + Quadratic(_Qf, _s[_K], _xr));
+      }
+
+      std::size_t Horizon() const { return _K; }
+
+    private:
+      template <int P>
+      static T Quadratic(const Matrix<T, P> & W,
+                         const std::array<T, std::size_t(P)> & x,
+                         const std::array<T, std::size_t(P)> & r)
+      {
+        T s(0);
+        for (int i = 0; i < P; ++i)
+          for (int j = 0; j < P; ++j)
+            s += (x[i] - r[i]) * W(i, j) * (x[j] - r[j]);
+        return s;
+      }
+
+      void Clip(Input & u) const
+      {
+        for (int j = 0; j < M; ++j)
+          u[j] = std::min(_upper[j], std::max(_lower[j], u[j]));
+      }
+
+      // End states, defects and sensitivities of every interval.
+      void Linearize()
+      {
+        const T h = _dt / T(_options.substeps);
+        ParallelFor(_K, [&](std::size_t k, unsigned thread) {
+          std::array<Scalar, std::size_t(N)> x;
+          std::array<Scalar, std::size_t(M)> u;
+          for (int i = 0; i < N; ++i)
+            x[i] = Scalar(_s[k][i], i);
+          for (int j = 0; j < M; ++j)
+            u[j] = Scalar(_q[k][j], N + j);
+          AutonomousExogenousSystem<Scalar, N, M> f(_plant, u);
+          for (int s = 0; s < _options.substeps; ++s)
+            _steppers[thread].Step(f, h * T(s), h, x);
+          for (int i = 0; i < N; ++i) {
+            _d[k][i] = x[i].Value() - _s[k + 1][i];
+            for (int j = 0; j < N; ++j)
+              _A[k](i, j) = x[i].Derivative(j);
+            for (int j = 0; j < M; ++j)
+              _B[k](i, j) = x[i].Derivative(N + j);
+          }
+        }, _options.threads);
+      }
+
+      // Backward Riccati recursion of the Gauss-Newton QP in the steps dx,
+      // du with dx_{k+1} = A_k dx_k + B_k du_k + d_k: the cost to go from
+      // interval k is 1/2 dx^T P dx + p^T dx, and the optimal step is
+      // du_k = gain_k dx_k + feedforward_k.
+      void Riccati()
+      {
+        Matrix<T, N> P = _Qf;
+        State p;
+        Gradient(_Qf, _s[_K], _xr, p);
+        for (std::size_t k = _K; k-- > 0; ) {
+          const Matrix<T, N> & A = _A[k];
+          const Matrix<T, N, M> & B = _B[k];
+          // p + P d, P A and P B.
+          State pt;
+          for (int i = 0; i < N; ++i)
+            pt[i] = p[i] + internal::Dot<N, 1>(P.Row(i), _d[k].data());
+          Matrix<T, N> PA;
+          MatMul(P, A, PA);
+          Matrix<T, N, M> PB;
+          MatMul(P, B, PB);
+          // H = R + B^T P B, G = B^T P A, g = R (u - ur) + B^T (p + P d).
+          Matrix<T, M> H;
+          Matrix<T, M, N> G;
+          Input g;
+          Gradient(_R, _q[k], _ur, g);
+          for (int a = 0; a < M; ++a) {
+            for (int b = 0; b < M; ++b) {
+              T s(0);
+              for (int i = 0; i < N; ++i)
+                s += B(i, a) * PB(i, b);
+              H(a, b) = _R(a, b) + s;
+            }
+            for (int j = 0; j < N; ++j) {
+              T s(0);
+              for (int i = 0; i < N; ++i)
+                s += B(i, a) * PA(i, j);
+              G(a, j) = s;
+            }
+            for (int i = 0; i < N; ++i)
+              g[a] += B(i, a) * pt[i];
+          }
+          if (!CholeskyFactor(H))
+            throw std::runtime_error("ModelPredictiveController: reduced "
+                                     "Hessian is not positive definite");
+          Matrix<T, M, N> & gain = _gain[k];
+          for (int j = 0; j < N; ++j) {
+            Input column;
+            for (int a = 0; a < M; ++a)
+              column[a] = -G(a, j);
+            CholeskySolve(H, column);
+            for (int a = 0; a < M; ++a)
+              gain(a, j) = column[a];
+          }
+          Input & feedforward = _feedforward[k];
+          for (int a = 0; a < M; ++a)
+            feedforward[a] = -g[a];
+          CholeskySolve(H, feedforward);
+          // P = Q + A^T P A + G^T gain, p = Q (x - xr) + A^T pt
+          // + G^T feedforward.
+          State next;
+          Gradient(_Q, _s[k], _xr, next);
+          for (int i = 0; i < N; ++i) {
+            for (int j = 0; j < N; ++j) {
+              T s(0);
+              for (int l = 0; l < N; ++l)
+                s += A(l, i) * PA(l, j);
+              for (int a = 0; a < M; ++a)
+                s += G(a, i) * gain(a, j);
+              P(i, j) = _Q(i, j) + s;
+            }
+            for (int l = 0; l < N; ++l)
+              next[i] += A(l, i) * pt[l];
+            for (int a = 0; a < M; ++a)
+              next[i] += G(a, i) * feedforward[a];
+          }
+          for (int i = 0; i < N; ++i)
+            for (int j = 0; j < i; ++j)
+              P(i, j) = P(j, i) = T(0.5) * (P(i, j) + P(j, i));
+          p = next;
+        }
+      }
+
+      // Forward pass: applies the steps from the measured state.
+      void Expand(const State & x0)
+      {
+        State dx;
+        for (int i = 0; i < N; ++i)
+          dx[i] = x0[i] - _s[0][i];
+        for (std::size_t k = 0; k < _K; ++k) {
+          Input du;
+          MatVec(_gain[k], dx, du);
+          Input u = _q[k];
+          for (int a = 0; a < M; ++a)
+            u[a] += du[a] + _feedforward[k][a];
+          Clip(u);
+          for (int a = 0; a < M; ++a)
+            du[a] = u[a] - _q[k][a];
+          _q[k] = u;
+          State next;
+          MatVec(_A[k], dx, next);
+          for (int i = 0; i < N; ++i) {
+            _s[k][i] += dx[i];
+            next[i] += _d[k][i] + internal::Dot<M, 1>(_B[k].Row(i),
+                                                     du.data());
+          }
+          dx = next;
+        }
+        for (int i = 0; i < N; ++i)
+          _s[_K][i] += dx[i];
+      }
+
+      template <int P>
+      static void Gradient(const Matrix<T, P> & W,
+                           const std::array<T, std::size_t(P)> & x,
+                           const std::array<T, std::size_t(P)> & r,
+                           std::array<T, std::size_t(P)> & g)
+      {
+        for (int i = 0; i < P; ++i) {
+          T s(0);
+          for (int j = 0; j < P; ++j)
+            s += W(i, j) * (x[j] - r[j]);
+          g[i] = s;
+        }
+      }
+
+      Plant & _plant;
+      std::size_t _K;
+      T _dt;
+      Matrix<T, N> _Q;
+      Matrix<T, M> _R;
+      Matrix<T, N> _Qf;
+      MPCOptions _options;
+      State _xr;
+      Input _ur, _lower, _upper;
+      std::vector<State> _s;
+      std::vector<Input> _q;
+      std::vector<State> _d;
+      std::vector<Matrix<T, N> > _A;
+      std::vector<Matrix<T, N, M> > _B;
+      std::vector<Matrix<T, M, N> > _gain;
+      std::vector<Input> _feedforward;
+      std::vector<RungeKutta4<std::array<Scalar, std::size_t(N)> > >
+        _steppers;
+  };
+}
+#endif
@@ -0,0 +1,107 @@
+/*! \file parallel.h
+ *  \brief A minimal thread pool free parallel loop.
+ *
+ *  The builders and drivers in this project evaluate many independent
+ *  mappings (grid nodes, ensemble members, shooting intervals, ...).  They all
+ *  go through ParallelFor so that thread creation, load balancing and error
+ *  propagation are handled in one place.
+ */
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dynamics {
+  /*!
+   * Number of hardware threads reported by the system, never less than one.
+   */
+  inline unsigned HardwareThreads()
+  {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+  }
+
+  /*!
+   * Number of threads ParallelFor will actually use for a loop of n
+   * iterations.  Callers use this to size per-thread scratch space.
+   *
+   * \param[in] threads Requested number of threads, 0 selects
+   *            HardwareThreads().
+   * \param[in] n Number of loop iterations.
+   */
+  inline unsigned ResolveThreads(unsigned threads, std::size_t n)
+  {
+    if (threads == 0)
+      threads = HardwareThreads();
+    if (n < threads)
+      threads = static_cast<unsigned>(n);
+    return threads == 0 ? 1 : threads;
+  }
+
+  /*!
+   * Calls f(i, thread) for every i in [0, n).  Iterations are handed out in
+   * chunks from a shared atomic counter so that uneven iteration costs are
+   * balanced across threads.  The second argument of f is the index of the
+   * calling thread in [0, ResolveThreads(threads, n)), which allows f to use
+   * per-thread scratch space without locking.
+   *
+   * The first exception thrown by any iteration stops the loop and is
+   * rethrown on the calling thread.
+   *
+   * \param[in] n Number of iterations.
+   * \param[in] f Loop body, called as f(std::size_t i, unsigned thread).
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \param[in] chunk Iterations claimed at a time, 0 selects a default.
+   */
+  template <class Function>
+  void ParallelFor(std::size_t n, Function f, unsigned threads = 0,
+                   std::size_t chunk = 0)
+  {
+    threads = ResolveThreads(threads, n);
+    if (threads == 1) {
+      for (std::size_t i = 0; i < n; ++i)
+        f(i, 0u);
+      return;
+    }
+    if (chunk == 0)
+      chunk = std::max<std::size_t>(1, n / (8 * threads));
+
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&](unsigned thread) {
+      try {
+        for (;;) {
+          std::size_t begin = next.fetch_add(chunk);
+          if (begin >= n)
+            break;
+          std::size_t end = std::min(n, begin + chunk);
+          for (std::size_t i = begin; i < end; ++i)
+            f(i, thread);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
+        next.store(n);
+      }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t)
+      pool.push_back(std::thread(worker, t));
+    worker(0);
+    for (std::size_t t = 0; t < pool.size(); ++t)
+      pool[t].join();
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+#endif
@@ -0,0 +1,280 @@
+/*! \file particle_filter.h
+ *  \brief Bootstrap particle filter with parallel propagation and
+ *  resampling.
+ *
+ *  Particles are propagated through a system (see integrators.h) with a
+ *  fixed step stepper and perturbed by a user supplied process noise, in
+ *  blocks of particles spread over threads.  Each particle draws from its
+ *  own random stream, seeded from (seed, step, particle), and all
+ *  reductions combine per-block partial results in block order, so results
+ *  do not depend on the number of threads.
+ *
+ *  Weights are kept as logarithms and normalized with a log-sum-exp
+ *  reduction, so likelihoods far below the smallest double do not
+ *  underflow.  When the effective sample size falls below a threshold the
+ *  particles are resampled systematically: a parallel prefix sum over the
+ *  weights gives every block the range of its cumulative weight, and each
+ *  block writes its copies independently.  Particle storage is allocated
+ *  once; resampling alternates between two buffers.
+ */
+
+#ifndef __PARTICLE_FILTER_H__
+#define __PARTICLE_FILTER_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "integrators.h"
+#include "parallel.h"
+#include "random.h"
+
+namespace dynamics {
+  /*! \struct ParticleFilterOptions
+   *  \brief Parameters of ParticleFilter.
+   */
+  struct ParticleFilterOptions {
+    ParticleFilterOptions()
+      : substeps(1), resample_threshold(0.5), block(1024), threads(0),
+        seed(0) {}
+
+    //! Steps of the stepper per prediction interval.
+    int substeps;
+    //! Resample when the effective sample size falls below this fraction
+    //! of the number of particles.
+    double resample_threshold;
+    //! Particles per parallel work item.
+    std::size_t block;
+    //! Number of threads, 0 selects HardwareThreads().
+    unsigned threads;
+    std::uint64_t seed;
+  };
+
+  /*! \class ParticleFilter
+   *  \brief Bootstrap (sequential importance resampling) particle filter.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam System System adapter of the process model; it is copied once
+   *          per block, and the mapping must tolerate concurrent calls.
+   *  \tparam Stepper Fixed step stepper, e.g. RungeKutta4.
+   */
+  template <class T, int N, class System,
+            class Stepper = RungeKutta4<std::array<T, std::size_t(N)> > >
+  class ParticleFilter {
+    public:
+      typedef std::array<T, std::size_t(N)> State;
+
+      /*!
+       * \param[in] f Process model; the filter keeps a reference.
+       * \param[in] particles Number of particles.
+       * \param[in] options Parameters; options.block must be positive.
+       */
+      ParticleFilter(System & f, std::size_t particles,
+                     const ParticleFilterOptions & options
+                       = ParticleFilterOptions())
+        : _f(f), _options(options), _n(particles),
+          _blocks(Blocks(particles, options.block)),
+          _x(particles), _scratch(particles), _log_weights(particles),
+          _weights(particles, T(1) / T(particles)),
+          _steppers(ResolveThreads(options.threads, _blocks)),
+          _block_max(_blocks), _block_sum(_blocks), _block_squares(_blocks),
+          _offsets(_blocks + 1), _step(0), _resamplings(0),
+          _ess(T(particles)) {}
+
+      /*!
+       * Draws the initial particles, with equal weights.
+       *
+       * \param[in] initial Called as initial(rng, x) for every particle;
+       *            rng is a SplitMix64.
+       */
+      template <class Initial>
+      void Initialize(Initial initial)
+      {
+        ParallelFor(_blocks, [&](std::size_t b, unsigned) {
+          for (std::size_t i = Begin(b); i < End(b); ++i) {
+            SplitMix64 rng(Seed(), i);
+            initial(rng, _x[i]);
+            _log_weights[i] = -std::log(T(_n));
+            _weights[i] = T(1) / T(_n);
+          }
+        }, _options.threads);
+        _ess = T(_n);
+        ++_step;
+      }
+
+      /*!
+       * Propagates every particle from t to t + dt and applies the process
+       * noise.
+       *
+       * \param[in] t Current time.
+       * \param[in] dt Prediction interval.
+       * \param[in] noise Called as noise(rng, x) after the propagation of
+       *            every particle; rng is a SplitMix64.
+       */
+      template <class Noise>
+      void Predict(T t, T dt, Noise noise)
+      {
+        const T h = dt / T(_options.substeps);
+        ParallelFor(_blocks, [&](std::size_t b, unsigned thread) {
+          System f(_f);
+          Stepper & stepper = _steppers[thread];
+          for (std::size_t i = Begin(b); i < End(b); ++i) {
+            for (int s = 0; s < _options.substeps; ++s)
+              stepper.Step(f, t + h * T(s), h, _x[i]);
+            SplitMix64 rng(Seed(), i);
+            noise(rng, _x[i]);
+          }
+        }, _options.threads);
+        ++_step;
+      }
+
+      /*!
+       * Reweights the particles by the likelihood of a measurement and
+       * resamples them if the effective sample size is too small.
+       *
+       * \param[in] log_likelihood Called as log_likelihood(x), returns the
+       *            log likelihood of the measurement given state x.
+       * \return Log of the likelihood of the measurement given the past
+       *         ones (its sum over all measurements is the log likelihood
+       *         of the model).
+       */
+      template <class LogLikelihood>
+      T Update(LogLikelihood log_likelihood)
+      {
+        ParallelFor(_blocks, [&](std::size_t b, unsigned) {
+          T m = -std::numeric_limits<T>::infinity();
+          for (std::size_t i = Begin(b); i < End(b); ++i) {
+            _log_weights[i] += T(log_likelihood(
+                static_cast<const State &>(_x[i])));
+            m = std::max(m, _log_weights[i]);
+          }
+          _block_max[b] = m;
+        }, _options.threads);
+        const T m = *std::max_element(_block_max.begin(), _block_max.end());
+        if (!(m > -std::numeric_limits<T>::infinity()))
+          throw std::runtime_error("ParticleFilter: all particles have zero "
+                                   "likelihood");
+
+        ParallelFor(_blocks, [&](std::size_t b, unsigned) {
+          T sum(0), squares(0);
+          for (std::size_t i = Begin(b); i < End(b); ++i) {
+            const T w = std::exp(_log_weights[i] - m);
+            _weights[i] = w;
+            sum += w;
+            squares += w * w;
+          }
+          _block_sum[b] = sum;
+          _block_squares[b] = squares;
+        }, _options.threads);
+        // Exclusive prefix sum of the block sums.
+        T squares(0);
+        _offsets[0] = T(0);
+        for (std::size_t b = 0; b < _blocks; ++b) {
+          _offsets[b + 1] = _offsets[b] + _block_sum[b];
+          squares += _block_squares[b];
+        }
+        const T total = _offsets[_blocks];
+        const T log_total = m + std::log(total);
+        _ess = total * total / squares;
+
+        if (_ess < T(_options.resample_threshold) * T(_n)) {
+          Resample(total);
+        } else {
+          ParallelFor(_blocks, [&](std::size_t b, unsigned) {
+            for (std::size_t i = Begin(b); i < End(b); ++i) {
+              _log_weights[i] -= log_total;
+              _weights[i] /= total;
+            }
+          }, _options.threads);
+        }
+        ++_step;
+        return log_total;
+      }
+
+      //! Weighted mean of the particles.
+      State Mean() const
+      {
+        State mean;
+        mean.fill(T(0));
+        for (std::size_t i = 0; i < _n; ++i)
+          for (int k = 0; k < N; ++k)
+            mean[k] += _weights[i] * _x[i][k];
+        return mean;
+      }
+
+      //! Effective sample size 1 / sum w_i^2 before the last resampling.
+      T EffectiveSampleSize() const { return _ess; }
+
+      const std::vector<State> & Particles() const { return _x; }
+      //! Normalized weights.
+      const std::vector<T> & Weights() const { return _weights; }
+      //! Number of resamplings so far.
+      std::size_t Resamplings() const { return _resamplings; }
+
+    private:
+      static std::size_t Blocks(std::size_t particles, std::size_t block)
+      {
+        if (block == 0)
+          throw std::invalid_argument("ParticleFilter: block must be "
+                                      "positive");
+        return (particles + block - 1) / block;
+      }
+
+      std::size_t Begin(std::size_t b) const { return b * _options.block; }
+      std::size_t End(std::size_t b) const
+      {
+        return std::min(_n, (b + 1) * _options.block);
+      }
+
+      std::uint64_t Seed() const { return Mix64(_options.seed + _step); }
+
+      // Systematic resampling: copy j is particle i if the point
+      // (j + u) total / n falls into the cumulative weight interval of i.
+      void Resample(T total)
+      {
+        SplitMix64 rng(Seed(), _n);
+        const T u = std::uniform_real_distribution<T>(T(0), T(1))(rng);
+        const T scale = T(_n) / total;
+        ParallelFor(_blocks, [&](std::size_t b, unsigned) {
+          T c = _offsets[b];
+          std::size_t j = First(c * scale, u);
+          for (std::size_t i = Begin(b); i < End(b); ++i) {
+            // End the block exactly where the next one starts.
+            c = i + 1 == End(b) ? _offsets[b + 1] : c + _weights[i];
+            const std::size_t next = First(c * scale, u);
+            for (; j < next; ++j)
+              _scratch[j] = _x[i];
+          }
+        }, _options.threads);
+        _x.swap(_scratch);
+        std::fill(_log_weights.begin(), _log_weights.end(),
+                  -std::log(T(_n)));
+        std::fill(_weights.begin(), _weights.end(), T(1) / T(_n));
+        ++_resamplings;
+      }
+
+      // Index of the first point j + u at or above c, clamped to [0, n].
+      std::size_t First(T c, T u) const
+      {
+        const T j = std::ceil(c - u);
+        return j <= T(0) ? 0 : std::min(_n, std::size_t(j));
+      }
+
+      System & _f;
+      ParticleFilterOptions _options;
+      std::size_t _n, _blocks;
+      std::vector<State> _x, _scratch;
+      std::vector<T> _log_weights, _weights;
+      std::vector<Stepper> _steppers;
+      std::vector<T> _block_max, _block_sum, _block_squares, _offsets;
+      std::uint64_t _step;
+      std::size_t _resamplings;
+      T _ess;
+  };
+}
+#endif
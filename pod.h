@@ -0,0 +1,370 @@
+/*! \file pod.h
+ *  \brief Proper orthogonal decomposition (POD) model order reduction.
+ *
+ *  A large model dx/dt = f(x) is replaced by a Galerkin projection onto the
+ *  dominant left singular vectors V of a snapshot matrix,
+ *
+ *      x ~ xbar + V a,    da/dt = V^T f(xbar + V a),
+ *
+ *  and the nonlinear term is optionally hyper-reduced with the discrete
+ *  empirical interpolation method (DEIM): f is approximated from m of its
+ *  components, f ~ U (P^T U)^{-1} P^T f, where U are the dominant left
+ *  singular vectors of right hand side snapshots and P selects the
+ *  interpolation components.  The reduced model then only requests those m
+ *  components through ComputeRHSComponents.
+ *
+ *  Singular vectors are computed with a randomized range finder followed by
+ *  an eigenvalue problem in the small sketched space, so the cost is linear
+ *  in the state dimension and in the number of snapshots.
+ */
+
+#ifndef __POD_H__
+#define __POD_H__
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "dense.h"
+#include "mappings.h"
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \class SnapshotCollector
+   *  \brief Integrator observer that stores every stride-th state.
+   *  \tparam T Data type of state variables (typically double).
+   *
+   *  Pass it as the observer of Integrate; the snapshots are the columns of
+   *  Snapshots().
+   */
+  template <class T>
+  class SnapshotCollector {
+    public:
+      /*!
+       * \param[in] stride Store every stride-th observed state.
+       */
+      explicit SnapshotCollector(std::size_t stride = 1)
+        : _stride(stride == 0 ? 1 : stride), _seen(0) {}
+
+      template <class I, class State>
+      void operator()(const I &, const State & x)
+      {
+        if (_seen++ % _stride)
+          return;
+        if (_snapshots.Cols() == 0)
+          _snapshots.Resize(x.size(), 0);
+        _snapshots.AppendColumn(&x[0]);
+      }
+
+      const DenseMatrix<T> & Snapshots() const { return _snapshots; }
+
+    private:
+      std::size_t _stride, _seen;
+      DenseMatrix<T> _snapshots;
+  };
+
+  /*!
+   * Truncated singular value decomposition A ~ U diag(sigma) W^T by a
+   * randomized range finder with power iterations (Halko, Martinsson and
+   * Tropp, 2011).  Only U and sigma are returned.
+   *
+   * \param[in] A Matrix to decompose.
+   * \param[in] rank Number of singular triplets to return.
+   * \param[out] U Leading left singular vectors, A.Rows() x rank.
+   * \param[out] sigma Leading singular values in decreasing order.
+   * \param[in] oversampling Extra sketch columns beyond rank.
+   * \param[in] power_iterations Subspace iterations sharpening the sketch.
+   * \param[in] seed Seed of the Gaussian test matrix.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   */
+  template <class T>
+  void RandomizedSVD(const DenseMatrix<T> & A, std::size_t rank,
+                     DenseMatrix<T> & U, std::vector<T> & sigma,
+                     std::size_t oversampling = 10, int power_iterations = 2,
+                     unsigned long seed = 0, unsigned threads = 0)
+  {
+    const std::size_t k = std::min(rank + oversampling,
+                                   std::min(A.Rows(), A.Cols()));
+    if (rank == 0 || rank > k)
+      throw std::invalid_argument("RandomizedSVD: invalid rank");
+    std::mt19937_64 engine(seed);
+    std::normal_distribution<T> normal;
+    DenseMatrix<T> omega(A.Cols(), k);
+    for (std::size_t j = 0; j < k; ++j)
+      for (std::size_t i = 0; i < A.Cols(); ++i)
+        omega(i, j) = normal(engine);
+
+    DenseMatrix<T> Y, Z;
+    Multiply(A, omega, Y, threads);
+    Orthonormalize(Y);
+    for (int q = 0; q < power_iterations; ++q) {
+      TransposeMultiply(A, Y, Z, threads);
+      Orthonormalize(Z);
+      Multiply(A, Z, Y, threads);
+      Orthonormalize(Y);
+    }
+
+    // A ~ Y B with B = Y^T A small; the left singular vectors of B are the
+    // eigenvectors of B B^T.
+    DenseMatrix<T> Bt, G, W;
+    TransposeMultiply(A, Y, Bt, threads);
+    TransposeMultiply(Bt, Bt, G, threads);
+    std::vector<T> lambda;
+    SymmetricEigen(G, lambda, W);
+    sigma.resize(rank);
+    for (std::size_t j = 0; j < rank; ++j)
+      sigma[j] = std::sqrt(std::max(lambda[j], T(0)));
+    DenseMatrix<T> Wr(k, rank);
+    for (std::size_t j = 0; j < rank; ++j)
+      std::copy(W.Column(j), W.Column(j) + k, Wr.Column(j));
+    Multiply(Y, Wr, U, threads);
+  }
+
+  /*!
+   * Greedy DEIM selection of interpolation components (Chaturantabut and
+   * Sorensen, 2010).
+   *
+   * \param[in] U Basis of the nonlinear term, one basis vector per column.
+   * \return Index of the component selected for each basis vector.
+   */
+  template <class T>
+  std::vector<int> DEIMIndices(const DenseMatrix<T> & U)
+  {
+    const std::size_t n = U.Rows(), m = U.Cols();
+    std::vector<int> indices;
+    std::vector<T> r(n);
+    for (std::size_t l = 0; l < m; ++l) {
+      const T * u = U.Column(l);
+      std::copy(u, u + n, r.begin());
+      if (l > 0) {
+        // Interpolate u_l from the previous basis vectors at the previous
+        // indices and take the component of the largest residual.
+        DenseMatrix<T> PU(l, l);
+        std::vector<T> c(l);
+        for (std::size_t i = 0; i < l; ++i) {
+          c[i] = u[indices[i]];
+          for (std::size_t j = 0; j < l; ++j)
+            PU(i, j) = U(indices[i], j);
+        }
+        std::vector<std::size_t> pivots;
+        if (!LUFactor(PU, pivots))
+          throw std::runtime_error("DEIMIndices: singular interpolation");
+        LUSolve(PU, pivots, c.data());
+        for (std::size_t j = 0; j < l; ++j)
+          for (std::size_t i = 0; i < n; ++i)
+            r[i] -= c[j] * U(i, j);
+      }
+      std::size_t best = 0;
+      for (std::size_t i = 1; i < n; ++i)
+        if (std::fabs(r[i]) > std::fabs(r[best]))
+          best = i;
+      indices.push_back(static_cast<int>(best));
+    }
+    return indices;
+  }
+
+  /*! \struct PODOptions
+   *  \brief Parameters of ReduceModel.
+   */
+  struct PODOptions {
+    PODOptions()
+      : rank(10), deim_rank(0), oversampling(10), power_iterations(2),
+        seed(0), threads(0), center(true) {}
+
+    //! Dimension of the reduced state space.
+    std::size_t rank;
+    //! Number of DEIM components, 0 for a plain Galerkin projection.
+    std::size_t deim_rank;
+    //! Extra sketch columns of the randomized SVD.
+    std::size_t oversampling;
+    //! Power iterations of the randomized SVD.
+    int power_iterations;
+    //! Seed of the randomized SVD.
+    unsigned long seed;
+    //! Number of threads, 0 selects HardwareThreads().
+    unsigned threads;
+    //! Subtract the snapshot mean before computing the basis.
+    bool center;
+  };
+
+  /*! \class PODMapping
+   *  \brief Reduced order model of a large autonomous, endogenous mapping.
+   *  \tparam T Data type of state variables (typically double).
+   *
+   *  The reduced state a has Dimension() = rank entries and is related to
+   *  the full state by Lift and Project.  The full model must outlive the
+   *  reduced one.
+   */
+  template <class T>
+  class PODMapping : public MappingAutonomousEndogenous<T, Dynamic> {
+    public:
+      typedef MappingAutonomousEndogenous<T, Dynamic> FullMapping;
+
+      /*!
+       * \param[in] full Full order model.
+       * \param[in] mean Centering state xbar.
+       * \param[in] basis Orthonormal POD basis V, one column per mode.
+       * \param[in] sigma Singular values of the POD modes.
+       * \param[in] indices DEIM components, empty for Galerkin projection.
+       * \param[in] projector V^T U (P^T U)^{-1}, rank x indices.size().
+       */
+      PODMapping(FullMapping & full, const std::vector<T> & mean,
+                 const DenseMatrix<T> & basis, const std::vector<T> & sigma,
+                 const std::vector<int> & indices,
+                 const DenseMatrix<T> & projector)
+        : _full(full), _mean(mean), _basis(basis), _sigma(sigma),
+          _indices(indices), _projector(projector) {}
+
+      virtual int Dimension() const
+      {
+        return static_cast<int>(_basis.Cols());
+      }
+
+      virtual void ComputeRHS(const std::vector<T> & a, std::vector<T> & rhs)
+      {
+        Lift(a, _x);
+        rhs.assign(_basis.Cols(), T(0));
+        if (_indices.empty()) {
+          _f.resize(_x.size());
+          _full.ComputeRHS(_x, _f);
+          for (std::size_t j = 0; j < _basis.Cols(); ++j) {
+            const T * v = _basis.Column(j);
+            T s(0);
+            for (std::size_t i = 0; i < _f.size(); ++i)
+              s += v[i] * _f[i];
+            rhs[j] = s;
+          }
+        } else {
+          _full.ComputeRHSComponents(_x, _indices, _f);
+          for (std::size_t k = 0; k < _indices.size(); ++k)
+            for (std::size_t j = 0; j < _basis.Cols(); ++j)
+              rhs[j] += _projector(j, k) * _f[k];
+        }
+      }
+
+      /*!
+       * Full state xbar + V a of a reduced state.
+       */
+      void Lift(const std::vector<T> & a, std::vector<T> & x) const
+      {
+        x = _mean;
+        for (std::size_t j = 0; j < _basis.Cols(); ++j) {
+          const T * v = _basis.Column(j);
+          for (std::size_t i = 0; i < x.size(); ++i)
+            x[i] += a[j] * v[i];
+        }
+      }
+
+      /*!
+       * Reduced state V^T (x - xbar) of a full state.
+       */
+      void Project(const std::vector<T> & x, std::vector<T> & a) const
+      {
+        a.assign(_basis.Cols(), T(0));
+        for (std::size_t j = 0; j < _basis.Cols(); ++j) {
+          const T * v = _basis.Column(j);
+          for (std::size_t i = 0; i < x.size(); ++i)
+            a[j] += v[i] * (x[i] - _mean[i]);
+        }
+      }
+
+      //! POD basis V.
+      const DenseMatrix<T> & Basis() const { return _basis; }
+      //! Singular values of the retained modes.
+      const std::vector<T> & SingularValues() const { return _sigma; }
+      //! DEIM interpolation components, empty without hyper-reduction.
+      const std::vector<int> & InterpolationIndices() const
+      {
+        return _indices;
+      }
+
+    private:
+      FullMapping & _full;
+      std::vector<T> _mean;
+      DenseMatrix<T> _basis;
+      std::vector<T> _sigma;
+      std::vector<int> _indices;
+      DenseMatrix<T> _projector;
+      std::vector<T> _x, _f;
+  };
+
+  /*!
+   * Builds a POD reduced model from state snapshots, e.g. collected with a
+   * SnapshotCollector during an integrator run.  With options.deim_rank > 0
+   * the right hand side is evaluated at every snapshot (in parallel, so
+   * ComputeRHS must tolerate concurrent calls when options.threads != 1) to
+   * build the DEIM basis.
+   *
+   * \param[in] full Full order model.
+   * \param[in] snapshots States, one per column.
+   * \param[in] options Reduction parameters.
+   */
+  template <class T>
+  PODMapping<T> ReduceModel(MappingAutonomousEndogenous<T, Dynamic> & full,
+                            const DenseMatrix<T> & snapshots,
+                            const PODOptions & options = PODOptions())
+  {
+    const std::size_t n = snapshots.Rows(), s = snapshots.Cols();
+    if (n != static_cast<std::size_t>(full.Dimension()) || s == 0)
+      throw std::invalid_argument("ReduceModel: snapshot shape mismatch");
+
+    std::vector<T> mean(n, T(0));
+    DenseMatrix<T> X(snapshots);
+    if (options.center) {
+      for (std::size_t j = 0; j < s; ++j)
+        for (std::size_t i = 0; i < n; ++i)
+          mean[i] += X(i, j) / T(s);
+      for (std::size_t j = 0; j < s; ++j)
+        for (std::size_t i = 0; i < n; ++i)
+          X(i, j) -= mean[i];
+    }
+    DenseMatrix<T> V;
+    std::vector<T> sigma;
+    RandomizedSVD(X, options.rank, V, sigma, options.oversampling,
+                  options.power_iterations, options.seed, options.threads);
+
+    std::vector<int> indices;
+    DenseMatrix<T> projector;
+    if (options.deim_rank > 0) {
+      DenseMatrix<T> F(n, s);
+      ParallelFor(s, [&](std::size_t j, unsigned) {
+        std::vector<T> xj(snapshots.Column(j), snapshots.Column(j) + n);
+        std::vector<T> fj(n);
+        full.ComputeRHS(xj, fj);
+        std::copy(fj.begin(), fj.end(), F.Column(j));
+      }, options.threads);
+
+      DenseMatrix<T> U;
+      std::vector<T> tau;
+      RandomizedSVD(F, options.deim_rank, U, tau, options.oversampling,
+                    options.power_iterations, options.seed + 1,
+                    options.threads);
+      indices = DEIMIndices(U);
+
+      // projector = V^T U (P^T U)^{-1}, computed row by row from
+      // (P^T U)^T projector^T = (V^T U)^T.
+      const std::size_t m = indices.size(), r = V.Cols();
+      DenseMatrix<T> PUt(m, m), VtU;
+      for (std::size_t i = 0; i < m; ++i)
+        for (std::size_t j = 0; j < m; ++j)
+          PUt(j, i) = U(indices[i], j);
+      std::vector<std::size_t> pivots;
+      if (!LUFactor(PUt, pivots))
+        throw std::runtime_error("ReduceModel: singular DEIM interpolation");
+      TransposeMultiply(V, U, VtU, options.threads);
+      projector.Resize(r, m);
+      std::vector<T> row(m);
+      for (std::size_t i = 0; i < r; ++i) {
+        for (std::size_t k = 0; k < m; ++k)
+          row[k] = VtU(i, k);
+        LUSolve(PUt, pivots, row.data());
+        for (std::size_t k = 0; k < m; ++k)
+          projector(i, k) = row[k];
+      }
+    }
+    return PODMapping<T>(full, mean, V, sigma, indices, projector);
+  }
+}
+#endif
@@ -0,0 +1,358 @@
+/*! \file ptc.h
+ *  \brief Pseudo-transient continuation for hard steady state problems.
+ *
+ *  Pseudo-transient continuation (Psi-tc, Kelley and Keyes, 1998) finds a
+ *  steady state of dx/dt = r(x) by taking linearized implicit Euler steps
+ *
+ *      (I / dt - J(x)) s = r(x),  x += s,
+ *
+ *  with a pseudo time step dt that grows by switched evolution relaxation
+ *  (SER), dt_{k+1} = dt_k |r(x_k)| / |r(x_{k+1})|.  Small steps follow the
+ *  transient, which makes the iteration robust from poor initial guesses
+ *  and steers it to stable steady states; as the residual falls the steps
+ *  grow without bound and the iteration turns into Newton's method with
+ *  its fast local convergence.
+ *
+ *  As in equilibrium.h, r(x) = f(x) for flows and f(x) - x for maps.
+ *  Dynamic mappings solve the linear systems with GMRES on matrix free
+ *  Jacobian products (see krylov.h), fixed size ones factor the Jacobian
+ *  with the dense LU of fixed_linalg.h.
+ */
+
+#ifndef __PTC_H__
+#define __PTC_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "autodiff.h"
+#include "equilibrium.h"
+#include "fixed_linalg.h"
+#include "krylov.h"
+#include "mappings.h"
+#include "trace.h"
+
+namespace dynamics {
+  /*! \struct PseudoTransientOptions
+   *  \brief Parameters of PseudoTransientContinuation.
+   */
+  struct PseudoTransientOptions {
+    PseudoTransientOptions()
+      : kind(FlowEquilibrium), tolerance(1e-8), initial_step(1e-1),
+        max_step(1e12), max_iterations(500)
+    {
+      gmres.tolerance = 1e-4;
+    }
+
+    EquilibriumKind kind;
+    //! Convergence when the largest residual component is below this.
+    double tolerance;
+    //! Initial pseudo time step.
+    double initial_step;
+    //! Largest pseudo time step.
+    double max_step;
+    //! Largest number of pseudo time steps.
+    int max_iterations;
+    //! Parameters of the linear solves of Dynamic mappings.
+    GmresOptions gmres;
+  };
+
+  /*! \struct PseudoTransientResult
+   *  \brief Result of PseudoTransientContinuation.
+   */
+  template <class T>
+  struct PseudoTransientResult {
+    //! Largest residual component at the final state.
+    T residual;
+    bool converged;
+    //! Number of pseudo time steps taken (including rejected ones).
+    int iterations;
+    //! Right hand side evaluations, including those for Jacobians.
+    long rhs_evaluations;
+    //! Total number of Krylov iterations (Dynamic mappings only).
+    long linear_iterations;
+    //! Final pseudo time step.
+    T step;
+  };
+
+  namespace internal {
+    template <class State>
+    typename State::value_type TwoNorm(const State & x)
+    {
+      typename State::value_type s(0);
+      for (std::size_t i = 0; i < x.size(); ++i)
+        s += x[i] * x[i];
+      return std::sqrt(s);
+    }
+
+    template <class State>
+    typename State::value_type InfinityNorm(const State & x)
+    {
+      typename State::value_type m(0);
+      for (std::size_t i = 0; i < x.size(); ++i)
+        m = std::max(m, std::fabs(x[i]));
+      return m;
+    }
+
+    // The Psi-tc iteration; step(x, r, dt, s) solves (I / dt - J(x)) s = r
+    // and returns false if it could not.
+    template <class State, class Residual, class LinearStep>
+    PseudoTransientResult<typename State::value_type>
+    PseudoTransient(Residual & residual, LinearStep & step, State & x,
+                    const PseudoTransientOptions & options)
+    {
+      typedef typename State::value_type T;
+      PseudoTransientResult<T> result;
+      result.converged = false;
+      result.iterations = 0;
+      result.linear_iterations = 0;
+      result.step = T(options.initial_step);
+      State r(x), rt(x), s(x), xt(x);
+      residual(x, r);
+      T norm = TwoNorm(r);
+      for (;;) {
+        result.residual = InfinityNorm(r);
+        if (result.residual <= T(options.tolerance)) {
+          result.converged = true;
+          break;
+        }
+        if (result.iterations == options.max_iterations)
+          break;
+        ++result.iterations;
+        bool solved;
+        {
+          DYNAMICS_TRACE_SPAN("linear solve");
+          solved = step(x, r, result.step, s);
+        }
+        T norm_t = std::numeric_limits<T>::infinity();
+        if (solved) {
+          for (std::size_t i = 0; i < x.size(); ++i)
+            xt[i] = x[i] + s[i];
+          residual(xt, rt);
+          norm_t = TwoNorm(rt);
+        }
+        if (!(norm_t < std::numeric_limits<T>::infinity())) {
+          // Retry the step from x with a much smaller pseudo time step.
+          result.step /= T(10);
+          if (result.step < std::numeric_limits<T>::min())
+            break;
+          continue;
+        }
+        // SER, kept above the initial step: a transient that raises the
+        // residual (e.g. leaving an unstable state or oscillating) would
+        // otherwise shrink the step until the iteration stalls.
+        result.step = std::min(T(options.max_step), std::max(
+            T(options.initial_step),
+            result.step * norm / std::max(norm_t,
+                                          std::numeric_limits<T>::min())));
+        x.swap(xt);
+        r.swap(rt);
+        norm = norm_t;
+      }
+      return result;
+    }
+
+    // Residual of a Dynamic mapping that counts its evaluations.
+    template <class T>
+    class DynamicResidual {
+      public:
+        DynamicResidual(MappingAutonomousEndogenous<T, Dynamic> & f,
+                        EquilibriumKind kind)
+          : _f(f), _kind(kind), _evaluations(0) {}
+
+        void operator()(const std::vector<T> & x, std::vector<T> & r)
+        {
+          r.resize(x.size());
+          _f.ComputeRHS(x, r);
+          ++_evaluations;
+          if (_kind == MapFixedPoint)
+            for (std::size_t i = 0; i < x.size(); ++i)
+              r[i] -= x[i];
+        }
+
+        long Evaluations() const { return _evaluations; }
+
+      private:
+        MappingAutonomousEndogenous<T, Dynamic> & _f;
+        EquilibriumKind _kind;
+        long _evaluations;
+    };
+
+    // (I / dt - J) s = r by GMRES on matrix free Jacobian products.
+    template <class T>
+    class KrylovStep {
+      public:
+        KrylovStep(MappingAutonomousEndogenous<T, Dynamic> & f,
+                   const PseudoTransientOptions & options)
+          : _J(f), _options(options), _iterations(0) {}
+
+        bool operator()(const std::vector<T> & x, const std::vector<T> & r,
+                        T dt, std::vector<T> & s)
+        {
+          // J v approximates the Jacobian of f, so the residual of a map
+          // (f(x) - x) is linearized from f(x) = r + x.
+          _fx = r;
+          if (_options.kind == MapFixedPoint)
+            for (std::size_t i = 0; i < x.size(); ++i)
+              _fx[i] += x[i];
+          _J.Linearize(x, _fx);
+          _dt = dt;
+          s.assign(x.size(), T(0));
+          KrylovResult<T> k = Gmres(*this, r, s, _options.gmres);
+          _iterations += k.iterations;
+          return k.residual < T(1);
+        }
+
+        // The operator I / dt - J of the residual.
+        void operator()(const std::vector<T> & v, std::vector<T> & Av)
+        {
+          _J(v, Av);
+          const T shift = T(1) / _dt
+            + (_options.kind == MapFixedPoint ? T(1) : T(0));
+          for (std::size_t i = 0; i < v.size(); ++i)
+            Av[i] = shift * v[i] - Av[i];
+        }
+
+        long Evaluations() const { return _J.Evaluations(); }
+        long Iterations() const { return _iterations; }
+
+      private:
+        JacobianVectorProduct<T> _J;
+        const PseudoTransientOptions & _options;
+        std::vector<T> _fx;
+        T _dt;
+        long _iterations;
+    };
+
+    // (I / dt - J) s = r by dense LU of a fixed size Jacobian.
+    template <class T, int N, class Jacobian>
+    class DenseStep {
+      public:
+        explicit DenseStep(Jacobian & jacobian) : _jacobian(jacobian) {}
+
+        bool operator()(const std::array<T, N> & x,
+                        const std::array<T, N> & r, T dt,
+                        std::array<T, N> & s)
+        {
+          _jacobian(x, _W);
+          for (int i = 0; i < N; ++i) {
+            for (int j = 0; j < N; ++j)
+              _W(i, j) = -_W(i, j);
+            _W(i, i) += T(1) / dt;
+          }
+          std::array<int, N> pivots;
+          if (!LUFactor(_W, pivots))
+            return false;
+          s = r;
+          LUSolve(_W, pivots, s);
+          return true;
+        }
+
+      private:
+        Jacobian & _jacobian;
+        Matrix<T, N> _W;
+    };
+
+    // Residual of a fixed size mapping that counts its evaluations.
+    template <class T, int N>
+    class CountingResidual {
+      public:
+        CountingResidual(MappingAutonomousEndogenous<T, N> & f,
+                         EquilibriumKind kind)
+          : _residual(f, kind), _evaluations(0) {}
+
+        void operator()(const std::array<T, N> & x, std::array<T, N> & r)
+        {
+          _residual(x, r);
+          ++_evaluations;
+        }
+
+        long Evaluations() const { return _evaluations; }
+
+      private:
+        EquilibriumResidual<T, N> _residual;
+        long _evaluations;
+    };
+  }
+
+  /*!
+   * Finds a steady state of a Dynamic mapping by pseudo-transient
+   * continuation with Jacobian-free Newton-Krylov linear solves.
+   *
+   * \param[in] f Mapping.
+   * \param[in,out] x Initial guess, replaced by the final iterate.
+   * \param[in] options Parameters.
+   */
+  template <class T>
+  PseudoTransientResult<T>
+  PseudoTransientContinuation(MappingAutonomousEndogenous<T, Dynamic> & f,
+                              std::vector<T> & x,
+                              const PseudoTransientOptions & options
+                                = PseudoTransientOptions())
+  {
+    internal::DynamicResidual<T> residual(f, options.kind);
+    internal::KrylovStep<T> step(f, options);
+    PseudoTransientResult<T> result =
+      internal::PseudoTransient(residual, step, x, options);
+    result.rhs_evaluations = residual.Evaluations() + step.Evaluations();
+    result.linear_iterations = step.Iterations();
+    return result;
+  }
+
+  /*!
+   * Finds a steady state of a fixed size mapping by pseudo-transient
+   * continuation with forward difference Jacobians.
+   *
+   * \param[in] f Mapping.
+   * \param[in,out] x Initial guess, replaced by the final iterate.
+   * \param[in] options Parameters.
+   */
+  template <class T, int N>
+  PseudoTransientResult<T>
+  PseudoTransientContinuation(MappingAutonomousEndogenous<T, N> & f,
+                              std::array<T, std::size_t(N)> & x,
+                              const PseudoTransientOptions & options
+                                = PseudoTransientOptions())
+  {
+    internal::CountingResidual<T, N> residual(f, options.kind);
+    internal::FiniteDifferenceJacobian<T, N> jacobian(
+        internal::EquilibriumResidual<T, N>(f, options.kind));
+    internal::DenseStep<T, N, internal::FiniteDifferenceJacobian<T, N> >
+      step(jacobian);
+    PseudoTransientResult<T> result =
+      internal::PseudoTransient(residual, step, x, options);
+    result.rhs_evaluations = residual.Evaluations()
+      + long(N + 1) * result.iterations;
+    return result;
+  }
+
+  /*!
+   * Finds a steady state of a fixed size mapping by pseudo-transient
+   * continuation with exact Jacobians.
+   *
+   * \param[in] f Mapping.
+   * \param[in] df The same mapping instantiated with Dual<T, N> scalars.
+   * \param[in,out] x Initial guess, replaced by the final iterate.
+   * \param[in] options Parameters.
+   */
+  template <class T, int N>
+  PseudoTransientResult<T>
+  PseudoTransientContinuation(MappingAutonomousEndogenous<T, N> & f,
+                              MappingAutonomousEndogenous<Dual<T, N>, N> & df,
+                              std::array<T, std::size_t(N)> & x,
+                              const PseudoTransientOptions & options
+                                = PseudoTransientOptions())
+  {
+    internal::CountingResidual<T, N> residual(f, options.kind);
+    internal::DualJacobian<T, N> jacobian(df, options.kind);
+    internal::DenseStep<T, N, internal::DualJacobian<T, N> > step(jacobian);
+    PseudoTransientResult<T> result =
+      internal::PseudoTransient(residual, step, x, options);
+    result.rhs_evaluations = residual.Evaluations() + result.iterations;
+    return result;
+  }
+}
+#endif
@@ -0,0 +1,295 @@
+/*! \file qmc.h
+ *  \brief Quasi-Monte Carlo sampling of initial conditions and parameters.
+ *
+ *  Low discrepancy sequences fill the unit cube more evenly than
+ *  pseudo-random samples, so ensemble means of smooth outputs converge at
+ *  close to O(1/n) instead of O(1/sqrt(n)).  Both sequences here give
+ *  random access to their points, which lets ensemble members draw their
+ *  point by index from any thread.
+ *
+ *  Randomization by Owen's nested uniform scrambling keeps the low
+ *  discrepancy, makes every point uniformly distributed, and allows error
+ *  estimates from a few independently scrambled replicates.
+ */
+
+#ifndef __QMC_H__
+#define __QMC_H__
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "ensemble.h"
+#include "random.h"
+
+namespace dynamics {
+  /*! \class SobolSequence
+   *  \brief Sobol' sequence with optional Owen scrambling.
+   *
+   *  Direction numbers are those of Joe and Kuo (new-joe-kuo-6.21201) for up
+   *  to 21 dimensions, with 32 bits of resolution.  Scrambling uses the hash
+   *  based nested uniform scrambling of Burley (2020), which costs a few
+   *  integer operations per coordinate.
+   */
+  class SobolSequence {
+    public:
+      //! Largest supported number of dimensions.
+      static const int MaxDimensions = 21;
+
+      /*!
+       * \param[in] dimensions Number of coordinates per point.
+       * \param[in] scramble Apply Owen scrambling.
+       * \param[in] seed Seed of the scrambling; different seeds give
+       *            independent replicates.
+       */
+      explicit SobolSequence(int dimensions, bool scramble = true,
+                             std::uint64_t seed = 0)
+        : _dimensions(dimensions), _scramble(scramble),
+          _directions(dimensions * 32), _seeds(dimensions)
+      {
+        if (dimensions < 1 || dimensions > MaxDimensions)
+          throw std::invalid_argument("SobolSequence: unsupported dimension");
+        // Degree s, coefficients a and initial direction numbers m of the
+        // primitive polynomials for dimensions 2, 3, ...
+        static const unsigned table[MaxDimensions - 1][9] = {
+          {1, 0, 1},
+          {2, 1, 1, 3},
+          {3, 1, 1, 3, 1},
+          {3, 2, 1, 1, 1},
+          {4, 1, 1, 1, 3, 3},
+          {4, 4, 1, 3, 5, 13},
+          {5, 2, 1, 1, 5, 5, 17},
+          {5, 4, 1, 1, 5, 5, 5},
+          {5, 7, 1, 1, 7, 11, 19},
+          {5, 11, 1, 1, 5, 1, 1},
+          {5, 13, 1, 1, 1, 3, 11},
+          {5, 14, 1, 3, 5, 5, 31},
+          {6, 1, 1, 3, 3, 9, 7, 49},
+          {6, 13, 1, 1, 1, 15, 21, 21},
+          {6, 16, 1, 3, 1, 13, 27, 49},
+          {6, 19, 1, 1, 1, 15, 7, 5},
+          {6, 22, 1, 3, 1, 15, 13, 25},
+          {6, 25, 1, 1, 5, 5, 19, 61},
+          {7, 1, 1, 3, 7, 11, 23, 15, 103},
+          {7, 4, 1, 3, 7, 13, 13, 15, 69}
+        };
+        for (int b = 0; b < 32; ++b)
+          _directions[b] = 1u << (31 - b);
+        for (int d = 1; d < dimensions; ++d) {
+          const unsigned * row = table[d - 1];
+          const unsigned s = row[0], a = row[1];
+          std::uint32_t * v = &_directions[d * 32];
+          for (unsigned b = 0; b < s; ++b)
+            v[b] = row[2 + b] << (31 - b);
+          for (unsigned b = s; b < 32; ++b) {
+            v[b] = v[b - s] ^ (v[b - s] >> s);
+            for (unsigned k = 1; k < s; ++k)
+              if ((a >> (s - 1 - k)) & 1u)
+                v[b] ^= v[b - k];
+          }
+        }
+        for (int d = 0; d < dimensions; ++d)
+          _seeds[d] = static_cast<std::uint32_t>(Mix64(seed * 64 + d));
+      }
+
+      int Dimensions() const { return _dimensions; }
+
+      /*!
+       * Computes point number index.  Unscrambled points lie on the dyadic
+       * grid and the first one is the origin; scrambled points are moved to
+       * the centers of their 2^-32 cells so that none lies on the boundary.
+       *
+       * \param[in] index Index of the point, below 2^32; larger indices
+       *            throw std::out_of_range.
+       * \param[out] u Dimensions() coordinates in [0, 1).
+       */
+      template <class T>
+      void Point(std::uint64_t index, T * u) const
+      {
+        if (index >> 32)
+          throw std::out_of_range("SobolSequence: index beyond 2^32");
+        for (int d = 0; d < _dimensions; ++d) {
+          const std::uint32_t * v = &_directions[d * 32];
+          std::uint32_t x = 0;
+          std::uint64_t i = index;
+          for (int b = 0; i; ++b, i >>= 1)
+            if (i & 1u)
+              x ^= v[b];
+          if (_scramble)
+            u[d] = (T(NestedUniformScramble(x, _seeds[d])) + T(0.5))
+              * T(1.0 / 4294967296.0);
+          else
+            u[d] = T(x) * T(1.0 / 4294967296.0);
+        }
+      }
+
+    private:
+      static std::uint32_t ReverseBits(std::uint32_t x)
+      {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+      }
+
+      // Each output bit only depends on the seed and on the more significant
+      // input bits, which is exactly Owen's nested scrambling.
+      static std::uint32_t NestedUniformScramble(std::uint32_t x,
+                                                 std::uint32_t seed)
+      {
+        x = ReverseBits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return ReverseBits(x);
+      }
+
+      int _dimensions;
+      bool _scramble;
+      std::vector<std::uint32_t> _directions;
+      std::vector<std::uint32_t> _seeds;
+  };
+
+  /*! \class HaltonSequence
+   *  \brief Halton sequence with optional Owen scrambling.
+   *
+   *  Coordinate d is the radical inverse of the index in the d-th prime
+   *  base.  With scrambling, every digit is permuted by a uniformly random
+   *  permutation that depends on the seed, the digit position and all more
+   *  significant digits, and digits are generated until double precision is
+   *  exhausted.  This is exact Owen scrambling, at a cost proportional to the
+   *  base per digit, so scrambled Halton points are more expensive than
+   *  Sobol' points in high dimensions.
+   */
+  class HaltonSequence {
+    public:
+      //! Largest supported number of dimensions.
+      static const int MaxDimensions = 32;
+
+      /*!
+       * \param[in] dimensions Number of coordinates per point.
+       * \param[in] scramble Apply Owen scrambling.
+       * \param[in] seed Seed of the scrambling; different seeds give
+       *            independent replicates.
+       */
+      explicit HaltonSequence(int dimensions, bool scramble = true,
+                              std::uint64_t seed = 0)
+        : _dimensions(dimensions), _scramble(scramble), _seed(Mix64(seed))
+      {
+        if (dimensions < 1 || dimensions > MaxDimensions)
+          throw std::invalid_argument("HaltonSequence: unsupported dimension");
+      }
+
+      int Dimensions() const { return _dimensions; }
+
+      /*!
+       * Computes point number index.
+       *
+       * \param[in] index Index of the point.
+       * \param[out] u Dimensions() coordinates in [0, 1).
+       */
+      template <class T>
+      void Point(std::uint64_t index, T * u) const
+      {
+        static const unsigned primes[MaxDimensions] = {
+          2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+          59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127,
+          131
+        };
+        for (int d = 0; d < _dimensions; ++d) {
+          const unsigned base = primes[d];
+          const double inverse = 1.0 / base;
+          double factor = inverse, value = 0.0;
+          std::uint64_t i = index;
+          std::uint64_t node = Mix64(_seed ^ std::uint64_t(d));
+          // Unscrambled expansions end with the last nonzero digit; scrambled
+          // ones continue through the permuted zeros down to 2^-53.
+          while (_scramble ? factor > 1.1e-16 : i != 0) {
+            unsigned digit = static_cast<unsigned>(i % base);
+            i /= base;
+            unsigned permuted = _scramble ? Permute(digit, base, node)
+                                          : digit;
+            node = Mix64(node ^ (std::uint64_t(digit) + 1) * 0x9e37u);
+            value += permuted * factor;
+            factor *= inverse;
+          }
+          u[d] = T(value < 1.0 ? value : 1.0 - 1.1e-16);
+        }
+      }
+
+    private:
+      // Image of digit under the uniformly random permutation of
+      // {0, ..., base - 1} selected by key (Fisher-Yates shuffle).
+      static unsigned Permute(unsigned digit, unsigned base,
+                              std::uint64_t key)
+      {
+        unsigned pi[131];
+        for (unsigned k = 0; k < base; ++k)
+          pi[k] = k;
+        for (unsigned k = base - 1; k > 0; --k) {
+          key = Mix64(key);
+          unsigned j = static_cast<unsigned>(key % (k + 1));
+          unsigned t = pi[k];
+          pi[k] = pi[j];
+          pi[j] = t;
+        }
+        return pi[digit];
+      }
+
+      int _dimensions;
+      bool _scramble;
+      std::uint64_t _seed;
+  };
+
+  /*!
+   * Feeds the first points of a low discrepancy sequence into the ensemble
+   * runner.  Member i receives point i of the sequence, which it maps to
+   * initial conditions and parameters of its integration.
+   *
+   * For error estimates, run a few replicates with independently seeded
+   * scrambled sequences and treat the replicate means as independent
+   * samples.
+   *
+   * \param[in] sequence SobolSequence, HaltonSequence or any class with
+   *            Dimensions() and Point(index, u).
+   * \param[in] points Number of points (ensemble members).
+   * \param[in] prototype Empty accumulator copied once per thread.
+   * \param[in] member Called as member(u, accumulator, thread), with u a
+   *            pointer to Dimensions() coordinates in [0, 1).
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \param[in] offset Index of the first point used.
+   * \return The merged accumulator.
+   *
+   * The last point is computed before the run, so a range of indices the
+   * sequence does not support (2^32 points for SobolSequence) throws
+   * before any member is integrated.
+   */
+  template <class Sequence, class Accumulator, class Member>
+  Accumulator RunQuasiMonteCarlo(const Sequence & sequence,
+                                 std::size_t points,
+                                 const Accumulator & prototype,
+                                 Member member, unsigned threads = 0,
+                                 std::uint64_t offset = 0)
+  {
+    std::vector<std::vector<double> > u(ResolveThreads(threads, points),
+                                        std::vector<double>(
+                                            sequence.Dimensions()));
+    if (points > 0) {
+      const std::uint64_t last = offset + (points - 1);
+      if (last < offset)
+        throw std::out_of_range("RunQuasiMonteCarlo: index overflow");
+      sequence.Point(last, u[0].data());
+    }
+    return RunEnsemble(points, prototype,
+                       [&](std::size_t i, Accumulator & accumulator,
+                           unsigned thread) {
+      sequence.Point(offset + i, u[thread].data());
+      member(static_cast<const double *>(u[thread].data()), accumulator,
+             thread);
+    }, threads);
+  }
+}
+#endif
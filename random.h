@@ -0,0 +1,62 @@
+/*! \file random.h
+ *  \brief Small, reproducible random number generators.
+ *
+ *  Parallel drivers need one independent random stream per ensemble member
+ *  that does not depend on which thread runs the member.  SplitMix64 is
+ *  cheap to seed from (seed, stream) pairs and satisfies the standard
+ *  uniform random bit generator requirements, so it works with the
+ *  distributions of <random>.
+ */
+
+#ifndef __RANDOM_H__
+#define __RANDOM_H__
+#include <cstdint>
+#include <limits>
+
+namespace dynamics {
+  /*!
+   * The splitmix64 finalizer, a cheap and well mixing 64 bit hash.
+   */
+  inline std::uint64_t Mix64(std::uint64_t x)
+  {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  /*! \class SplitMix64
+   *  \brief The splitmix64 generator (Steele, Lea and Flood, 2014).
+   */
+  class SplitMix64 {
+    public:
+      typedef std::uint64_t result_type;
+
+      /*!
+       * \param[in] seed Seed of the generator.
+       * \param[in] stream Index of an independent stream, e.g. the index of
+       *            an ensemble member.
+       */
+      explicit SplitMix64(std::uint64_t seed = 0, std::uint64_t stream = 0)
+        : _state(Mix64(seed) ^ Mix64(~stream)) {}
+
+      static constexpr result_type min() { return 0; }
+      static constexpr result_type max()
+      {
+        return std::numeric_limits<result_type>::max();
+      }
+
+      result_type operator()()
+      {
+        _state += 0x9e3779b97f4a7c15ull;
+        std::uint64_t z = _state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+      }
+
+    private:
+      std::uint64_t _state;
+  };
+}
+#endif
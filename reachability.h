@@ -0,0 +1,579 @@
+/*! \file reachability.h
+ *  \brief Zonotope reachability analysis of mappings with bounded inputs.
+ *
+ *  ComputeReachableSets encloses every trajectory of dx/dt = f(x, u) that
+ *  starts in a zonotope (a centrally symmetric polytope c + G [-1, 1]^g)
+ *  under any input signal u(t) within a box, by conservative linearization
+ *  (Althoff, Stursberg and Buss, 2008).  In every time step
+ *
+ *    - f is linearized at the center of the current set with automatic
+ *      differentiation,
+ *    - an a priori box enclosure of the states over the step is found by a
+ *      Picard iteration in interval arithmetic,
+ *    - the Lagrange remainder of the linearization over that box, taken
+ *      from an interval enclosure of the Jacobian (mean value form), joins
+ *      the inputs as an additional bounded disturbance, and
+ *    - the linear system is propagated by a truncated Taylor series of the
+ *      matrix exponential whose remainder is bounded in norm.
+ *
+ *  The mapping is evaluated with Dual<Interval<T>, N + M> scalars (see
+ *  autodiff.h and interval.h), which gives values and Jacobians over boxes
+ *  in one pass.  Generator counts are kept bounded by Girard's reduction,
+ *  which boxes the generators that matter least.  The initial set can be
+ *  split into pieces whose flowpipes are computed in parallel; smaller
+ *  pieces also have smaller linearization errors.
+ */
+
+#ifndef __REACHABILITY_H__
+#define __REACHABILITY_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "autodiff.h"
+#include "fixed_linalg.h"
+#include "interval.h"
+#include "mappings.h"
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \class Zonotope
+   *  \brief The set c + sum_k b_k g_k with all |b_k| <= 1.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   */
+  template <class T, int N>
+  class Zonotope {
+    public:
+      typedef std::array<T, std::size_t(N)> Vector;
+
+      Zonotope() { _center.fill(T(0)); }
+
+      //! A point.
+      explicit Zonotope(const Vector & center) : _center(center) {}
+
+      //! Axis aligned box.
+      static Zonotope Box(const Vector & lower, const Vector & upper)
+      {
+        Zonotope z;
+        for (int i = 0; i < N; ++i) {
+          z._center[i] = T(0.5) * (lower[i] + upper[i]);
+          Vector g;
+          g.fill(T(0));
+          g[i] = T(0.5) * (upper[i] - lower[i]);
+          if (g[i] > T(0))
+            z._generators.push_back(g);
+        }
+        return z;
+      }
+
+      const Vector & Center() const { return _center; }
+      Vector & Center() { return _center; }
+
+      const std::vector<Vector> & Generators() const { return _generators; }
+      std::vector<Vector> & Generators() { return _generators; }
+
+      void AddGenerator(const Vector & g) { _generators.push_back(g); }
+
+      //! Radii of the smallest enclosing box.
+      Vector Radius() const
+      {
+        Vector r;
+        r.fill(T(0));
+        for (std::size_t k = 0; k < _generators.size(); ++k)
+          for (int i = 0; i < N; ++i)
+            r[i] += std::fabs(_generators[k][i]);
+        return r;
+      }
+
+      //! Smallest enclosing box.
+      void Bounds(Vector & lower, Vector & upper) const
+      {
+        const Vector r = Radius();
+        for (int i = 0; i < N; ++i) {
+          lower[i] = _center[i] - r[i];
+          upper[i] = _center[i] + r[i];
+        }
+      }
+
+      //! Largest value of d^T x over the set.
+      T Support(const Vector & d) const
+      {
+        T s(0);
+        for (int i = 0; i < N; ++i)
+          s += d[i] * _center[i];
+        for (std::size_t k = 0; k < _generators.size(); ++k) {
+          T p(0);
+          for (int i = 0; i < N; ++i)
+            p += d[i] * _generators[k][i];
+          s += std::fabs(p);
+        }
+        return s;
+      }
+
+      /*!
+       * Encloses the set by one with at most order N generators, replacing
+       * the generators with the smallest difference of 1- and infinity
+       * norms (those closest to being axis aligned) by a box (Girard's
+       * method).
+       */
+      void Reduce(std::size_t order)
+      {
+        const std::size_t limit = std::max<std::size_t>(order, 1) * N;
+        if (_generators.size() <= limit)
+          return;
+        std::vector<std::pair<T, std::size_t> > rank(_generators.size());
+        for (std::size_t k = 0; k < _generators.size(); ++k) {
+          T one(0), inf(0);
+          for (int i = 0; i < N; ++i) {
+            one += std::fabs(_generators[k][i]);
+            inf = std::max(inf, std::fabs(_generators[k][i]));
+          }
+          rank[k] = std::make_pair(one - inf, k);
+        }
+        std::sort(rank.begin(), rank.end());
+        const std::size_t boxed = _generators.size() - (limit - N);
+        Vector box;
+        box.fill(T(0));
+        for (std::size_t k = 0; k < boxed; ++k)
+          for (int i = 0; i < N; ++i)
+            box[i] += std::fabs(_generators[rank[k].second][i]);
+        std::vector<Vector> kept;
+        kept.reserve(limit);
+        for (std::size_t k = boxed; k < rank.size(); ++k)
+          kept.push_back(_generators[rank[k].second]);
+        for (int i = 0; i < N; ++i)
+          if (box[i] > T(0)) {
+            Vector g;
+            g.fill(T(0));
+            g[i] = box[i];
+            kept.push_back(g);
+          }
+        _generators.swap(kept);
+      }
+
+      /*!
+       * Splits the set in halves along its longest generator; the union of
+       * the halves is the set.
+       */
+      void Split(Zonotope & first, Zonotope & second) const
+      {
+        first = second = *this;
+        if (_generators.empty())
+          return;
+        std::size_t longest = 0;
+        T length(-1);
+        for (std::size_t k = 0; k < _generators.size(); ++k) {
+          T s(0);
+          for (int i = 0; i < N; ++i)
+            s += _generators[k][i] * _generators[k][i];
+          if (s > length) {
+            length = s;
+            longest = k;
+          }
+        }
+        for (int i = 0; i < N; ++i) {
+          const T half = T(0.5) * _generators[longest][i];
+          first._center[i] -= half;
+          second._center[i] += half;
+          first._generators[longest][i] = half;
+          second._generators[longest][i] = half;
+        }
+      }
+
+    private:
+      Vector _center;
+      std::vector<Vector> _generators;
+  };
+
+  /*! \struct ReachabilityOptions
+   *  \brief Parameters of ComputeReachableSets.
+   */
+  struct ReachabilityOptions {
+    ReachabilityOptions()
+      : taylor(4), order(20), splits(0), threads(0) {}
+
+    //! Order of the Taylor series of the matrix exponential.
+    int taylor;
+    //! Largest number of generators per state dimension.
+    std::size_t order;
+    //! The initial set is split into 2^splits pieces.
+    int splits;
+    //! Number of threads computing pieces, 0 selects HardwareThreads().
+    unsigned threads;
+  };
+
+  /*! \class Flowpipe
+   *  \brief Reachable sets computed by ComputeReachableSets.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   */
+  template <class T, int N>
+  class Flowpipe {
+    public:
+      typedef std::array<T, std::size_t(N)> Vector;
+
+      /*!
+       * \param[in] sets Sets of every piece at the time steps.
+       * \param[in] lower Lower corners of the boxes enclosing every piece
+       *            during the steps.
+       * \param[in] upper Upper corners of those boxes.
+       */
+      Flowpipe(const std::vector<std::vector<Zonotope<T, N> > > & sets,
+               const std::vector<std::vector<Vector> > & lower,
+               const std::vector<std::vector<Vector> > & upper)
+        : _steps(sets.empty() ? 0 : sets[0].size() - 1), _sets(sets),
+          _lower(lower), _upper(upper) {}
+
+      std::size_t Pieces() const { return _sets.size(); }
+      std::size_t Steps() const { return _steps; }
+
+      //! Enclosure of the states of piece p at time step k.
+      const Zonotope<T, N> & Set(std::size_t p, std::size_t k) const
+      {
+        return _sets[p][k];
+      }
+
+      //! Box enclosing all states at time step k.
+      void Bounds(std::size_t k, Vector & lower, Vector & upper) const
+      {
+        for (std::size_t p = 0; p < _sets.size(); ++p) {
+          Vector l, u;
+          _sets[p][k].Bounds(l, u);
+          for (int i = 0; i < N; ++i) {
+            lower[i] = p == 0 ? l[i] : std::min(lower[i], l[i]);
+            upper[i] = p == 0 ? u[i] : std::max(upper[i], u[i]);
+          }
+        }
+      }
+
+      //! Box enclosing all states between time steps k and k + 1.
+      void Tube(std::size_t k, Vector & lower, Vector & upper) const
+      {
+        for (std::size_t p = 0; p < _sets.size(); ++p)
+          for (int i = 0; i < N; ++i) {
+            lower[i] = p == 0 ? _lower[p][k][i]
+              : std::min(lower[i], _lower[p][k][i]);
+            upper[i] = p == 0 ? _upper[p][k][i]
+              : std::max(upper[i], _upper[p][k][i]);
+          }
+      }
+
+    private:
+      std::size_t _steps;
+      std::vector<std::vector<Zonotope<T, N> > > _sets;
+      std::vector<std::vector<Vector> > _lower, _upper;
+  };
+
+  /*! \class ReachabilityStepper
+   *  \brief One step of conservative linearization.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of exogenous inputs.
+   */
+  template <class T, int N, int M>
+  class ReachabilityStepper {
+    public:
+      typedef Dual<Interval<T>, N + M> Scalar;
+      typedef MappingAutonomousExogenous<Scalar, N, M> Mapping;
+      typedef std::array<T, std::size_t(N)> Vector;
+      typedef std::array<T, std::size_t(M)> Input;
+
+      /*!
+       * \param[in] f Mapping evaluated over boxes.
+       * \param[in] lower Lower bounds of the inputs.
+       * \param[in] upper Upper bounds of the inputs.
+       * \param[in] h Time step.
+       * \param[in] options Parameters.
+       */
+      ReachabilityStepper(Mapping & f, const Input & lower,
+                          const Input & upper, T h,
+                          const ReachabilityOptions & options)
+        : _f(f), _h(h), _options(options)
+      {
+        for (int j = 0; j < M; ++j)
+          _u[j] = Interval<T>(lower[j], upper[j]);
+        if (!(h > T(0)) || options.taylor < 1)
+          throw std::invalid_argument("ReachabilityStepper: bad step or "
+                                      "Taylor order");
+      }
+
+      /*!
+       * Advances the enclosure R by one step.
+       *
+       * \param[in,out] R Enclosure of the states at the start of the step,
+       *                replaced by one at its end.
+       * \param[out] lower Lower corner of a box enclosing the states
+       *             during the step.
+       * \param[out] upper Upper corner of that box.
+       */
+      void Step(Zonotope<T, N> & R, Vector & lower, Vector & upper)
+      {
+        const Vector & c = R.Center();
+        const Vector radius = R.Radius();
+
+        // Linearization at the center; the remainder accounts for the
+        // midpoints being used.
+        std::array<Interval<T>, std::size_t(N)> point;
+        for (int i = 0; i < N; ++i)
+          point[i] = Interval<T>(c[i]);
+        std::array<Interval<T>, std::size_t(M)> center;
+        for (int j = 0; j < M; ++j)
+          center[j] = Interval<T>(_u[j].Mid());
+        Evaluate(point, center);
+        Matrix<T, N, N + M> J;
+        Vector f0;
+        std::array<Interval<T>, std::size_t(N)> fc;
+        for (int i = 0; i < N; ++i) {
+          fc[i] = _rhs[i].Value();
+          f0[i] = fc[i].Mid();
+          for (int a = 0; a < N + M; ++a)
+            J(i, a) = _rhs[i].Derivative(a).Mid();
+        }
+
+        // A priori enclosure E of the states over the step: if
+        // R + [0, h] f(E, U) lies within E, all trajectories stay in it.
+        std::array<Interval<T>, std::size_t(N)> start, E, next;
+        for (int i = 0; i < N; ++i)
+          start[i] = Interval<T>::Outward(c[i] - radius[i],
+                                          c[i] + radius[i]);
+        const Interval<T> span(T(0), _h);
+        E = start;
+        bool enclosed = false;
+        for (int attempt = 0; attempt < 30 && !enclosed; ++attempt) {
+          Evaluate(E, _u);
+          enclosed = true;
+          for (int i = 0; i < N; ++i) {
+            next[i] = start[i] + span * _rhs[i].Value();
+            enclosed = enclosed && next[i].Within(E[i]);
+          }
+          if (enclosed) {
+            E = next;
+          } else {
+            for (int i = 0; i < N; ++i) {
+              const Interval<T> hull = Hull(E[i], next[i]);
+              const T grow = T(0.1) * hull.Width()
+                + std::numeric_limits<T>::epsilon()
+                  * (1 + std::fabs(hull.Mid()));
+              E[i] = Interval<T>::Outward(hull.Lower() - grow,
+                                          hull.Upper() + grow);
+            }
+          }
+        }
+        if (!enclosed)
+          throw std::runtime_error("ReachabilityStepper: no a priori "
+                                   "enclosure, reduce the time step");
+        for (int i = 0; i < N; ++i) {
+          lower[i] = E[i].Lower();
+          upper[i] = E[i].Upper();
+        }
+
+        // Lagrange remainder over E x U in mean value form,
+        // f(z) - f0 - J (z - z*) in (f(z*) - f0) + (J(E x U) - J)(z - z*).
+        Evaluate(E, _u);
+        std::array<Interval<T>, std::size_t(N)> L;
+        for (int i = 0; i < N; ++i) {
+          L[i] = fc[i] - Interval<T>(f0[i]);
+          for (int a = 0; a < N + M; ++a) {
+            const Interval<T> z = a < N ? E[a] - Interval<T>(c[a])
+              : _u[a - N] - center[a - N];
+            L[i] += (_rhs[i].Derivative(a) - Interval<T>(J(i, a))) * z;
+          }
+        }
+
+        // The deviation y = x - c obeys dy/dt = A y + v with v in the
+        // zonotope V = f0 + B (U - u*) + L.
+        Vector vc;
+        std::vector<Vector> vg;
+        T vnorm(0);
+        for (int i = 0; i < N; ++i)
+          vc[i] = f0[i] + L[i].Mid();
+        for (int j = 0; j < M; ++j) {
+          Vector g;
+          for (int i = 0; i < N; ++i)
+            g[i] = J(i, N + j) * _u[j].Radius();
+          vg.push_back(g);
+        }
+        for (int i = 0; i < N; ++i) {
+          Vector g;
+          g.fill(T(0));
+          g[i] = L[i].Radius();
+          if (g[i] > T(0))
+            vg.push_back(g);
+        }
+        Vector vr;
+        vr.fill(T(0));
+        for (std::size_t k = 0; k < vg.size(); ++k)
+          for (int i = 0; i < N; ++i)
+            vr[i] += std::fabs(vg[k][i]);
+        for (int i = 0; i < N; ++i)
+          vnorm = std::max(vnorm, std::fabs(vc[i]) + vr[i]);
+
+        // Taylor series Phi = sum (A h)^q / q! and the input terms
+        // h (A h)^q / (q + 1)!, of which those beyond the first are boxed
+        // one by one, since inputs vary within the step; phi bounds the
+        // norm of the series remainder.
+        const int p = _options.taylor;
+        Matrix<T, N> Ah, power = Matrix<T, N>::Identity(),
+          Phi = Matrix<T, N>::Identity(), Gamma1 = Matrix<T, N>::Zero();
+        _terms.resize(p);
+        T norm(0);
+        for (int i = 0; i < N; ++i) {
+          T row(0);
+          for (int k = 0; k < N; ++k) {
+            Ah(i, k) = J(i, k) * _h;
+            row += std::fabs(Ah(i, k));
+          }
+          norm = std::max(norm, row);
+        }
+        T factorial(1);
+        for (int q = 1; q <= p; ++q) {
+          MatMul(Matrix<T, N>(power), Ah, power);
+          factorial *= T(q);
+          for (int i = 0; i < N; ++i)
+            for (int k = 0; k < N; ++k) {
+              Phi(i, k) += power(i, k) / factorial;
+              _terms[q - 1](i, k) = _h * power(i, k)
+                / (factorial * T(q + 1));
+              Gamma1(i, k) += _terms[q - 1](i, k);
+            }
+        }
+        const T ratio = norm / T(p + 2);
+        if (!(ratio < T(1)))
+          throw std::runtime_error("ReachabilityStepper: time step too "
+                                   "large for the Taylor order");
+        const T phi = std::pow(norm, T(p + 1))
+          / (factorial * T(p + 1) * (1 - ratio));
+
+        // New set: c + Gamma vc + Phi G + h G_V + box of the remainders.
+        Vector box;
+        T rmax(0);
+        for (int i = 0; i < N; ++i)
+          rmax = std::max(rmax, radius[i]);
+        for (int i = 0; i < N; ++i) {
+          box[i] = phi * (rmax + _h * vnorm);
+          for (std::size_t k = 0; k < vg.size(); ++k)
+            for (int q = 0; q < p; ++q) {
+              T s(0);
+              for (int a = 0; a < N; ++a)
+                s += _terms[q](i, a) * vg[k][a];
+              box[i] += std::fabs(s);
+            }
+        }
+        Vector shift;
+        for (int i = 0; i < N; ++i) {
+          T s = _h * vc[i];
+          for (int a = 0; a < N; ++a)
+            s += Gamma1(i, a) * vc[a];
+          shift[i] = s;
+        }
+        std::vector<Vector> & G = R.Generators();
+        for (std::size_t k = 0; k < G.size(); ++k) {
+          Vector g;
+          for (int i = 0; i < N; ++i) {
+            T s(0);
+            for (int a = 0; a < N; ++a)
+              s += Phi(i, a) * G[k][a];
+            g[i] = s;
+          }
+          G[k] = g;
+        }
+        for (std::size_t k = 0; k < vg.size(); ++k) {
+          Vector g;
+          for (int i = 0; i < N; ++i)
+            g[i] = _h * vg[k][i];
+          R.AddGenerator(g);
+        }
+        // Rounding in the products above is covered by a relative margin.
+        const T eps = std::numeric_limits<T>::epsilon() * T(4 * (N + p));
+        const Vector spread = R.Radius();
+        for (int i = 0; i < N; ++i) {
+          R.Center()[i] += shift[i];
+          Vector g;
+          g.fill(T(0));
+          g[i] = box[i] + eps * (spread[i] + std::fabs(R.Center()[i]));
+          if (g[i] > T(0))
+            R.AddGenerator(g);
+        }
+        R.Reduce(_options.order);
+      }
+
+    private:
+      template <class X, class U>
+      void Evaluate(const X & x, const U & u)
+      {
+        std::array<Scalar, std::size_t(N)> xs;
+        std::array<Scalar, std::size_t(M)> us;
+        for (int i = 0; i < N; ++i)
+          xs[i] = Scalar(x[i], i);
+        for (int j = 0; j < M; ++j)
+          us[j] = Scalar(u[j], N + j);
+        _f.ComputeRHS(xs, us, _rhs);
+      }
+
+      Mapping & _f;
+      T _h;
+      ReachabilityOptions _options;
+      std::array<Interval<T>, std::size_t(M)> _u;
+      std::array<Scalar, std::size_t(N)> _rhs;
+      std::vector<Matrix<T, N> > _terms;
+  };
+
+  /*!
+   * Encloses the states reachable from an initial set under inputs within
+   * a box.
+   *
+   * \param[in] f Mapping instantiated with Dual<Interval<T>, N + M>
+   *            scalars; ComputeRHS must tolerate concurrent calls when
+   *            threads != 1.
+   * \param[in] initial Initial set.
+   * \param[in] lower Lower bounds of the inputs.
+   * \param[in] upper Upper bounds of the inputs.
+   * \param[in] h Time step.
+   * \param[in] steps Number of steps.
+   * \param[in] options Parameters.
+   */
+  template <class T, int N, int M>
+  Flowpipe<T, N>
+  ComputeReachableSets(MappingAutonomousExogenous<Dual<Interval<T>, N + M>,
+                                                  N, M> & f,
+                       const Zonotope<T, N> & initial,
+                       const std::array<T, std::size_t(M)> & lower,
+                       const std::array<T, std::size_t(M)> & upper,
+                       T h, std::size_t steps,
+                       const ReachabilityOptions & options =
+                         ReachabilityOptions())
+  {
+    std::vector<Zonotope<T, N> > pieces(1, initial);
+    for (int s = 0; s < options.splits; ++s) {
+      std::vector<Zonotope<T, N> > halves(2 * pieces.size());
+      for (std::size_t k = 0; k < pieces.size(); ++k)
+        pieces[k].Split(halves[2 * k], halves[2 * k + 1]);
+      pieces.swap(halves);
+    }
+    typedef std::array<T, std::size_t(N)> Vector;
+    std::vector<std::vector<Zonotope<T, N> > > sets(pieces.size());
+    std::vector<std::vector<Vector> > tube_lower(pieces.size()),
+      tube_upper(pieces.size());
+    ParallelFor(pieces.size(), [&](std::size_t p, unsigned) {
+      ReachabilityStepper<T, N, M> stepper(f, lower, upper, h, options);
+      Zonotope<T, N> R = pieces[p];
+      R.Reduce(options.order);
+      sets[p].reserve(steps + 1);
+      sets[p].push_back(R);
+      tube_lower[p].resize(steps);
+      tube_upper[p].resize(steps);
+      for (std::size_t k = 0; k < steps; ++k) {
+        stepper.Step(R, tube_lower[p][k], tube_upper[p][k]);
+        sets[p].push_back(R);
+      }
+    }, options.threads, 1);
+    return Flowpipe<T, N>(sets, tube_lower, tube_upper);
+  }
+}
+#endif
@@ -0,0 +1,430 @@
+/*! \file sindy.h
+ *  \brief Sparse identification of nonlinear dynamics (SINDy).
+ *
+ *  Models dx/dt = f(x, u) are learned from recorded trajectories by
+ *  expressing every component of f as a sparse linear combination of
+ *  candidate functions, here monomials in the states and inputs,
+ *
+ *      dx_i/dt = sum_k xi_ki theta_k(x, u).
+ *
+ *  The coefficients xi are found by sequentially thresholded least squares:
+ *  a least squares fit, after which coefficients smaller than a threshold
+ *  are removed and the remaining ones refitted until the set of active
+ *  terms no longer changes.  Candidate functions are evaluated over the
+ *  samples in parallel blocks that are reduced directly into the normal
+ *  equations, so the library matrix is never stored.
+ *
+ *  The result is a SparseMapping, a MappingAutonomousExogenous that plugs
+ *  into the integrators, and can also be written out as C++ source of a
+ *  mapping templated over its scalar type.
+ */
+
+#ifndef __SINDY_H__
+#define __SINDY_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "dense.h"
+#include "mappings.h"
+#include "parallel.h"
+
+namespace dynamics {
+  /*! \class PolynomialLibrary
+   *  \brief Monomials in the states and inputs up to a total degree.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of exogenous inputs.
+   *
+   *  Terms are ordered by degree, the constant first; variables are the
+   *  states followed by the inputs.
+   */
+  template <class T, int N, int M>
+  class PolynomialLibrary {
+    public:
+      typedef std::array<int, std::size_t(N + M)> Exponents;
+
+      /*!
+       * \param[in] degree Largest total degree of the monomials.
+       */
+      explicit PolynomialLibrary(int degree) : _degree(degree)
+      {
+        if (degree < 0)
+          throw std::invalid_argument("PolynomialLibrary: negative degree");
+        Exponents e;
+        e.fill(0);
+        for (int d = 0; d <= degree; ++d)
+          Enumerate(e, 0, d);
+      }
+
+      //! Number of candidate functions.
+      std::size_t Terms() const { return _terms.size(); }
+
+      //! Exponents of the variables in term k.
+      const Exponents & Term(std::size_t k) const { return _terms[k]; }
+
+      //! Largest total degree.
+      int Degree() const { return _degree; }
+
+      /*!
+       * Values of all terms.
+       *
+       * \param[in] x States.
+       * \param[in] u Inputs.
+       * \param[out] theta Terms() values.
+       */
+      void Evaluate(const std::array<T, N> & x, const std::array<T, M> & u,
+                    T * theta) const
+      {
+        for (std::size_t k = 0; k < _terms.size(); ++k)
+          theta[k] = Monomial(_terms[k], x, u);
+      }
+
+      /*!
+       * Value of the monomial with exponents e.
+       */
+      template <class S>
+      static S Monomial(const Exponents & e, const std::array<S, N> & x,
+                        const std::array<S, M> & u)
+      {
+        S value(1);
+        for (int v = 0; v < N + M; ++v)
+          for (int p = 0; p < e[v]; ++p)
+            value = value * (v < N ? x[v] : u[v - N]);
+        return value;
+      }
+
+      /*!
+       * C++ expression of term k, in terms of arrays x and u.
+       */
+      std::string Name(std::size_t k) const
+      {
+        std::ostringstream name;
+        for (int v = 0; v < N + M; ++v)
+          for (int p = 0; p < _terms[k][v]; ++p) {
+            if (name.tellp() > 0)
+              name << "*";
+            if (v < N)
+              name << "x[" << v << "]";
+            else
+              name << "u[" << v - N << "]";
+          }
+        return name.tellp() > 0 ? name.str() : std::string("1");
+      }
+
+    private:
+      // Appends all exponents of total degree d in variables v, v + 1, ...
+      // in lexicographically decreasing order.
+      void Enumerate(Exponents & e, int v, int d)
+      {
+        if (v == N + M - 1) {
+          e[v] = d;
+          _terms.push_back(e);
+          e[v] = 0;
+          return;
+        }
+        for (int p = d; p >= 0; --p) {
+          e[v] = p;
+          Enumerate(e, v + 1, d - p);
+        }
+        e[v] = 0;
+      }
+
+      int _degree;
+      std::vector<Exponents> _terms;
+  };
+
+  /*! \class SparseMapping
+   *  \brief Mapping whose right hand side is a sparse combination of
+   *         monomials, as fitted by FitSINDy.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of exogenous inputs.
+   *
+   *  Only terms with a nonzero coefficient are evaluated.
+   */
+  template <class T, int N, int M>
+  class SparseMapping : public MappingAutonomousExogenous<T, N, M> {
+    public:
+      /*!
+       * \param[in] library Candidate functions.
+       * \param[in] coefficients library.Terms() x N matrix, column i holds
+       *            the coefficients of component i.
+       */
+      SparseMapping(const PolynomialLibrary<T, N, M> & library,
+                    const DenseMatrix<T> & coefficients)
+        : _library(library), _coefficients(coefficients)
+      {
+        if (coefficients.Rows() != library.Terms()
+            || coefficients.Cols() != std::size_t(N))
+          throw std::invalid_argument("SparseMapping: coefficients do not "
+                                      "match the library");
+        for (std::size_t k = 0; k < library.Terms(); ++k) {
+          Active term;
+          term.exponents = library.Term(k);
+          bool used = false;
+          for (int i = 0; i < N; ++i) {
+            term.coefficients[i] = coefficients(k, i);
+            used = used || coefficients(k, i) != T(0);
+          }
+          if (used)
+            _active.push_back(term);
+        }
+      }
+
+      virtual void ComputeRHS(const std::array<T, N> & x,
+                              const std::array<T, M> & u,
+                              std::array<T, N> & rhs)
+      {
+        rhs.fill(T(0));
+        for (std::size_t k = 0; k < _active.size(); ++k) {
+          const T value = PolynomialLibrary<T, N, M>::Monomial(
+              _active[k].exponents, x, u);
+          for (int i = 0; i < N; ++i)
+            rhs[i] += _active[k].coefficients[i] * value;
+        }
+      }
+
+      //! Coefficient of term k in component i.
+      T Coefficient(std::size_t k, int i) const
+      {
+        return _coefficients(k, i);
+      }
+
+      //! Coefficients, one column per component.
+      const DenseMatrix<T> & Coefficients() const { return _coefficients; }
+
+      //! Candidate functions.
+      const PolynomialLibrary<T, N, M> & Library() const { return _library; }
+
+      //! Number of nonzero coefficients.
+      std::size_t Nonzeros() const
+      {
+        std::size_t count = 0;
+        for (std::size_t k = 0; k < _active.size(); ++k)
+          for (int i = 0; i < N; ++i)
+            count += _active[k].coefficients[i] != T(0);
+        return count;
+      }
+
+      /*!
+       * C++ source of an equivalent mapping templated over its scalar, so
+       * the fitted model can be compiled in (and, e.g., differentiated
+       * with Dual scalars).
+       *
+       * \param[in] name Name of the generated class.
+       */
+      std::string Source(const std::string & name) const
+      {
+        std::ostringstream s;
+        s << std::setprecision(17);
+        s << "template <class S>\n"
+          << "class " << name << "\n"
+          << "  : public dynamics::MappingAutonomousExogenous<S, " << N
+          << ", " << M << "> {\n"
+          << "  public:\n"
+          << "    virtual void ComputeRHS(const std::array<S, " << N
+          << "> & x,\n"
+          << "                            const std::array<S, " << M
+          << "> & u,\n"
+          << "                            std::array<S, " << N
+          << "> & rhs)\n"
+          << "    {\n";
+        for (int i = 0; i < N; ++i) {
+          s << "      rhs[" << i << "] = S(0)";
+          for (std::size_t k = 0; k < _library.Terms(); ++k) {
+            const T c = _coefficients(k, i);
+            if (c == T(0))
+              continue;
+            s << "\n        " << (c < T(0) ? "- " : "+ ") << std::fabs(c);
+            if (_library.Name(k) != "1")
+              s << "*" << _library.Name(k);
+          }
+          s << ";\n";
+        }
+        s << "    }\n"
+          << "};\n";
+        return s.str();
+      }
+
+    private:
+      struct Active {
+        typename PolynomialLibrary<T, N, M>::Exponents exponents;
+        std::array<T, N> coefficients;
+      };
+
+      PolynomialLibrary<T, N, M> _library;
+      DenseMatrix<T> _coefficients;
+      std::vector<Active> _active;
+  };
+
+  /*!
+   * Time derivatives of uniformly sampled states by fourth order central
+   * differences, falling back to second order next to the ends.
+   *
+   * \param[in] x States of one trajectory at spacing dt, at least 3.
+   * \param[in] dt Sampling interval.
+   * \param[out] dx Estimated derivatives at the samples.
+   */
+  template <class T, std::size_t N>
+  void FiniteDifferenceDerivatives(const std::vector<std::array<T, N> > & x,
+                                   T dt,
+                                   std::vector<std::array<T, N> > & dx)
+  {
+    const std::size_t n = x.size();
+    if (n < 3)
+      throw std::invalid_argument("FiniteDifferenceDerivatives: need at "
+                                  "least 3 samples");
+    dx.resize(n);
+    for (std::size_t j = 0; j < n; ++j)
+      for (std::size_t i = 0; i < N; ++i) {
+        if (j == 0)
+          dx[j][i] = (-3 * x[0][i] + 4 * x[1][i] - x[2][i]) / (2 * dt);
+        else if (j + 1 == n)
+          dx[j][i] = (3 * x[j][i] - 4 * x[j - 1][i] + x[j - 2][i])
+            / (2 * dt);
+        else if (j == 1 || j + 2 == n)
+          dx[j][i] = (x[j + 1][i] - x[j - 1][i]) / (2 * dt);
+        else
+          dx[j][i] = (8 * (x[j + 1][i] - x[j - 1][i])
+                      - (x[j + 2][i] - x[j - 2][i])) / (12 * dt);
+      }
+  }
+
+  /*! \struct SINDyOptions
+   *  \brief Parameters of FitSINDy.
+   */
+  struct SINDyOptions {
+    SINDyOptions()
+      : threshold(0.1), ridge(1e-10), max_iterations(20), block(1024),
+        threads(0) {}
+
+    //! Coefficients smaller in magnitude are removed.
+    double threshold;
+    //! Tikhonov regularization relative to the diagonal of the normal
+    //! equations.
+    double ridge;
+    //! Largest number of threshold and refit passes.
+    int max_iterations;
+    //! Samples per parallel block; results do not depend on the number of
+    //! threads.
+    std::size_t block;
+    //! Number of threads evaluating the library, 0 selects
+    //! HardwareThreads().
+    unsigned threads;
+  };
+
+  /*!
+   * Fits a sparse model dx/dt = f(x, u) by sequentially thresholded least
+   * squares.  Samples of several trajectories may be concatenated, with
+   * derivatives estimated per trajectory.
+   *
+   * \param[in] library Candidate functions.
+   * \param[in] x Sampled states.
+   * \param[in] u Inputs at the samples; may be empty when M is 0.
+   * \param[in] dx Time derivatives at the samples, e.g. from
+   *            FiniteDifferenceDerivatives.
+   * \param[in] options Parameters.
+   */
+  template <class T, int N, int M>
+  SparseMapping<T, N, M>
+  FitSINDy(const PolynomialLibrary<T, N, M> & library,
+           const std::vector<std::array<T, std::size_t(N)> > & x,
+           const std::vector<std::array<T, std::size_t(M)> > & u,
+           const std::vector<std::array<T, std::size_t(N)> > & dx,
+           const SINDyOptions & options = SINDyOptions())
+  {
+    const std::size_t n = x.size(), terms = library.Terms();
+    if (dx.size() != n || (M > 0 && u.size() != n) || n == 0)
+      throw std::invalid_argument("FitSINDy: sample counts do not match");
+    if (options.block == 0)
+      throw std::invalid_argument("FitSINDy: block must be positive");
+
+    // Normal equations Theta^T Theta and Theta^T dx, accumulated per block
+    // and reduced in block order.
+    const std::size_t blocks = (n + options.block - 1) / options.block;
+    std::vector<DenseMatrix<T> > gram(blocks), rhs(blocks);
+    ParallelFor(blocks, [&](std::size_t b, unsigned) {
+      gram[b].Resize(terms, terms);
+      rhs[b].Resize(terms, N);
+      std::vector<T> theta(terms);
+      std::array<T, std::size_t(M)> none;
+      none.fill(T(0));
+      const std::size_t end = std::min(n, (b + 1) * options.block);
+      for (std::size_t j = b * options.block; j < end; ++j) {
+        library.Evaluate(x[j], M > 0 ? u[j] : none, theta.data());
+        for (std::size_t c = 0; c < terms; ++c) {
+          for (std::size_t r = c; r < terms; ++r)
+            gram[b](r, c) += theta[r] * theta[c];
+          for (int i = 0; i < N; ++i)
+            rhs[b](c, i) += theta[c] * dx[j][i];
+        }
+      }
+    }, options.threads);
+    DenseMatrix<T> G(terms, terms), B(terms, N);
+    for (std::size_t b = 0; b < blocks; ++b)
+      for (std::size_t c = 0; c < terms; ++c) {
+        for (std::size_t r = c; r < terms; ++r)
+          G(r, c) += gram[b](r, c);
+        for (int i = 0; i < N; ++i)
+          B(c, i) += rhs[b](c, i);
+      }
+    for (std::size_t c = 0; c < terms; ++c)
+      for (std::size_t r = 0; r < c; ++r)
+        G(r, c) = G(c, r);
+
+    // Columns are scaled to unit norm before solving.
+    std::vector<T> scale(terms);
+    for (std::size_t k = 0; k < terms; ++k)
+      scale[k] = G(k, k) > T(0) ? T(1) / std::sqrt(G(k, k)) : T(0);
+
+    DenseMatrix<T> xi(terms, N);
+    std::vector<std::size_t> pivots;
+    for (int i = 0; i < N; ++i) {
+      std::vector<std::size_t> active;
+      for (std::size_t k = 0; k < terms; ++k)
+        if (scale[k] > T(0))
+          active.push_back(k);
+      for (int pass = 0; pass < options.max_iterations; ++pass) {
+        const std::size_t m = active.size();
+        DenseMatrix<T> A(m, m);
+        std::vector<T> c(m);
+        for (std::size_t q = 0; q < m; ++q) {
+          for (std::size_t p = 0; p < m; ++p)
+            A(p, q) = G(active[p], active[q]) * scale[active[p]]
+              * scale[active[q]];
+          A(q, q) += T(options.ridge);
+          c[q] = B(active[q], i) * scale[active[q]];
+        }
+        if (m > 0) {
+          if (!LUFactor(A, pivots))
+            throw std::runtime_error("FitSINDy: singular normal equations");
+          LUSolve(A, pivots, c.data());
+        }
+        for (std::size_t k = 0; k < terms; ++k)
+          xi(k, i) = T(0);
+        std::vector<std::size_t> kept;
+        for (std::size_t q = 0; q < m; ++q) {
+          const T value = c[q] * scale[active[q]];
+          xi(active[q], i) = value;
+          if (std::fabs(value) >= T(options.threshold))
+            kept.push_back(active[q]);
+        }
+        if (kept.size() == m)
+          break;
+        active.swap(kept);
+      }
+      for (std::size_t k = 0; k < terms; ++k)
+        if (std::fabs(xi(k, i)) < T(options.threshold))
+          xi(k, i) = T(0);
+    }
+    return SparseMapping<T, N, M>(library, xi);
+  }
+}
+#endif
@@ -0,0 +1,344 @@
+/*! \file statistics.h
+ *  \brief Streaming, mergeable statistics of ensemble outputs.
+ *
+ *  Accumulators in this file see every sample once, use memory independent
+ *  of the number of samples, and can be merged.  Ensemble drivers give each
+ *  thread its own accumulator and merge them at the end, so no locking is
+ *  needed while samples are added.
+ *
+ *  Moments are exact.  Quantiles are approximated by KLL sketches, whose
+ *  rank error is about 1.7/k for a sketch of about 3k retained samples.
+ */
+
+#ifndef __STATISTICS_H__
+#define __STATISTICS_H__
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "random.h"
+
+namespace dynamics {
+  /*! \class RunningMoments
+   *  \brief Count, mean and variance of a stream of samples.
+   *  \tparam T Data type of the samples (typically double).
+   *
+   *  Samples are added with Welford's update and accumulators are merged
+   *  with the pairwise update of Chan, Golub and LeVeque, both of which are
+   *  numerically stable.
+   */
+  template <class T>
+  class RunningMoments {
+    public:
+      RunningMoments() : _count(0), _mean(0), _m2(0) {}
+
+      //! Adds one sample.
+      void Add(const T & x)
+      {
+        ++_count;
+        T delta = x - _mean;
+        _mean += delta / T(_count);
+        _m2 += delta * (x - _mean);
+      }
+
+      //! Adds all samples seen by another accumulator.
+      void Merge(const RunningMoments & other)
+      {
+        if (other._count == 0)
+          return;
+        if (_count == 0) {
+          *this = other;
+          return;
+        }
+        std::size_t count = _count + other._count;
+        T delta = other._mean - _mean;
+        _mean += delta * T(other._count) / T(count);
+        _m2 += other._m2
+          + delta * delta * T(_count) * T(other._count) / T(count);
+        _count = count;
+      }
+
+      std::size_t Count() const { return _count; }
+      T Mean() const { return _mean; }
+
+      //! Unbiased sample variance, zero for fewer than two samples.
+      T Variance() const
+      {
+        return _count > 1 ? _m2 / T(_count - 1) : T(0);
+      }
+
+      //! Standard error of the mean.
+      T StandardError() const
+      {
+        return _count > 1 ? std::sqrt(Variance() / T(_count)) : T(0);
+      }
+
+    private:
+      std::size_t _count;
+      T _mean, _m2;
+  };
+
+  /*! \class TrajectoryMoments
+   *  \brief RunningMoments of every output at every output time.
+   *  \tparam T Data type of the samples (typically double).
+   *
+   *  Memory is proportional to times x outputs, independent of the number of
+   *  trajectories added.
+   */
+  template <class T>
+  class TrajectoryMoments {
+    public:
+      TrajectoryMoments() : _times(0), _outputs(0) {}
+
+      /*!
+       * \param[in] times Number of output times.
+       * \param[in] outputs Number of outputs per time.
+       */
+      TrajectoryMoments(std::size_t times, std::size_t outputs)
+        : _times(times), _outputs(outputs), _moments(times * outputs) {}
+
+      /*!
+       * Adds the outputs of one trajectory at output time k.
+       *
+       * \param[in] k Output time index.
+       * \param[in] values Outputs() values.
+       */
+      void Add(std::size_t k, const T * values)
+      {
+        RunningMoments<T> * m = &_moments[k * _outputs];
+        for (std::size_t p = 0; p < _outputs; ++p)
+          m[p].Add(values[p]);
+      }
+
+      //! Adds all trajectories seen by another accumulator.
+      void Merge(const TrajectoryMoments & other)
+      {
+        if (other._times != _times || other._outputs != _outputs)
+          throw std::invalid_argument("TrajectoryMoments: shape mismatch");
+        for (std::size_t i = 0; i < _moments.size(); ++i)
+          _moments[i].Merge(other._moments[i]);
+      }
+
+      //! Moments of output p at output time k.
+      const RunningMoments<T> & operator()(std::size_t k,
+                                           std::size_t p) const
+      {
+        return _moments[k * _outputs + p];
+      }
+
+      std::size_t Times() const { return _times; }
+      std::size_t Outputs() const { return _outputs; }
+
+    private:
+      std::size_t _times, _outputs;
+      std::vector<RunningMoments<T> > _moments;
+  };
+
+  /*! \class QuantileSketch
+   *  \brief Mergeable approximate quantiles of a stream of samples.
+   *  \tparam T Data type of the samples (typically double).
+   *
+   *  This is the KLL sketch of Karnin, Lang and Liberty (2016).  Samples are
+   *  kept in a hierarchy of compactors; level h holds samples of weight 2^h.
+   *  When the sketch is full, the lowest full level is sorted and every
+   *  other sample (starting at a random offset) is promoted to the next level
+   *  with twice the weight.  Level capacities shrink geometrically with depth
+   *  below the top level, so the sketch holds at most about 3k samples no
+   *  matter how many were added.
+   */
+  template <class T>
+  class QuantileSketch {
+    public:
+      /*!
+       * \param[in] k Capacity of the top level; larger is more accurate.
+       * \param[in] seed Seed of the compaction coin flips.
+       */
+      explicit QuantileSketch(std::size_t k = 200, std::uint64_t seed = 0)
+        : _k(std::max<std::size_t>(k, 8)), _count(0), _size(0),
+          _coin(seed), _levels(1)
+      {
+        UpdateCapacities();
+      }
+
+      //! Adds one sample.
+      void Add(const T & x)
+      {
+        _levels[0].push_back(x);
+        ++_count;
+        ++_size;
+        if (_size > _capacity)
+          Compress();
+      }
+
+      //! Adds all samples seen by another sketch.
+      void Merge(const QuantileSketch & other)
+      {
+        if (other._levels.size() > _levels.size()) {
+          _levels.resize(other._levels.size());
+          UpdateCapacities();
+        }
+        for (std::size_t h = 0; h < other._levels.size(); ++h)
+          _levels[h].insert(_levels[h].end(), other._levels[h].begin(),
+                            other._levels[h].end());
+        _count += other._count;
+        _size += other._size;
+        Compress();
+      }
+
+      //! Number of samples added.
+      std::size_t Count() const { return _count; }
+
+      //! Number of samples retained.
+      std::size_t Size() const { return _size; }
+
+      /*!
+       * Approximate q-quantile: the smallest retained sample whose estimated
+       * rank is at least q Count().
+       *
+       * \param[in] q Probability in [0, 1].
+       */
+      T Quantile(double q) const
+      {
+        if (_size == 0)
+          throw std::logic_error("QuantileSketch: no samples");
+        std::vector<std::pair<T, std::uint64_t> > weighted;
+        weighted.reserve(_size);
+        for (std::size_t h = 0; h < _levels.size(); ++h)
+          for (std::size_t i = 0; i < _levels[h].size(); ++i)
+            weighted.push_back(std::make_pair(_levels[h][i],
+                                              std::uint64_t(1) << h));
+        std::sort(weighted.begin(), weighted.end());
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < weighted.size(); ++i)
+          total += weighted[i].second;
+        double target = q * double(total);
+        std::uint64_t rank = 0;
+        for (std::size_t i = 0; i < weighted.size(); ++i) {
+          rank += weighted[i].second;
+          if (double(rank) >= target)
+            return weighted[i].first;
+        }
+        return weighted.back().first;
+      }
+
+    private:
+      // Level capacities only change when a level is added, so they are
+      // cached rather than recomputed for every sample.
+      void UpdateCapacities()
+      {
+        _capacities.resize(_levels.size());
+        _capacity = 0;
+        double c = double(_k);
+        for (std::size_t h = _levels.size(); h-- > 0; c *= 2.0 / 3.0) {
+          _capacities[h] = std::max<std::size_t>(
+              2, static_cast<std::size_t>(std::ceil(c)));
+          _capacity += _capacities[h];
+        }
+      }
+
+      void Compress()
+      {
+        while (_size > _capacity) {
+          std::size_t h = 0;
+          while (_levels[h].size() < _capacities[h])
+            ++h;
+          if (h + 1 == _levels.size()) {
+            _levels.push_back(std::vector<T>());
+            UpdateCapacities();
+          }
+          std::vector<T> & level = _levels[h];
+          std::sort(level.begin(), level.end());
+          // An odd sample out stays behind at its current weight.
+          std::size_t pairs = level.size() / 2;
+          std::size_t offset = _coin() & 1u;
+          for (std::size_t i = 0; i < pairs; ++i)
+            _levels[h + 1].push_back(level[2 * i + offset]);
+          T odd = level.back();
+          bool keep = level.size() % 2 != 0;
+          level.clear();
+          if (keep)
+            level.push_back(odd);
+          _size -= pairs;
+        }
+      }
+
+      std::size_t _k, _count, _size, _capacity;
+      SplitMix64 _coin;
+      std::vector<std::vector<T> > _levels;
+      std::vector<std::size_t> _capacities;
+  };
+
+  /*! \class EnsembleStatistics
+   *  \brief Moments and quantiles of every output at every output time.
+   *  \tparam T Data type of the samples (typically double).
+   *
+   *  This is the accumulator to hand to RunEnsemble for mean, variance and
+   *  quantile bands over time.  Memory is proportional to times x outputs x
+   *  the sketch size, independent of the number of ensemble members.
+   */
+  template <class T>
+  class EnsembleStatistics {
+    public:
+      EnsembleStatistics() {}
+
+      /*!
+       * \param[in] times Number of output times.
+       * \param[in] outputs Number of outputs per time.
+       * \param[in] k Sketch parameter, see QuantileSketch.
+       */
+      EnsembleStatistics(std::size_t times, std::size_t outputs,
+                         std::size_t k = 200)
+        : _moments(times, outputs)
+      {
+        _sketches.reserve(times * outputs);
+        for (std::size_t i = 0; i < times * outputs; ++i)
+          _sketches.push_back(QuantileSketch<T>(k, i));
+      }
+
+      /*!
+       * Adds the outputs of one ensemble member at output time k.
+       *
+       * \param[in] k Output time index.
+       * \param[in] values Outputs() values.
+       */
+      void Add(std::size_t k, const T * values)
+      {
+        _moments.Add(k, values);
+        QuantileSketch<T> * s = &_sketches[k * _moments.Outputs()];
+        for (std::size_t p = 0; p < _moments.Outputs(); ++p)
+          s[p].Add(values[p]);
+      }
+
+      //! Adds all ensemble members seen by another accumulator.
+      void Merge(const EnsembleStatistics & other)
+      {
+        _moments.Merge(other._moments);
+        for (std::size_t i = 0; i < _sketches.size(); ++i)
+          _sketches[i].Merge(other._sketches[i]);
+      }
+
+      //! Moments of output p at output time k.
+      const RunningMoments<T> & Moments(std::size_t k, std::size_t p) const
+      {
+        return _moments(k, p);
+      }
+
+      //! Approximate q-quantile of output p at output time k.
+      T Quantile(std::size_t k, std::size_t p, double q) const
+      {
+        return _sketches[k * _moments.Outputs() + p].Quantile(q);
+      }
+
+      std::size_t Times() const { return _moments.Times(); }
+      std::size_t Outputs() const { return _moments.Outputs(); }
+
+    private:
+      TrajectoryMoments<T> _moments;
+      std::vector<QuantileSketch<T> > _sketches;
+  };
+}
+#endif
@@ -0,0 +1,681 @@
+/*! \file surrogate.h
+ *  \brief Tabulated surrogates of expensive mappings.
+ *
+ *  A surrogate samples the right hand side of a mapping on a uniform grid
+ *  once and then replaces every later ComputeRHS call by a multilinear
+ *  interpolation in that table.  This pays off when the right hand side calls
+ *  expensive routines but only depends on a handful (2-4) of inputs.
+ *
+ *  The table is stored in a cache-blocked layout: the grid is cut into tiles
+ *  of block^D nodes, tiles are stored one after the other, and all outputs of
+ *  a node are contiguous.  The 2^D corners of an interpolation cell therefore
+ *  usually live in the same few cache lines.  Tables can be written to disk
+ *  and mapped back into memory with mmap, so large tables are shared between
+ *  processes and loaded lazily by the operating system.
+ */
+
+#ifndef __SURROGATE_H__
+#define __SURROGATE_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappings.h"
+#include "parallel.h"
+#include "trace.h"
+
+namespace dynamics {
+  /*! \class GridTable
+   *  \brief Values of a function sampled on a uniform grid.
+   *  \tparam T Data type of inputs and outputs (typically double).
+   *  \tparam D Number of inputs (grid dimensions).
+   *  \tparam P Number of outputs stored per grid node.
+   *
+   *  Copies share the same storage, which is either owned memory or a
+   *  read-only file mapping.  Fill copies on write: it stores the values in
+   *  new memory owned by this table only, so shared storage and mapped
+   *  files are never modified.
+   */
+  template <class T, int D, int P>
+  class GridTable {
+    public:
+      /*!
+       * Creates an empty table.
+       *
+       * \param[in] lower Lower corner of the tabulated region.
+       * \param[in] upper Upper corner of the tabulated region.
+       * \param[in] points Number of grid nodes along each input, at least 2.
+       * \param[in] block Number of nodes along each input in a cache tile.
+       */
+      GridTable(const std::array<T, D> & lower,
+                const std::array<T, D> & upper,
+                const std::array<int, D> & points,
+                int block = 4)
+        : _lower(lower), _upper(upper), _points(points), _block(block),
+          _data(0)
+      {
+        for (int d = 0; d < D; ++d) {
+          if (_points[d] < 2 || !(_upper[d] > _lower[d]))
+            throw std::invalid_argument("GridTable: degenerate grid");
+        }
+        if (_block < 1)
+          throw std::invalid_argument("GridTable: block must be positive");
+        _error.fill(T(0));
+        Layout();
+        std::shared_ptr<std::vector<T> > storage(
+            new std::vector<T>(_size, T(0)));
+        _data = storage->data();
+        _owner = storage;
+      }
+
+      /*!
+       * Evaluates f at every grid node and stores the result.  The nodes are
+       * distributed over threads with ParallelFor, so f must tolerate
+       * concurrent calls when threads != 1.  The interpolation error
+       * estimate is updated from the filled table.  The values go to newly
+       * allocated storage, which copies of this table do not see.
+       *
+       * \param[in] f Called as f(node, value, thread) with
+       *            node a std::array<T, D> and value a std::array<T, P>.
+       * \param[in] threads Number of threads, 0 selects HardwareThreads().
+       */
+      template <class Function>
+      void Fill(Function f, unsigned threads = 0)
+      {
+        std::shared_ptr<std::vector<T> > storage(
+            new std::vector<T>(_size, T(0)));
+        T * data = storage->data();
+        ParallelFor(_nodes, [&](std::size_t n, unsigned thread) {
+          std::array<int, D> index;
+          std::array<T, D> node;
+          Unravel(n, index);
+          for (int d = 0; d < D; ++d)
+            node[d] = _lower[d] + index[d] * Spacing(d);
+          std::array<T, P> value;
+          f(node, value, thread);
+          std::memcpy(data + Offset(index), value.data(), sizeof(value));
+        }, threads);
+        _data = data;
+        _owner = storage;
+        EstimateError(threads);
+      }
+
+      /*!
+       * Multilinear interpolation of the table at x.  Inputs outside the
+       * tabulated region are clamped to its boundary; if an input is NaN,
+       * every output is NaN, as it would be for the tabulated function.
+       *
+       * \param[in] x Point at which to interpolate.
+       * \param[out] value Interpolated outputs.
+       */
+      void Interpolate(const std::array<T, D> & x,
+                       std::array<T, P> & value) const
+      {
+        std::array<std::size_t, D> a0, a1;
+        std::array<T, D> w;
+        for (int d = 0; d < D; ++d) {
+          T s = (x[d] - _lower[d]) / Spacing(d);
+          if (s != s) {
+            value.fill(std::numeric_limits<T>::quiet_NaN());
+            return;
+          }
+          // Clamp before converting, so that the cast is always defined.
+          s = std::min(std::max(s, T(0)), T(_points[d] - 1));
+          const int c = std::min(static_cast<int>(std::floor(s)),
+                                 _points[d] - 2);
+          w[d] = s - T(c);
+          a0[d] = Term(d, c);
+          a1[d] = Term(d, c + 1);
+        }
+        value.fill(T(0));
+        for (int corner = 0; corner < (1 << D); ++corner) {
+          T weight(1);
+          std::size_t address = 0;
+          for (int d = 0; d < D; ++d) {
+            if (corner & (1 << d)) {
+              weight *= w[d];
+              address += a1[d];
+            } else {
+              weight *= T(1) - w[d];
+              address += a0[d];
+            }
+          }
+          const T * v = _data + address;
+          for (int p = 0; p < P; ++p)
+            value[p] += weight * v[p];
+        }
+      }
+
+      /*!
+       * Estimated maximum interpolation error of each output over the
+       * tabulated region.  Multilinear interpolation of a smooth function
+       * has an error of at most h^2/8 max|f''| per input, and h^2 f'' is
+       * measured from second differences of the table itself, so the
+       * estimate is free but blind to features smaller than the grid.
+       */
+      const std::array<T, P> & ErrorEstimate() const { return _error; }
+
+      /*!
+       * Value stored at a grid node.
+       *
+       * \param[in] index Node index along each input.
+       */
+      const T * Node(const std::array<int, D> & index) const
+      {
+        return _data + Offset(index);
+      }
+
+      const std::array<T, D> & Lower() const { return _lower; }
+      const std::array<T, D> & Upper() const { return _upper; }
+      const std::array<int, D> & Points() const { return _points; }
+
+      /*!
+       * Writes the table to a file in native byte order.
+       *
+       * \param[in] path File name.
+       */
+      void Save(const std::string & path) const
+      {
+        DYNAMICS_TRACE_SPAN("io flush");
+        Header header;
+        FillHeader(header);
+        std::FILE * file = std::fopen(path.c_str(), "wb");
+        if (!file)
+          throw std::runtime_error("GridTable: cannot open " + path);
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+          && std::fwrite(_data, sizeof(T), _size, file) == _size;
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok)
+          throw std::runtime_error("GridTable: cannot write " + path);
+      }
+
+      /*!
+       * Maps a table written by Save into memory.  The file is mapped
+       * read-only and the pages are loaded on first access; the mapping is
+       * released when the last copy of the returned table is destroyed.
+       *
+       * \param[in] path File name.
+       */
+      static GridTable Load(const std::string & path)
+      {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+          throw std::runtime_error("GridTable: cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0
+            || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+          ::close(fd);
+          throw std::runtime_error("GridTable: cannot read " + path);
+        }
+        std::size_t length = static_cast<std::size_t>(st.st_size);
+        void * address = ::mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED)
+          throw std::runtime_error("GridTable: cannot map " + path);
+        std::shared_ptr<void> owner(address, Unmapper(length));
+
+        Header header;
+        std::memcpy(&header, address, sizeof(header));
+        Header expected;
+        std::memset(&expected, 0, sizeof(expected));
+        std::memcpy(expected.magic, Magic(), sizeof(expected.magic));
+        if (std::memcmp(header.magic, expected.magic, sizeof(header.magic))
+            || header.scalar != sizeof(T) || header.inputs != D
+            || header.outputs != P)
+          throw std::runtime_error("GridTable: incompatible table " + path);
+        if (!ValidHeader(header, (length - sizeof(Header)) / sizeof(T))
+            || (length - sizeof(Header)) % sizeof(T) != 0)
+          throw std::runtime_error("GridTable: corrupt table " + path);
+
+        GridTable table(header.lower, header.upper, header.points,
+                        header.block, owner);
+        if (length != sizeof(Header) + table._size * sizeof(T))
+          throw std::runtime_error("GridTable: truncated table " + path);
+        table._error = header.error;
+        table._data = reinterpret_cast<const T *>(
+            static_cast<const char *>(address) + sizeof(Header));
+        return table;
+      }
+
+    private:
+      static const char * Magic() { return "DYNTAB01"; }
+
+      struct Header {
+        char magic[8];
+        std::size_t scalar;
+        int inputs, outputs, block, pad;
+        std::array<T, D> lower, upper;
+        std::array<int, D> points;
+        std::array<T, P> error;
+      };
+
+      struct Unmapper {
+        explicit Unmapper(std::size_t length) : _length(length) {}
+        void operator()(void * address) const { ::munmap(address, _length); }
+        std::size_t _length;
+      };
+
+      GridTable(const std::array<T, D> & lower,
+                const std::array<T, D> & upper,
+                const std::array<int, D> & points,
+                int block, const std::shared_ptr<void> & owner)
+        : _lower(lower), _upper(upper), _points(points), _block(block),
+          _data(0), _owner(owner)
+      {
+        _error.fill(T(0));
+        Layout();
+      }
+
+      // Checks a header read from a file: a nondegenerate grid and a
+      // storage size, computed without overflow, of at most values.
+      static bool ValidHeader(const Header & header, std::size_t values)
+      {
+        if (header.block < 1)
+          return false;
+        std::size_t size = P;
+        for (int d = 0; d < D; ++d) {
+          if (header.points[d] < 2 || !(header.upper[d] > header.lower[d]))
+            return false;
+          const std::size_t block = std::size_t(header.block);
+          const std::size_t tiles =
+            (std::size_t(header.points[d]) + block - 1) / block;
+          if (block > values / size || tiles > values / (size * block))
+            return false;
+          size *= tiles * block;
+        }
+        return size <= values;
+      }
+
+      void FillHeader(Header & header) const
+      {
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, Magic(), sizeof(header.magic));
+        header.scalar = sizeof(T);
+        header.inputs = D;
+        header.outputs = P;
+        header.block = _block;
+        header.lower = _lower;
+        header.upper = _upper;
+        header.points = _points;
+        header.error = _error;
+      }
+
+      // Computes tile counts, strides and the total storage size.  The
+      // address of node i is the sum over inputs of Term(d, i[d]), which
+      // lets Interpolate form all corner addresses from 2*D partial sums.
+      void Layout()
+      {
+        std::size_t tile = 1;
+        for (int d = 0; d < D; ++d) {
+          _inner[d] = tile;
+          tile *= _block;
+        }
+        std::size_t tiles = 1;
+        _nodes = 1;
+        for (int d = 0; d < D; ++d) {
+          _outer[d] = tiles * tile;
+          tiles *= (_points[d] + _block - 1) / _block;
+          _nodes *= _points[d];
+        }
+        _size = tiles * tile * P;
+      }
+
+      T Spacing(int d) const
+      {
+        return (_upper[d] - _lower[d]) / T(_points[d] - 1);
+      }
+
+      std::size_t Term(int d, int i) const
+      {
+        return (std::size_t(i / _block) * _outer[d]
+                + std::size_t(i % _block) * _inner[d]) * P;
+      }
+
+      std::size_t Offset(const std::array<int, D> & index) const
+      {
+        std::size_t address = 0;
+        for (int d = 0; d < D; ++d)
+          address += Term(d, index[d]);
+        return address;
+      }
+
+      void Unravel(std::size_t n, std::array<int, D> & index) const
+      {
+        for (int d = 0; d < D; ++d) {
+          index[d] = static_cast<int>(n % _points[d]);
+          n /= _points[d];
+        }
+      }
+
+      void EstimateError(unsigned threads)
+      {
+        std::vector<std::array<T, P> > partial(ResolveThreads(threads,
+                                                              _nodes));
+        for (std::size_t t = 0; t < partial.size(); ++t)
+          partial[t].fill(T(0));
+        ParallelFor(_nodes, [&](std::size_t n, unsigned thread) {
+          std::array<int, D> index;
+          Unravel(n, index);
+          std::array<T, P> bound;
+          bound.fill(T(0));
+          for (int d = 0; d < D; ++d) {
+            if (index[d] == 0 || index[d] == _points[d] - 1)
+              continue;
+            std::array<int, D> lo(index), hi(index);
+            --lo[d];
+            ++hi[d];
+            const T * f0 = Node(lo);
+            const T * f1 = Node(index);
+            const T * f2 = Node(hi);
+            for (int p = 0; p < P; ++p)
+              bound[p] += std::fabs(f0[p] - 2 * f1[p] + f2[p]) / T(8);
+          }
+          for (int p = 0; p < P; ++p)
+            if (bound[p] > partial[thread][p])
+              partial[thread][p] = bound[p];
+        }, threads);
+        _error.fill(T(0));
+        for (std::size_t t = 0; t < partial.size(); ++t)
+          for (int p = 0; p < P; ++p)
+            if (partial[t][p] > _error[p])
+              _error[p] = partial[t][p];
+      }
+
+      std::array<T, D> _lower, _upper;
+      std::array<int, D> _points;
+      int _block;
+      std::array<std::size_t, D> _inner, _outer;
+      std::size_t _nodes, _size;
+      std::array<T, P> _error;
+      const T * _data;
+      std::shared_ptr<void> _owner;
+  };
+
+  /*! \class TabulatedMappingAutonomousEndogenous
+   *  \brief Surrogate for a MappingAutonomousEndogenous.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *
+   *  The right hand side is interpolated from a table over the state space.
+   */
+  template <class T, int N>
+  class TabulatedMappingAutonomousEndogenous
+    : public MappingAutonomousEndogenous<T, N> {
+    public:
+      /*!
+       * \param[in] table Table of right hand sides over the state space.
+       */
+      explicit TabulatedMappingAutonomousEndogenous(
+          const GridTable<T, N, N> & table) : _table(table) {}
+
+      virtual void ComputeRHS(const std::array<T, N> & x,
+                              std::array<T, N> & rhs)
+      {
+        _table.Interpolate(x, rhs);
+      }
+
+      /*!
+       * Underlying table, e.g. for GridTable::Save or error estimates.
+       */
+      const GridTable<T, N, N> & Table() const { return _table; }
+
+    private:
+      GridTable<T, N, N> _table;
+  };
+
+  /*! \class TabulatedMappingAutonomousExogenous
+   *  \brief Surrogate for a MappingAutonomousExogenous.
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of exogenous inputs.
+   *
+   *  The right hand side is interpolated from a table over the joint space of
+   *  states and inputs, states first.
+   */
+  template <class T, int N, int M>
+  class TabulatedMappingAutonomousExogenous
+    : public MappingAutonomousExogenous<T, N, M> {
+    public:
+      /*!
+       * \param[in] table Table of right hand sides over states and inputs.
+       */
+      explicit TabulatedMappingAutonomousExogenous(
+          const GridTable<T, N + M, N> & table) : _table(table) {}
+
+      virtual void ComputeRHS(const std::array<T, N> & x,
+                              const std::array<T, M> & u,
+                              std::array<T, N> & rhs)
+      {
+        std::array<T, N + M> xu;
+        std::copy(x.begin(), x.end(), xu.begin());
+        std::copy(u.begin(), u.end(), xu.begin() + N);
+        _table.Interpolate(xu, rhs);
+      }
+
+      /*!
+       * Underlying table, e.g. for GridTable::Save or error estimates.
+       */
+      const GridTable<T, N + M, N> & Table() const { return _table; }
+
+    private:
+      GridTable<T, N + M, N> _table;
+  };
+
+  /*! \class TabulatedMappingNonAutonomousEndogenous
+   *  \brief Surrogate for a MappingNonAutonomousEndogenous.
+   *  \tparam I Data type of independent variable (typically double).
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *
+   *  The right hand side is interpolated from a table over the joint space of
+   *  states and the independent variable, which comes last.
+   */
+  template <class I, class T, int N>
+  class TabulatedMappingNonAutonomousEndogenous
+    : public MappingNonAutonomousEndogenous<I, T, N> {
+    public:
+      /*!
+       * \param[in] table Table of right hand sides over states and time.
+       */
+      explicit TabulatedMappingNonAutonomousEndogenous(
+          const GridTable<T, N + 1, N> & table) : _table(table) {}
+
+      virtual void ComputeRHS(const I & ti, const std::array<T, N> & x,
+                              std::array<T, N> & rhs)
+      {
+        std::array<T, N + 1> xt;
+        std::copy(x.begin(), x.end(), xt.begin());
+        xt[N] = T(ti);
+        _table.Interpolate(xt, rhs);
+      }
+
+      /*!
+       * Underlying table, e.g. for GridTable::Save or error estimates.
+       */
+      const GridTable<T, N + 1, N> & Table() const { return _table; }
+
+    private:
+      GridTable<T, N + 1, N> _table;
+  };
+
+  /*! \class TabulatedMappingNonAutonomousExogenous
+   *  \brief Surrogate for a MappingNonAutonomousExogenous.
+   *  \tparam I Data type of independent variable (typically double).
+   *  \tparam T Data type of state variables (typically double).
+   *  \tparam N Dimension of the state space.
+   *  \tparam M Dimension of exogenous inputs.
+   *
+   *  The right hand side is interpolated from a table over states, inputs
+   *  and the independent variable, in that order.
+   */
+  template <class I, class T, int N, int M>
+  class TabulatedMappingNonAutonomousExogenous
+    : public MappingNonAutonomousExogenous<I, T, N, M> {
+    public:
+      /*!
+       * \param[in] table Table of right hand sides over states, inputs and
+       *            time.
+       */
+      explicit TabulatedMappingNonAutonomousExogenous(
+          const GridTable<T, N + M + 1, N> & table) : _table(table) {}
+
+      virtual void ComputeRHS(const I & ti, const std::array<T, N> & x,
+                              const std::array<T, M> & u,
+                              std::array<T, N> & rhs)
+      {
+        std::array<T, N + M + 1> xut;
+        std::copy(x.begin(), x.end(), xut.begin());
+        std::copy(u.begin(), u.end(), xut.begin() + N);
+        xut[N + M] = T(ti);
+        _table.Interpolate(xut, rhs);
+      }
+
+      /*!
+       * Underlying table, e.g. for GridTable::Save or error estimates.
+       */
+      const GridTable<T, N + M + 1, N> & Table() const { return _table; }
+
+    private:
+      GridTable<T, N + M + 1, N> _table;
+  };
+
+  /*!
+   * Builds a surrogate of an autonomous, endogenous mapping by sampling its
+   * right hand side on a uniform grid over the state space.
+   *
+   * \param[in] f Mapping to sample; ComputeRHS must tolerate concurrent calls
+   *            when threads != 1.
+   * \param[in] lower Lower corner of the tabulated region.
+   * \param[in] upper Upper corner of the tabulated region.
+   * \param[in] points Number of grid nodes along each state.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \param[in] block Number of nodes along each state in a cache tile.
+   */
+  // T and N are deduced from the mapping only; std::array's size parameter
+  // is a std::size_t and cannot be deduced as an int.
+  template <class T, int N>
+  TabulatedMappingAutonomousEndogenous<T, N>
+  Tabulate(MappingAutonomousEndogenous<T, N> & f,
+           const std::array<T, std::size_t(N)> & lower,
+           const std::array<T, std::size_t(N)> & upper,
+           const std::array<int, std::size_t(N)> & points,
+           unsigned threads = 0, int block = 4)
+  {
+    GridTable<T, N, N> table(lower, upper, points, block);
+    table.Fill([&](const std::array<T, N> & x, std::array<T, N> & rhs,
+                   unsigned) { f.ComputeRHS(x, rhs); }, threads);
+    return TabulatedMappingAutonomousEndogenous<T, N>(table);
+  }
+
+  /*!
+   * Builds a surrogate of an autonomous, exogenous mapping by sampling its
+   * right hand side on a uniform grid over states and inputs.
+   *
+   * \param[in] f Mapping to sample; ComputeRHS must tolerate concurrent calls
+   *            when threads != 1.
+   * \param[in] lower Lower corner of the tabulated region, states first.
+   * \param[in] upper Upper corner of the tabulated region, states first.
+   * \param[in] points Number of grid nodes along each state and input.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \param[in] block Number of nodes along each dimension in a cache tile.
+   */
+  template <class T, int N, int M>
+  TabulatedMappingAutonomousExogenous<T, N, M>
+  Tabulate(MappingAutonomousExogenous<T, N, M> & f,
+           const std::array<T, N + M> & lower,
+           const std::array<T, N + M> & upper,
+           const std::array<int, N + M> & points,
+           unsigned threads = 0, int block = 4)
+  {
+    GridTable<T, N + M, N> table(lower, upper, points, block);
+    table.Fill([&](const std::array<T, N + M> & xu, std::array<T, N> & rhs,
+                   unsigned) {
+      std::array<T, N> x;
+      std::array<T, M> u;
+      std::copy(xu.begin(), xu.begin() + N, x.begin());
+      std::copy(xu.begin() + N, xu.end(), u.begin());
+      f.ComputeRHS(x, u, rhs);
+    }, threads);
+    return TabulatedMappingAutonomousExogenous<T, N, M>(table);
+  }
+
+  /*!
+   * Builds a surrogate of a non-autonomous, endogenous mapping by sampling
+   * its right hand side on a uniform grid over states and an interval of
+   * the independent variable.
+   *
+   * \param[in] f Mapping to sample; ComputeRHS must tolerate concurrent calls
+   *            when threads != 1.
+   * \param[in] lower Lower corner of the tabulated region, states first and
+   *            the independent variable last.
+   * \param[in] upper Upper corner of the tabulated region.
+   * \param[in] points Number of grid nodes along each dimension.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \param[in] block Number of nodes along each dimension in a cache tile.
+   */
+  template <class I, class T, int N>
+  TabulatedMappingNonAutonomousEndogenous<I, T, N>
+  Tabulate(MappingNonAutonomousEndogenous<I, T, N> & f,
+           const std::array<T, N + 1> & lower,
+           const std::array<T, N + 1> & upper,
+           const std::array<int, N + 1> & points,
+           unsigned threads = 0, int block = 4)
+  {
+    GridTable<T, N + 1, N> table(lower, upper, points, block);
+    table.Fill([&](const std::array<T, N + 1> & xt, std::array<T, N> & rhs,
+                   unsigned) {
+      std::array<T, N> x;
+      std::copy(xt.begin(), xt.begin() + N, x.begin());
+      f.ComputeRHS(I(xt[N]), x, rhs);
+    }, threads);
+    return TabulatedMappingNonAutonomousEndogenous<I, T, N>(table);
+  }
+
+  /*!
+   * Builds a surrogate of a non-autonomous, exogenous mapping by sampling
+   * its right hand side on a uniform grid over states, inputs and an
+   * interval of the independent variable.
+   *
+   * \param[in] f Mapping to sample; ComputeRHS must tolerate concurrent calls
+   *            when threads != 1.
+   * \param[in] lower Lower corner of the tabulated region: states, inputs,
+   *            then the independent variable.
+   * \param[in] upper Upper corner of the tabulated region.
+   * \param[in] points Number of grid nodes along each dimension.
+   * \param[in] threads Number of threads, 0 selects HardwareThreads().
+   * \param[in] block Number of nodes along each dimension in a cache tile.
+   */
+  template <class I, class T, int N, int M>
+  TabulatedMappingNonAutonomousExogenous<I, T, N, M>
+  Tabulate(MappingNonAutonomousExogenous<I, T, N, M> & f,
+           const std::array<T, N + M + 1> & lower,
+           const std::array<T, N + M + 1> & upper,
+           const std::array<int, N + M + 1> & points,
+           unsigned threads = 0, int block = 4)
+  {
+    GridTable<T, N + M + 1, N> table(lower, upper, points, block);
+    table.Fill([&](const std::array<T, N + M + 1> & xut,
+                   std::array<T, N> & rhs, unsigned) {
+      std::array<T, N> x;
+      std::array<T, M> u;
+      std::copy(xut.begin(), xut.begin() + N, x.begin());
+      std::copy(xut.begin() + N, xut.begin() + N + M, u.begin());
+      f.ComputeRHS(I(xut[N + M]), x, u, rhs);
+    }, threads);
+    return TabulatedMappingNonAutonomousExogenous<I, T, N, M>(table);
+  }
+}
+#endif
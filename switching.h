@@ -0,0 +1,361 @@
+/*! \file switching.h
+ *  \brief Integration with automatic stiffness detection and switching
+ *  between an explicit and an implicit method.
+ *
+ *  Whether a model is stiff often depends on the time interval: a relaxation
+ *  oscillator is stiff on its slow branches and not during its fast
+ *  transitions.  IntegrateSwitching starts with the explicit Dormand-Prince
+ *  pair, which is cheap per step, and watches the estimate of h times the
+ *  dominant eigenvalue that the method gets for free from its last two
+ *  stages.  When that sits at the stability boundary for several steps, not
+ *  necessarily consecutive, the step size is limited by stability and the
+ *  integration switches to the variable step, second order BDF method, which
+ *  costs a Jacobian and a factorization per step but is stable at any step
+ *  size.  While the implicit method runs, the dominant eigenvalue is estimated
+ *  from the Jacobian it computes anyway, and the integration switches back as
+ *  soon as the explicit method would be stable at the current step size (the
+ *  same idea as LSODA, with different methods).
+ *
+ *  Both methods append their accepted points to a common history, so BDF2
+ *  starts right after a switch from the last explicit steps without a
+ *  restart phase.
+ */
+
+#ifndef __SWITCHING_H__
+#define __SWITCHING_H__
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <tuple>
+
+#include "fixed_linalg.h"
+#include "integrators.h"
+
+namespace dynamics {
+  /*! \struct SwitchingOptions
+   *  \brief Parameters of IntegrateSwitching.
+   */
+  struct SwitchingOptions {
+    SwitchingOptions()
+      : stiff_threshold(3.25), stiff_steps(5), calm_steps(6),
+        nonstiff_threshold(2.0), nonstiff_steps(5), newton_iterations(4) {}
+
+    //! Tolerances and step size limits.
+    AdaptiveOptions integration;
+    //! h |lambda| of the explicit method above which a step counts as stiff.
+    double stiff_threshold;
+    /*!
+     * Stiff steps before switching to the implicit method.  Near the
+     * stability boundary h |lambda| fluctuates around the threshold, so
+     * the steps need not be consecutive; the count restarts after
+     * calm_steps consecutive non-stiff steps (as in Hairer's DOPRI5).
+     */
+    int stiff_steps;
+    //! Consecutive non-stiff explicit steps that restart the stiff count.
+    int calm_steps;
+    //! h |lambda| of the implicit method below which a step counts as not
+    //! stiff.
+    double nonstiff_threshold;
+    //! Consecutive non-stiff steps before switching to the explicit method.
+    int nonstiff_steps;
+    //! Largest number of Newton iterations per implicit step.
+    int newton_iterations;
+  };
+
+  /*! \struct SwitchingReport
+   *  \brief Work done by IntegrateSwitching.
+   */
+  struct SwitchingReport : public AdaptiveReport {
+    SwitchingReport()
+      : explicit_steps(0), implicit_steps(0), switches(0),
+        jacobian_evaluations(0) {}
+
+    //! Accepted steps of the explicit method.
+    std::size_t explicit_steps;
+    //! Accepted steps of the implicit method.
+    std::size_t implicit_steps;
+    //! Number of switches between the methods.
+    std::size_t switches;
+    //! Jacobian evaluations of the implicit method.
+    std::size_t jacobian_evaluations;
+  };
+
+  namespace internal {
+    // Root mean square of e scaled by atol + rtol |x|.
+    template <class T, std::size_t N>
+    T ScaledNorm(const std::array<T, N> & e, const std::array<T, N> & x,
+                 const AdaptiveOptions & options)
+    {
+      T sum(0);
+      for (std::size_t i = 0; i < N; ++i) {
+        T r = e[i] / (T(options.atol) + T(options.rtol) * std::fabs(x[i]));
+        sum += r * r;
+      }
+      return std::sqrt(sum / T(N));
+    }
+
+    // Spectral radius of J from the growth of |J^k v| (power iteration);
+    // the geometric mean over the iterations also handles complex pairs.
+    template <class T, int N>
+    T SpectralRadius(const Matrix<T, N> & J)
+    {
+      const int iterations = 12;
+      std::array<T, N> v, w;
+      for (int i = 0; i < N; ++i)
+        v[i] = T(1) + T(i) / T(N);
+      T log_growth(0), norm(0);
+      for (int i = 0; i < N; ++i)
+        norm += v[i] * v[i];
+      norm = std::sqrt(norm);
+      for (int k = 0; k < iterations; ++k) {
+        for (int i = 0; i < N; ++i)
+          v[i] /= norm;
+        MatVec(J, v, w);
+        norm = T(0);
+        for (int i = 0; i < N; ++i)
+          norm += w[i] * w[i];
+        norm = std::sqrt(norm);
+        if (norm == T(0))
+          return T(0);
+        log_growth += std::log(norm);
+        v = w;
+      }
+      return std::exp(log_growth / T(iterations));
+    }
+  }
+
+  /*!
+   * Integrates from t0 to t1, switching between DormandPrince54 and
+   * variable step BDF2 according to the detected stiffness, and calls
+   * observe(t, x) at the initial point and after every accepted step.
+   *
+   * \param[in] f System with a std::array State, called as f(t, x, rhs),
+   *            e.g. a NonAutonomousExogenousSystem.
+   * \param[in] t0 Initial value of the independent variable.
+   * \param[in] t1 Final value of the independent variable.
+   * \param[in,out] x Initial state, replaced by the final state.
+   * \param[in] options Parameters.
+   * \param[in] observe Observer, called as observe(t, x).
+   */
+  template <class System, class I, class State, class Observer>
+  SwitchingReport IntegrateSwitching(System & f, I t0, I t1, State & x,
+                                     const SwitchingOptions & options,
+                                     Observer && observe)
+  {
+    typedef typename State::value_type T;
+    const int N = static_cast<int>(std::tuple_size<State>::value);
+    const AdaptiveOptions & tolerances = options.integration;
+    SolverMetrics * metrics = tolerances.metrics;
+    SwitchingReport report;
+    DormandPrince54<State> dopri;
+    const std::size_t dopri_evaluations = dopri.Evaluations();
+    observe(t0, static_cast<const State &>(x));
+
+    // The two accepted points before the current one, newest first.
+    std::array<State, 2> past;
+    std::array<I, 2> tpast;
+    past.fill(x);
+    tpast.fill(t0);
+    int history = 0;
+    bool stiff = false;
+    int count = 0, calm = 0;
+    I h = I(tolerances.initial_step);
+    if (h == I(0)) {
+      h = InitialStepSize(f, t0, x, tolerances);
+      ++report.rhs_evaluations;
+    }
+
+    State y, fy, g, delta, predictor;
+    Matrix<T, N> J, W;
+    std::array<int, N> pivots;
+    I t = t0;
+    while (t < t1) {
+      if (report.accepted + report.rejected == tolerances.max_steps)
+        break;
+      h = std::min(h, I(tolerances.max_step));
+      const bool last = t + h >= t1;
+      if (last)
+        h = t1 - t;
+
+      DYNAMICS_TRACE_SPAN("step");
+      T error, factor;
+      if (!stiff) {
+        error = dopri.Attempt(f, t, h, x, y, tolerances.rtol,
+                              tolerances.atol);
+        factor = error > T(0) ? T(0.9) * std::pow(error, T(-0.2)) : T(5);
+        factor = std::min(T(5), std::max(T(0.2), factor));
+        if (error <= T(1)) {
+          dopri.Accept();
+          ++report.explicit_steps;
+          if (dopri.Stiffness() > T(options.stiff_threshold)) {
+            ++count;
+            calm = 0;
+          } else if (++calm == options.calm_steps) {
+            count = 0;
+          }
+        }
+      } else {
+        // BDF2 with step ratio w = h / h_prev:
+        //   y - a x + b x_prev = h c f(t + h, y),
+        // a = (1 + w)^2 / (1 + 2 w), b = w^2 / (1 + 2 w),
+        // c = (1 + w) / (1 + 2 w).
+        const I hp = t - tpast[0], hpp = tpast[0] - tpast[1];
+        const T w = T(h / hp);
+        const T a = (1 + w) * (1 + w) / (1 + 2 * w);
+        const T b = w * w / (1 + 2 * w);
+        const T c = (1 + w) / (1 + 2 * w);
+        // Quadratic extrapolation of the last three points as predictor.
+        const I s = t + h;
+        const T l0 = T((s - tpast[0]) * (s - tpast[1]) / (hp * (hp + hpp)));
+        const T l1 = T((s - t) * (s - tpast[1]) / (-hp * hpp));
+        const T l2 = T((s - t) * (s - tpast[0]) / ((hp + hpp) * hpp));
+        for (int i = 0; i < N; ++i)
+          predictor[i] = l0 * x[i] + l1 * past[0][i] + l2 * past[1][i];
+
+        // Newton matrix W = I - h c J from a forward difference Jacobian
+        // at the current point.
+        const T sqrt_eps = std::sqrt(std::numeric_limits<T>::epsilon());
+        {
+          DYNAMICS_TRACE_SPAN("jacobian");
+          State fx, xd(x);
+          f(t, x, fx);
+          for (int j = 0; j < N; ++j) {
+            const T d = sqrt_eps * std::max(T(1), std::fabs(x[j]));
+            xd[j] = x[j] + d;
+            f(t, xd, fy);
+            xd[j] = x[j];
+            for (int i = 0; i < N; ++i)
+              J(i, j) = (fy[i] - fx[i]) / d;
+          }
+        }
+        report.rhs_evaluations += N + 1;
+        ++report.jacobian_evaluations;
+        for (int i = 0; i < N; ++i) {
+          for (int j = 0; j < N; ++j)
+            W(i, j) = -T(h) * c * J(i, j);
+          W(i, i) += T(1);
+        }
+        bool converged;
+        {
+          DYNAMICS_TRACE_SPAN("lu");
+          converged = LUFactor(W, pivots);
+        }
+        y = predictor;
+        int iterations = 0;
+        for (int k = 0; converged && k < options.newton_iterations; ++k) {
+          ++iterations;
+          f(s, y, fy);
+          ++report.rhs_evaluations;
+          for (int i = 0; i < N; ++i)
+            delta[i] = -(y[i] - a * x[i] + b * past[0][i]
+                         - T(h) * c * fy[i]);
+          LUSolve(W, pivots, delta);
+          for (int i = 0; i < N; ++i)
+            y[i] += delta[i];
+          T change = internal::ScaledNorm(delta, y, tolerances);
+          if (!(change < std::numeric_limits<T>::infinity()))
+            break;
+          if (change <= T(0.01))
+            break;
+          if (k + 1 == options.newton_iterations)
+            converged = false;
+        }
+        for (int i = 0; i < N && converged; ++i)
+          converged = y[i] - y[i] == T(0);
+        if (metrics) {
+          metrics->jacobian_evaluations.Add();
+          metrics->newton_iterations.Observe(iterations);
+        }
+        if (!converged) {
+          ++report.rejected;
+          if (metrics)
+            metrics->rejected_steps.Add();
+          h = h / I(4);
+          continue;
+        }
+
+        // Local error (2/9) h^3 |x'''| with x''' from the third divided
+        // difference of the new and the last three points.
+        const I h3 = h * h * h;
+        for (int i = 0; i < N; ++i) {
+          T d10 = (y[i] - x[i]) / T(h);
+          T d21 = (x[i] - past[0][i]) / T(hp);
+          T d32 = (past[0][i] - past[1][i]) / T(hpp);
+          T d20 = (d10 - d21) / T(h + hp);
+          T d31 = (d21 - d32) / T(hp + hpp);
+          T d30 = (d20 - d31) / T(h + hp + hpp);
+          g[i] = T(4) / T(3) * T(h3) * d30;
+        }
+        error = internal::ScaledNorm(g, y, tolerances);
+        factor = error > T(0) ? T(0.9) * std::pow(error, T(-1) / T(3))
+          : T(2);
+        factor = std::min(T(2), std::max(T(0.2), factor));
+        if (error <= T(1)) {
+          ++report.implicit_steps;
+          count = T(h) * factor * internal::SpectralRadius(J)
+            < T(options.nonstiff_threshold) ? count + 1 : 0;
+        }
+      }
+
+      if (error <= T(1)) {
+        ++report.accepted;
+        if (metrics) {
+          metrics->steps.Add();
+          metrics->step_size.Observe(double(h));
+        }
+        past[1] = past[0];
+        tpast[1] = tpast[0];
+        past[0] = x;
+        tpast[0] = t;
+        history = std::min(history + 1, 2);
+        t = last ? t1 : t + h;
+        x.swap(y);
+        observe(t, static_cast<const State &>(x));
+      } else {
+        ++report.rejected;
+        if (metrics)
+          metrics->rejected_steps.Add();
+        factor = std::min(factor, T(1));
+      }
+      h = h * I(factor);
+
+      // Switch when the detector fired for enough steps; BDF2 needs two
+      // points of history.
+      if (!stiff && count >= options.stiff_steps && history == 2) {
+        stiff = true;
+        count = calm = 0;
+        ++report.switches;
+        if (metrics)
+          metrics->switches.Add();
+      } else if (stiff && count >= options.nonstiff_steps) {
+        stiff = false;
+        count = 0;
+        dopri.Reset();
+        ++report.switches;
+        if (metrics)
+          metrics->switches.Add();
+      }
+    }
+    report.success = !(t < t1);
+    report.rhs_evaluations += dopri.Evaluations() - dopri_evaluations;
+    if (metrics)
+      metrics->rhs_evaluations.Add(report.rhs_evaluations);
+    return report;
+  }
+
+  /*!
+   * Integrates from t0 to t1, switching between DormandPrince54 and
+   * variable step BDF2 according to the detected stiffness.
+   */
+  template <class System, class I, class State>
+  SwitchingReport IntegrateSwitching(System & f, I t0, I t1, State & x,
+                                     const SwitchingOptions & options
+                                       = SwitchingOptions())
+  {
+    return IntegrateSwitching(f, t0, t1, x, options,
+                              [](const I &, const State &) {});
+  }
+}
+#endif
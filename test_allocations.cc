@@ -0,0 +1,330 @@
+/*! \example test_allocations.cc
+ * This is an example of how to check that the hot paths of a simulation
+ * do not allocate: global operator new (and, with glibc, malloc) are
+ * replaced by counting versions, and every hot path is run once to warm
+ * up and then measured.
+ */
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "batched.h"
+#include "equilibrium.h"
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "kalman.h"
+#include "mappings.h"
+#include "metrics.h"
+#include "mpc.h"
+#include "switching.h"
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> allocations(0);
+
+static void * Allocate(std::size_t size)
+{
+  if (counting.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void * operator new(std::size_t size)
+{
+  void * p = Allocate(size);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  return Allocate(size);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  return Allocate(size);
+}
+
+void operator delete(void * p) noexcept { std::free(p); }
+void operator delete[](void * p) noexcept { std::free(p); }
+void operator delete(void * p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+void operator delete[](void * p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+#ifdef __GLIBC__
+// glibc lets programs replace malloc; count C allocations as well, e.g.
+// from C library calls on a hot path.
+extern "C" {
+  void * __libc_malloc(std::size_t);
+  void * __libc_calloc(std::size_t, std::size_t);
+  void * __libc_realloc(void *, std::size_t);
+  void __libc_free(void *);
+
+  void * malloc(std::size_t size)
+  {
+    if (counting.load(std::memory_order_relaxed))
+      allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+  }
+
+  void * calloc(std::size_t n, std::size_t size)
+  {
+    if (counting.load(std::memory_order_relaxed))
+      allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+  }
+
+  void * realloc(void * p, std::size_t size)
+  {
+    if (counting.load(std::memory_order_relaxed))
+      allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+  }
+
+  void free(void * p) { __libc_free(p); }
+}
+#endif
+
+class Pendulum : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    Pendulum(double l, double g = 9.81) : _l(l), _g(g) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -_g/_l*std::sin(x[0]);
+    }
+
+  private:
+    double _l, _g;
+};
+
+// The Pendulum with a torque input, over any scalar type.
+template <class S>
+class DrivenPendulum
+  : public dynamics::MappingAutonomousExogenous<S, 2, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            const std::array<S, 1> & u,
+                            std::array<S, 2> & rhs)
+    {
+      using std::sin;
+      rhs[0] = x[1];
+      rhs[1] = -sin(x[0]) + u[0];
+    }
+};
+
+class Henon : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    Henon(double a = 1.4, double b = 0.3) : _a(a), _b(b) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1] + 1.0 - _a*x[0]*x[0];
+      rhs[1] = _b * x[0];
+    }
+
+  private:
+    double _a, _b;
+};
+
+// Chain of n pendulums coupled by springs to their neighbours.
+class PendulumChain
+  : public dynamics::MappingAutonomousEndogenous<double, dynamics::Dynamic> {
+  public:
+    PendulumChain(int n) : _n(n) {}
+    virtual int Dimension() const { return 2*_n; }
+    virtual void ComputeRHS(const std::vector<double> & x,
+                            std::vector<double> & rhs)
+    {
+      for (int i = 0; i < _n; ++i) {
+        double left = i > 0 ? x[2*i - 2] : x[2*i];
+        double right = i + 1 < _n ? x[2*i + 2] : x[2*i];
+        rhs[2*i] = x[2*i + 1];
+        rhs[2*i + 1] = -std::sin(x[2*i]) + 0.5*(left - 2*x[2*i] + right);
+      }
+    }
+
+  private:
+    int _n;
+};
+
+// Runs a hot path once to warm up, then counts the allocations of a
+// second run.
+template <class Function>
+static bool Check(const char * name, Function run)
+{
+  run();
+  allocations.store(0);
+  counting.store(true);
+  run();
+  counting.store(false);
+  long n = allocations.load();
+  std::cout << name << ": " << n << " allocations" << std::endl;
+  return n == 0;
+}
+
+int main(void)
+{
+  // The replacements see allocations, so zero counts below mean something.
+  counting.store(true);
+  {
+    std::vector<double> * volatile w = new std::vector<double>(10);
+    delete w;
+  }
+  counting.store(false);
+  if (allocations.load() < 2) {
+    std::cerr << "allocations are not counted" << std::endl;
+    return EXIT_FAILURE;
+  }
+  bool ok = true;
+
+  Pendulum pendulum(1.0);
+  dynamics::AutonomousEndogenousSystem<double, 2> f =
+    dynamics::MakeSystem(pendulum);
+  std::array<double, 2> x = {{1.0, 0.0}};
+  double sum = 0.0;
+
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  ok &= Check("fixed step RK4 (Pendulum)", [&]() {
+    dynamics::Integrate(rk4, f, 0.0, 0.01, 1000, x,
+                        [&](double, const std::array<double, 2> & y) {
+                          sum += y[0];
+                        });
+  });
+
+  dynamics::DormandPrince54<std::array<double, 2> > dopri;
+  dynamics::MetricsRegistry registry;
+  dynamics::SolverMetrics metrics(registry);
+  dynamics::AdaptiveOptions adaptive;
+  adaptive.metrics = &metrics;
+  ok &= Check("adaptive DOPRI5 with metrics (Pendulum)", [&]() {
+    dynamics::IntegrateAdaptive(dopri, f, 0.0, 10.0, x, adaptive);
+  });
+
+  dynamics::SwitchingOptions switching;
+  ok &= Check("stiffness switching (Pendulum)", [&]() {
+    dynamics::IntegrateSwitching(f, 0.0, 10.0, x, switching);
+  });
+
+  Henon henon;
+  std::array<double, 2> y = {{0.1, 0.1}}, z;
+  ok &= Check("map iteration (Henon)", [&]() {
+    for (int k = 0; k < 10000; ++k) {
+      henon.ComputeRHS(y, z);
+      y = z;
+    }
+  });
+
+  dynamics::EquilibriumOptions newton;
+  newton.kind = dynamics::MapFixedPoint;
+  ok &= Check("fixed point Newton (Henon)", [&]() {
+    std::array<double, 2> x0 = {{0.5, 0.2}};
+    dynamics::FindEquilibrium(henon, x0, newton);
+  });
+
+  // Batched right hand sides, Jacobians and LU of a stiff ensemble.
+  dynamics::BatchedRosenbrock<std::array<double, 2>, 8> rosenbrock;
+  std::array<std::array<double, 2>, 8> batch;
+  for (int b = 0; b < 8; ++b) {
+    batch[b][0] = 0.1*b;
+    batch[b][1] = 0.0;
+  }
+  ok &= Check("batched Rosenbrock (Pendulum)", [&]() {
+    for (int k = 0; k < 100; ++k)
+      rosenbrock.Step(f, 0.01*k, 0.01, batch);
+  });
+
+  // Dynamic size states only allocate on the first step.
+  PendulumChain chain(100);
+  dynamics::AutonomousEndogenousSystem<double, dynamics::Dynamic> g =
+    dynamics::MakeSystem(chain);
+  std::vector<double> u(200, 0.1), v(200);
+  dynamics::RungeKutta4<std::vector<double> > rk4_chain;
+  ok &= Check("fixed step RK4 (PendulumChain)", [&]() {
+    for (int k = 0; k < 100; ++k)
+      rk4_chain.Step(g, 0.01*k, 0.01, u);
+  });
+  dynamics::DormandPrince54<std::vector<double> > dopri_chain;
+  ok &= Check("DOPRI5 steps (PendulumChain)", [&]() {
+    double t = 0.0;
+    for (int k = 0; k < 100; ++k) {
+      if (dopri_chain.Attempt(g, t, 0.01, u, v, 1e-6, 1e-9) <= 1.0) {
+        dopri_chain.Accept();
+        u.swap(v);
+        t += 0.01;
+      }
+    }
+  });
+
+  // Kalman filter cycles on the Pendulum, observing its angle.
+  dynamics::Matrix<double, 2> P0 = dynamics::Matrix<double, 2>::Identity();
+  dynamics::Matrix<double, 2> Q = dynamics::Matrix<double, 2>::Zero();
+  dynamics::Matrix<double, 1> R = dynamics::Matrix<double, 1>::Identity();
+  std::array<double, 2> x0 = {{1.0, 0.0}};
+  dynamics::ExtendedKalmanFilter<double, 2,
+    dynamics::AutonomousEndogenousSystem<double, 2> > ekf(f, x0, P0);
+  dynamics::UnscentedKalmanFilter<double, 2,
+    dynamics::AutonomousEndogenousSystem<double, 2> > ukf(f, x0, P0);
+  auto angle = [](const std::array<double, 2> & s,
+                  std::array<double, 1> & z) { z[0] = s[0]; };
+  ok &= Check("EKF and UKF cycles (Pendulum)", [&]() {
+    for (int k = 0; k < 100; ++k) {
+      std::array<double, 1> z = {{std::cos(0.01*k)}};
+      ekf.Predict(0.01*k, 0.01, Q);
+      ekf.Update(angle, z, R);
+      ukf.Predict(0.01*k, 0.01, Q);
+      ukf.Update(angle, z, R);
+    }
+  });
+
+  // Real-time iterations of nonlinear MPC.
+  DrivenPendulum<dynamics::Dual<double, 3> > driven;
+  dynamics::Matrix<double, 1> Ru = dynamics::Matrix<double, 1>::Identity();
+  dynamics::ModelPredictiveController<double, 2, 1> mpc(driven, 20, 0.05,
+                                                        P0, Ru, P0);
+  ok &= Check("MPC solves (Pendulum)", [&]() {
+    for (int k = 0; k < 10; ++k) {
+      mpc.Solve(x0);
+      mpc.Shift();
+    }
+  });
+
+  // Dense linear algebra.
+  dynamics::Matrix<double, 6> A, LU;
+  std::array<int, 6> pivots;
+  std::array<double, 6> b;
+  for (int i = 0; i < 6; ++i) {
+    b[i] = 1.0;
+    for (int j = 0; j < 6; ++j)
+      A(i, j) = i == j ? 4.0 : 1.0/(1 + i + j);
+  }
+  ok &= Check("fixed size LU", [&]() {
+    LU = A;
+    dynamics::LUFactor(LU, pivots);
+    dynamics::LUSolve(LU, pivots, b);
+  });
+
+  std::cout << "(" << sum + x[0] + y[0] + u[0] + batch[0][0] + b[0] << ")"
+            << std::endl;
+  if (!ok) {
+    std::cerr << "hot paths allocate after warm-up" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*! \example test_batched.cc
+ * This is an example of how to integrate an ensemble of stiff systems with
+ * batched factorizations of their Newton matrices.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+#include "batched.h"
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "random.h"
+#include "statistics.h"
+
+// Van der Pol oscillator; stiff for large mu.
+class VanDerPol : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    VanDerPol(double mu) : _mu(mu) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = _mu*((1 - x[0]*x[0])*x[1] - x[0]);
+    }
+
+  private:
+    double _mu;
+};
+
+// x' = -x, y' = -1000 (y - cos(t)) written autonomously with z = t.
+class StiffLinear : public dynamics::MappingAutonomousEndogenous<double, 3> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 3> & x,
+                            std::array<double, 3> & rhs)
+    {
+      rhs[0] = -x[0];
+      rhs[1] = -1000.0*(x[1] - std::cos(x[2]));
+      rhs[2] = 1.0;
+    }
+};
+
+// x' = 1024 x, whose finite difference Jacobian is exact.
+class Growth : public dynamics::MappingAutonomousEndogenous<double, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 1> & x,
+                            std::array<double, 1> & rhs)
+    {
+      rhs[0] = 1024.0*x[0];
+    }
+};
+
+int main(void)
+{
+  // Batched solves agree with one-at-a-time solves, including lanes that
+  // pivot differently.
+  const int N = 5, B = 8;
+  dynamics::SplitMix64 rng(3);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  dynamics::BatchedMatrix<double, N, B> A;
+  dynamics::BatchedVector<double, N, B> x;
+  std::array<dynamics::Matrix<double, N>, B> a;
+  std::array<std::array<double, N>, B> y;
+  for (int b = 0; b < B; ++b)
+    for (int i = 0; i < N; ++i) {
+      x(i)[b] = y[b][i] = uniform(rng);
+      for (int j = 0; j < N; ++j)
+        A(i, j)[b] = a[b](i, j) = uniform(rng);
+    }
+  std::array<int, N*B> pivots;
+  if (!dynamics::BatchedLUFactor(A, pivots)) {
+    std::cerr << "random matrices reported singular" << std::endl;
+    return EXIT_FAILURE;
+  }
+  dynamics::BatchedLUSolve(A, pivots, x);
+  double worst = 0.0;
+  for (int b = 0; b < B; ++b) {
+    std::array<int, N> p;
+    dynamics::LUFactor(a[b], p);
+    dynamics::LUSolve(a[b], p, y[b]);
+    for (int i = 0; i < N; ++i)
+      worst = std::max(worst, std::fabs(x(i)[b] - y[b][i]));
+  }
+  std::cout << "batched and single LU differ by " << worst << std::endl;
+  if (worst > 1e-10) {
+    std::cerr << "batched LU inaccurate" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Second order convergence on a stiff problem at steps far beyond the
+  // explicit stability limit of 0.002.
+  StiffLinear stiff;
+  dynamics::AutonomousEndogenousSystem<double, 3> g =
+    dynamics::MakeSystem(stiff);
+  double previous = 0.0;
+  for (int refine = 0; refine < 3; ++refine) {
+    const std::size_t steps = 20 << refine;
+    const double h = 1.0/steps;
+    dynamics::RunningMoments<double> error = dynamics::RunRosenbrockEnsemble<4>(
+        g, 6, 0.0, h, steps, dynamics::RunningMoments<double>(),
+        [](std::size_t i, std::array<double, 3> & x0) {
+          x0[0] = 1.0 + i;
+          x0[1] = 0.0;
+          x0[2] = 0.0;
+        },
+        [&](std::size_t i, std::size_t k, const std::array<double, 3> & x,
+            dynamics::RunningMoments<double> & acc) {
+          if (k == steps)
+            acc.Add(std::fabs(x[0] - (1.0 + i)*std::exp(-1.0)));
+        }, 2);
+    std::cout << "h = " << h << ": mean error " << error.Mean() << std::endl;
+    if (error.Count() != 6 || (refine > 0 && error.Mean() > 0.3*previous)) {
+      std::cerr << "ROS2 does not converge at second order" << std::endl;
+      return EXIT_FAILURE;
+    }
+    previous = error.Mean();
+  }
+
+  // Stiff Van der Pol ensemble on the slow branch; results do not depend on
+  // the number of threads or the grouping of members into batches.
+  VanDerPol vdp(1000.0);
+  dynamics::AutonomousEndogenousSystem<double, 2> f =
+    dynamics::MakeSystem(vdp);
+  dynamics::RunningMoments<double> results[2];
+  for (int run = 0; run < 2; ++run) {
+    auto initial = [](std::size_t i, std::array<double, 2> & x0) {
+      x0[0] = 2.0 - 0.01*i;
+      x0[1] = 0.0;
+    };
+    auto record = [](std::size_t, std::size_t k,
+                     const std::array<double, 2> & x,
+                     dynamics::RunningMoments<double> & acc) {
+      if (k == 1000)
+        acc.Add(x[0]);
+    };
+    results[run] = run == 0
+      ? dynamics::RunRosenbrockEnsemble<8>(
+          f, 21, 0.0, 0.0005, 1000, dynamics::RunningMoments<double>(),
+          initial, record, 1)
+      : dynamics::RunRosenbrockEnsemble<4>(
+          f, 21, 0.0, 0.0005, 1000, dynamics::RunningMoments<double>(),
+          initial, record, 3);
+  }
+  std::cout << "Van der Pol (mu = 1000) at t = 0.5: mean "
+            << results[0].Mean() << std::endl;
+  if (results[0].Count() != 21 || !std::isfinite(results[0].Mean())
+      || std::fabs(results[0].Mean() - results[1].Mean()) > 1e-12
+      || results[0].Mean() < 1.0 || results[0].Mean() > 2.0) {
+    std::cerr << "stiff ensemble inconsistent" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // A step size with gamma h lambda = 1 in floating point makes the Newton
+  // matrix of x' = lambda x singular; the ensemble must not go on with the
+  // non-finite states.
+  const double gamma = 1.0 + 1.0/std::sqrt(2.0), lambda = 1024.0;
+  const double delta = std::sqrt(std::numeric_limits<double>::epsilon());
+  double singular = 1.0/(gamma*lambda);
+  for (int k = 0; k < 4; ++k)
+    singular = std::nextafter(singular, 0.0);
+  for (int k = 0; k < 8 && -gamma*singular/delta*(lambda*delta) + 1.0 != 0;
+       ++k)
+    singular = std::nextafter(singular, 1.0);
+  Growth growth;
+  dynamics::AutonomousEndogenousSystem<double, 1> e =
+    dynamics::MakeSystem(growth);
+  bool thrown = false;
+  try {
+    dynamics::RunRosenbrockEnsemble<4>(
+        e, 3, 0.0, singular, 2, dynamics::RunningMoments<double>(),
+        [](std::size_t, std::array<double, 1> & x0) { x0[0] = 1.0; },
+        [](std::size_t, std::size_t, const std::array<double, 1> &,
+           dynamics::RunningMoments<double> &) {}, 1);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  if (!thrown) {
+    std::cerr << "singular Newton matrix not reported" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*! \example test_cell_mapping.cc
+ * This is an example of how to find attractors and their domains of
+ * attraction by simple cell mapping.
+ */
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "cell_mapping.h"
+#include "integrators.h"
+#include "mappings.h"
+
+// Henon map.
+class Henon : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    Henon(double a = 1.4, double b = 0.3) : _a(a), _b(b) {}
+
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = 1.0 - _a*x[0]*x[0] + x[1];
+      rhs[1] = _b*x[0];
+    }
+
+  private:
+    double _a, _b;
+};
+
+// Damped double well oscillator x'' = -0.25 x' + x - x^3, with stable
+// equilibria at (-1, 0) and (1, 0).
+class DoubleWell : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -0.25*x[1] + x[0] - x[0]*x[0]*x[0];
+    }
+};
+
+typedef dynamics::CellGrid<double, 2> Grid;
+typedef dynamics::SimpleCellMapping<double, 2> CellMapping;
+
+int main(void)
+{
+  const double h = 0.05;
+  const std::size_t steps = 10;
+  const std::array<double, 2> lower = {{-2.0, -2.0}}, upper = {{2.0, 2.0}};
+  const std::array<std::size_t, 2> cells = {{200, 200}};
+  Grid grid(lower, upper, cells);
+  DoubleWell well;
+
+  // Cell mapping of the flow over 0.5 time units.
+  dynamics::CellMappingOptions options;
+  options.threads = 1;
+  CellMapping serial(grid, options);
+  std::chrono::steady_clock::time_point begin =
+    std::chrono::steady_clock::now();
+  serial.BuildFlow(well, h, steps);
+  serial.Analyze();
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+  options.threads = 4;
+  CellMapping threaded(grid, options);
+  threaded.BuildFlow(well, h, steps);
+  threaded.Analyze();
+  if (serial.Images() != threaded.Images()) {
+    std::cerr << "results depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Rebuilding discards the previous analysis.
+  threaded.BuildFlow(well, h, steps);
+  const std::size_t discarded = threaded.Groups();
+  threaded.Analyze();
+  if (discarded != 0 || threaded.Groups() != serial.Groups()
+      || threaded.Period(1) != serial.Period(1)) {
+    std::cerr << "rebuilding kept stale groups" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Rounding to cell centers turns the slow spirals into the foci into
+  // short cycles around them, so groups are assigned to an equilibrium by
+  // the position of their cycle; those near the saddle are left out.
+  std::vector<int> side(serial.Groups(), 0);
+  std::vector<std::size_t> sizes = serial.DomainSizes();
+  std::size_t domain[2] = {0, 0};
+  for (std::size_t g = 1; g < serial.Groups(); ++g) {
+    std::array<double, 2> x;
+    grid.Center(serial.Representative(g), x);
+    side[g] = x[0] < -0.5 ? -1 : (x[0] > 0.5 ? 1 : 0);
+    if (side[g] != 0)
+      domain[side[g] > 0] += sizes[g];
+  }
+  std::cout << "double well: " << grid.Cells() << " cells, "
+            << serial.Groups() << " groups, domains of the equilibria "
+            << domain[0] << " and " << domain[1] << " cells, " << seconds
+            << " s" << std::endl;
+  if (domain[0] < grid.Cells() / 4 || domain[1] < grid.Cells() / 4) {
+    std::cerr << "domains of attraction not found" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Compare with long integrations from a sample of cell centers, which
+  // is what the cell map saves.
+  dynamics::AutonomousEndogenousSystem<double, 2> system(well);
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  std::size_t sampled = 0, agree = 0;
+  begin = std::chrono::steady_clock::now();
+  for (std::size_t c = 0; c < grid.Cells(); c += 97) {
+    std::array<double, 2> x;
+    grid.Center(c, x);
+    for (int k = 0; k < 2000; ++k)
+      rk4.Step(system, k*h, h, x);
+    const int s = side[serial.Group(c)];
+    if (s != 0) {
+      ++sampled;
+      agree += (s < 0) == (x[0] < 0.0);
+    }
+  }
+  const double direct = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+  std::cout << "agreement with integration on " << sampled << " cells: "
+            << double(agree)/sampled << " (integration of these cells took "
+            << direct << " s)" << std::endl;
+  if (double(agree) < 0.95*sampled) {
+    std::cerr << "domains of attraction disagree with integration"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Henon map: orbits from cells outside the basin of the strange
+  // attractor escape to the sink; the others end in periodic groups that
+  // approximate the attractor.
+  const std::array<double, 2> hl = {{-1.5, -0.5}}, hu = {{1.5, 0.5}};
+  const std::array<std::size_t, 2> hc = {{600, 200}};
+  Grid henon_grid(hl, hu, hc);
+  Henon henon;
+  CellMapping map(henon_grid);
+  map.BuildMap(henon);
+  map.Analyze();
+  std::size_t bounded = 0, matches = 0, checked = 0;
+  for (std::size_t c = 0; c < henon_grid.Cells(); c += 13) {
+    std::array<double, 2> x, y;
+    henon_grid.Center(c, x);
+    bool escaped = false;
+    for (int k = 0; k < 200 && !escaped; ++k) {
+      henon.ComputeRHS(x, y);
+      x = y;
+      escaped = std::fabs(x[0]) > 10.0;
+    }
+    ++checked;
+    bounded += map.Group(c) != 0;
+    matches += (map.Group(c) != 0) == !escaped;
+  }
+  std::cout << "Henon: " << map.Groups() - 1 << " periodic groups, "
+            << "bounded fraction " << double(bounded)/checked
+            << ", agreement with iteration " << double(matches)/checked
+            << std::endl;
+  if (double(matches) < 0.9*checked) {
+    std::cerr << "Henon basin disagrees with iteration" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+/*! \example test_collocation.cc
+ * This is an example of how to plan trajectories of a mapping by
+ * Hermite-Simpson direct collocation.
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "autodiff.h"
+#include "collocation.h"
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "mappings.h"
+
+// x'' = u
+template <class S>
+class DoubleIntegrator
+  : public dynamics::MappingAutonomousExogenous<S, 2, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            const std::array<S, 1> & u,
+                            std::array<S, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = u[0];
+    }
+};
+
+// Damped pendulum driven by a torque; upright is theta = pi.
+template <class S>
+class Pendulum : public dynamics::MappingAutonomousExogenous<S, 2, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            const std::array<S, 1> & u,
+                            std::array<S, 2> & rhs)
+    {
+      using std::sin;
+      rhs[0] = x[1];
+      rhs[1] = -sin(x[0]) - 0.1*x[1] + u[0];
+    }
+};
+
+typedef dynamics::TrajectoryOptimizer<double, 2, 1> Optimizer;
+typedef dynamics::Dual<double, 6> Scalar;
+
+// Inputs linear between the nodes of a solution.
+class Interpolated {
+  public:
+    Interpolated(const Optimizer & optimizer, double duration)
+      : _optimizer(optimizer),
+        _h(duration/optimizer.Intervals()) {}
+
+    double operator()(double t) const
+    {
+      std::size_t k = std::min(std::size_t(t/_h),
+                               _optimizer.Intervals() - 1);
+      double s = t/_h - k;
+      return (1 - s)*_optimizer.Inputs(k)[0]
+        + s*_optimizer.Inputs(k + 1)[0];
+    }
+
+  private:
+    const Optimizer & _optimizer;
+    double _h;
+};
+
+static Optimizer::State Swing(unsigned threads, double & seconds,
+                              dynamics::CollocationResult<double> & result,
+                              double & miss)
+{
+  const double pi = 3.14159265358979323846, duration = 5.0;
+  Pendulum<double> pendulum;
+  Pendulum<Scalar> dual;
+  dynamics::Matrix<double, 2> Q = dynamics::Matrix<double, 2>::Zero();
+  dynamics::Matrix<double, 1> R = dynamics::Matrix<double, 1>::Identity();
+  dynamics::CollocationOptions options;
+  options.threads = threads;
+  Optimizer optimizer(pendulum, dual, 100, duration, Q, R, Q, options);
+  Optimizer::State start = {{0.0, 0.0}}, end = {{pi, 0.0}};
+  Optimizer::Input zero = {{0.0}};
+  optimizer.SetFinalState(end);
+  optimizer.Initialize(start, end, zero);
+  std::chrono::steady_clock::time_point begin =
+    std::chrono::steady_clock::now();
+  result = optimizer.Solve(start);
+  seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+
+  // Replaying the planned inputs on the model reaches the upright state.
+  Interpolated input(optimizer, duration);
+  std::array<double, 1> u = {{0.0}};
+  dynamics::AutonomousExogenousSystem<double, 2, 1> g(pendulum, u);
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  std::array<double, 2> x = start;
+  const int steps = 20000;
+  const double h = duration/steps;
+  for (int k = 0; k < steps; ++k) {
+    // Inputs at the midpoint of every step are accurate to second order.
+    g.Input()[0] = input((k + 0.5)*h);
+    rk4.Step(g, k*h, h, x);
+  }
+  miss = std::max(std::fabs(x[0] - pi), std::fabs(x[1]));
+  return optimizer.States(50);
+}
+
+int main(void)
+{
+  // Minimum energy transfer of a double integrator from rest at 0 to rest
+  // at 1 in unit time: the optimal input is u(t) = 6 - 12 t, with cost 6.
+  // Hermite-Simpson is exact for its cubic states and the problem is a
+  // quadratic program, which SQP solves in one step.
+  DoubleIntegrator<double> integrator;
+  DoubleIntegrator<Scalar> dual;
+  dynamics::Matrix<double, 2> Q = dynamics::Matrix<double, 2>::Zero();
+  dynamics::Matrix<double, 1> R = dynamics::Matrix<double, 1>::Identity();
+  Optimizer transfer(integrator, dual, 50, 1.0, Q, R, Q);
+  Optimizer::State start = {{0.0, 0.0}}, end = {{1.0, 0.0}};
+  Optimizer::Input zero = {{0.0}};
+  transfer.SetFinalState(end);
+  transfer.Initialize(start, start, zero);
+  dynamics::CollocationResult<double> result = transfer.Solve(start);
+  double error = 0.0;
+  for (std::size_t k = 0; k <= 50; ++k)
+    error = std::max(error,
+                     std::fabs(transfer.Inputs(k)[0] - (6 - 12*k/50.0)));
+  std::cout << "double integrator: " << result.iterations << " iterations, "
+            << "cost " << result.cost << ", largest input error " << error
+            << std::endl;
+  if (!result.converged || result.iterations > 2 || error > 1e-9
+      || std::fabs(result.cost - 6.0) > 1e-9) {
+    std::cerr << "collocation misses the minimum energy transfer"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Swing-up of a pendulum, a nonlinear problem; threads only change how
+  // intervals are evaluated.
+  double seconds[2], miss[2];
+  dynamics::CollocationResult<double> swing[2];
+  Optimizer::State serial = Swing(1, seconds[0], swing[0], miss[0]);
+  Optimizer::State threaded = Swing(4, seconds[1], swing[1], miss[1]);
+  std::cout << "swing-up: " << swing[0].iterations << " iterations, cost "
+            << swing[0].cost << ", infeasibility " << swing[0].infeasibility
+            << ", replayed final error " << miss[0] << ", " << seconds[0]
+            << " s (1 thread), " << seconds[1] << " s (4 threads)"
+            << std::endl;
+  if (!swing[0].converged || swing[0].infeasibility > 1e-9
+      || miss[0] > 1e-3) {
+    std::cerr << "collocation does not swing up the pendulum" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (serial != threaded || swing[0].iterations != swing[1].iterations) {
+    std::cerr << "results depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
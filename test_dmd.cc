@@ -0,0 +1,321 @@
+/*! \example test_dmd.cc
+ * This is an example of how to compute a dynamic mode decomposition of a
+ * trajectory while it is integrated, without storing snapshots.
+ */
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "dense.h"
+#include "dmd.h"
+#include "integrators.h"
+#include "mappings.h"
+
+typedef std::complex<double> Complex;
+
+// Three damped oscillators embedded in a large state space: x = U z with
+// orthonormal U and dz/dt = B z for block diagonal B.
+class Embedded
+  : public dynamics::MappingAutonomousEndogenous<double, dynamics::Dynamic> {
+  public:
+    Embedded(int n, const std::vector<double> & decay,
+             const std::vector<double> & frequency)
+      : _U(n, 2*decay.size()), _decay(decay), _frequency(frequency),
+        _z(2*decay.size())
+    {
+      std::mt19937 rng(5);
+      std::normal_distribution<double> normal;
+      for (std::size_t j = 0; j < _U.Cols(); ++j)
+        for (int i = 0; i < n; ++i)
+          _U(i, j) = normal(rng);
+      dynamics::Orthonormalize(_U);
+    }
+
+    virtual int Dimension() const { return int(_U.Rows()); }
+
+    virtual void ComputeRHS(const std::vector<double> & x,
+                            std::vector<double> & rhs)
+    {
+      for (std::size_t j = 0; j < _U.Cols(); ++j) {
+        double s = 0.0;
+        for (std::size_t i = 0; i < _U.Rows(); ++i)
+          s += _U(i, j)*x[i];
+        _z[j] = s;
+      }
+      std::fill(rhs.begin(), rhs.end(), 0.0);
+      for (std::size_t k = 0; k < _decay.size(); ++k) {
+        const double a = _z[2*k], b = _z[2*k + 1];
+        const double da = -_decay[k]*a - _frequency[k]*b;
+        const double db = _frequency[k]*a - _decay[k]*b;
+        for (std::size_t i = 0; i < _U.Rows(); ++i)
+          rhs[i] += _U(i, 2*k)*da + _U(i, 2*k + 1)*db;
+      }
+    }
+
+    const dynamics::DenseMatrix<double> & Basis() const { return _U; }
+
+  private:
+    dynamics::DenseMatrix<double> _U;
+    std::vector<double> _decay, _frequency, _z;
+};
+
+// Stability function of RungeKutta4, the exact eigenvalue of one step.
+static Complex RungeKutta4Factor(Complex z)
+{
+  return 1.0 + z*(1.0 + z*(0.5 + z*(1.0/6 + z/24.0)));
+}
+
+// Largest distance from a computed eigenvalue of A to the nearest known
+// one and from a known eigenvalue to the nearest computed one.
+static double SpectrumError(const dynamics::DenseMatrix<double> & A,
+                            const std::vector<Complex> & known)
+{
+  std::vector<Complex> values;
+  dynamics::DenseMatrix<Complex> vectors;
+  dynamics::NonsymmetricEigen(A, values, vectors);
+  double error = values.size() == known.size() ? 0.0 : 1e300;
+  for (int pass = 0; pass < 2; ++pass) {
+    const std::vector<Complex> & from = pass ? known : values;
+    const std::vector<Complex> & to = pass ? values : known;
+    for (std::size_t i = 0; i < from.size(); ++i) {
+      double nearest = 1e300;
+      for (std::size_t j = 0; j < to.size(); ++j)
+        nearest = std::min(nearest, std::abs(from[i] - to[j]));
+      error = std::max(error, nearest);
+    }
+  }
+  return error;
+}
+
+// Eigenvalue problems with known spectra: similarity transforms of block
+// diagonal matrices, cyclic permutations (which defeat the standard
+// shifts), Jordan blocks, the zero matrix and a companion matrix.
+static double EigenvalueRegressions()
+{
+  std::mt19937 rng(2);
+  std::normal_distribution<double> normal;
+  double worst = 0.0;
+  for (int trial = 0; trial < 300; ++trial) {
+    const std::size_t n = 1 + trial % 17;
+    dynamics::DenseMatrix<double> D(n, n), S(n, n), inverse(n, n), SD, A;
+    std::vector<Complex> known;
+    for (std::size_t i = 0; i < n; ) {
+      if (i + 1 < n && trial % 3 != 0) {
+        const double re = normal(rng), im = std::fabs(normal(rng)) + 0.1;
+        D(i, i) = D(i + 1, i + 1) = re;
+        D(i, i + 1) = im;
+        D(i + 1, i) = -im;
+        known.push_back(Complex(re, im));
+        known.push_back(Complex(re, -im));
+        i += 2;
+      } else {
+        D(i, i) = normal(rng);
+        known.push_back(D(i, i));
+        ++i;
+      }
+    }
+    for (std::size_t j = 0; j < n; ++j)
+      for (std::size_t i = 0; i < n; ++i)
+        S(i, j) = (i == j ? 3.0 : 0.0) + 0.3*normal(rng);
+    dynamics::DenseMatrix<double> LU(S);
+    std::vector<std::size_t> pivots;
+    dynamics::LUFactor(LU, pivots);
+    for (std::size_t j = 0; j < n; ++j) {
+      inverse(j, j) = 1.0;
+      dynamics::LUSolve(LU, pivots, inverse.Column(j));
+    }
+    dynamics::Multiply(S, D, SD, 1);
+    dynamics::Multiply(SD, inverse, A, 1);
+    worst = std::max(worst, SpectrumError(A, known));
+  }
+  for (std::size_t n = 2; n <= 12; ++n) {
+    dynamics::DenseMatrix<double> P(n, n);
+    std::vector<Complex> known;
+    for (std::size_t i = 0; i < n; ++i) {
+      P((i + 1) % n, i) = 1.0;
+      known.push_back(std::polar(1.0, 2*M_PI*double(i)/double(n)));
+    }
+    worst = std::max(worst, SpectrumError(P, known));
+  }
+  dynamics::DenseMatrix<double> J(6, 6), Z(5, 5);
+  for (std::size_t i = 0; i < 6; ++i) {
+    J(i, i) = 2.0;
+    if (i + 1 < 6)
+      J(i, i + 1) = 1.0;
+  }
+  worst = std::max(worst, SpectrumError(J, std::vector<Complex>(6, 2.0)));
+  worst = std::max(worst, SpectrumError(Z, std::vector<Complex>(5, 0.0)));
+  // Companion matrix of (x - 1)(x - 2)...(x - 8); its roots are
+  // ill-conditioned, so the tolerance is looser.
+  std::vector<double> c(9, 0.0);
+  std::vector<Complex> roots;
+  c[0] = 1.0;
+  for (int r = 1; r <= 8; ++r) {
+    for (int i = r; i >= 1; --i)
+      c[i] -= r*c[i - 1];
+    roots.push_back(double(r));
+  }
+  dynamics::DenseMatrix<double> C(8, 8);
+  for (std::size_t j = 0; j < 8; ++j)
+    C(0, j) = -c[j + 1];
+  for (std::size_t i = 1; i < 8; ++i)
+    C(i, i - 1) = 1.0;
+  worst = std::max(worst, 1e-4*SpectrumError(C, roots));
+  return worst;
+}
+
+int main(void)
+{
+  // Eigenpairs of a random nonsymmetric matrix.
+  std::mt19937 rng(1);
+  std::normal_distribution<double> normal;
+  dynamics::DenseMatrix<double> M(12, 12);
+  for (std::size_t j = 0; j < 12; ++j)
+    for (std::size_t i = 0; i < 12; ++i)
+      M(i, j) = normal(rng);
+  std::vector<Complex> values;
+  dynamics::DenseMatrix<Complex> vectors;
+  dynamics::NonsymmetricEigen(M, values, vectors);
+  double residual = 0.0;
+  for (std::size_t k = 0; k < 12; ++k)
+    for (std::size_t i = 0; i < 12; ++i) {
+      Complex s = 0.0;
+      for (std::size_t j = 0; j < 12; ++j)
+        s += M(i, j)*vectors(j, k);
+      residual = std::max(residual, std::abs(s - values[k]*vectors(i, k)));
+    }
+  std::cout << "nonsymmetric eigenpairs: largest residual " << residual
+            << std::endl;
+  if (residual > 1e-12) {
+    std::cerr << "inaccurate eigenpairs" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double spectra = EigenvalueRegressions();
+  std::cout << "known spectra: largest eigenvalue error " << spectra
+            << std::endl;
+  if (spectra > 1e-12) {
+    std::cerr << "inaccurate eigenvalues" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Streaming DMD of a long run observed every other step; the bases are
+  // limited to rank 8, more than the 6 active directions.
+  const int n = 500;
+  const double h = 0.02;
+  const std::size_t steps = 2000;
+  const double decay[] = {0.01, 0.05, 0.2}, frequency[] = {1.0, 2.5, 0.4};
+  Embedded model(n, std::vector<double>(decay, decay + 3),
+                 std::vector<double>(frequency, frequency + 3));
+  std::vector<double> x(n);
+  for (int i = 0; i < n; ++i)
+    for (std::size_t j = 0; j < 6; ++j)
+      x[i] += model.Basis()(i, j);
+  dynamics::AutonomousEndogenousSystem<double, dynamics::Dynamic> f =
+    dynamics::MakeSystem(model);
+  dynamics::RungeKutta4<std::vector<double> > stepper;
+  dynamics::StreamingDMD<double> dmd(8, 2);
+  dynamics::Integrate(stepper, f, 0.0, h, steps, x, dmd);
+
+  dynamics::DenseMatrix<Complex> modes;
+  dmd.Compute(values, modes);
+  double error = 0.0, outside = 0.0;
+  for (int k = 0; k < 3; ++k)
+    for (int sign = -1; sign <= 1; sign += 2) {
+      // Two steps per sample.
+      const Complex exact = std::pow(
+          RungeKutta4Factor(h*Complex(-decay[k], sign*frequency[k])), 2);
+      std::size_t best = 0;
+      for (std::size_t j = 1; j < values.size(); ++j)
+        if (std::abs(values[j] - exact) < std::abs(values[best] - exact))
+          best = j;
+      error = std::max(error, std::abs(values[best] - exact));
+      // Modes lie in the span of the embedding.
+      const Complex * mode = modes.Column(best);
+      std::vector<Complex> c(6);
+      for (std::size_t j = 0; j < 6; ++j)
+        for (int i = 0; i < n; ++i)
+          c[j] += model.Basis()(i, j)*mode[i];
+      for (int i = 0; i < n; ++i) {
+        Complex r = mode[i];
+        for (std::size_t j = 0; j < 6; ++j)
+          r -= model.Basis()(i, j)*c[j];
+        outside = std::max(outside, std::abs(r));
+      }
+    }
+  std::cout << dmd.Pairs() << " pairs, rank " << dmd.Rank()
+            << ", largest eigenvalue error " << error
+            << ", largest mode component outside the embedding " << outside
+            << std::endl;
+  if (dmd.Rank() > 8 || error > 1e-8 || outside > 1e-8) {
+    std::cerr << "streaming DMD misses the oscillators" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // With a rank below the number of active directions, the bases are
+  // truncated to the dominant directions at every sample and the two
+  // slowest oscillators are still found.
+  for (int i = 0; i < n; ++i) {
+    x[i] = 0.0;
+    for (std::size_t j = 0; j < 6; ++j)
+      x[i] += model.Basis()(i, j)*(j < 4 ? 1.0 : 1e-3);
+  }
+  dynamics::StreamingDMD<double> truncated(4, 2);
+  dynamics::Integrate(stepper, f, 0.0, h, steps, x, truncated);
+  truncated.Eigenvalues(values);
+  double slow = 0.0;
+  for (int k = 0; k < 2; ++k) {
+    const Complex exact = std::pow(
+        RungeKutta4Factor(h*Complex(-decay[k], frequency[k])), 2);
+    double best = 1e300;
+    for (std::size_t j = 0; j < values.size(); ++j)
+      best = std::min(best, std::abs(values[j] - exact));
+    slow = std::max(slow, best);
+  }
+  std::cout << "rank 4: largest error of the two slowest eigenvalues "
+            << slow << std::endl;
+  if (truncated.Rank() != 4 || slow > 1e-3) {
+    std::cerr << "truncated streaming DMD misses the slow oscillators"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The dominant directions change after the rank is reached: a weak
+  // rotation in span{e1, e2} is followed by a strong decaying one in
+  // span{e3, e4}.  The bases have to follow the new directions.
+  dynamics::StreamingDMD<double> moving(2);
+  const Complex weak = std::polar(1.0, 0.3), strong = std::polar(0.99, 0.5);
+  Complex z(0.01);
+  for (int k = 0; k < 20; ++k) {
+    const double a[4] = {z.real(), z.imag(), 0.0, 0.0};
+    z *= weak;
+    const double b[4] = {z.real(), z.imag(), 0.0, 0.0};
+    moving.Update(a, b, 4);
+  }
+  z = Complex(1.0);
+  for (int k = 0; k < 200; ++k) {
+    const double a[4] = {0.0, 0.0, z.real(), z.imag()};
+    z *= strong;
+    const double b[4] = {0.0, 0.0, z.real(), z.imag()};
+    moving.Update(a, b, 4);
+  }
+  moving.Compute(values, modes);
+  double followed = 0.0, old = 0.0;
+  for (std::size_t j = 0; j < values.size(); ++j) {
+    followed = std::max(followed, std::min(
+        std::abs(values[j] - strong), std::abs(values[j] - std::conj(strong))));
+    old = std::max(old, std::abs(modes(0, j)) + std::abs(modes(1, j)));
+  }
+  std::cout << "moving subspace: largest eigenvalue error " << followed
+            << ", largest mode component in span{e1, e2} " << old
+            << std::endl;
+  if (values.size() != 2 || followed > 1e-6 || old > 1e-6) {
+    std::cerr << "streaming DMD does not follow the dominant subspace"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
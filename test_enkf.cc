@@ -0,0 +1,224 @@
+/*! \example test_enkf.cc
+ * This is an example of how to estimate the state of a large mapping with
+ * the localized ensemble transform Kalman filter.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "dense.h"
+#include "enkf.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "random.h"
+
+// Lorenz (1996) model on a ring of n sites, chaotic for F = 8.
+class Lorenz96
+  : public dynamics::MappingAutonomousEndogenous<double, dynamics::Dynamic> {
+  public:
+    Lorenz96(int n) : _n(n) {}
+    virtual int Dimension() const { return _n; }
+    virtual void ComputeRHS(const std::vector<double> & x,
+                            std::vector<double> & rhs)
+    {
+      for (int i = 0; i < _n; ++i)
+        rhs[i] = (x[(i + 1) % _n] - x[(i + _n - 2) % _n])*x[(i + _n - 1) % _n]
+          - x[i] + 8.0;
+    }
+
+  private:
+    int _n;
+};
+
+typedef dynamics::AutonomousEndogenousSystem<double, dynamics::Dynamic>
+  System;
+typedef dynamics::EnsembleKalmanFilter<double, System> Filter;
+
+// Observes every other site.
+struct EverySecond {
+  void operator()(const std::vector<double> & x,
+                  std::vector<double> & y) const
+  {
+    y.resize(x.size()/2);
+    for (std::size_t l = 0; l < y.size(); ++l)
+      y[l] = x[2*l];
+  }
+};
+
+// Sample mean and covariance of the members.
+static void Moments(const Filter & filter, std::vector<double> & mean,
+                    dynamics::DenseMatrix<double> & covariance)
+{
+  const std::size_t n = filter.Dimension(), m = filter.Members();
+  mean.assign(n, 0.0);
+  for (std::size_t k = 0; k < m; ++k)
+    for (std::size_t i = 0; i < n; ++i)
+      mean[i] += filter.Member(k)[i]/m;
+  covariance.Resize(n, n);
+  for (std::size_t k = 0; k < m; ++k)
+    for (std::size_t j = 0; j < n; ++j)
+      for (std::size_t i = 0; i < n; ++i)
+        covariance(i, j) += (filter.Member(k)[i] - mean[i])
+          *(filter.Member(k)[j] - mean[j])/(m - 1);
+}
+
+// Assimilates every other site of a Lorenz 96 truth run with the LETKF
+// and returns the RMS error of the analysis means after spin-up.
+static double Assimilate(int n, std::size_t members, unsigned threads,
+                         std::vector<double> & final_mean, double & seconds)
+{
+  const double dt = 0.05, r = 1.0;
+  const int cycles = 200, spinup = 50;
+  Lorenz96 model(n);
+  System f = dynamics::MakeSystem(model);
+  dynamics::RungeKutta4<std::vector<double> > rk4;
+  dynamics::SplitMix64 rng(5);
+  std::normal_distribution<double> normal;
+  std::vector<double> truth(n, 8.0);
+  truth[0] += 0.01;
+  for (int k = 0; k < 1000; ++k)
+    rk4.Step(f, 0.0, dt, truth);
+
+  dynamics::EnsembleKalmanOptions options;
+  options.inflation = 1.05;
+  options.threads = threads;
+  options.block = 8;
+  Filter filter(f, n, members, options);
+  filter.Initialize([&](dynamics::SplitMix64 & g, std::vector<double> & x) {
+    std::normal_distribution<double> spread(0.0, 3.0);
+    for (int i = 0; i < n; ++i)
+      x[i] = truth[i] + spread(g);
+  });
+  EverySecond h;
+  auto localization = [&](std::size_t i, std::vector<std::size_t> & obs,
+                          std::vector<double> & weights) {
+    for (int l = 0; l < n/2; ++l) {
+      int d = std::abs(int(i) - 2*l);
+      double w = dynamics::GaspariCohn(double(std::min(d, n - d)), 4.0);
+      if (w > 0) {
+        obs.push_back(l);
+        weights.push_back(w);
+      }
+    }
+  };
+  std::vector<double> z, variances(n/2, r);
+  double error = 0.0;
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  for (int k = 0; k < cycles; ++k) {
+    rk4.Step(f, k*dt, dt, truth);
+    h(truth, z);
+    for (std::size_t l = 0; l < z.size(); ++l)
+      z[l] += std::sqrt(r)*normal(rng);
+    filter.Predict(k*dt, dt);
+    filter.Update(h, z, variances, localization);
+    if (k >= spinup) {
+      const std::vector<double> & mean = filter.Mean();
+      for (int i = 0; i < n; ++i)
+        error += (mean[i] - truth[i])*(mean[i] - truth[i]);
+    }
+  }
+  seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  final_mean = filter.Mean();
+  return std::sqrt(error/((cycles - spinup)*n));
+}
+
+int main(void)
+{
+  // On a linear observation operator the analysis moments of the ensemble
+  // are the Kalman filter update of its forecast moments.
+  const std::size_t n = 6, m = 10;
+  Lorenz96 small(n);
+  System g = dynamics::MakeSystem(small);
+  Filter filter(g, n, m);
+  filter.Initialize([](dynamics::SplitMix64 & rng, std::vector<double> & x) {
+    std::normal_distribution<double> normal;
+    for (std::size_t i = 0; i < x.size(); ++i)
+      x[i] = normal(rng) + 0.1*i;
+  });
+  std::vector<double> mean, z(3), r(3, 0.5);
+  dynamics::DenseMatrix<double> P;
+  Moments(filter, mean, P);
+  for (std::size_t l = 0; l < 3; ++l)
+    z[l] = 1.0 - 0.5*l;
+  // Innovation covariance S = H P H^T + R and gain K = P H^T S^-1.
+  dynamics::DenseMatrix<double> S(3, 3), K(n, 3);
+  for (std::size_t a = 0; a < 3; ++a)
+    for (std::size_t b = 0; b < 3; ++b)
+      S(a, b) = P(2*a, 2*b) + (a == b ? r[a] : 0.0);
+  std::vector<std::size_t> pivots;
+  dynamics::LUFactor(S, pivots);
+  for (std::size_t i = 0; i < n; ++i) {
+    double row[3] = {P(i, 0), P(i, 2), P(i, 4)};
+    dynamics::LUSolve(S, pivots, row);
+    for (std::size_t a = 0; a < 3; ++a)
+      K(i, a) = row[a];
+  }
+  std::vector<double> expected_mean(mean);
+  dynamics::DenseMatrix<double> expected(P);
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t a = 0; a < 3; ++a) {
+      expected_mean[i] += K(i, a)*(z[a] - mean[2*a]);
+      for (std::size_t j = 0; j < n; ++j)
+        expected(i, j) -= K(i, a)*P(2*a, j);
+    }
+  }
+  EverySecond h;
+  filter.Update(h, z, r);
+  Moments(filter, mean, P);
+  double difference = 0.0;
+  for (std::size_t i = 0; i < n; ++i) {
+    difference = std::max(difference, std::fabs(mean[i] - expected_mean[i]));
+    for (std::size_t j = 0; j < n; ++j)
+      difference = std::max(difference, std::fabs(P(i, j) - expected(i, j)));
+  }
+  std::cout << "ETKF analysis differs from the Kalman update by "
+            << difference << std::endl;
+  if (difference > 1e-10) {
+    std::cerr << "ETKF analysis is not a Kalman update" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Localization lets 10 members track a 40 site chaotic model observed at
+  // every other site with unit noise.
+  std::vector<double> serial, threaded;
+  double seconds[2];
+  double error = Assimilate(40, 10, 1, serial, seconds[0]);
+  Assimilate(40, 10, 4, threaded, seconds[1]);
+  double mismatch = 0.0;
+  for (std::size_t i = 0; i < serial.size(); ++i)
+    mismatch = std::max(mismatch, std::fabs(serial[i] - threaded[i]));
+  std::cout << "LETKF on Lorenz 96: RMS error " << error << ", "
+            << 200/seconds[0] << " cycles/s (1 thread), " << 200/seconds[1]
+            << " (4 threads), difference between thread counts "
+            << mismatch << std::endl;
+  if (error > 0.5) {
+    std::cerr << "LETKF does not track Lorenz 96" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (mismatch != 0.0) {
+    std::cerr << "results depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Empty blocks are rejected instead of dividing by zero.
+  dynamics::EnsembleKalmanOptions empty;
+  empty.block = 0;
+  bool rejected = false;
+  try {
+    Filter unblocked(g, n, m, empty);
+  } catch (const std::invalid_argument &) {
+    rejected = true;
+  }
+  if (!rejected) {
+    std::cerr << "ensemble Kalman filter accepted an empty block"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/*! \example test_equilibrium.cc
+ * This is an example of how to find the equilibria of a flow and the fixed
+ * points of a map, with Jacobians from automatic differentiation.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "autodiff.h"
+#include "equilibrium.h"
+#include "mappings.h"
+
+// Written over the scalar type so that it can be instantiated with Dual.
+template <class S>
+class Pendulum : public dynamics::MappingAutonomousEndogenous<S, 2> {
+  public:
+    Pendulum(double l, double g = 9.81) : _l(l), _g(g) {}
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            std::array<S, 2> & rhs)
+    {
+      using std::sin;
+      rhs[0] = x[1];
+      rhs[1] = -_g/_l*sin(x[0]) - 0.5*x[1];
+    }
+
+  private:
+    double _l, _g;
+};
+
+template <class S>
+class Henon : public dynamics::MappingAutonomousEndogenous<S, 2> {
+  public:
+    Henon(double a = 1.4, double b = 0.3) : _a(a), _b(b) {}
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            std::array<S, 2> & rhs)
+    {
+      rhs[0] = 1 - _a*x[0]*x[0] + x[1];
+      rhs[1] = _b*x[0];
+    }
+
+  private:
+    double _a, _b;
+};
+
+// Coupled linear relaxation x' = x_{k+1} - 2 x_k + 1 (cyclic), whose
+// only equilibrium is x = 1; large enough N exceeds the Sobol' table.
+template <int N>
+class Chain : public dynamics::MappingAutonomousEndogenous<double, N> {
+  public:
+    virtual void ComputeRHS(const std::array<double, N> & x,
+                            std::array<double, N> & rhs)
+    {
+      for (int k = 0; k < N; ++k)
+        rhs[k] = x[(k + 1) % N] - 2.0*x[k] + 1.0;
+    }
+};
+
+// Multistart from starts drawn for the dimension of the chain.
+template <int N>
+bool ChainEquilibrium()
+{
+  Chain<N> chain;
+  std::array<double, N> lower, upper;
+  lower.fill(-2.0);
+  upper.fill(2.0);
+  std::vector<dynamics::EquilibriumResult<double, N> > roots =
+    dynamics::FindEquilibria(chain, lower, upper, 4);
+  std::cout << N << " dimensional chain: " << roots.size()
+            << " equilibria" << std::endl;
+  if (roots.size() != 1)
+    return false;
+  for (int k = 0; k < N; ++k)
+    if (std::fabs(roots[0].x[k] - 1.0) > 1e-9)
+      return false;
+  return true;
+}
+
+int main(void)
+{
+  typedef dynamics::Dual<double, 2> D;
+
+  // Derivatives of a composite expression.
+  D u(0.7, 0), v(-1.3, 1);
+  D w = exp(u*v)/(1 + v*v) - sqrt(u)*atan(v) + pow(u, 3.0);
+  double dwdu = v.Value()*std::exp(u.Value()*v.Value())
+                /(1 + v.Value()*v.Value())
+    - 0.5/std::sqrt(u.Value())*std::atan(v.Value())
+    + 3*u.Value()*u.Value();
+  if (std::fabs(w.Derivative(0) - dwdu) > 1e-12) {
+    std::cerr << "wrong derivative " << w.Derivative(0) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Fixed points of the Henon map, with exact and approximate Jacobians.
+  Henon<double> henon;
+  Henon<D> dhenon;
+  dynamics::EquilibriumOptions options;
+  options.kind = dynamics::MapFixedPoint;
+  std::array<double, 2> guess = {{5.0, -3.0}};
+  dynamics::EquilibriumResult<double, 2> exact =
+    dynamics::FindEquilibrium(henon, dhenon, guess, options);
+  dynamics::EquilibriumResult<double, 2> approximate =
+    dynamics::FindEquilibrium(henon, guess, options);
+  options.broyden = false;
+  dynamics::EquilibriumResult<double, 2> newton =
+    dynamics::FindEquilibrium(henon, dhenon, guess, options);
+  options.broyden = true;
+  const double a = 1.4, b = 0.3;
+  const double xp = (-(1 - b) + std::sqrt((1 - b)*(1 - b) + 4*a))/(2*a);
+  std::cout << "Henon fixed point (" << exact.x[0] << ", " << exact.x[1]
+            << ") after " << exact.iterations << " iterations, "
+            << exact.jacobian_evaluations << " Jacobians (Newton: "
+            << newton.jacobian_evaluations << ")" << std::endl;
+  if (!exact.converged || !approximate.converged || !newton.converged
+      || std::fabs(exact.x[0] - xp) > 1e-9
+      || std::fabs(exact.x[1] - b*xp) > 1e-9
+      || std::fabs(approximate.x[0] - xp) > 1e-8
+      || exact.jacobian_evaluations >= newton.jacobian_evaluations) {
+    std::cerr << "Henon fixed point not found" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Multistart finds both fixed points of the map and all three
+  // equilibria of the damped pendulum in the box (Newton may also reach
+  // some outside), independent of the number of threads.
+  std::array<double, 2> lower = {{-3.0, -3.0}}, upper = {{3.0, 3.0}};
+  std::vector<dynamics::EquilibriumResult<double, 2> > fixed =
+    dynamics::FindEquilibria(henon, dhenon, lower, upper, 64, options);
+  std::cout << fixed.size() << " Henon fixed points" << std::endl;
+  if (fixed.size() != 2) {
+    std::cerr << "wrong number of fixed points" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Pendulum<double> pendulum(1.0);
+  Pendulum<D> dpendulum(1.0);
+  options.kind = dynamics::FlowEquilibrium;
+  lower[0] = -4.0;
+  upper[0] = 4.0;
+  std::vector<std::vector<dynamics::EquilibriumResult<double, 2> > > runs;
+  for (unsigned threads = 1; threads <= 4; threads += 3) {
+    options.threads = threads;
+    runs.push_back(dynamics::FindEquilibria(pendulum, dpendulum, lower,
+                                            upper, 64, options));
+  }
+  std::cout << runs[1].size() << " pendulum equilibria, angles";
+  for (std::size_t i = 0; i < runs[1].size(); ++i)
+    std::cout << " " << runs[1][i].x[0];
+  std::cout << std::endl;
+  if (runs[0].size() != runs[1].size()) {
+    std::cerr << "multistart depends on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+  int at_zero = 0, at_pi = 0;
+  for (std::size_t i = 0; i < runs[1].size(); ++i) {
+    double angle = runs[1][i].x[0];
+    if (std::fabs(runs[1][i].x[1]) > 1e-9
+        || std::fabs(angle/M_PI - std::floor(angle/M_PI + 0.5)) > 1e-9) {
+      std::cerr << "not an equilibrium" << std::endl;
+      return EXIT_FAILURE;
+    }
+    at_zero += std::fabs(angle) < 1e-9;
+    at_pi += std::fabs(std::fabs(angle) - M_PI) < 1e-9;
+    for (std::size_t j = 0; j < i; ++j)
+      if (std::fabs(runs[1][j].x[0] - angle) < 1e-6) {
+        std::cerr << "duplicate equilibrium" << std::endl;
+        return EXIT_FAILURE;
+      }
+  }
+  if (at_zero != 1 || at_pi != 2) {
+    std::cerr << "equilibria missing" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Beyond the Sobol' table the starts fall back to Halton points, and
+  // beyond the Halton primes to independent uniform points.
+  if (!ChainEquilibrium<25>() || !ChainEquilibrium<40>()) {
+    std::cerr << "multistart failed in high dimension" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/*! \example test_estimation.cc
+ * This is an example of how to fit the parameters of a mapping to a
+ * measured trajectory by multiple shooting least squares.
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "autodiff.h"
+#include "estimation.h"
+#include "integrators.h"
+#include "mappings.h"
+
+// Lotka-Volterra predator-prey model, x' = a x - b x y, y' = c x y - d y,
+// with parameters (a, b, c, d).
+template <class S>
+class LotkaVolterra : public dynamics::MappingAutonomousExogenous<S, 2, 4> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            const std::array<S, 4> & p,
+                            std::array<S, 2> & rhs)
+    {
+      rhs[0] = p[0]*x[0] - p[1]*x[0]*x[1];
+      rhs[1] = p[2]*x[0]*x[1] - p[3]*x[1];
+    }
+};
+
+// x' = p x^2, which blows up in finite time for positive p and x.
+template <class S>
+class Blowup : public dynamics::MappingAutonomousExogenous<S, 1, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 1> & x,
+                            const std::array<S, 1> & p,
+                            std::array<S, 1> & rhs)
+    {
+      rhs[0] = p[0]*x[0]*x[0];
+    }
+};
+
+typedef dynamics::EstimationResult<double, 2, 4> Result;
+
+int main(void)
+{
+  // Noisy measurements of about three periods of the oscillation.
+  const std::array<double, 4> truth = {{1.0, 0.5, 0.5, 1.0}};
+  const std::size_t samples = 151;
+  const double dt = 0.1, sigma = 0.02;
+  LotkaVolterra<double> model;
+  LotkaVolterra<dynamics::Dual<double, 6> > dual;
+  dynamics::AutonomousExogenousSystem<double, 2, 4> system(model, truth);
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  std::mt19937 rng(3);
+  std::normal_distribution<double> noise(0.0, sigma);
+  std::vector<double> times(samples);
+  std::vector<std::array<double, 2> > data(samples);
+  std::array<double, 2> x = {{1.0, 3.0}};
+  for (std::size_t j = 0; j < samples; ++j) {
+    times[j] = j*dt;
+    data[j][0] = x[0] + noise(rng);
+    data[j][1] = x[1] + noise(rng);
+    for (int k = 0; k < 10; ++k)
+      rk4.Step(system, times[j] + k*dt/10, dt/10, x);
+  }
+  const std::array<double, 2> deviation = {{sigma, sigma}};
+  const std::array<double, 4> guess = {{1.8, 0.3, 0.9, 0.5}};
+
+  // Single shooting from the poor guess fits a trajectory that has
+  // drifted out of phase with the data.
+  dynamics::EstimationOptions options;
+  options.segments = 1;
+  Result single = dynamics::EstimateParameters(model, dual, times, data,
+                                               deviation, guess, options);
+
+  // Multiple shooting keeps every segment close to the data.
+  options.segments = 15;
+  double seconds[2];
+  Result multiple[2];
+  const unsigned threads[2] = {1, 4};
+  for (int i = 0; i < 2; ++i) {
+    options.threads = threads[i];
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    multiple[i] = dynamics::EstimateParameters(model, dual, times, data,
+                                               deviation, guess, options);
+    seconds[i] = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  double error[2] = {0.0, 0.0};
+  for (int k = 0; k < 4; ++k) {
+    error[0] = std::max(error[0], std::fabs(single.parameters[k]
+                                            - truth[k]));
+    error[1] = std::max(error[1], std::fabs(multiple[0].parameters[k]
+                                            - truth[k]));
+  }
+  std::cout << "single shooting: " << single.iterations << " iterations, "
+            << "cost " << single.cost << ", largest parameter error "
+            << error[0] << std::endl;
+  std::cout << "multiple shooting: " << multiple[0].iterations
+            << " iterations, cost " << multiple[0].cost << ", defect "
+            << multiple[0].defect << ", largest parameter error "
+            << error[1] << ", " << seconds[0] << " s (1 thread), "
+            << seconds[1] << " s (4 threads)" << std::endl;
+
+  // With 302 measurements of unit weighted variance the cost at the truth
+  // is about 151.
+  if (!multiple[0].converged || error[1] > 0.02
+      || multiple[0].cost > 200.0 || multiple[0].defect > 1e-4) {
+    std::cerr << "multiple shooting does not recover the parameters"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (single.cost < 10*multiple[0].cost) {
+    std::cerr << "single shooting unexpectedly fits from the poor guess"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (multiple[0].parameters != multiple[1].parameters
+      || multiple[0].iterations != multiple[1].iterations) {
+    std::cerr << "results depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Exact samples of x = 1 / (1 + t / 2), i.e. p = -1/2, fitted from
+  // p = 5, whose single shooting trajectory diverges at t = 0.2.  The fit
+  // has to stop and report failure; short segments do not diverge.
+  Blowup<double> blowup;
+  Blowup<dynamics::Dual<double, 2> > dual_blowup;
+  std::vector<double> blowup_times;
+  std::vector<std::array<double, 1> > blowup_data;
+  for (int j = 0; j <= 20; ++j) {
+    blowup_times.push_back(0.2*j);
+    const std::array<double, 1> y = {{1.0/(1.0 + 0.1*j)}};
+    blowup_data.push_back(y);
+  }
+  const std::array<double, 1> blowup_sigma = {{0.01}}, diverging = {{5.0}};
+  dynamics::EstimationOptions blowup_options;
+  blowup_options.segments = 1;
+  dynamics::EstimationResult<double, 1, 1> diverged =
+    dynamics::EstimateParameters(blowup, dual_blowup, blowup_times,
+                                 blowup_data, blowup_sigma, diverging,
+                                 blowup_options);
+  blowup_options.segments = 20;
+  dynamics::EstimationResult<double, 1, 1> recovered =
+    dynamics::EstimateParameters(blowup, dual_blowup, blowup_times,
+                                 blowup_data, blowup_sigma, diverging,
+                                 blowup_options);
+  std::cout << "diverging guess: single shooting stops after "
+            << diverged.iterations << " iterations, multiple shooting "
+            << "finds p = " << recovered.parameters[0] << std::endl;
+  if (diverged.converged
+      || diverged.iterations > blowup_options.max_iterations
+      || !recovered.converged
+      || std::fabs(recovered.parameters[0] + 0.5) > 1e-6) {
+    std::cerr << "diverging guess not handled" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
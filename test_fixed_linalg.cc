@@ -0,0 +1,91 @@
+/*! \example test_fixed_linalg.cc
+ * This is an example of how to factor and solve small systems whose size is
+ * the state dimension of a mapping.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "fixed_linalg.h"
+#include "random.h"
+
+template <int N>
+double CheckSquare(dynamics::SplitMix64 & rng)
+{
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  dynamics::Matrix<double, N> A, B, S;
+  std::array<double, N> x, b, y;
+  for (int i = 0; i < N; ++i) {
+    x[i] = uniform(rng);
+    for (int j = 0; j < N; ++j)
+      A(i, j) = B(i, j) = uniform(rng);
+  }
+  // S = B B^T + I is symmetric positive definite.
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j) {
+      S(i, j) = i == j ? 1.0 : 0.0;
+      for (int k = 0; k < N; ++k)
+        S(i, j) += B(i, k)*B(j, k);
+    }
+
+  double worst = 0.0;
+  dynamics::MatVec(A, x, b);
+  std::array<int, N> pivots;
+  if (!dynamics::LUFactor(A, pivots))
+    return 1.0;
+  dynamics::LUSolve(A, pivots, b);
+  for (int i = 0; i < N; ++i)
+    worst = std::max(worst, std::fabs(b[i] - x[i]));
+
+  dynamics::MatVec(S, x, y);
+  if (!dynamics::CholeskyFactor(S))
+    return 1.0;
+  dynamics::CholeskySolve(S, y);
+  for (int i = 0; i < N; ++i)
+    worst = std::max(worst, std::fabs(y[i] - x[i]));
+  return worst;
+}
+
+int main(void)
+{
+  dynamics::SplitMix64 rng(5);
+  double worst = 0.0;
+  for (int trial = 0; trial < 20; ++trial) {
+    worst = std::max(worst, CheckSquare<1>(rng));
+    worst = std::max(worst, CheckSquare<2>(rng));
+    worst = std::max(worst, CheckSquare<3>(rng));
+    worst = std::max(worst, CheckSquare<6>(rng));
+    worst = std::max(worst, CheckSquare<13>(rng));
+    worst = std::max(worst, CheckSquare<32>(rng));
+  }
+  std::cout << "LU and Cholesky solve error " << worst << std::endl;
+  if (worst > 1e-8) {
+    std::cerr << "square solves inaccurate" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Least squares fit of a quadratic to 7 exact samples.
+  dynamics::Matrix<double, 7, 3> V;
+  std::array<double, 7> z;
+  for (int i = 0; i < 7; ++i) {
+    double t = 0.5*i - 1.0;
+    V(i, 0) = 1.0;
+    V(i, 1) = t;
+    V(i, 2) = t*t;
+    z[i] = 2.0 - 3.0*t + 0.5*t*t;
+  }
+  std::array<double, 3> tau;
+  dynamics::QRFactor(V, tau);
+  dynamics::QRSolve(V, tau, z);
+  std::cout << "QR least squares " << z[0] << " " << z[1] << " " << z[2]
+            << std::endl;
+  if (std::fabs(z[0] - 2.0) > 1e-12 || std::fabs(z[1] + 3.0) > 1e-12
+      || std::fabs(z[2] - 0.5) > 1e-12 || std::fabs(z[5]) > 1e-12) {
+    std::cerr << "QR solve inaccurate" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
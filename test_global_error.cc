@@ -0,0 +1,113 @@
+/*! \example test_global_error.cc
+ * This is an example of how to estimate the global error of an adaptive
+ * integration and pick the loosest tolerance that meets an error target.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "global_error.h"
+#include "integrators.h"
+#include "mappings.h"
+
+// Harmonic oscillator with a slowly decaying amplitude; the exact solution
+// is known, so estimated errors can be compared with true ones.
+class Oscillator : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -x[0] - 0.1*x[1];
+    }
+};
+
+// Solution from x(0) = (1, 0).
+static std::array<double, 2> Exact(double t)
+{
+  const double w = std::sqrt(1.0 - 0.0025), d = std::exp(-0.05*t);
+  std::array<double, 2> x = {{
+    d*(std::cos(w*t) + 0.05/w*std::sin(w*t)),
+    -d*(1.0/w)*std::sin(w*t)
+  }};
+  return x;
+}
+
+static double Error(const std::array<double, 2> & x, double t)
+{
+  std::array<double, 2> e = Exact(t);
+  return std::max(std::fabs(x[0] - e[0]), std::fabs(x[1] - e[1]));
+}
+
+int main(void)
+{
+  Oscillator oscillator;
+  dynamics::AutonomousEndogenousSystem<double, 2> f =
+    dynamics::MakeSystem(oscillator);
+  dynamics::DormandPrince54<std::array<double, 2> > stepper;
+  const double t1 = 30.0;
+  const std::array<double, 2> x0 = {{1.0, 0.0}};
+
+  // Adaptive steps meet tighter tolerances with more work.
+  std::size_t previous = 0;
+  for (int k = 4; k <= 10; k += 3) {
+    dynamics::AdaptiveOptions options;
+    options.rtol = std::pow(10.0, -k);
+    options.atol = options.rtol;
+    std::array<double, 2> x = x0;
+    dynamics::AdaptiveReport report =
+      dynamics::IntegrateAdaptive(stepper, f, 0.0, t1, x, options);
+    std::cout << "rtol " << options.rtol << ": " << report.accepted
+              << " steps, " << report.rejected << " rejected, "
+              << report.rhs_evaluations << " RHS evaluations, error "
+              << Error(x, t1) << std::endl;
+    if (!report.success || report.accepted <= previous
+        || Error(x, t1) > 1e3*options.rtol) {
+      std::cerr << "adaptive integration failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    previous = report.accepted;
+  }
+
+  // Estimated global errors are within a small factor of the true ones,
+  // with the exponent assumed and measured.
+  for (int measure = 0; measure < 2; ++measure) {
+    dynamics::GlobalErrorOptions options;
+    options.integration.rtol = 1e-5;
+    options.integration.atol = 1e-5;
+    if (measure)
+      options.exponent = 0.0;
+    std::array<double, 2> x = x0, coarse = x0;
+    dynamics::GlobalErrorReport<double> report =
+      dynamics::EstimateGlobalError(stepper, f, 0.0, t1, x, options);
+    dynamics::IntegrateAdaptive(stepper, f, 0.0, t1, coarse,
+                                options.integration);
+    double actual = Error(coarse, t1);
+    std::cout << "rtol 1e-5: estimated error " << report.error
+              << ", actual " << actual << " (" << report.work.accepted
+              << " steps), exponent " << report.exponent << std::endl;
+    if (report.error > 3.0*actual || report.error < actual/3.0
+        || report.reference_error > report.error) {
+      std::cerr << "global error estimate off" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // The predicted tolerance meets the target.
+    const double target = 1e-7;
+    dynamics::AdaptiveOptions chosen = options.integration;
+    chosen.rtol = chosen.atol = dynamics::ToleranceForError(report, target);
+    std::array<double, 2> y = x0;
+    dynamics::AdaptiveReport work =
+      dynamics::IntegrateAdaptive(stepper, f, 0.0, t1, y, chosen);
+    std::cout << "target " << target << ": rtol " << chosen.rtol << ", "
+              << work.accepted << " steps, error " << Error(y, t1)
+              << std::endl;
+    if (Error(y, t1) > 3.0*target || Error(y, t1) < target/30.0) {
+      std::cerr << "tolerance prediction off" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
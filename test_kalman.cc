@@ -0,0 +1,167 @@
+/*! \example test_kalman.cc
+ * This is an example of how to estimate the state of a mapping from noisy
+ * measurements with the extended and the unscented Kalman filter.
+ */
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "kalman.h"
+#include "mappings.h"
+#include "random.h"
+
+// Damped pendulum driven by a torque input.
+class Pendulum : public dynamics::MappingAutonomousExogenous<double, 2, 1> {
+  public:
+    Pendulum(bool linear = false) : _linear(linear) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            const std::array<double, 1> & u,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -(_linear ? x[0] : std::sin(x[0])) - 0.1*x[1] + u[0];
+    }
+
+  private:
+    bool _linear;
+};
+
+// Position of the bob of a unit pendulum.
+struct Bob {
+  void operator()(const std::array<double, 2> & x,
+                  std::array<double, 2> & y) const
+  {
+    y[0] = std::sin(x[0]);
+    y[1] = -std::cos(x[0]);
+  }
+};
+
+// Angle only.
+struct Angle {
+  void operator()(const std::array<double, 2> & x,
+                  std::array<double, 1> & y) const
+  {
+    y[0] = x[0];
+  }
+};
+
+typedef dynamics::AutonomousExogenousSystem<double, 2, 1> System;
+
+int main(void)
+{
+  const double dt = 0.01;
+  const int cycles = 3000;
+  dynamics::SplitMix64 rng(7);
+  std::normal_distribution<double> normal;
+
+  // Track a swinging pendulum from the measured position of its bob,
+  // starting from a poor initial estimate.
+  Pendulum pendulum;
+  std::array<double, 1> u = {{0.0}};
+  System truth_system(pendulum, u), ekf_system(pendulum, u),
+    ukf_system(pendulum, u);
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  std::array<double, 2> truth = {{2.0, 0.0}}, guess = {{1.0, 1.0}};
+  dynamics::Matrix<double, 2> P0 = dynamics::Matrix<double, 2>::Identity();
+  dynamics::Matrix<double, 2> Q = dynamics::Matrix<double, 2>::Zero();
+  Q(1, 1) = 1e-6;
+  dynamics::Matrix<double, 2> R = dynamics::Matrix<double, 2>::Identity();
+  const double sigma = 0.05;
+  R(0, 0) = R(1, 1) = sigma*sigma;
+  dynamics::KalmanOptions options;
+  options.substeps = 2;
+  dynamics::ExtendedKalmanFilter<double, 2, System> ekf(ekf_system, guess,
+                                                        P0, options);
+  dynamics::UnscentedKalmanFilter<double, 2, System> ukf(ukf_system, guess,
+                                                         P0, options);
+  Bob bob;
+  double ekf_error = 0.0, ukf_error = 0.0, ekf_nis = 0.0, ukf_nis = 0.0;
+  double seconds[2] = {0.0, 0.0};
+  for (int k = 0; k < cycles; ++k) {
+    const double t = k*dt;
+    u[0] = 0.2*std::sin(0.5*t);
+    truth_system.Input() = ekf_system.Input() = ukf_system.Input() = u;
+    rk4.Step(truth_system, t, dt, truth);
+    std::array<double, 2> z;
+    bob(truth, z);
+    z[0] += sigma*normal(rng);
+    z[1] += sigma*normal(rng);
+
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    ekf.Predict(t, dt, Q);
+    double nis = ekf.Update(bob, z, R);
+    std::chrono::steady_clock::time_point middle =
+      std::chrono::steady_clock::now();
+    ukf.Predict(t, dt, Q);
+    double unis = ukf.Update(bob, z, R);
+    std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now();
+    seconds[0] += std::chrono::duration<double>(middle - start).count();
+    seconds[1] += std::chrono::duration<double>(end - middle).count();
+
+    if (k >= cycles/2) {
+      ekf_error += std::pow(ekf.Mean()[0] - truth[0], 2);
+      ukf_error += std::pow(ukf.Mean()[0] - truth[0], 2);
+      ekf_nis += nis;
+      ukf_nis += unis;
+    }
+  }
+  ekf_error = std::sqrt(ekf_error/(cycles/2));
+  ukf_error = std::sqrt(ukf_error/(cycles/2));
+  ekf_nis /= cycles/2;
+  ukf_nis /= cycles/2;
+  std::cout << "EKF: RMS angle error " << ekf_error << ", mean NIS "
+            << ekf_nis << ", " << cycles/seconds[0] << " cycles/s"
+            << std::endl;
+  std::cout << "UKF: RMS angle error " << ukf_error << ", mean NIS "
+            << ukf_nis << ", " << cycles/seconds[1] << " cycles/s"
+            << std::endl;
+  // Measurements of the bob position have a noise of 0.05 per coordinate;
+  // a consistent filter has a mean NIS near P = 2.
+  if (ekf_error > 0.02 || ukf_error > 0.02 || ekf_nis < 1.0 || ekf_nis > 3.0
+      || ukf_nis < 1.0 || ukf_nis > 3.0) {
+    std::cerr << "filters do not track the pendulum" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // On a linear model both filters are exact and agree.
+  Pendulum linear(true);
+  System ekf_linear(linear, u), ukf_linear(linear, u);
+  dynamics::ExtendedKalmanFilter<double, 2, System> lekf(ekf_linear, guess,
+                                                         P0);
+  dynamics::UnscentedKalmanFilter<double, 2, System> lukf(ukf_linear, guess,
+                                                          P0);
+  Angle angle;
+  dynamics::Matrix<double, 1> r;
+  r(0, 0) = 0.01;
+  double difference = 0.0;
+  for (int k = 0; k < 500; ++k) {
+    std::array<double, 1> z = {{std::cos(0.02*k)}};
+    lekf.Predict(k*dt, dt, Q);
+    lukf.Predict(k*dt, dt, Q);
+    lekf.Update(angle, z, r);
+    lukf.Update(angle, z, r);
+    for (int i = 0; i < 2; ++i) {
+      difference = std::max(difference,
+                             std::fabs(lekf.Mean()[i] - lukf.Mean()[i]));
+      for (int j = 0; j < 2; ++j)
+        difference = std::max(difference,
+                              std::fabs(lekf.Covariance()(i, j)
+                                        - lukf.Covariance()(i, j)));
+    }
+  }
+  std::cout << "linear model: EKF and UKF differ by " << difference
+            << std::endl;
+  if (difference > 1e-6) {
+    std::cerr << "EKF and UKF disagree on a linear model" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/*! \example test_metrics.cc
+ * This is an example of how to collect solver health metrics from an
+ * ensemble of integrations and dump them in Prometheus text format.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include "ensemble.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "metrics.h"
+#include "switching.h"
+
+// Damped oscillator.
+class Oscillator : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -x[0] - 0.1*x[1];
+    }
+};
+
+// Van der Pol oscillator; stiff on the slow branches for large mu.
+class VanDerPol : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    VanDerPol(double mu) : _mu(mu) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = _mu*((1 - x[0]*x[0])*x[1] - x[0]);
+    }
+
+  private:
+    double _mu;
+};
+
+// Sums of the reports of an ensemble.
+struct Work {
+  Work() : accepted(0), rejected(0), rhs_evaluations(0) {}
+  void Merge(const Work & other)
+  {
+    accepted += other.accepted;
+    rejected += other.rejected;
+    rhs_evaluations += other.rhs_evaluations;
+  }
+  std::size_t accepted, rejected, rhs_evaluations;
+};
+
+int main(void)
+{
+  dynamics::MetricsRegistry registry;
+  dynamics::SolverMetrics metrics(registry);
+
+  // Logarithmic buckets: (2^(k-1), 2^k], everything below the first bound
+  // in the first bucket and everything above the last in the overflow.
+  dynamics::Histogram h = registry.AddHistogram("test_values", "Values.",
+                                                -2, 3);
+  const double values[] = {0.01, 0.25, 0.26, 1.0, 1.5, 8.0, 100.0};
+  const int expected[] = {0, 0, 1, 2, 3, 5, 6};
+  for (int i = 0; i < 7; ++i) {
+    h.Observe(values[i]);
+    if (h.Index(values[i]) != expected[i]) {
+      std::cerr << values[i] << " in bucket " << h.Index(values[i])
+                << " instead of " << expected[i] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (h.Buckets() != 7 || h.Count() != 7 || h.Bucket(0) != 2
+      || std::fabs(h.Sum() - 111.02) > 1e-12) {
+    std::cerr << "histogram totals wrong" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Per-thread updates from an ensemble add up to the integrators' own
+  // reports.
+  Oscillator oscillator;
+  dynamics::AutonomousEndogenousSystem<double, 2> f =
+    dynamics::MakeSystem(oscillator);
+  const std::size_t members = 40;
+  const double t1 = 20.0;
+  Work work = dynamics::RunEnsemble(members, Work(),
+      [&](std::size_t i, Work & acc, unsigned) {
+        dynamics::AutonomousEndogenousSystem<double, 2> g(f);
+        dynamics::DormandPrince54<std::array<double, 2> > stepper;
+        dynamics::AdaptiveOptions options;
+        options.rtol = 1e-4*(1 + i % 4);
+        options.metrics = &metrics;
+        std::array<double, 2> x = {{1.0 + 0.1*i, 0.0}};
+        dynamics::AdaptiveReport report =
+          dynamics::IntegrateAdaptive(stepper, g, 0.0, t1, x, options);
+        acc.accepted += report.accepted;
+        acc.rejected += report.rejected;
+        acc.rhs_evaluations += report.rhs_evaluations;
+      }, 4);
+  std::cout << metrics.steps.Value() << " steps, "
+            << metrics.rejected_steps.Value() << " rejected, "
+            << metrics.rhs_evaluations.Value() << " RHS evaluations, "
+            << metrics.rhs_evaluations.Value()/metrics.step_size.Sum()
+            << " per unit time" << std::endl;
+  if (metrics.steps.Value() != work.accepted
+      || metrics.rejected_steps.Value() != work.rejected
+      || metrics.rhs_evaluations.Value() != work.rhs_evaluations
+      || metrics.step_size.Count() != work.accepted
+      || std::fabs(metrics.step_size.Sum() - members*t1) > 1e-9) {
+    std::cerr << "metrics disagree with the reports" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The switching integrator also reports its implicit steps.
+  VanDerPol vdp(1000.0);
+  dynamics::AutonomousEndogenousSystem<double, 2> v =
+    dynamics::MakeSystem(vdp);
+  dynamics::SwitchingOptions options;
+  options.integration.metrics = &metrics;
+  std::array<double, 2> x = {{2.0, 0.0}};
+  dynamics::SwitchingReport report =
+    dynamics::IntegrateSwitching(v, 0.0, 50.0, x, options);
+  std::cout << report.switches << " switches, "
+            << metrics.newton_iterations.Count() << " Newton solves, "
+            << metrics.newton_iterations.Sum() << " iterations" << std::endl;
+  if (metrics.switches.Value() != report.switches || report.switches == 0
+      || metrics.jacobian_evaluations.Value() != report.jacobian_evaluations
+      || metrics.newton_iterations.Count() != report.jacobian_evaluations
+      || metrics.steps.Value() != work.accepted + report.accepted) {
+    std::cerr << "switching metrics disagree with the report" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The dump has one sample per counter and cumulative histogram buckets.
+  const std::string path = "test_metrics.prom";
+  registry.Write(path);
+  std::ifstream file(path.c_str());
+  std::string text((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  std::ostringstream steps, total, values_bucket;
+  steps << "\ndynamics_steps_total " << metrics.steps.Value() << "\n";
+  total << "\ndynamics_step_size_bucket{le=\"+Inf\"} "
+        << metrics.step_size.Count() << "\n";
+  values_bucket << "\ntest_values_bucket{le=\"1\"} 4\n";
+  if (text.find("# TYPE dynamics_step_size histogram\n") == std::string::npos
+      || text.find(steps.str()) == std::string::npos
+      || text.find(total.str()) == std::string::npos
+      || text.find(values_bucket.str()) == std::string::npos) {
+    std::cerr << "unexpected dump:\n" << text << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/*! \example test_mlmc.cc
+ * This is an example of how to estimate the expected final state of a
+ * stochastic differential equation with multilevel Monte Carlo.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "mappings.h"
+#include "mlmc.h"
+#include "random.h"
+
+// Geometric Brownian motion dx = mu x dt + sigma x dW, written as a mapping
+// whose exogenous input is the white noise dW/dt.
+class GeometricBrownianMotion : public dynamics::MappingAutonomousExogenous<double, 1, 1> {
+  public:
+    GeometricBrownianMotion(double mu, double sigma) : _mu(mu), _sigma(sigma) {}
+
+    virtual void ComputeRHS(const std::array<double, 1> & x,
+                            const std::array<double, 1> & u,
+                            std::array<double, 1> & rhs)
+    {
+      rhs[0] = _mu*x[0] + _sigma*x[0]*u[0];
+    }
+
+  private:
+    double _mu, _sigma;
+};
+
+int main(void)
+{
+  GeometricBrownianMotion gbm(0.05, 0.2);
+  // Uncertain initial condition, uniform in [0.9, 1.1].
+  auto initial = [](dynamics::SplitMix64 & rng, std::array<double, 1> & x) {
+    x[0] = std::uniform_real_distribution<double>(0.9, 1.1)(rng);
+  };
+  auto output = [](const std::array<double, 1> & x) { return x[0]; };
+  auto sampler = dynamics::MakeSDEPathSampler(gbm, 1.0, 4, initial, output);
+
+  dynamics::MLMCOptions options;
+  options.epsilon = 2e-3;
+  options.threads = 4;
+  dynamics::MLMCResult<double> r =
+    dynamics::RunMultilevelMonteCarlo<double>(sampler, options);
+
+  double exact = std::exp(0.05);
+  std::cout << "MLMC estimate of E[x(1)] " << r.estimate << " (exact "
+            << exact << ")" << std::endl;
+  for (std::size_t l = 0; l < r.levels.size(); ++l)
+    std::cout << "level " << l << ": " << r.levels[l].correction.Count()
+              << " samples, variance " << r.levels[l].correction.Variance()
+              << std::endl;
+  if (!r.converged || std::fabs(r.estimate - exact) > 3.0*options.epsilon
+      || std::sqrt(r.variance) > options.epsilon) {
+    std::cerr << "MLMC estimate out of tolerance" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (std::size_t l = 2; l < r.levels.size(); ++l)
+    if (r.levels[l].correction.Count() > r.levels[1].correction.Count()) {
+      std::cerr << "fine levels should need fewer samples" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  // Samples are tied to their random streams, not to threads.
+  options.threads = 1;
+  dynamics::MLMCResult<double> r1 =
+    dynamics::RunMultilevelMonteCarlo<double>(sampler, options);
+  if (std::fabs(r1.estimate - r.estimate) > 1e-12) {
+    std::cerr << "MLMC estimate depends on the thread count" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/*! \example test_mpc.cc
+ * This is an example of how to stabilize a mapping with nonlinear model
+ * predictive control, solving a multiple shooting problem every sample.
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "autodiff.h"
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "mpc.h"
+
+// Damped pendulum driven by a torque; upright is theta = pi.
+template <class S>
+class Pendulum : public dynamics::MappingAutonomousExogenous<S, 2, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            const std::array<S, 1> & u,
+                            std::array<S, 2> & rhs)
+    {
+      using std::sin;
+      rhs[0] = x[1];
+      rhs[1] = -sin(x[0]) - 0.1*x[1] + u[0];
+    }
+};
+
+typedef dynamics::ModelPredictiveController<double, 2, 1> Controller;
+
+const double pi = 3.14159265358979323846;
+const double dt = 0.05;
+const std::size_t horizon = 40;
+
+static void Weights(dynamics::Matrix<double, 2> & Q,
+                    dynamics::Matrix<double, 1> & R,
+                    dynamics::Matrix<double, 2> & Qf)
+{
+  Q = dynamics::Matrix<double, 2>::Identity();
+  Q(1, 1) = 0.1;
+  R(0, 0) = 0.1;
+  Qf = Q;
+  Qf(0, 0) = Qf(1, 1) = 10.0;
+}
+
+// Cost of the inputs u from x0, by simulating the plant (single shooting).
+static double Cost(const std::array<double, 2> & x0,
+                   const std::vector<double> & u)
+{
+  dynamics::Matrix<double, 2> Q, Qf;
+  dynamics::Matrix<double, 1> R;
+  Weights(Q, R, Qf);
+  Pendulum<double> pendulum;
+  std::array<double, 1> input = {{0.0}};
+  dynamics::AutonomousExogenousSystem<double, 2, 1> f(pendulum, input);
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  std::array<double, 2> x = x0;
+  double cost = 0.0;
+  for (std::size_t k = 0; k < u.size(); ++k) {
+    const double e0 = x[0] - pi, e1 = x[1];
+    cost += Q(0, 0)*e0*e0 + Q(1, 1)*e1*e1 + R(0, 0)*u[k]*u[k];
+    f.Input()[0] = u[k];
+    rk4.Step(f, 0.0, dt, x);
+  }
+  const double e0 = x[0] - pi, e1 = x[1];
+  return 0.5*(cost + Qf(0, 0)*e0*e0 + Qf(1, 1)*e1*e1);
+}
+
+// Closed loop from x0 with one SQP iteration per sample; returns the final
+// state and the solve latencies.
+static std::array<double, 2> ClosedLoop(unsigned threads,
+                                        std::vector<double> & latencies)
+{
+  Pendulum<dynamics::Dual<double, 3> > model;
+  dynamics::Matrix<double, 2> Q, Qf;
+  dynamics::Matrix<double, 1> R;
+  Weights(Q, R, Qf);
+  dynamics::MPCOptions options;
+  options.threads = threads;
+  Controller mpc(model, horizon, dt, Q, R, Qf, options);
+  std::array<double, 2> reference = {{pi, 0.0}}, x = {{pi - 1.0, 0.0}};
+  std::array<double, 1> zero = {{0.0}}, lower = {{-1.5}}, upper = {{1.5}};
+  mpc.SetReference(reference, zero);
+  mpc.SetBounds(lower, upper);
+  mpc.Initialize(x, zero);
+
+  Pendulum<double> pendulum;
+  dynamics::AutonomousExogenousSystem<double, 2, 1> plant(pendulum, zero);
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  latencies.clear();
+  for (int k = 0; k < 200; ++k) {
+    std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    plant.Input() = mpc.Solve(x);
+    latencies.push_back(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count());
+    mpc.Shift();
+    rk4.Step(plant, k*dt, dt, x);
+  }
+  return x;
+}
+
+int main(void)
+{
+  dynamics::Matrix<double, 2> Q, Qf;
+  dynamics::Matrix<double, 1> R;
+  Weights(Q, R, Qf);
+
+  // Iterated to convergence, multiple shooting finds a stationary point of
+  // the single shooting cost.
+  Pendulum<dynamics::Dual<double, 3> > model;
+  dynamics::MPCOptions options;
+  options.iterations = 30;
+  Controller mpc(model, horizon, dt, Q, R, Qf, options);
+  std::array<double, 2> reference = {{pi, 0.0}}, x0 = {{pi - 0.5, 0.3}};
+  std::array<double, 1> zero = {{0.0}};
+  mpc.SetReference(reference, zero);
+  mpc.Initialize(x0, zero);
+  mpc.Solve(x0);
+  std::vector<double> u(horizon);
+  for (std::size_t k = 0; k < horizon; ++k)
+    u[k] = mpc.Inputs(k)[0];
+  const double cost = Cost(x0, u);
+  std::mt19937 rng(1);
+  std::normal_distribution<double> normal;
+  std::vector<double> plus(u), minus(u);
+  const double eps = 1e-5;
+  for (std::size_t k = 0; k < horizon; ++k) {
+    const double d = normal(rng);
+    plus[k] += eps*d;
+    minus[k] -= eps*d;
+  }
+  const double slope = (Cost(x0, plus) - Cost(x0, minus))/(2*eps);
+  std::cout << "converged: defect " << mpc.Defect() << ", cost " << cost
+            << " (shooting cost " << mpc.Cost() << "), directional "
+            << "derivative " << slope << std::endl;
+  if (mpc.Defect() > 1e-10 || std::fabs(cost - mpc.Cost()) > 1e-10
+      || std::fabs(slope) > 1e-5) {
+    std::cerr << "multiple shooting did not converge to an optimum"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Real-time iterations stabilize the upright pendulum with bounded
+  // torque.
+  std::vector<double> serial, threaded;
+  std::array<double, 2> x = ClosedLoop(1, serial);
+  std::array<double, 2> y = ClosedLoop(4, threaded);
+  std::sort(serial.begin(), serial.end());
+  std::sort(threaded.begin(), threaded.end());
+  std::cout << "closed loop: final error " << std::fabs(x[0] - pi)
+            << ", median latency " << 1e6*serial[serial.size()/2]
+            << " us (1 thread), " << 1e6*threaded[threaded.size()/2]
+            << " us (4 threads), max " << 1e6*serial.back() << " us"
+            << std::endl;
+  if (std::fabs(x[0] - pi) > 1e-3 || std::fabs(x[1]) > 1e-3) {
+    std::cerr << "controller does not stabilize the pendulum" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (x != y) {
+    std::cerr << "results depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (serial[serial.size()/2] > 0.01) {
+    std::cerr << "solves do not fit a 10 ms sample" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+/*! \example test_particle_filter.cc
+ * This is an example of how to estimate the state of a mapping with a
+ * particle filter, checked against the exact Kalman filter of a linear
+ * model.
+ */
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "fixed_linalg.h"
+#include "integrators.h"
+#include "kalman.h"
+#include "mappings.h"
+#include "particle_filter.h"
+#include "random.h"
+
+// Linear decay towards zero.
+class Decay : public dynamics::MappingAutonomousEndogenous<double, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 1> & x,
+                            std::array<double, 1> & rhs)
+    {
+      rhs[0] = -0.5*x[0];
+    }
+};
+
+typedef dynamics::AutonomousEndogenousSystem<double, 1> System;
+typedef dynamics::ParticleFilter<double, 1, System> Filter;
+
+const double dt = 0.1, q = 0.01, r = 0.04;
+const int cycles = 100;
+
+// Runs a particle filter over the measurements z and returns its means.
+static std::vector<double> Run(const std::vector<double> & z,
+                               std::size_t particles, unsigned threads,
+                               double offset, std::size_t & resamplings,
+                               double & seconds)
+{
+  Decay decay;
+  System f = dynamics::MakeSystem(decay);
+  dynamics::ParticleFilterOptions options;
+  options.threads = threads;
+  options.substeps = 2;
+  options.seed = 11;
+  Filter filter(f, particles, options);
+  filter.Initialize([](dynamics::SplitMix64 & rng, std::array<double, 1> & x) {
+    x[0] = 1.0 + std::normal_distribution<double>()(rng);
+  });
+  std::chrono::steady_clock::time_point start =
+    std::chrono::steady_clock::now();
+  std::vector<double> means;
+  for (int k = 0; k < cycles; ++k) {
+    filter.Predict(k*dt, dt,
+                   [](dynamics::SplitMix64 & rng, std::array<double, 1> & x) {
+                     std::normal_distribution<double> normal;
+                     x[0] += std::sqrt(q)*normal(rng);
+                   });
+    filter.Update([&](const std::array<double, 1> & x) {
+      return offset - 0.5*(z[k] - x[0])*(z[k] - x[0])/r;
+    });
+    means.push_back(filter.Mean()[0]);
+  }
+  seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  resamplings = filter.Resamplings();
+  return means;
+}
+
+int main(void)
+{
+  // Simulate the model and its noisy measurements.
+  dynamics::SplitMix64 rng(3);
+  std::normal_distribution<double> normal;
+  Decay decay;
+  System f = dynamics::MakeSystem(decay);
+  dynamics::RungeKutta4<std::array<double, 1> > rk4;
+  std::array<double, 1> truth = {{1.5}};
+  std::vector<double> z;
+  for (int k = 0; k < cycles; ++k) {
+    rk4.Step(f, k*dt, dt/2, truth);
+    rk4.Step(f, k*dt + dt/2, dt/2, truth);
+    truth[0] += std::sqrt(q)*normal(rng);
+    z.push_back(truth[0] + std::sqrt(r)*normal(rng));
+  }
+
+  // The Kalman filter is exact for a linear model with Gaussian noise.
+  std::array<double, 1> x0 = {{1.0}};
+  dynamics::Matrix<double, 1> P0 = dynamics::Matrix<double, 1>::Identity();
+  dynamics::Matrix<double, 1> Q, R;
+  Q(0, 0) = q;
+  R(0, 0) = r;
+  dynamics::KalmanOptions kalman;
+  kalman.substeps = 2;
+  dynamics::ExtendedKalmanFilter<double, 1, System> ekf(f, x0, P0, kalman);
+  auto identity = [](const std::array<double, 1> & x,
+                     std::array<double, 1> & y) { y[0] = x[0]; };
+  std::vector<double> exact, deviation;
+  for (int k = 0; k < cycles; ++k) {
+    std::array<double, 1> measurement = {{z[k]}};
+    ekf.Predict(k*dt, dt, Q);
+    ekf.Update(identity, measurement, R);
+    exact.push_back(ekf.Mean()[0]);
+    deviation.push_back(std::sqrt(ekf.Covariance()(0, 0)));
+  }
+
+  const std::size_t particles = 20000;
+  std::size_t resamplings[3];
+  double seconds[3];
+  std::vector<double> serial = Run(z, particles, 1, 0.0, resamplings[0],
+                                   seconds[0]);
+  std::vector<double> threaded = Run(z, particles, 4, 0.0, resamplings[1],
+                                     seconds[1]);
+  // Likelihoods of exp(-2000) underflow unless weights are kept as logs.
+  std::vector<double> tiny = Run(z, particles, 4, -2000.0, resamplings[2],
+                                 seconds[2]);
+  double error = 0.0, mismatch = 0.0, shift = 0.0;
+  for (int k = 0; k < cycles; ++k) {
+    error = std::max(error, std::fabs(serial[k] - exact[k])/deviation[k]);
+    mismatch = std::max(mismatch, std::fabs(serial[k] - threaded[k]));
+    shift = std::max(shift, std::fabs(serial[k] - tiny[k]));
+  }
+  std::cout << particles << " particles: largest error " << error
+            << " posterior deviations, " << resamplings[0]
+            << " resamplings, " << cycles*particles/seconds[0]
+            << " particle updates/s (1 thread), "
+            << cycles*particles/seconds[1] << " (4 threads)" << std::endl;
+  std::cout << "difference between thread counts " << mismatch
+            << ", with tiny likelihoods " << shift << std::endl;
+  if (error > 0.1 || resamplings[0] == 0) {
+    std::cerr << "particle filter disagrees with the Kalman filter"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (mismatch != 0.0 || resamplings[1] != resamplings[0]) {
+    std::cerr << "results depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!(shift < 1e-9)) {
+    std::cerr << "small likelihoods change the estimate" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Empty blocks are rejected instead of dividing by zero.
+  dynamics::ParticleFilterOptions empty;
+  empty.block = 0;
+  bool rejected = false;
+  try {
+    Filter filter(f, particles, empty);
+  } catch (const std::invalid_argument &) {
+    rejected = true;
+  }
+  if (!rejected) {
+    std::cerr << "particle filter accepted an empty block" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
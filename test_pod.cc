@@ -0,0 +1,137 @@
+/*! \example test_pod.cc
+ * This is an example of how to reduce a large Dynamic mapping with POD and
+ * DEIM, using snapshots collected from an integrator run.
+ */
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "dense.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "pod.h"
+
+// Allen-Cahn equation u_t = nu u_xx + u - u^3 on (0, 1) with homogeneous
+// Dirichlet boundary conditions, discretized by central differences.
+class AllenCahn : public dynamics::MappingAutonomousEndogenous<double, dynamics::Dynamic> {
+  public:
+    AllenCahn(int n, double nu) : _n(n), _nu(nu), _evaluated(0)
+    {
+      _c = nu*(n + 1.0)*(n + 1.0);
+    }
+
+    virtual int Dimension() const { return _n; }
+
+    virtual void ComputeRHS(const std::vector<double> & x,
+                            std::vector<double> & rhs)
+    {
+      for (int i = 0; i < _n; ++i)
+        rhs[i] = Component(x, i);
+      _evaluated += _n;
+    }
+
+    virtual void ComputeRHSComponents(const std::vector<double> & x,
+                                      const std::vector<int> & components,
+                                      std::vector<double> & values)
+    {
+      values.resize(components.size());
+      for (std::size_t k = 0; k < components.size(); ++k)
+        values[k] = Component(x, components[k]);
+      _evaluated += long(components.size());
+    }
+
+    long Evaluated() const { return _evaluated; }
+
+  private:
+    double Component(const std::vector<double> & x, int i) const
+    {
+      double left = i > 0 ? x[i - 1] : 0.0;
+      double right = i + 1 < _n ? x[i + 1] : 0.0;
+      return _c*(left - 2.0*x[i] + right) + x[i] - x[i]*x[i]*x[i];
+    }
+
+    int _n;
+    double _nu, _c;
+    // ReduceModel evaluates snapshots concurrently.
+    std::atomic<long> _evaluated;
+};
+
+int main(void)
+{
+  // The randomized SVD recovers the spectrum of an exactly low rank matrix.
+  dynamics::DenseMatrix<double> A(300, 40);
+  for (std::size_t j = 0; j < A.Cols(); ++j)
+    for (std::size_t i = 0; i < A.Rows(); ++i)
+      A(i, j) = 3.0*std::sin(0.01*i)*std::cos(0.3*j)
+        + 0.5*std::cos(0.05*i*j) + 1e-3*(i == j);
+  dynamics::DenseMatrix<double> U;
+  std::vector<double> sigma;
+  dynamics::RandomizedSVD(A, 5, U, sigma);
+  dynamics::DenseMatrix<double> UtU;
+  dynamics::TransposeMultiply(U, U, UtU);
+  for (std::size_t j = 0; j < UtU.Cols(); ++j)
+    for (std::size_t i = 0; i < UtU.Rows(); ++i)
+      if (std::fabs(UtU(i, j) - (i == j)) > 1e-10) {
+        std::cerr << "singular vectors not orthonormal" << std::endl;
+        return EXIT_FAILURE;
+      }
+  for (std::size_t k = 1; k < sigma.size(); ++k)
+    if (sigma[k] > sigma[k - 1]) {
+      std::cerr << "singular values not sorted" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  // Full order run, collecting every 10th state.
+  const int n = 400;
+  const double h = 0.002;
+  const std::size_t steps = 1000;
+  AllenCahn full(n, 1e-3);
+  std::vector<double> x0(n);
+  for (int i = 0; i < n; ++i) {
+    double s = (i + 1.0)/(n + 1.0);
+    x0[i] = 0.8*std::sin(M_PI*s) + 0.3*std::sin(3.0*M_PI*s)
+      - 0.2*std::sin(7.0*M_PI*s);
+  }
+  dynamics::AutonomousEndogenousSystem<double, dynamics::Dynamic> fs =
+    dynamics::MakeSystem(full);
+  dynamics::RungeKutta4<std::vector<double> > stepper;
+  dynamics::SnapshotCollector<double> snapshots(10);
+  std::vector<double> x(x0);
+  dynamics::Integrate(stepper, fs, 0.0, h, steps, x, snapshots);
+
+  // Reduced run with POD and DEIM.
+  dynamics::PODOptions options;
+  options.rank = 12;
+  options.deim_rank = 24;
+  dynamics::PODMapping<double> reduced =
+    dynamics::ReduceModel(full, snapshots.Snapshots(), options);
+  std::vector<double> a;
+  reduced.Project(x0, a);
+  dynamics::AutonomousEndogenousSystem<double, dynamics::Dynamic> rs =
+    dynamics::MakeSystem(reduced);
+  long before = full.Evaluated();
+  dynamics::Integrate(stepper, rs, 0.0, h, steps, a,
+                      [](double, const std::vector<double> &) {});
+  long per_step = (full.Evaluated() - before)/(4*steps);
+
+  std::vector<double> xr;
+  reduced.Lift(a, xr);
+  double error = 0.0, norm = 0.0;
+  for (int i = 0; i < n; ++i) {
+    error += (xr[i] - x[i])*(xr[i] - x[i]);
+    norm += x[i]*x[i];
+  }
+  error = std::sqrt(error/norm);
+  std::cout << "POD/DEIM reduced Allen-Cahn (" << n << " -> "
+            << reduced.Dimension() << " states, " << per_step
+            << " components per RHS)" << std::endl;
+  std::cout << "relative error " << error << std::endl;
+  if (error > 1e-2 || per_step != 24) {
+    std::cerr << "reduced model inaccurate" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
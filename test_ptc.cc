@@ -0,0 +1,113 @@
+/*! \example test_ptc.cc
+ * This is an example of how to find steady states by pseudo-transient
+ * continuation, for a large Dynamic mapping and for a small fixed size one.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "autodiff.h"
+#include "equilibrium.h"
+#include "mappings.h"
+#include "ptc.h"
+
+// Allen-Cahn equation u_t = nu u_xx + u - u^3 on (0, 1) with homogeneous
+// Dirichlet boundary conditions, discretized by central differences.
+class AllenCahn : public dynamics::MappingAutonomousEndogenous<double, dynamics::Dynamic> {
+  public:
+    AllenCahn(int n, double nu) : _n(n), _c(nu*(n + 1.0)*(n + 1.0)) {}
+
+    virtual int Dimension() const { return _n; }
+
+    virtual void ComputeRHS(const std::vector<double> & x,
+                            std::vector<double> & rhs)
+    {
+      for (int i = 0; i < _n; ++i) {
+        double left = i > 0 ? x[i - 1] : 0.0;
+        double right = i + 1 < _n ? x[i + 1] : 0.0;
+        rhs[i] = _c*(left - 2.0*x[i] + right) + x[i] - x[i]*x[i]*x[i];
+      }
+    }
+
+  private:
+    int _n;
+    double _c;
+};
+
+template <class S>
+class Pendulum : public dynamics::MappingAutonomousEndogenous<S, 2> {
+  public:
+    Pendulum(double l, double g = 9.81) : _l(l), _g(g) {}
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            std::array<S, 2> & rhs)
+    {
+      using std::sin;
+      rhs[0] = x[1];
+      rhs[1] = -_g/_l*sin(x[0]) - 0.5*x[1];
+    }
+
+  private:
+    double _l, _g;
+};
+
+int main(void)
+{
+  // From a small perturbation of the unstable zero state, Psi-tc follows
+  // the transient to the stable plateau solution.
+  const int n = 200;
+  AllenCahn model(n, 1e-3);
+  std::vector<double> u(n);
+  for (int i = 0; i < n; ++i)
+    u[i] = 0.5*std::sin(M_PI*(i + 1.0)/(n + 1.0));
+  dynamics::PseudoTransientResult<double> result =
+    dynamics::PseudoTransientContinuation(model, u);
+  std::cout << "Allen-Cahn: residual " << result.residual << " after "
+            << result.iterations << " steps, " << result.linear_iterations
+            << " Krylov iterations, " << result.rhs_evaluations
+            << " RHS evaluations; u(1/2) = " << u[n/2] << std::endl;
+  if (!result.converged || std::fabs(u[n/2] - 1.0) > 1e-6 || u[0] <= 0.0) {
+    std::cerr << "Allen-Cahn steady state not found" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // An empty Krylov subspace is rejected instead of restarting forever.
+  dynamics::PseudoTransientOptions empty;
+  empty.gmres.restart = 0;
+  std::vector<double> v(n, 0.1);
+  bool rejected = false;
+  try {
+    dynamics::PseudoTransientContinuation(model, v, empty);
+  } catch (const std::invalid_argument &) {
+    rejected = true;
+  }
+  if (!rejected) {
+    std::cerr << "GMRES accepted a zero restart length" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Newton from a large initial angle lands on an unstable equilibrium
+  // (the inverted pendulum); Psi-tc follows the damped motion to rest.
+  Pendulum<double> pendulum(1.0);
+  Pendulum<dynamics::Dual<double, 2> > dpendulum(1.0);
+  std::array<double, 2> x = {{2.5, 0.0}};
+  dynamics::EquilibriumResult<double, 2> newton =
+    dynamics::FindEquilibrium(pendulum, dpendulum, x);
+  dynamics::PseudoTransientResult<double> exact =
+    dynamics::PseudoTransientContinuation(pendulum, dpendulum, x);
+  std::array<double, 2> y = {{2.5, 0.0}};
+  dynamics::PseudoTransientResult<double> approximate =
+    dynamics::PseudoTransientContinuation(pendulum, y);
+  std::cout << "Pendulum: Newton angle " << newton.x[0] << ", Psi-tc angle "
+            << x[0] << " after " << exact.iterations << " steps"
+            << std::endl;
+  if (!exact.converged || !approximate.converged || std::fabs(x[0]) > 1e-8
+      || std::fabs(y[0]) > 1e-7) {
+    std::cerr << "pendulum rest state not found" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+/*! \example test_qmc.cc
+ * This is an example of how to propagate uncertain initial conditions of a
+ * pendulum with quasi-Monte Carlo sampling and streaming statistics.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "integrators.h"
+#include "mappings.h"
+#include "qmc.h"
+#include "statistics.h"
+
+class Pendulum : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    Pendulum(double l, double g = 9.81) : _l(l), _g(g) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -_g/_l*std::sin(x[0]);
+    }
+
+  private:
+    double _l, _g;
+};
+
+// Smooth test integrand over [0, 1]^5 with integral 1.
+template <class Sequence>
+double IntegrationError(const Sequence & sequence, std::size_t n)
+{
+  dynamics::RunningMoments<double> m = dynamics::RunQuasiMonteCarlo(
+      sequence, n, dynamics::RunningMoments<double>(),
+      [](const double * u, dynamics::RunningMoments<double> & acc, unsigned) {
+        double f = 1.0;
+        for (int d = 0; d < 5; ++d)
+          f *= 1.0 + 0.5*std::sin(2.0*M_PI*(u[d] - 0.1*d))
+            + (u[d] - 0.5);
+        acc.Add(f);
+      }, 3);
+  return std::fabs(m.Mean() - 1.0);
+}
+
+int main(void)
+{
+  // The first 2^k unscrambled and scrambled Sobol' points put exactly one
+  // point in each interval of length 2^-k of every coordinate.
+  const int k = 10;
+  for (int scramble = 0; scramble < 2; ++scramble) {
+    dynamics::SobolSequence sobol(dynamics::SobolSequence::MaxDimensions,
+                                  scramble != 0, 7);
+    std::vector<std::vector<int> > hits(sobol.Dimensions(),
+                                        std::vector<int>(1 << k, 0));
+    double u[dynamics::SobolSequence::MaxDimensions];
+    for (std::uint64_t i = 0; i < (1u << k); ++i) {
+      sobol.Point(i, u);
+      for (int d = 0; d < sobol.Dimensions(); ++d)
+        ++hits[d][static_cast<int>(u[d]*(1 << k))];
+    }
+    for (int d = 0; d < sobol.Dimensions(); ++d)
+      for (int c = 0; c < (1 << k); ++c)
+        if (hits[d][c] != 1) {
+          std::cerr << "Sobol' points not stratified" << std::endl;
+          return EXIT_FAILURE;
+        }
+  }
+
+  // Randomized QMC beats plain Monte Carlo by orders of magnitude on a
+  // smooth integrand.
+  std::mt19937_64 engine(3);
+  std::uniform_real_distribution<double> uniform;
+  dynamics::RunningMoments<double> mc;
+  for (int i = 0; i < 4096; ++i) {
+    double f = 1.0;
+    for (int d = 0; d < 5; ++d) {
+      double x = uniform(engine);
+      f *= 1.0 + 0.5*std::sin(2.0*M_PI*(x - 0.1*d)) + (x - 0.5);
+    }
+    mc.Add(f);
+  }
+  double sobol_error = IntegrationError(dynamics::SobolSequence(5), 4096);
+  double halton_error = IntegrationError(dynamics::HaltonSequence(5), 4096);
+  std::cout << "Integration error with 4096 points" << std::endl;
+  std::cout << "MC " << std::fabs(mc.Mean() - 1.0) << " (standard error "
+            << mc.StandardError() << ")" << std::endl;
+  std::cout << "Sobol' " << sobol_error << std::endl;
+  std::cout << "Halton " << halton_error << std::endl;
+  if (sobol_error > 0.1*mc.StandardError()
+      || halton_error > 0.3*mc.StandardError()) {
+    std::cerr << "QMC did not improve on MC" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Pendulum with uncertain initial angle and rate; mean and variance of
+  // the state at 21 output times, accumulated per thread and merged.
+  Pendulum p(1.0, 1.0);
+  const std::size_t times = 21, substeps = 10;
+  const double h = 0.01;
+  dynamics::TrajectoryMoments<double> prototype(times, 2);
+  std::vector<dynamics::TrajectoryMoments<double> > results;
+  for (unsigned threads = 1; threads <= 4; threads += 3) {
+    results.push_back(dynamics::RunQuasiMonteCarlo(
+        dynamics::SobolSequence(2, true, 11), 2048, prototype,
+        [&](const double * u, dynamics::TrajectoryMoments<double> & acc,
+            unsigned) {
+          std::array<double, 2> x = {{0.2 + 0.4*u[0], -0.1 + 0.2*u[1]}};
+          dynamics::AutonomousEndogenousSystem<double, 2> f =
+            dynamics::MakeSystem(p);
+          dynamics::RungeKutta4<std::array<double, 2> > stepper;
+          acc.Add(0, x.data());
+          for (std::size_t k = 1; k < times; ++k) {
+            for (std::size_t s = 0; s < substeps; ++s)
+              stepper.Step(f, 0.0, h, x);
+            acc.Add(k, x.data());
+          }
+        }, threads));
+  }
+  const dynamics::RunningMoments<double> & last = results[1](times - 1, 0);
+  std::cout << "Pendulum angle at t = 2: mean " << last.Mean()
+            << ", variance " << last.Variance() << std::endl;
+  for (std::size_t k = 0; k < times; ++k)
+    for (std::size_t p = 0; p < 2; ++p)
+      if (std::fabs(results[0](k, p).Mean() - results[1](k, p).Mean())
+          > 1e-12 || results[1](k, p).Count() != 2048) {
+        std::cerr << "merged statistics differ" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+  // Sobol' points exist for indices below 2^32 only; a run reaching past
+  // them throws before any member runs.
+  const std::uint64_t end = std::uint64_t(1) << 32;
+  std::size_t ran = 0;
+  bool thrown = false;
+  try {
+    dynamics::RunningMoments<double> none = dynamics::RunQuasiMonteCarlo(
+        dynamics::SobolSequence(2), 2, dynamics::RunningMoments<double>(),
+        [&](const double *, dynamics::RunningMoments<double> &, unsigned) {
+          ++ran;
+        }, 1, end - 1);
+    (void)none;
+  } catch (const std::out_of_range &) {
+    thrown = true;
+  }
+  if (!thrown || ran != 0) {
+    std::cerr << "Sobol' index beyond 2^32 accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+/*! \example test_reachability.cc
+ * This is an example of how to enclose the reachable states of a mapping
+ * with bounded inputs by zonotopes.
+ */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "autodiff.h"
+#include "integrators.h"
+#include "interval.h"
+#include "mappings.h"
+#include "reachability.h"
+
+// Van der Pol oscillator with a bounded force,
+// x'' = (1 - x^2) x' - x + u.
+template <class S>
+class VanDerPol : public dynamics::MappingAutonomousExogenous<S, 2, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            const std::array<S, 1> & u,
+                            std::array<S, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = (1.0 - x[0]*x[0])*x[1] - x[0] + u[0];
+    }
+};
+
+// Damped pendulum with a bounded torque.
+template <class S>
+class Pendulum : public dynamics::MappingAutonomousExogenous<S, 2, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<S, 2> & x,
+                            const std::array<S, 1> & u,
+                            std::array<S, 2> & rhs)
+    {
+      using std::sin;
+      rhs[0] = x[1];
+      rhs[1] = -sin(x[0]) - 0.2*x[1] + u[0];
+    }
+};
+
+typedef dynamics::Interval<double> Interval;
+typedef dynamics::Dual<Interval, 3> Scalar;
+typedef std::array<double, 2> Vector;
+
+// Largest violation of the enclosures by simulated trajectories that start
+// in the initial box with inputs switching at random within the bounds.
+static double Violation(dynamics::MappingAutonomousExogenous<double, 2, 1>
+                          & f,
+                        const dynamics::Flowpipe<double, 2> & flowpipe,
+                        const Vector & lower, const Vector & upper,
+                        double bound, double h)
+{
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::array<double, 1> u = {{0.0}};
+  dynamics::AutonomousExogenousSystem<double, 2, 1> system(f, u);
+  dynamics::RungeKutta4<Vector> rk4;
+  const int fine = 10;
+  double violation = -1e300;
+  for (int trial = 0; trial < 100; ++trial) {
+    Vector x;
+    for (int i = 0; i < 2; ++i) {
+      // Corners are the most likely to leave a poor enclosure.
+      double s = trial < 4 ? double((trial >> i) & 1) : uniform(rng);
+      x[i] = lower[i] + s*(upper[i] - lower[i]);
+    }
+    for (std::size_t k = 0; k < flowpipe.Steps(); ++k) {
+      Vector l, r;
+      flowpipe.Tube(k, l, r);
+      for (int j = 0; j < fine; ++j) {
+        if (j % 5 == 0)
+          system.Input()[0] = bound*(2*uniform(rng) - 1);
+        for (int i = 0; i < 2; ++i)
+          violation = std::max(violation, std::max(l[i] - x[i],
+                                                   x[i] - r[i]));
+        rk4.Step(system, 0.0, h/fine, x);
+      }
+      flowpipe.Bounds(k + 1, l, r);
+      for (int i = 0; i < 2; ++i)
+        violation = std::max(violation, std::max(l[i] - x[i], x[i] - r[i]));
+      if (flowpipe.Pieces() == 1) {
+        // Support functions of the zonotope in a few directions.
+        for (int d = 0; d < 8; ++d) {
+          Vector direction = {{std::cos(0.785*d), std::sin(0.785*d)}};
+          const dynamics::Zonotope<double, 2> & Z = flowpipe.Set(0, k + 1);
+          violation = std::max(violation, direction[0]*x[0]
+                               + direction[1]*x[1] - Z.Support(direction));
+        }
+      }
+    }
+  }
+  return violation;
+}
+
+int main(void)
+{
+  // Interval functions enclose their values at sampled points.
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<double> uniform(-4.0, 4.0);
+  for (int trial = 0; trial < 1000; ++trial) {
+    double a = uniform(rng), b = uniform(rng);
+    Interval x(std::min(a, b), std::max(a, b));
+    Interval s = sin(x), c = cos(x), e = exp(x), q = x*x - 2.0*x;
+    for (int k = 0; k <= 10; ++k) {
+      double t = std::min(x.Lower() + 0.1*k*(x.Upper() - x.Lower()),
+                          x.Upper());
+      if (!s.Contains(std::sin(t)) || !c.Contains(std::cos(t))
+          || !e.Contains(std::exp(t)) || !q.Contains(t*t - 2.0*t)) {
+        std::cerr << "interval functions miss values on " << x << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // Pendulum under torques in [-0.1, 0.1] for 4 s.
+  Pendulum<double> pendulum;
+  Pendulum<Scalar> pendulum_box;
+  const Vector lower = {{0.9, -0.1}}, upper = {{1.1, 0.1}};
+  const std::array<double, 1> umin = {{-0.1}}, umax = {{0.1}};
+  const double h = 0.02;
+  dynamics::Flowpipe<double, 2> pipe = dynamics::ComputeReachableSets(
+      pendulum_box, dynamics::Zonotope<double, 2>::Box(lower, upper),
+      umin, umax, h, 200);
+  Vector l, r;
+  pipe.Bounds(200, l, r);
+  const double violation = Violation(pendulum, pipe, lower, upper, 0.1, h);
+  std::cout << "pendulum: final box [" << l[0] << ", " << r[0] << "] x ["
+            << l[1] << ", " << r[1] << "], largest violation by samples "
+            << violation << std::endl;
+  if (violation > 0.0 || r[0] - l[0] > 1.0) {
+    std::cerr << "pendulum enclosure not sound or too wide" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Van der Pol: splitting the initial set shrinks linearization errors;
+  // pieces are computed in parallel.
+  VanDerPol<double> vdp;
+  VanDerPol<Scalar> vdp_box;
+  const Vector start_lower = {{1.2, 2.2}}, start_upper = {{1.4, 2.4}};
+  const std::array<double, 1> fmin = {{-0.02}}, fmax = {{0.02}};
+  const dynamics::Zonotope<double, 2> start =
+    dynamics::Zonotope<double, 2>::Box(start_lower, start_upper);
+  double width[2], seconds[2];
+  dynamics::ReachabilityOptions options;
+  std::vector<dynamics::Flowpipe<double, 2> > pipes;
+  for (int i = 0; i < 2; ++i) {
+    options.splits = 4*i;
+    options.threads = 1;
+    std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+    pipes.push_back(dynamics::ComputeReachableSets(vdp_box, start, fmin,
+                                                   fmax, 0.01, 300,
+                                                   options));
+    seconds[i] = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+    pipes[i].Bounds(300, l, r);
+    width[i] = std::max(r[0] - l[0], r[1] - l[1]);
+  }
+  options.threads = 4;
+  dynamics::Flowpipe<double, 2> threaded = dynamics::ComputeReachableSets(
+      vdp_box, start, fmin, fmax, 0.01, 300, options);
+  const double split_violation = Violation(vdp, pipes[1], start_lower,
+                                           start_upper, 0.02, 0.01);
+  std::cout << "Van der Pol: final width " << width[0] << " (1 piece, "
+            << seconds[0] << " s), " << width[1] << " (16 pieces, "
+            << seconds[1] << " s), largest violation by samples "
+            << split_violation << std::endl;
+  if (split_violation > 0.0 || !(width[1] < width[0])) {
+    std::cerr << "Van der Pol enclosure not sound or splitting does not "
+              << "help" << std::endl;
+    return EXIT_FAILURE;
+  }
+  Vector lt, rt;
+  threaded.Bounds(300, lt, rt);
+  pipes[1].Bounds(300, l, r);
+  if (l != lt || r != rt) {
+    std::cerr << "results depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
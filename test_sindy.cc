@@ -0,0 +1,129 @@
+/*! \example test_sindy.cc
+ * This is an example of how to learn a mapping from a recorded trajectory
+ * by sparse identification of nonlinear dynamics.
+ */
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "integrators.h"
+#include "mappings.h"
+#include "sindy.h"
+
+// Forced Duffing oscillator, x'' = -0.2 x' - x - x^3 + u.
+class Duffing : public dynamics::MappingAutonomousExogenous<double, 2, 1> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            const std::array<double, 1> & u,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -0.2*x[1] - x[0] - x[0]*x[0]*x[0] + u[0];
+    }
+};
+
+static double Forcing(double t) { return 0.8*std::cos(1.3*t); }
+
+// Simulates f from x0 with the forcing held over steps of h, returning the
+// states and inputs every sample steps.
+static void Simulate(dynamics::MappingAutonomousExogenous<double, 2, 1> & f,
+                     std::array<double, 2> x, double h, std::size_t steps,
+                     std::size_t sample,
+                     std::vector<std::array<double, 2> > & states,
+                     std::vector<std::array<double, 1> > & inputs)
+{
+  std::array<double, 1> u = {{0.0}};
+  dynamics::AutonomousExogenousSystem<double, 2, 1> system(f, u);
+  dynamics::RungeKutta4<std::array<double, 2> > rk4;
+  states.clear();
+  inputs.clear();
+  for (std::size_t k = 0; k <= steps; ++k) {
+    system.Input()[0] = Forcing(k*h);
+    if (k % sample == 0) {
+      states.push_back(x);
+      inputs.push_back(system.Input());
+    }
+    if (k < steps)
+      rk4.Step(system, k*h, h, x);
+  }
+}
+
+int main(void)
+{
+  // The forcing changes slowly compared to the fine steps, so the samples
+  // follow the continuously forced oscillator closely.
+  Duffing duffing;
+  const double h = 1e-3, dt = 1e-2;
+  std::vector<std::array<double, 2> > x, dx;
+  std::vector<std::array<double, 1> > u;
+  const std::array<double, 2> x0 = {{1.5, 0.0}};
+  Simulate(duffing, x0, h, 40000, 10, x, u);
+  dynamics::FiniteDifferenceDerivatives(x, dt, dx);
+
+  dynamics::PolynomialLibrary<double, 2, 1> library(3);
+  dynamics::SINDyOptions options;
+  options.threshold = 0.05;
+  options.threads = 1;
+  dynamics::SparseMapping<double, 2, 1> model =
+    dynamics::FitSINDy(library, x, u, dx, options);
+  options.threads = 4;
+  dynamics::SparseMapping<double, 2, 1> threaded =
+    dynamics::FitSINDy(library, x, u, dx, options);
+
+  // Exact model: coefficients of x[1] in rhs[0], and of x[1], x[0],
+  // x[0]^3 and u[0] in rhs[1].
+  double error = 0.0;
+  std::size_t wrong = 0;
+  for (std::size_t k = 0; k < library.Terms(); ++k) {
+    const std::string name = library.Name(k);
+    const double exact[2] = {
+      name == "x[1]" ? 1.0 : 0.0,
+      name == "x[1]" ? -0.2 : name == "x[0]" ? -1.0
+        : name == "x[0]*x[0]*x[0]" ? -1.0 : name == "u[0]" ? 1.0 : 0.0};
+    for (int i = 0; i < 2; ++i) {
+      error = std::max(error, std::fabs(model.Coefficient(k, i)
+                                        - exact[i]));
+      wrong += (model.Coefficient(k, i) != 0.0) != (exact[i] != 0.0);
+    }
+  }
+  std::cout << library.Terms() << " candidate terms, " << model.Nonzeros()
+            << " selected, largest coefficient error " << error
+            << std::endl;
+  std::cout << model.Source("LearnedDuffing");
+  if (wrong > 0 || error > 1e-3) {
+    std::cerr << "SINDy does not recover the Duffing oscillator"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The learned mapping plugs into the integrators and reproduces the
+  // trajectory from a different initial state.
+  std::vector<std::array<double, 2> > exact, learned;
+  std::vector<std::array<double, 1> > inputs;
+  const std::array<double, 2> x1 = {{-0.5, 1.0}};
+  Simulate(duffing, x1, h, 5000, 1000, exact, inputs);
+  Simulate(model, x1, h, 5000, 1000, learned, inputs);
+  double deviation = 0.0;
+  for (std::size_t k = 0; k < exact.size(); ++k)
+    for (int i = 0; i < 2; ++i)
+      deviation = std::max(deviation, std::fabs(exact[k][i]
+                                                - learned[k][i]));
+  std::cout << "largest deviation of the learned trajectory " << deviation
+            << std::endl;
+  if (deviation > 1e-2) {
+    std::cerr << "learned model does not reproduce the trajectory"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for (std::size_t k = 0; k < library.Terms(); ++k)
+    for (int i = 0; i < 2; ++i)
+      if (model.Coefficient(k, i) != threaded.Coefficient(k, i)) {
+        std::cerr << "results depend on the number of threads" << std::endl;
+        return EXIT_FAILURE;
+      }
+  return EXIT_SUCCESS;
+}
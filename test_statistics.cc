@@ -0,0 +1,122 @@
+/*! \example test_statistics.cc
+ * This is an example of how to accumulate mean, variance and quantile bands
+ * of an ensemble of pendulum trajectories without storing the trajectories.
+ */
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "ensemble.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "random.h"
+#include "statistics.h"
+
+class Pendulum : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    Pendulum(double l, double g = 9.81) : _l(l), _g(g) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -_g/_l*std::sin(x[0]);
+    }
+
+  private:
+    double _l, _g;
+};
+
+int main(void)
+{
+  // Merged moments and sketches agree with the whole stream.
+  dynamics::SplitMix64 engine(1);
+  std::normal_distribution<double> normal(2.0, 3.0);
+  std::vector<double> samples(200000);
+  for (std::size_t i = 0; i < samples.size(); ++i)
+    samples[i] = normal(engine);
+  dynamics::RunningMoments<double> all, parts[4];
+  std::vector<dynamics::QuantileSketch<double> > sketches(
+      4, dynamics::QuantileSketch<double>(200));
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    all.Add(samples[i]);
+    parts[i % 4].Add(samples[i]);
+    sketches[i % 4].Add(samples[i]);
+  }
+  for (int p = 1; p < 4; ++p) {
+    parts[0].Merge(parts[p]);
+    sketches[0].Merge(sketches[p]);
+  }
+  if (parts[0].Count() != all.Count()
+      || std::fabs(parts[0].Mean() - all.Mean()) > 1e-12
+      || std::fabs(parts[0].Variance() - all.Variance()) > 1e-9) {
+    std::cerr << "merged moments differ" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::sort(samples.begin(), samples.end());
+  std::cout << "KLL sketch of " << sketches[0].Count() << " samples keeps "
+            << sketches[0].Size() << std::endl;
+  const double q[] = {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99};
+  for (int i = 0; i < 7; ++i) {
+    double x = sketches[0].Quantile(q[i]);
+    double rank = double(std::lower_bound(samples.begin(), samples.end(), x)
+                         - samples.begin())/samples.size();
+    std::cout << q[i] << " quantile " << x << " has rank " << rank
+              << std::endl;
+    if (std::fabs(rank - q[i]) > 0.015) {
+      std::cerr << "quantile out of tolerance" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (sketches[0].Size() > 700) {
+    std::cerr << "sketch grows with the number of samples" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Ensemble of pendulums with random initial angles; every member draws
+  // from its own stream, so results do not depend on the thread count.
+  Pendulum p(1.0, 1.0);
+  const std::size_t times = 11, members = 5000;
+  std::vector<dynamics::EnsembleStatistics<double> > results;
+  for (unsigned threads = 1; threads <= 4; threads += 3) {
+    results.push_back(dynamics::RunEnsemble(
+        members, dynamics::EnsembleStatistics<double>(times, 2),
+        [&](std::size_t i, dynamics::EnsembleStatistics<double> & acc,
+            unsigned) {
+          dynamics::SplitMix64 rng(42, i);
+          std::uniform_real_distribution<double> angle(0.1, 1.0);
+          std::array<double, 2> x = {{angle(rng), 0.0}};
+          dynamics::AutonomousEndogenousSystem<double, 2> f =
+            dynamics::MakeSystem(p);
+          dynamics::RungeKutta4<std::array<double, 2> > stepper;
+          acc.Add(0, x.data());
+          for (std::size_t k = 1; k < times; ++k) {
+            for (int s = 0; s < 20; ++s)
+              stepper.Step(f, 0.0, 0.01, x);
+            acc.Add(k, x.data());
+          }
+        }, threads));
+  }
+  const dynamics::EnsembleStatistics<double> & s = results[1];
+  std::cout << "Pendulum angle at t = 2: mean "
+            << s.Moments(times - 1, 0).Mean() << ", 90% band ["
+            << s.Quantile(times - 1, 0, 0.05) << ", "
+            << s.Quantile(times - 1, 0, 0.95) << "]" << std::endl;
+  for (std::size_t k = 0; k < times; ++k) {
+    const dynamics::RunningMoments<double> & m0 = results[0].Moments(k, 0);
+    const dynamics::RunningMoments<double> & m1 = s.Moments(k, 0);
+    if (m1.Count() != members || std::fabs(m0.Mean() - m1.Mean()) > 1e-12
+        || s.Quantile(k, 0, 0.05) > m1.Mean()
+        || s.Quantile(k, 0, 0.95) < m1.Mean()
+        || std::fabs(s.Quantile(k, 0, 0.5) - results[0].Quantile(k, 0, 0.5))
+           > 0.05) {
+      std::cerr << "ensemble statistics inconsistent" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+/*! \example test_surrogate.cc
+ * This is an example of how to replace a mapping by a tabulated surrogate and
+ * how to persist the table on disk.
+ */
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include "mappings.h"
+#include "surrogate.h"
+
+class Pendulum : public dynamics::MappingAutonomousEndogenous<double, 2> {
+  public:
+    Pendulum(double l, double g = 9.81) : _l(l), _g(g) {}
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -_g/_l*std::sin(x[0]);
+    }
+
+  private:
+    double _l, _g;
+};
+
+class PendulumWithTorque : public dynamics::MappingAutonomousExogenous<double, 2, 1> {
+  public:
+    PendulumWithTorque(double l, double g = 9.81, double m = 1.0)
+      : _l(l), _g(g), _m(m) {}
+
+    virtual void ComputeRHS(const std::array<double, 2> & x,
+                            const std::array<double, 1> & u,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -_g/_l*std::sin(x[0]) + u[0]/(_m*_l*_l);
+    }
+
+  private:
+    double _l, _g, _m;
+};
+
+// Periodically driven, torqued pendulum.
+class DrivenPendulum
+  : public dynamics::MappingNonAutonomousExogenous<double, double, 2, 1> {
+  public:
+    virtual void ComputeRHS(const double & t,
+                            const std::array<double, 2> & x,
+                            const std::array<double, 1> & u,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -std::sin(x[0]) + 0.5*std::cos(t) + u[0];
+    }
+};
+
+// The same without the torque.
+class FreeDrivenPendulum
+  : public dynamics::MappingNonAutonomousEndogenous<double, double, 2> {
+  public:
+    virtual void ComputeRHS(const double & t,
+                            const std::array<double, 2> & x,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -std::sin(x[0]) + 0.5*std::cos(t);
+    }
+};
+
+int main(void)
+{
+  Pendulum p0(1.0, 1.0);
+  std::array<double, 2> lower = {{-M_PI, -2.0}};
+  std::array<double, 2> upper = {{M_PI, 2.0}};
+  std::array<int, 2> points = {{129, 17}};
+  dynamics::TabulatedMappingAutonomousEndogenous<double, 2> s0 =
+    dynamics::Tabulate(p0, lower, upper, points, 2);
+
+  // Compare against the exact right hand side off the grid nodes.
+  double worst = 0.0;
+  for (int i = 0; i < 1000; ++i) {
+    std::array<double, 2> x = {{-3.0 + 6.0*i/999.0, std::sin(0.37*i)}};
+    std::array<double, 2> exact, approx;
+    p0.ComputeRHS(x, exact);
+    s0.ComputeRHS(x, approx);
+    worst = std::max(worst, std::fabs(exact[1] - approx[1]));
+    if (std::fabs(exact[0] - approx[0]) > 1e-12) {
+      std::cerr << "linear component not reproduced" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  double estimate = s0.Table().ErrorEstimate()[1];
+  std::cout << "Pendulum surrogate (autonomous, endogenous)" << std::endl;
+  std::cout << worst << " <= " << estimate << std::endl;
+  if (worst > 1.01*estimate || estimate > 1e-3) {
+    std::cerr << "error estimate does not bound the error" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Round trip through a memory mapped file.
+  const char * path = "test_surrogate.tab";
+  s0.Table().Save(path);
+  dynamics::TabulatedMappingAutonomousEndogenous<double, 2> s1(
+      dynamics::GridTable<double, 2, 2>::Load(path));
+
+  // A header with a zero block size is rejected instead of dividing by it.
+  const long block = 8 + long(sizeof(std::size_t)) + 2 * long(sizeof(int));
+  const int zero = 0;
+  std::FILE * file = std::fopen(path, "r+b");
+  bool rejected = false;
+  if (file && std::fseek(file, block, SEEK_SET) == 0
+      && std::fwrite(&zero, sizeof(zero), 1, file) == 1
+      && std::fclose(file) == 0) {
+    try {
+      dynamics::GridTable<double, 2, 2>::Load(path);
+    } catch (const std::runtime_error &) {
+      rejected = true;
+    }
+  }
+  std::remove(path);
+  if (!rejected) {
+    std::cerr << "corrupt table accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Filling a copy of a mapped table leaves the mapping untouched.
+  dynamics::GridTable<double, 2, 2> refilled(s1.Table());
+  refilled.Fill([](const std::array<double, 2> &,
+                   std::array<double, 2> & value, unsigned) {
+    value.fill(1.0);
+  });
+  if (refilled.Node(std::array<int, 2>())[0] != 1.0
+      || s1.Table().Node(std::array<int, 2>())[0]
+      != s0.Table().Node(std::array<int, 2>())[0]) {
+    std::cerr << "fill modified shared storage" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::array<double, 2> x = {{0.3, -0.7}};
+  std::array<double, 2> a0, a1;
+  s0.ComputeRHS(x, a0);
+  s1.ComputeRHS(x, a1);
+  if (a0 != a1 || s1.Table().ErrorEstimate() != s0.Table().ErrorEstimate()) {
+    std::cerr << "mapped table differs" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  PendulumWithTorque p1(1.0, 1.0, 1.0);
+  std::array<double, 3> lower1 = {{-M_PI, -2.0, -1.0}};
+  std::array<double, 3> upper1 = {{M_PI, 2.0, 1.0}};
+  std::array<int, 3> points1 = {{65, 9, 5}};
+  dynamics::TabulatedMappingAutonomousExogenous<double, 2, 1> s2 =
+    dynamics::Tabulate(p1, lower1, upper1, points1);
+  std::array<double, 1> u = {{0.5}};
+  std::array<double, 2> exact, approx;
+  p1.ComputeRHS(x, u, exact);
+  s2.ComputeRHS(x, u, approx);
+  std::cout << "Pendulum surrogate (autonomous, exogenous)" << std::endl;
+  std::cout << approx[0] << std::endl << approx[1] << std::endl;
+  if (std::fabs(exact[1] - approx[1]) > s2.Table().ErrorEstimate()[1]) {
+    std::cerr << "exogenous surrogate out of tolerance" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Non-autonomous surrogates tabulate time as the last input.
+  FreeDrivenPendulum p3;
+  std::array<double, 3> lower3 = {{-M_PI, -2.0, 0.0}};
+  std::array<double, 3> upper3 = {{M_PI, 2.0, 2*M_PI}};
+  std::array<int, 3> points3 = {{65, 9, 65}};
+  dynamics::TabulatedMappingNonAutonomousEndogenous<double, double, 2> s3 =
+    dynamics::Tabulate(p3, lower3, upper3, points3);
+  DrivenPendulum p4;
+  std::array<double, 4> lower4 = {{-M_PI, -2.0, -1.0, 0.0}};
+  std::array<double, 4> upper4 = {{M_PI, 2.0, 1.0, 2*M_PI}};
+  std::array<int, 4> points4 = {{65, 9, 5, 65}};
+  dynamics::TabulatedMappingNonAutonomousExogenous<double, double, 2, 1> s4 =
+    dynamics::Tabulate(p4, lower4, upper4, points4);
+  double worst3 = 0.0, worst4 = 0.0;
+  for (int i = 0; i < 1000; ++i) {
+    const double t = 6.0*i/999.0;
+    std::array<double, 2> y = {{-3.0 + 6.0*i/999.0, std::sin(0.37*i)}};
+    p3.ComputeRHS(t, y, exact);
+    s3.ComputeRHS(t, y, approx);
+    worst3 = std::max(worst3, std::fabs(exact[1] - approx[1]));
+    p4.ComputeRHS(t, y, u, exact);
+    s4.ComputeRHS(t, y, u, approx);
+    worst4 = std::max(worst4, std::fabs(exact[1] - approx[1]));
+  }
+  std::cout << "Driven pendulum surrogates (non-autonomous)" << std::endl;
+  std::cout << worst3 << " <= " << s3.Table().ErrorEstimate()[1] << std::endl;
+  std::cout << worst4 << " <= " << s4.Table().ErrorEstimate()[1] << std::endl;
+  if (worst3 > 1.01*s3.Table().ErrorEstimate()[1]
+      || worst4 > 1.01*s4.Table().ErrorEstimate()[1]) {
+    std::cerr << "non-autonomous surrogate out of tolerance" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // NaN inputs give NaN outputs; huge inputs are clamped to the table.
+  std::array<double, 2> nan = {{std::nan(""), 0.0}}, huge = {{1e300, -1e300}};
+  std::array<double, 2> nan_rhs, huge_rhs, corner_rhs;
+  std::array<double, 2> corner = {{M_PI, -2.0}};
+  s0.ComputeRHS(nan, nan_rhs);
+  s0.ComputeRHS(huge, huge_rhs);
+  s0.ComputeRHS(corner, corner_rhs);
+  if (!std::isnan(nan_rhs[0]) || !std::isnan(nan_rhs[1])
+      || huge_rhs != corner_rhs) {
+    std::cerr << "NaN or out of range inputs mishandled" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/*! \example test_switching.cc
+ * This is an example of how to integrate a model that is stiff on some
+ * time intervals only, switching methods automatically.
+ */
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "integrators.h"
+#include "mappings.h"
+#include "switching.h"
+
+// Forced Van der Pol oscillator; stiff on the slow branches of its
+// relaxation oscillation and not during the fast jumps between them.
+class ForcedVanDerPol
+  : public dynamics::MappingNonAutonomousExogenous<double, double, 2, 1> {
+  public:
+    ForcedVanDerPol(double mu) : _mu(mu) {}
+    virtual void ComputeRHS(const double &, const std::array<double, 2> & x,
+                            const std::array<double, 1> & u,
+                            std::array<double, 2> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = _mu*((1 - x[0]*x[0])*x[1] - x[0]) + u[0];
+    }
+
+  private:
+    double _mu;
+};
+
+// Forcing signal of the exogenous input.
+struct Forcing {
+  void operator()(double t, std::array<double, 1> & u) const
+  {
+    u[0] = 0.5*std::sin(t);
+  }
+};
+
+int main(void)
+{
+  ForcedVanDerPol vdp(200.0);
+  dynamics::NonAutonomousExogenousSystem<double, double, 2, 1, Forcing> f =
+    dynamics::MakeSystem(vdp, Forcing());
+  const std::array<double, 2> x0 = {{2.0, 0.0}};
+  const double t1 = 20.0;
+
+  // Reference solution from the explicit method at a tight tolerance.
+  dynamics::DormandPrince54<std::array<double, 2> > dopri;
+  dynamics::AdaptiveOptions tight;
+  tight.rtol = tight.atol = 1e-10;
+  std::array<double, 2> reference = x0;
+  dynamics::AdaptiveReport exact =
+    dynamics::IntegrateAdaptive(dopri, f, 0.0, t1, reference, tight);
+
+  dynamics::SwitchingOptions options;
+  options.integration.rtol = options.integration.atol = 1e-5;
+  std::array<double, 2> x = x0, y = x0;
+  dynamics::SwitchingReport report =
+    dynamics::IntegrateSwitching(f, 0.0, t1, x, options);
+  dynamics::AdaptiveReport plain =
+    dynamics::IntegrateAdaptive(dopri, f, 0.0, t1, y, options.integration);
+  std::cout << "switching: " << report.explicit_steps << " explicit and "
+            << report.implicit_steps << " implicit steps, "
+            << report.switches << " switches, " << report.rhs_evaluations
+            << " RHS evaluations; explicit only: " << plain.accepted
+            << " steps, " << plain.rhs_evaluations << " RHS evaluations"
+            << std::endl;
+  std::cout << "x(" << t1 << ") = " << x[0] << ", explicit only "
+            << y[0] << ", reference " << reference[0] << " ("
+            << exact.accepted << " steps)" << std::endl;
+  if (!report.success || report.switches < 4 || report.explicit_steps == 0
+      || report.implicit_steps == 0
+      || report.rhs_evaluations >= plain.rhs_evaluations
+      || std::fabs(x[0] - reference[0]) > 0.01) {
+    std::cerr << "stiffness switching failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The non-stiff oscillator never leaves the explicit method.
+  ForcedVanDerPol harmonic(0.0);
+  dynamics::NonAutonomousExogenousSystem<double, double, 2, 1, Forcing> g =
+    dynamics::MakeSystem(harmonic, Forcing());
+  std::array<double, 2> z = {{1.0, 0.0}};
+  report = dynamics::IntegrateSwitching(g, 0.0, 50.0, z, options);
+  if (!report.success || report.switches != 0 || report.implicit_steps) {
+    std::cerr << "non-stiff problem switched" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
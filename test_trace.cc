@@ -0,0 +1,107 @@
+/*! \example test_trace.cc
+ * This is an example of how to record a timeline of an ensemble
+ * integration for chrome://tracing or Perfetto.  The example is compiled
+ * with DYNAMICS_ENABLE_TRACING defined.
+ */
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+
+#include "batched.h"
+#include "ensemble.h"
+#include "integrators.h"
+#include "mappings.h"
+#include "statistics.h"
+#include "trace.h"
+
+// Damped oscillator with a stiff fast variable.
+class Oscillator : public dynamics::MappingAutonomousEndogenous<double, 3> {
+  public:
+    virtual void ComputeRHS(const std::array<double, 3> & x,
+                            std::array<double, 3> & rhs)
+    {
+      rhs[0] = x[1];
+      rhs[1] = -x[0] - 0.1*x[1];
+      rhs[2] = -100.0*(x[2] - x[0]);
+    }
+};
+
+// Number of occurrences of a pattern in text.
+static std::size_t Count(const std::string & text, const std::string & pattern)
+{
+  std::size_t n = 0;
+  for (std::size_t i = text.find(pattern); i != std::string::npos;
+       i = text.find(pattern, i + 1))
+    ++n;
+  return n;
+}
+
+int main(void)
+{
+  Oscillator oscillator;
+  dynamics::AutonomousEndogenousSystem<double, 3> f =
+    dynamics::MakeSystem(oscillator);
+  dynamics::TraceRecorder & recorder = dynamics::TraceRecorder::Instance();
+  auto member = [&](std::size_t i, dynamics::RunningMoments<double> & acc,
+                    unsigned) {
+    dynamics::AutonomousEndogenousSystem<double, 3> g(f);
+    dynamics::DormandPrince54<std::array<double, 3> > stepper;
+    std::array<double, 3> x = {{1.0 + 0.1*i, 0.0, 0.0}};
+    dynamics::IntegrateAdaptive(stepper, g, 0.0, 5.0, x);
+    acc.Add(x[0]);
+  };
+
+  // Nothing is recorded before tracing starts.
+  dynamics::RunEnsemble(8, dynamics::RunningMoments<double>(), member, 2);
+  if (recorder.Size() != 0) {
+    std::cerr << "spans recorded before tracing started" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The trace is written again, with the same contents, at exit.
+  const std::string path = "test_trace.json";
+  dynamics::StartTracing(path);
+  dynamics::RunEnsemble(8, dynamics::RunningMoments<double>(), member, 2);
+  dynamics::RunRosenbrockEnsemble<4>(
+      f, 8, 0.0, 0.01, 20, dynamics::RunningMoments<double>(),
+      [](std::size_t i, std::array<double, 3> & x0) {
+        x0[0] = 1.0 + 0.1*i;
+        x0[1] = x0[2] = 0.0;
+      },
+      [](std::size_t, std::size_t, const std::array<double, 3> & x,
+         dynamics::RunningMoments<double> & acc) {
+        acc.Add(x[0]);
+      }, 2);
+  dynamics::StopTracing();
+  const std::size_t spans = recorder.Size();
+  recorder.Write(path);
+
+  std::ifstream file(path.c_str());
+  std::string json((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  std::set<std::string> threads;
+  for (std::size_t i = json.find("\"tid\":"); i != std::string::npos;
+       i = json.find("\"tid\":", i + 1))
+    threads.insert(json.substr(i, json.find_first_of(",}", i) - i));
+  std::cout << spans << " spans on " << threads.size() << " threads, "
+            << json.size() << " bytes" << std::endl;
+  if (Count(json, "\"ph\":\"X\"") != spans
+      || Count(json, "\"ph\":\"M\"") != threads.size()
+      || Count(json, "{") != Count(json, "}")
+      || json.find("{\"displayTimeUnit\"") != 0) {
+    std::cerr << "malformed trace" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const char * names[] = {"member", "step", "jacobian", "lu", "rhs batch"};
+  for (int i = 0; i < 5; ++i)
+    if (Count(json, std::string("\"name\":\"") + names[i] + "\"") == 0) {
+      std::cerr << "no " << names[i] << " spans" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+/*! \file trace.h
+ *  \brief Optional timeline tracing in Chrome trace event format.
+ *
+ *  The integrators, solvers and ensemble drivers mark the phases of their
+ *  work (steps, Jacobians, factorizations, ensemble members, file output)
+ *  with DYNAMICS_TRACE_SPAN.  When a program is compiled with
+ *  DYNAMICS_ENABLE_TRACING defined, every span is timed and appended to a
+ *  buffer owned by the calling thread, so recording takes no locks; after
+ *  StartTracing the buffers are written as Chrome trace event JSON, which
+ *  chrome://tracing and Perfetto display as one timeline per thread.
+ *
+ *  Without DYNAMICS_ENABLE_TRACING the macro expands to nothing, so
+ *  tracing costs nothing unless it is compiled in.  Compiled in but not
+ *  started, a span costs one relaxed atomic load.
+ *
+ *  The macro changes the bodies of inline functions and templates in
+ *  every header that includes this one, so DYNAMICS_ENABLE_TRACING must
+ *  be defined for all translation units of a program or for none (e.g. on
+ *  the compiler command line).  Mixing them violates the one definition
+ *  rule: the linker keeps one of the two versions of each function, and
+ *  spans may silently be recorded in some calls and missing in others.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef DYNAMICS_ENABLE_TRACING
+#define DYNAMICS_TRACE_CONCAT_(a, b) a##b
+#define DYNAMICS_TRACE_CONCAT(a, b) DYNAMICS_TRACE_CONCAT_(a, b)
+/*!
+ * Traces the rest of the enclosing scope as a span called name, which must
+ * be a string literal (or otherwise outlive the trace).
+ */
+#define DYNAMICS_TRACE_SPAN(name) \
+  ::dynamics::TraceSpan DYNAMICS_TRACE_CONCAT(dynamics_trace_span_, \
+                                              __LINE__)(name)
+#else
+#define DYNAMICS_TRACE_SPAN(name) do {} while (false)
+#endif
+
+namespace dynamics {
+  /*! \class TraceRecorder
+   *  \brief Process wide registry of the per-thread span buffers.
+   *
+   *  Buffers are owned by the registry rather than by their threads, so
+   *  spans of worker threads that have exited are still written out.
+   */
+  class TraceRecorder {
+    public:
+      //! One completed span.
+      struct Span {
+        const char * name;
+        std::int64_t begin, end;
+      };
+
+      //! Spans of one thread, in order of completion.
+      struct Buffer {
+        unsigned thread;
+        std::vector<Span> spans;
+      };
+
+      //! The process wide recorder.
+      static TraceRecorder & Instance()
+      {
+        static TraceRecorder recorder;
+        return recorder;
+      }
+
+      bool Enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+      void Enable(bool enabled)
+      {
+        _enabled.store(enabled, std::memory_order_relaxed);
+      }
+
+      //! Nanoseconds since the recorder was created.
+      std::int64_t Now() const
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - _origin).count();
+      }
+
+      //! The calling thread's buffer, registered on first use.
+      Buffer & ThreadBuffer()
+      {
+        static thread_local Buffer * buffer = 0;
+        if (!buffer) {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _buffers.push_back(std::unique_ptr<Buffer>(new Buffer));
+          buffer = _buffers.back().get();
+          buffer->thread = static_cast<unsigned>(_buffers.size());
+          buffer->spans.reserve(4096);
+        }
+        return *buffer;
+      }
+
+      /*!
+       * Writes all spans recorded so far as Chrome trace event JSON.  Call
+       * it when no traced work is running, e.g. at exit.
+       *
+       * \param[in] path Output file.
+       */
+      void Write(const std::string & path)
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::FILE * file = std::fopen(path.c_str(), "w");
+        if (!file)
+          throw std::runtime_error("TraceRecorder: cannot open " + path);
+        std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+        bool first = true;
+        for (std::size_t b = 0; b < _buffers.size(); ++b) {
+          const Buffer & buffer = *_buffers[b];
+          std::fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                       "\"pid\":1,\"tid\":%u,\"args\":{\"name\":"
+                       "\"thread %u\"}}", first ? "" : ",", buffer.thread,
+                       buffer.thread);
+          first = false;
+          for (std::size_t i = 0; i < buffer.spans.size(); ++i) {
+            const Span & s = buffer.spans[i];
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\","
+                         "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         s.name, buffer.thread, s.begin * 1e-3,
+                         (s.end - s.begin) * 1e-3);
+          }
+        }
+        std::fputs("\n]}\n", file);
+        if (std::fclose(file) != 0)
+          throw std::runtime_error("TraceRecorder: cannot write " + path);
+      }
+
+      //! Number of spans recorded so far.
+      std::size_t Size()
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::size_t size = 0;
+        for (std::size_t b = 0; b < _buffers.size(); ++b)
+          size += _buffers[b]->spans.size();
+        return size;
+      }
+
+      //! Discards all recorded spans.
+      void Clear()
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (std::size_t b = 0; b < _buffers.size(); ++b)
+          _buffers[b]->spans.clear();
+      }
+
+      //! Output file of StartTracing.
+      std::string & Path() { return _path; }
+
+    private:
+      TraceRecorder()
+        : _enabled(false), _origin(std::chrono::steady_clock::now()) {}
+
+      std::atomic<bool> _enabled;
+      std::chrono::steady_clock::time_point _origin;
+      std::mutex _mutex;
+      std::vector<std::unique_ptr<Buffer> > _buffers;
+      std::string _path;
+  };
+
+  /*! \class TraceSpan
+   *  \brief Records the lifetime of a scope as a span; see
+   *  DYNAMICS_TRACE_SPAN.
+   */
+  class TraceSpan {
+    public:
+      explicit TraceSpan(const char * name)
+        : _name(name),
+          _begin(TraceRecorder::Instance().Enabled()
+                 ? TraceRecorder::Instance().Now() : -1) {}
+
+      ~TraceSpan()
+      {
+        if (_begin < 0)
+          return;
+        TraceRecorder & recorder = TraceRecorder::Instance();
+        TraceRecorder::Span span = {_name, _begin, recorder.Now()};
+        recorder.ThreadBuffer().spans.push_back(span);
+      }
+
+    private:
+      TraceSpan(const TraceSpan &);
+      TraceSpan & operator=(const TraceSpan &);
+
+      const char * _name;
+      std::int64_t _begin;
+  };
+
+  namespace internal {
+    inline void WriteTraceAtExit()
+    {
+      TraceRecorder & recorder = TraceRecorder::Instance();
+      recorder.Enable(false);
+      try {
+        recorder.Write(recorder.Path());
+      } catch (const std::exception & e) {
+        std::fprintf(stderr, "%s\n", e.what());
+      }
+    }
+  }
+
+  /*!
+   * Starts recording spans and writes them to path when the program exits
+   * normally.  Spans are only recorded in code compiled with
+   * DYNAMICS_ENABLE_TRACING.
+   *
+   * \param[in] path Output file of the Chrome trace event JSON.
+   */
+  inline void StartTracing(const std::string & path)
+  {
+    TraceRecorder & recorder = TraceRecorder::Instance();
+    bool registered = !recorder.Path().empty();
+    recorder.Path() = path;
+    if (!registered)
+      std::atexit(internal::WriteTraceAtExit);
+    recorder.Enable(true);
+  }
+
+  //! Stops recording spans; what was recorded is kept.
+  inline void StopTracing()
+  {
+    TraceRecorder::Instance().Enable(false);
+  }
+}
+#endif